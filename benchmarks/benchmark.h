@@ -0,0 +1,108 @@
+#ifndef SAC_BENCHMARK_H
+#define SAC_BENCHMARK_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <SimpleAmqpClient/SimpleAmqpClient.h>
+
+#include <boost/chrono.hpp>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace benchmark {
+
+typedef boost::chrono::steady_clock bench_clock;
+
+struct config_t {
+  // Host of the broker to run against, AMQP_BROKER by default
+  std::string broker;
+  // The most seconds each benchmark runs for, not counting its setup
+  double duration;
+  // Message sizes go from 16 bytes up to this, in steps of 16 times
+  std::size_t max_message_size;
+  // Only benchmarks whose name contains this are run
+  std::string filter;
+  // Skip the benchmarks that need a broker
+  bool micro_only;
+};
+
+/**
+ * The timings of one benchmark, printed as a line of JSON
+ *
+ * The line has the benchmark's name, message size and parameters, the
+ * operations done, the seconds they took, operations and megabytes per
+ * second, and the p50, p90, p99 and largest latency of an operation in
+ * microseconds.
+ */
+class Result {
+ public:
+  Result(const std::string &name, std::size_t message_size);
+
+  // Adds to the parameters printed
+  void SetParam(const std::string &key, long value);
+
+  // Starts and stops the clock for the operations per second
+  void Start();
+  void Stop();
+  // Records the latency of one operation, or the average of a batch of them
+  void Record(bench_clock::duration latency, std::size_t operations = 1);
+
+  std::size_t Operations() const { return m_operations; }
+  // Seconds since Start
+  double Elapsed() const;
+
+  void Print() const;
+
+ private:
+  std::string m_name;
+  std::size_t m_message_size;
+  std::vector<std::pair<std::string, long> > m_params;
+  std::vector<double> m_latencies;
+  std::size_t m_operations;
+  bench_clock::time_point m_start;
+  bench_clock::duration m_elapsed;
+};
+
+// Whether the benchmark called name is to be run
+bool Selected(const config_t &config, const std::string &name);
+
+// The message sizes to try, 16 bytes up to max_message_size
+std::vector<std::size_t> MessageSizes(const config_t &config);
+
+// How many messages of size to queue up for a benchmark that consumes them,
+// bounded so that a run keeps to about 64 MB
+std::size_t MessageCount(std::size_t size);
+
+void RunBrokerBenchmarks(const config_t &config);
+void RunMicroBenchmarks(const config_t &config);
+
+}  // namespace benchmark
+
+#endif  // SAC_BENCHMARK_H
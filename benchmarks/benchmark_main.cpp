@@ -0,0 +1,180 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+/*
+ * Measures the throughput and latency of SimpleAmqpClient
+ *
+ * Usage: sac_benchmark [--broker HOST] [--duration SECONDS]
+ *                      [--max-size BYTES] [--filter NAME] [--micro]
+ *
+ * Each benchmark prints one line of JSON to stdout. The broker benchmarks
+ * declare their own server-named queues, so they may be run against a
+ * broker in use.
+ */
+
+#include "benchmark.h"
+
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace benchmark {
+
+Result::Result(const std::string &name, std::size_t message_size)
+    : m_name(name),
+      m_message_size(message_size),
+      m_operations(0),
+      m_start(bench_clock::now()),
+      m_elapsed(bench_clock::duration::zero()) {}
+
+void Result::SetParam(const std::string &key, long value) {
+  m_params.push_back(std::make_pair(key, value));
+}
+
+void Result::Start() { m_start = bench_clock::now(); }
+
+void Result::Stop() { m_elapsed = bench_clock::now() - m_start; }
+
+void Result::Record(bench_clock::duration latency, std::size_t operations) {
+  m_latencies.push_back(
+      boost::chrono::duration<double, boost::micro>(latency).count() /
+      operations);
+  m_operations += operations;
+}
+
+double Result::Elapsed() const {
+  return boost::chrono::duration<double>(bench_clock::now() - m_start)
+      .count();
+}
+
+namespace {
+double Percentile(const std::vector<double> &sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  std::size_t index = static_cast<std::size_t>(fraction * sorted.size());
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+}  // namespace
+
+void Result::Print() const {
+  std::vector<double> sorted(m_latencies);
+  std::sort(sorted.begin(), sorted.end());
+  const double seconds = boost::chrono::duration<double>(m_elapsed).count();
+  const double per_second = 0 < seconds ? m_operations / seconds : 0;
+
+  std::cout << "{\"benchmark\":\"" << m_name << "\",\"size\":"
+            << m_message_size;
+  for (std::vector<std::pair<std::string, long> >::const_iterator it =
+           m_params.begin();
+       it != m_params.end(); ++it) {
+    std::cout << ",\"" << it->first << "\":" << it->second;
+  }
+  std::cout << ",\"operations\":" << m_operations
+            << ",\"seconds\":" << seconds
+            << ",\"ops_per_sec\":" << per_second
+            << ",\"mb_per_sec\":" << per_second * m_message_size / 1048576
+            << ",\"p50_us\":" << Percentile(sorted, 0.5)
+            << ",\"p90_us\":" << Percentile(sorted, 0.9)
+            << ",\"p99_us\":" << Percentile(sorted, 0.99)
+            << ",\"max_us\":" << (sorted.empty() ? 0 : sorted.back()) << "}"
+            << std::endl;
+}
+
+bool Selected(const config_t &config, const std::string &name) {
+  return std::string::npos != name.find(config.filter);
+}
+
+std::vector<std::size_t> MessageSizes(const config_t &config) {
+  std::vector<std::size_t> sizes;
+  for (std::size_t size = 16; size <= config.max_message_size; size *= 16) {
+    sizes.push_back(size);
+  }
+  return sizes;
+}
+
+std::size_t MessageCount(std::size_t size) {
+  return std::max<std::size_t>(
+      4, std::min<std::size_t>(20000, 64 * 1024 * 1024 / size));
+}
+
+}  // namespace benchmark
+
+namespace {
+void Usage() {
+  std::cerr << "usage: sac_benchmark [--broker HOST] [--duration SECONDS]\n"
+               "                     [--max-size BYTES] [--filter NAME] "
+               "[--micro]\n";
+  std::exit(2);
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  benchmark::config_t config;
+  const char *broker = std::getenv("AMQP_BROKER");
+  config.broker = NULL == broker ? "" : broker;
+  config.duration = 2;
+  config.max_message_size = 16 * 1024 * 1024;
+  config.micro_only = false;
+
+  try {
+    for (int i = 1; i < argc; ++i) {
+      const bool has_value = i + 1 < argc;
+      if (0 == std::strcmp(argv[i], "--micro")) {
+        config.micro_only = true;
+      } else if (0 == std::strcmp(argv[i], "--broker") && has_value) {
+        config.broker = argv[++i];
+      } else if (0 == std::strcmp(argv[i], "--duration") && has_value) {
+        config.duration = boost::lexical_cast<double>(argv[++i]);
+      } else if (0 == std::strcmp(argv[i], "--max-size") && has_value) {
+        config.max_message_size =
+            boost::lexical_cast<std::size_t>(argv[++i]);
+      } else if (0 == std::strcmp(argv[i], "--filter") && has_value) {
+        config.filter = argv[++i];
+      } else {
+        Usage();
+      }
+    }
+  } catch (const boost::bad_lexical_cast &) {
+    Usage();
+  }
+
+  try {
+    benchmark::RunMicroBenchmarks(config);
+    if (!config.micro_only) {
+      benchmark::RunBrokerBenchmarks(config);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "sac_benchmark: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,244 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "benchmark.h"
+
+#include <string>
+#include <vector>
+
+namespace benchmark {
+
+namespace {
+using namespace AmqpClient;
+
+// Waited for any one message before giving up on the rest
+const int RECEIVE_TIMEOUT = 10000;
+
+enum publish_mode_t { pm_no_confirm, pm_confirm, pm_async_confirm };
+
+Channel::ptr_t Connect(const config_t &config) {
+  return Channel::Create(config.broker);
+}
+
+// Queues up count messages of size bytes, confirmed by the broker
+void Fill(Channel &channel, const std::string &queue, std::size_t size,
+          std::size_t count) {
+  BasicMessage::ptr_t message = BasicMessage::Create(std::string(size, 'f'));
+  for (std::size_t i = 0; i < count; ++i) {
+    channel.BasicPublishAsync("", queue, message);
+  }
+  channel.WaitForConfirms();
+}
+
+void Publish(const config_t &config, const char *name, publish_mode_t mode,
+             std::size_t size) {
+  Channel::ptr_t channel = Connect(config);
+  const std::string queue = channel->DeclareQueue("");
+  BasicMessage::ptr_t message = BasicMessage::Create(std::string(size, 'p'));
+  const std::size_t count = MessageCount(size);
+
+  Result result(name, size);
+  result.Start();
+  while (result.Operations() < count && result.Elapsed() < config.duration) {
+    const bench_clock::time_point start = bench_clock::now();
+    switch (mode) {
+      case pm_no_confirm:
+        channel->BasicPublish("", queue, message, false, false, false);
+        break;
+      case pm_confirm:
+        channel->BasicPublish("", queue, message);
+        break;
+      case pm_async_confirm:
+        channel->BasicPublishAsync("", queue, message);
+        break;
+    }
+    result.Record(bench_clock::now() - start);
+  }
+  // Pipelined publishes aren't done until they are confirmed
+  channel->WaitForConfirms();
+  result.Stop();
+  result.Print();
+  channel->DeleteQueue(queue);
+}
+
+void Consume(const config_t &config, boost::uint16_t prefetch,
+             std::size_t size) {
+  Channel::ptr_t channel = Connect(config);
+  const std::string queue = channel->DeclareQueue("");
+  const std::size_t count = MessageCount(size);
+  Fill(*channel, queue, size, count);
+  const std::string tag =
+      channel->BasicConsume(queue, "", true, false, true, prefetch);
+
+  Result result("consume", size);
+  result.SetParam("prefetch", prefetch);
+  result.Start();
+  Envelope::ptr_t envelope;
+  while (result.Operations() < count && result.Elapsed() < config.duration) {
+    const bench_clock::time_point start = bench_clock::now();
+    if (!channel->BasicConsumeMessage(tag, envelope, RECEIVE_TIMEOUT)) {
+      break;
+    }
+    channel->BasicAck(envelope);
+    result.Record(bench_clock::now() - start);
+  }
+  result.Stop();
+  result.Print();
+  channel->BasicCancel(tag);
+  channel->DeleteQueue(queue);
+}
+
+void Get(const config_t &config, std::size_t size) {
+  Channel::ptr_t channel = Connect(config);
+  const std::string queue = channel->DeclareQueue("");
+  const std::size_t count = MessageCount(size);
+  Fill(*channel, queue, size, count);
+
+  Result result("basic_get", size);
+  result.Start();
+  Envelope::ptr_t envelope;
+  while (result.Operations() < count && result.Elapsed() < config.duration) {
+    const bench_clock::time_point start = bench_clock::now();
+    if (!channel->BasicGet(envelope, queue)) {
+      break;
+    }
+    result.Record(bench_clock::now() - start);
+  }
+  result.Stop();
+  result.Print();
+  channel->DeleteQueue(queue);
+}
+
+// The server runs on its own connection in the same thread, each call's
+// latency is the request's trip there and the reply's trip back
+void RpcRoundTrip(const config_t &config, std::size_t size) {
+  Channel::ptr_t server = Connect(config);
+  const std::string queue = server->DeclareQueue("");
+  const std::string server_tag = server->BasicConsume(queue);
+  Channel::ptr_t channel = Connect(config);
+  RpcClient::ptr_t client = RpcClient::Create(channel);
+  BasicMessage::ptr_t request = BasicMessage::Create(std::string(size, 'r'));
+  const std::size_t count = MessageCount(size);
+
+  Result result("rpc_round_trip", size);
+  result.Start();
+  Envelope::ptr_t envelope;
+  BasicMessage::ptr_t reply;
+  while (result.Operations() < count && result.Elapsed() < config.duration) {
+    const bench_clock::time_point start = bench_clock::now();
+    const std::string id =
+        client->SendRequest("", queue, request, RECEIVE_TIMEOUT);
+    if (!server->BasicConsumeMessage(server_tag, envelope, RECEIVE_TIMEOUT)) {
+      break;
+    }
+    BasicMessage::ptr_t response =
+        BasicMessage::Create(envelope->Message()->Body());
+    response->CorrelationId(envelope->Message()->CorrelationId());
+    server->BasicPublish("", envelope->Message()->ReplyTo(), response, false,
+                         false, false);
+    if (!client->WaitForReply(id, reply)) {
+      break;
+    }
+    result.Record(bench_clock::now() - start);
+  }
+  result.Stop();
+  result.Print();
+}
+
+// Consumers of several queues on one connection, consumed from in the order
+// the deliveries arrive
+void FanIn(const config_t &config, std::size_t consumers, std::size_t size) {
+  Channel::ptr_t channel = Connect(config);
+  const std::size_t count = MessageCount(size);
+  std::vector<std::string> queues;
+  for (std::size_t i = 0; i < consumers; ++i) {
+    queues.push_back(channel->DeclareQueue(""));
+    Fill(*channel, queues.back(), size, count / consumers);
+  }
+  for (std::size_t i = 0; i < consumers; ++i) {
+    channel->BasicConsume(queues[i], "", true, false, true, 100);
+  }
+
+  Result result("fan_in", size);
+  result.SetParam("consumers", static_cast<long>(consumers));
+  result.Start();
+  Envelope::ptr_t envelope;
+  while (result.Operations() < count / consumers * consumers &&
+         result.Elapsed() < config.duration) {
+    const bench_clock::time_point start = bench_clock::now();
+    if (!channel->BasicConsumeMessage(envelope, RECEIVE_TIMEOUT)) {
+      break;
+    }
+    channel->BasicAck(envelope);
+    result.Record(bench_clock::now() - start);
+  }
+  result.Stop();
+  result.Print();
+  for (std::size_t i = 0; i < consumers; ++i) {
+    channel->DeleteQueue(queues[i]);
+  }
+}
+}  // namespace
+
+void RunBrokerBenchmarks(const config_t &config) {
+  const std::vector<std::size_t> sizes = MessageSizes(config);
+  for (std::vector<std::size_t>::const_iterator size = sizes.begin();
+       size != sizes.end(); ++size) {
+    if (Selected(config, "publish_no_confirm")) {
+      Publish(config, "publish_no_confirm", pm_no_confirm, *size);
+    }
+    if (Selected(config, "publish_confirm")) {
+      Publish(config, "publish_confirm", pm_confirm, *size);
+    }
+    if (Selected(config, "publish_async_confirm")) {
+      Publish(config, "publish_async_confirm", pm_async_confirm, *size);
+    }
+    if (Selected(config, "consume")) {
+      const boost::uint16_t prefetches[] = {1, 10, 100, 1000};
+      for (std::size_t i = 0; i < sizeof(prefetches) / sizeof(*prefetches);
+           ++i) {
+        Consume(config, prefetches[i], *size);
+      }
+    }
+    if (Selected(config, "basic_get")) {
+      Get(config, *size);
+    }
+    if (Selected(config, "rpc_round_trip")) {
+      RpcRoundTrip(config, *size);
+    }
+  }
+
+  if (Selected(config, "fan_in")) {
+    const std::size_t consumers[] = {1, 4, 16};
+    for (std::size_t i = 0; i < sizeof(consumers) / sizeof(*consumers); ++i) {
+      FanIn(config, consumers[i], 1024);
+    }
+  }
+}
+
+}  // namespace benchmark
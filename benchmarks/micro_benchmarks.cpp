@@ -0,0 +1,171 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// Put these first to avoid warnings about INT#_C macro redefinition
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#include "benchmark.h"
+
+#include "SimpleAmqpClient/TableImpl.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+
+namespace benchmark {
+
+namespace {
+using AmqpClient::BasicMessage;
+using AmqpClient::Detail::TableValueImpl;
+using AmqpClient::Detail::amqp_pool_ptr_t;
+
+// Headers like an application would send, mixing types and nesting
+AmqpClient::Table HeadersTable() {
+  AmqpClient::Table nested;
+  nested.insert(AmqpClient::TableEntry("region", "eu-west-1"));
+  nested.insert(AmqpClient::TableEntry("attempt", boost::int32_t(3)));
+
+  std::vector<AmqpClient::TableValue> tags;
+  tags.push_back(AmqpClient::TableValue("alpha"));
+  tags.push_back(AmqpClient::TableValue("beta"));
+  tags.push_back(AmqpClient::TableValue(boost::int64_t(42)));
+
+  AmqpClient::Table table;
+  table.insert(AmqpClient::TableEntry("x-trace-id",
+                                      "4bf92f3577b34da6a3ce929d0e0e4736"));
+  table.insert(AmqpClient::TableEntry("x-retry", boost::int32_t(0)));
+  table.insert(AmqpClient::TableEntry("x-priority", boost::uint8_t(5)));
+  table.insert(
+      AmqpClient::TableEntry("x-deadline", boost::int64_t(1700000000)));
+  table.insert(AmqpClient::TableEntry("x-replayed", false));
+  table.insert(AmqpClient::TableEntry("x-score", 0.75));
+  table.insert(AmqpClient::TableEntry("x-origin", nested));
+  table.insert(AmqpClient::TableEntry("x-tags", tags));
+  return table;
+}
+
+// Runs op in batches for the configured duration
+template <typename Op>
+void Run(const config_t &config, Result &result, std::size_t batch, Op op) {
+  result.Start();
+  while (result.Elapsed() < config.duration) {
+    const bench_clock::time_point start = bench_clock::now();
+    for (std::size_t i = 0; i < batch; ++i) {
+      op();
+    }
+    result.Record(bench_clock::now() - start, batch);
+  }
+  result.Stop();
+  result.Print();
+}
+
+struct CreateAmqpTable {
+  explicit CreateAmqpTable(const AmqpClient::Table &table) : table(table) {}
+  void operator()() {
+    amqp_pool_ptr_t pool;
+    TableValueImpl::CreateAmqpTable(table, pool);
+  }
+  const AmqpClient::Table &table;
+};
+
+struct CreatePreparedTable {
+  explicit CreatePreparedTable(const AmqpClient::Table &table)
+      : table(table) {}
+  void operator()() { AmqpClient::PreparedTable prepared(table); }
+  const AmqpClient::Table &table;
+};
+
+struct CreateTable {
+  explicit CreateTable(const amqp_table_t &table) : table(table) {}
+  void operator()() { TableValueImpl::CreateTable(table); }
+  const amqp_table_t &table;
+};
+
+struct CreateTableView {
+  explicit CreateTableView(const amqp_table_t &table) : table(table) {}
+  void operator()() {
+    TableValueImpl::CreateTableView(table, boost::shared_ptr<const void>());
+  }
+  const amqp_table_t &table;
+};
+
+struct CreateBasicMessage {
+  explicit CreateBasicMessage(const std::string &body) : body(body) {}
+  void operator()() {
+    BasicMessage::ptr_t message = BasicMessage::Create(body);
+    message->ContentType("application/octet-stream");
+    message->DeliveryMode(BasicMessage::dm_persistent);
+    message->CorrelationId("4bf92f3577b34da6");
+  }
+  const std::string &body;
+};
+}  // namespace
+
+void RunMicroBenchmarks(const config_t &config) {
+  const AmqpClient::Table table = HeadersTable();
+  amqp_pool_ptr_t pool;
+  const amqp_table_t amqp_table = TableValueImpl::CreateAmqpTable(table, pool);
+
+  if (Selected(config, "table_create_amqp")) {
+    Result result("table_create_amqp", 0);
+    result.SetParam("entries", static_cast<long>(table.size()));
+    Run(config, result, 1000, CreateAmqpTable(table));
+  }
+  if (Selected(config, "prepared_table_create")) {
+    Result result("prepared_table_create", 0);
+    result.SetParam("entries", static_cast<long>(table.size()));
+    Run(config, result, 1000, CreatePreparedTable(table));
+  }
+  if (Selected(config, "table_create")) {
+    Result result("table_create", 0);
+    result.SetParam("entries", static_cast<long>(table.size()));
+    Run(config, result, 1000, CreateTable(amqp_table));
+  }
+  if (Selected(config, "table_view_create")) {
+    Result result("table_view_create", 0);
+    result.SetParam("entries", static_cast<long>(table.size()));
+    Run(config, result, 1000, CreateTableView(amqp_table));
+  }
+
+  if (Selected(config, "basic_message_create")) {
+    const std::vector<std::size_t> sizes = MessageSizes(config);
+    for (std::vector<std::size_t>::const_iterator size = sizes.begin();
+         size != sizes.end(); ++size) {
+      const std::string body(*size, 'm');
+      Result result("basic_message_create", *size);
+      // Big bodies are copied a few times a batch, not a thousand
+      const std::size_t batch =
+          std::max<std::size_t>(1, std::min<std::size_t>(1000, 65536 / *size));
+      Run(config, result, batch, CreateBasicMessage(body));
+    }
+  }
+}
+
+}  // namespace benchmark
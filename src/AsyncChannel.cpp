@@ -0,0 +1,788 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// Put these first to avoid warnings about INT#_C macro redefinition
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#include "SimpleAmqpClient/AsyncChannel.h"
+
+#include "SimpleAmqpClient/AmqpException.h"
+#include "SimpleAmqpClient/AmqpLibraryException.h"
+#include "SimpleAmqpClient/ChannelImpl.h"
+#include "SimpleAmqpClient/ConsumerCancelledException.h"
+#include "SimpleAmqpClient/ConsumerTagNotFoundException.h"
+
+#include <boost/array.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/placeholders.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/weak_ptr.hpp>
+#include <chrono>
+#include <deque>
+#include <list>
+#include <map>
+#include <vector>
+
+namespace AmqpClient {
+
+namespace {
+class amqp_error_category : public boost::system::error_category {
+ public:
+  virtual const char *name() const BOOST_NOEXCEPT { return "amqp"; }
+
+  virtual std::string message(int value) const {
+    if (value < 0) {
+      return amqp_error_string2(value);
+    }
+    switch (value) {
+      case ae_consumer_cancelled:
+        return "consumer cancelled by the broker";
+      case ae_consumer_not_found:
+        return "consumer tag not found";
+      case 312:
+        return "NO_ROUTE";
+      case 313:
+        return "NO_CONSUMERS";
+      case 320:
+        return "CONNECTION_FORCED";
+      case 402:
+        return "INVALID_PATH";
+      case 403:
+        return "ACCESS_REFUSED";
+      case 404:
+        return "NOT_FOUND";
+      case 405:
+        return "RESOURCE_LOCKED";
+      case 406:
+        return "PRECONDITION_FAILED";
+      case 501:
+        return "FRAME_ERROR";
+      case 502:
+        return "SYNTAX_ERROR";
+      case 503:
+        return "COMMAND_INVALID";
+      case 504:
+        return "CHANNEL_ERROR";
+      case 505:
+        return "UNEXPECTED_FRAME";
+      case 506:
+        return "RESOURCE_ERROR";
+      case 530:
+        return "NOT_ALLOWED";
+      case 540:
+        return "NOT_IMPLEMENTED";
+      case 541:
+        return "INTERNAL_ERROR";
+      default:
+        return "unknown AMQP error";
+    }
+  }
+};
+
+// Must be called from within a catch block, turns the exception being
+// handled into the error passed to handlers
+boost::system::error_code CurrentErrorCode() {
+  try {
+    throw;
+  } catch (const ConsumerCancelledException &) {
+    return ae_consumer_cancelled;
+  } catch (const ConsumerTagNotFoundException &) {
+    return ae_consumer_not_found;
+  } catch (const AmqpException &e) {
+    return boost::system::error_code(e.reply_code(), AmqpErrorCategory());
+  } catch (const AmqpLibraryException &e) {
+    return boost::system::error_code(e.ErrorCode(), AmqpErrorCategory());
+  } catch (...) {
+    return boost::system::error_code(AMQP_STATUS_UNEXPECTED_STATE,
+                                     AmqpErrorCategory());
+  }
+}
+}  // namespace
+
+const boost::system::error_category &AmqpErrorCategory() {
+  static const amqp_error_category category;
+  return category;
+}
+
+namespace Detail {
+
+class AsyncChannelImpl
+    : public boost::enable_shared_from_this<AsyncChannelImpl>,
+      boost::noncopyable {
+ public:
+  AsyncChannelImpl(boost::asio::io_context &io_context,
+                   Channel::ptr_t channel);
+  ~AsyncChannelImpl();
+
+  void Close();
+
+  void Publish(const std::string &exchange_name,
+               const std::string &routing_key,
+               const BasicMessage::ptr_t &message, bool mandatory,
+               const AsyncChannel::publish_handler_t &handler);
+  void Consume(const std::string &consumer_tag,
+               const AsyncChannel::consume_handler_t &handler);
+  void DeclareQueue(const std::string &queue_name, bool passive, bool durable,
+                    bool exclusive, bool auto_delete,
+                    const AsyncChannel::name_handler_t &handler);
+  void BindQueue(const std::string &queue_name,
+                 const std::string &exchange_name,
+                 const std::string &routing_key,
+                 const AsyncChannel::error_handler_t &handler);
+  void BasicConsume(const std::string &queue, const std::string &consumer_tag,
+                    bool no_local, bool no_ack, bool exclusive,
+                    boost::uint16_t message_prefetch_count,
+                    const AsyncChannel::name_handler_t &handler);
+
+  boost::asio::io_context &m_io_context;
+
+ private:
+  typedef boost::function<void(const amqp_frame_t &)> response_handler_t;
+  // A method sent to the broker that is waiting for its reply
+  struct pending_rpc_t {
+    amqp_channel_t channel;
+    amqp_method_number_t response;
+    response_handler_t on_response;
+    AsyncChannel::error_handler_t on_error;
+  };
+  typedef std::list<pending_rpc_t> pending_rpc_list_t;
+
+  // Waits for messages, oldest first, keyed by consumer tag
+  typedef std::deque<AsyncChannel::consume_handler_t> consume_handler_list_t;
+  typedef std::map<std::string, consume_handler_list_t> consume_handler_map_t;
+
+  // Shared with the confirm callback given to the Channel, which empties it
+  // once the handler has been called
+  typedef boost::shared_ptr<AsyncChannel::publish_handler_t>
+      publish_handler_ptr_t;
+  typedef std::map<boost::uint64_t, publish_handler_ptr_t>
+      publish_handler_map_t;
+
+  void StartRpc(amqp_channel_t channel, amqp_method_number_t method,
+                void *decoded, amqp_method_number_t response,
+                const response_handler_t &on_response,
+                const AsyncChannel::error_handler_t &on_error);
+  void OnQueueDeclared(amqp_channel_t channel,
+                       const AsyncChannel::name_handler_t &handler,
+                       const amqp_frame_t &frame);
+  void OnQueueBound(amqp_channel_t channel,
+                    const AsyncChannel::error_handler_t &handler,
+                    const amqp_frame_t &frame);
+  void OnQosSet(amqp_channel_t channel, const std::string &queue,
+                const std::string &consumer_tag, bool no_local, bool no_ack,
+                bool exclusive, const AsyncChannel::name_handler_t &handler,
+                const amqp_frame_t &frame);
+  void OnConsumeStarted(amqp_channel_t channel,
+                        const AsyncChannel::name_handler_t &handler,
+                        const amqp_frame_t &frame);
+  static void OnConfirm(const boost::weak_ptr<AsyncChannelImpl> &self,
+                        const publish_handler_ptr_t &pending,
+                        boost::uint64_t sequence,
+                        Channel::publish_confirm_t status);
+
+  bool HasPendingWork() const;
+  // An RPC reply or publisher confirm is due, see
+  // ChannelImpl::ReadAvailableFrames
+  bool IsAwaitingReply() const;
+  void Wait();
+  void OnReadable(const boost::system::error_code &error);
+  void ArmHeartbeatTimer();
+  void OnHeartbeatTimer(const boost::system::error_code &error);
+  void Process();
+  void ProcessRpcs();
+  void ProcessDeliveries();
+  void FailConsumer(consume_handler_list_t &handlers,
+                    const boost::system::error_code &error);
+  void FailAll(const boost::system::error_code &error);
+
+  Channel::ptr_t m_channel;
+  ChannelImpl &m_impl;
+  // Only used to find out when the socket is readable, rabbitmq-c does all
+  // the reading and writing
+  boost::asio::posix::stream_descriptor m_socket;
+  // With heartbeats on, wakes up to have rabbitmq-c send one while the
+  // socket is quiet
+  boost::asio::steady_timer m_heartbeat_timer;
+  bool m_heartbeat_armed;
+  pending_rpc_list_t m_rpcs;
+  consume_handler_map_t m_consumers;
+  publish_handler_map_t m_publishes;
+  bool m_waiting;
+  // Set once the connection has failed or the AsyncChannel is destroyed,
+  // every later operation completes with it straight away
+  boost::system::error_code m_failure;
+};
+
+namespace {
+void FailWithName(const AsyncChannel::name_handler_t &handler,
+                  const boost::system::error_code &error) {
+  handler(error, std::string());
+}
+}  // namespace
+
+AsyncChannelImpl::AsyncChannelImpl(boost::asio::io_context &io_context,
+                                   Channel::ptr_t channel)
+    : m_io_context(io_context),
+      m_channel(channel),
+      m_impl(*channel->m_impl),
+      m_socket(io_context, amqp_get_sockfd(channel->m_impl->m_connection)),
+      m_heartbeat_timer(io_context),
+      m_heartbeat_armed(false),
+      m_waiting(false) {}
+
+AsyncChannelImpl::~AsyncChannelImpl() {
+  // The socket belongs to rabbitmq-c
+  if (m_socket.is_open()) {
+    m_socket.release();
+  }
+}
+
+void AsyncChannelImpl::Close() {
+  if (!m_failure) {
+    FailAll(boost::asio::error::operation_aborted);
+  }
+  if (m_socket.is_open()) {
+    // Also cancels any outstanding wait
+    m_socket.release();
+  }
+  m_heartbeat_timer.cancel();
+}
+
+void AsyncChannelImpl::Publish(const std::string &exchange_name,
+                               const std::string &routing_key,
+                               const BasicMessage::ptr_t &message,
+                               bool mandatory,
+                               const AsyncChannel::publish_handler_t &handler) {
+  if (m_failure) {
+    handler(m_failure, Channel::pc_lost);
+    return;
+  }
+
+  publish_handler_ptr_t pending =
+      boost::make_shared<AsyncChannel::publish_handler_t>(handler);
+  try {
+    boost::uint64_t sequence = m_channel->BasicPublishAsync(
+        exchange_name, routing_key, message, mandatory, false,
+        boost::bind(&AsyncChannelImpl::OnConfirm,
+                    boost::weak_ptr<AsyncChannelImpl>(shared_from_this()),
+                    pending, _1, _2));
+    if (!pending->empty()) {
+      m_publishes[sequence] = pending;
+    }
+  } catch (...) {
+    if (!pending->empty()) {
+      (*pending)(CurrentErrorCode(), Channel::pc_lost);
+      pending->clear();
+    }
+  }
+  Wait();
+}
+
+void AsyncChannelImpl::OnConfirm(const boost::weak_ptr<AsyncChannelImpl> &self,
+                                 const publish_handler_ptr_t &pending,
+                                 boost::uint64_t sequence,
+                                 Channel::publish_confirm_t status) {
+  boost::shared_ptr<AsyncChannelImpl> impl = self.lock();
+  if (impl) {
+    impl->m_publishes.erase(sequence);
+  }
+  if (!pending->empty()) {
+    AsyncChannel::publish_handler_t handler;
+    handler.swap(*pending);
+    handler(boost::system::error_code(), status);
+  }
+}
+
+void AsyncChannelImpl::Consume(const std::string &consumer_tag,
+                               const AsyncChannel::consume_handler_t &handler) {
+  if (m_failure) {
+    handler(m_failure, Envelope::ptr_t());
+    return;
+  }
+  m_consumers[consumer_tag].push_back(handler);
+  // The message may have been read already
+  Process();
+}
+
+void AsyncChannelImpl::DeclareQueue(
+    const std::string &queue_name, bool passive, bool durable, bool exclusive,
+    bool auto_delete, const AsyncChannel::name_handler_t &handler) {
+  if (m_failure) {
+    handler(m_failure, std::string());
+    return;
+  }
+
+  try {
+    m_impl.CheckIsConnected();
+    amqp_channel_t channel = m_impl.GetChannel();
+
+    amqp_queue_declare_t declare = {};
+    declare.queue = amqp_cstring_bytes(queue_name.c_str());
+    declare.passive = passive;
+    declare.durable = durable;
+    declare.exclusive = exclusive;
+    declare.auto_delete = auto_delete;
+    declare.nowait = false;
+    declare.arguments = amqp_empty_table;
+
+    StartRpc(channel, AMQP_QUEUE_DECLARE_METHOD, &declare,
+             AMQP_QUEUE_DECLARE_OK_METHOD,
+             boost::bind(&AsyncChannelImpl::OnQueueDeclared, this, channel,
+                         handler, _1),
+             boost::bind(&FailWithName, handler, _1));
+  } catch (...) {
+    handler(CurrentErrorCode(), std::string());
+  }
+  Wait();
+}
+
+void AsyncChannelImpl::OnQueueDeclared(
+    amqp_channel_t channel, const AsyncChannel::name_handler_t &handler,
+    const amqp_frame_t &frame) {
+  amqp_queue_declare_ok_t *declare_ok =
+      reinterpret_cast<amqp_queue_declare_ok_t *>(frame.payload.method.decoded);
+  std::string queue_name((char *)declare_ok->queue.bytes,
+                         declare_ok->queue.len);
+  m_impl.MaybeReleaseBuffersOnChannel(channel);
+  m_impl.ReturnChannel(channel);
+  handler(boost::system::error_code(), queue_name);
+}
+
+void AsyncChannelImpl::BindQueue(const std::string &queue_name,
+                                 const std::string &exchange_name,
+                                 const std::string &routing_key,
+                                 const AsyncChannel::error_handler_t &handler) {
+  if (m_failure) {
+    handler(m_failure);
+    return;
+  }
+
+  try {
+    m_impl.CheckIsConnected();
+    amqp_channel_t channel = m_impl.GetChannel();
+
+    amqp_queue_bind_t bind = {};
+    bind.queue = amqp_cstring_bytes(queue_name.c_str());
+    bind.exchange = amqp_cstring_bytes(exchange_name.c_str());
+    bind.routing_key = amqp_cstring_bytes(routing_key.c_str());
+    bind.nowait = false;
+    bind.arguments = amqp_empty_table;
+
+    StartRpc(channel, AMQP_QUEUE_BIND_METHOD, &bind, AMQP_QUEUE_BIND_OK_METHOD,
+             boost::bind(&AsyncChannelImpl::OnQueueBound, this, channel,
+                         handler, _1),
+             handler);
+  } catch (...) {
+    handler(CurrentErrorCode());
+  }
+  Wait();
+}
+
+void AsyncChannelImpl::OnQueueBound(
+    amqp_channel_t channel, const AsyncChannel::error_handler_t &handler,
+    const amqp_frame_t &) {
+  m_impl.MaybeReleaseBuffersOnChannel(channel);
+  m_impl.ReturnChannel(channel);
+  handler(boost::system::error_code());
+}
+
+void AsyncChannelImpl::BasicConsume(
+    const std::string &queue, const std::string &consumer_tag, bool no_local,
+    bool no_ack, bool exclusive, boost::uint16_t message_prefetch_count,
+    const AsyncChannel::name_handler_t &handler) {
+  if (m_failure) {
+    handler(m_failure, std::string());
+    return;
+  }
+
+  try {
+    m_impl.CheckIsConnected();
+    amqp_channel_t channel = m_impl.GetChannel();
+
+    // Same as Channel::BasicConsume: the qos goes first as it may have been
+    // set by a previous consumer on the channel
+    amqp_basic_qos_t qos = {};
+    qos.prefetch_size = 0;
+    qos.prefetch_count = message_prefetch_count;
+    qos.global = m_impl.BrokerHasNewQosBehavior();
+
+    StartRpc(channel, AMQP_BASIC_QOS_METHOD, &qos, AMQP_BASIC_QOS_OK_METHOD,
+             boost::bind(&AsyncChannelImpl::OnQosSet, this, channel, queue,
+                         consumer_tag, no_local, no_ack, exclusive, handler,
+                         _1),
+             boost::bind(&FailWithName, handler, _1));
+  } catch (...) {
+    handler(CurrentErrorCode(), std::string());
+  }
+  Wait();
+}
+
+void AsyncChannelImpl::OnQosSet(amqp_channel_t channel,
+                                const std::string &queue,
+                                const std::string &consumer_tag, bool no_local,
+                                bool no_ack, bool exclusive,
+                                const AsyncChannel::name_handler_t &handler,
+                                const amqp_frame_t &) {
+  m_impl.MaybeReleaseBuffersOnChannel(channel);
+
+  amqp_basic_consume_t consume = {};
+  consume.queue = amqp_cstring_bytes(queue.c_str());
+  consume.consumer_tag = amqp_cstring_bytes(consumer_tag.c_str());
+  consume.no_local = no_local;
+  consume.no_ack = no_ack;
+  consume.exclusive = exclusive;
+  consume.nowait = false;
+  consume.arguments = amqp_empty_table;
+
+  StartRpc(channel, AMQP_BASIC_CONSUME_METHOD, &consume,
+           AMQP_BASIC_CONSUME_OK_METHOD,
+           boost::bind(&AsyncChannelImpl::OnConsumeStarted, this, channel,
+                       handler, _1),
+           boost::bind(&FailWithName, handler, _1));
+}
+
+void AsyncChannelImpl::OnConsumeStarted(
+    amqp_channel_t channel, const AsyncChannel::name_handler_t &handler,
+    const amqp_frame_t &frame) {
+  amqp_basic_consume_ok_t *consume_ok =
+      reinterpret_cast<amqp_basic_consume_ok_t *>(frame.payload.method.decoded);
+  std::string tag((char *)consume_ok->consumer_tag.bytes,
+                  consume_ok->consumer_tag.len);
+  m_impl.MaybeReleaseBuffersOnChannel(channel);
+
+  m_impl.AddConsumer(tag, channel, m_channel->m_handle);
+  handler(boost::system::error_code(), tag);
+}
+
+void AsyncChannelImpl::StartRpc(amqp_channel_t channel,
+                                amqp_method_number_t method, void *decoded,
+                                amqp_method_number_t response,
+                                const response_handler_t &on_response,
+                                const AsyncChannel::error_handler_t &on_error) {
+  m_impl.CheckForError(m_impl.SendMethod(channel, method, decoded));
+
+  pending_rpc_t rpc;
+  rpc.channel = channel;
+  rpc.response = response;
+  rpc.on_response = on_response;
+  rpc.on_error = on_error;
+  m_rpcs.push_back(rpc);
+}
+
+bool AsyncChannelImpl::HasPendingWork() const {
+  return !m_rpcs.empty() || !m_consumers.empty() || !m_publishes.empty();
+}
+
+bool AsyncChannelImpl::IsAwaitingReply() const {
+  return !m_rpcs.empty() || !m_publishes.empty();
+}
+
+void AsyncChannelImpl::Wait() {
+  if (m_failure || !HasPendingWork()) {
+    return;
+  }
+  ArmHeartbeatTimer();
+  // At the buffer limits the socket stays readable until deliveries are
+  // consumed, Process is called again once a handler takes one
+  if (m_waiting || !m_impl.WantsToRead(IsAwaitingReply())) {
+    return;
+  }
+  m_waiting = true;
+
+  // rabbitmq-c may already have read more than it has handed back, the
+  // socket won't become readable for that
+  if (amqp_data_in_buffer(m_impl.m_connection) ||
+      amqp_frames_enqueued(m_impl.m_connection)) {
+    boost::asio::post(m_io_context,
+                      boost::bind(&AsyncChannelImpl::OnReadable,
+                                  shared_from_this(),
+                                  boost::system::error_code()));
+    return;
+  }
+  m_socket.async_wait(boost::asio::posix::stream_descriptor::wait_read,
+                      boost::bind(&AsyncChannelImpl::OnReadable,
+                                  shared_from_this(),
+                                  boost::asio::placeholders::error));
+}
+
+void AsyncChannelImpl::OnReadable(const boost::system::error_code &error) {
+  m_waiting = false;
+  if (m_failure || boost::asio::error::operation_aborted == error) {
+    return;
+  }
+  if (error) {
+    FailAll(error);
+    return;
+  }
+
+  try {
+    m_impl.ReadAvailableFrames(IsAwaitingReply());
+  } catch (...) {
+    FailAll(CurrentErrorCode());
+    return;
+  }
+  Process();
+}
+
+void AsyncChannelImpl::ArmHeartbeatTimer() {
+  const boost::chrono::microseconds interval = m_impl.HeartbeatPollInterval();
+  if (m_heartbeat_armed || boost::chrono::microseconds::max() == interval) {
+    return;
+  }
+  m_heartbeat_armed = true;
+  m_heartbeat_timer.expires_after(std::chrono::microseconds(interval.count()));
+  m_heartbeat_timer.async_wait(boost::bind(&AsyncChannelImpl::OnHeartbeatTimer,
+                                           shared_from_this(),
+                                           boost::asio::placeholders::error));
+}
+
+void AsyncChannelImpl::OnHeartbeatTimer(
+    const boost::system::error_code &error) {
+  m_heartbeat_armed = false;
+  if (m_failure || boost::asio::error::operation_aborted == error) {
+    return;
+  }
+
+  // Sends a heartbeat if one is due, and fails if the broker has missed
+  // sending its own
+  try {
+    m_impl.ReadAvailableFrames(IsAwaitingReply());
+  } catch (...) {
+    FailAll(CurrentErrorCode());
+    return;
+  }
+  Process();
+}
+
+void AsyncChannelImpl::Process() {
+  if (m_failure) {
+    return;
+  }
+
+  try {
+    try {
+      m_impl.ProcessBufferedConfirms();
+    } catch (const AmqpException &e) {
+      // The confirm channel was closed, the messages waiting on it have been
+      // reported as lost
+      if (!e.is_soft_error()) {
+        throw;
+      }
+    }
+    ProcessRpcs();
+    ProcessDeliveries();
+  } catch (...) {
+    FailAll(CurrentErrorCode());
+    return;
+  }
+  Wait();
+}
+
+void AsyncChannelImpl::ProcessRpcs() {
+  pending_rpc_list_t::iterator it = m_rpcs.begin();
+  while (it != m_rpcs.end()) {
+    const amqp_channel_t channel = it->channel;
+    amqp_frame_t frame;
+    bool replied = false;
+    try {
+      while (!replied && m_impl.HasQueuedFramesOnChannel(channel)) {
+        m_impl.GetNextFrameOnChannel(channel, frame,
+                                     boost::chrono::microseconds(0));
+        replied = AMQP_FRAME_METHOD == frame.frame_type &&
+                  it->response == frame.payload.method.id;
+      }
+    } catch (const AmqpException &e) {
+      // The broker closed the channel in reply
+      if (!e.is_soft_error()) {
+        throw;
+      }
+      pending_rpc_t rpc = *it;
+      it = m_rpcs.erase(it);
+      m_impl.MaybeReleaseBuffersOnChannel(channel);
+      rpc.on_error(CurrentErrorCode());
+      continue;
+    }
+
+    if (!replied) {
+      ++it;
+      continue;
+    }
+
+    // The response handler may start the next step on the same channel
+    pending_rpc_t rpc = *it;
+    it = m_rpcs.erase(it);
+    try {
+      rpc.on_response(frame);
+    } catch (...) {
+      rpc.on_error(CurrentErrorCode());
+    }
+  }
+}
+
+void AsyncChannelImpl::ProcessDeliveries() {
+  consume_handler_map_t::iterator it = m_consumers.begin();
+  while (it != m_consumers.end()) {
+    const std::string &consumer_tag = it->first;
+    consume_handler_list_t &handlers = it->second;
+
+    try {
+      const boost::array<amqp_channel_t, 1> channels = {
+          {m_impl.GetConsumerChannel(consumer_tag)}};
+
+      std::vector<Envelope::ptr_t> envelopes;
+      m_impl.TakeDeliveredMessages(channels, envelopes, handlers.size());
+      for (std::vector<Envelope::ptr_t>::const_iterator envelope =
+               envelopes.begin();
+           envelope != envelopes.end(); ++envelope) {
+        handlers.front()(boost::system::error_code(), *envelope);
+        handlers.pop_front();
+      }
+
+      // Anything else queued whole for the consumer, e.g., a basic.cancel
+      // from the broker
+      Envelope::ptr_t envelope;
+      while (!handlers.empty() &&
+             m_impl.HasQueuedDeliveryOnChannel(channels[0]) &&
+             m_channel->BasicConsumeMessage(consumer_tag, envelope, 0)) {
+        handlers.front()(boost::system::error_code(), envelope);
+        handlers.pop_front();
+      }
+    } catch (const ConsumerCancelledException &) {
+      FailConsumer(handlers, ae_consumer_cancelled);
+    } catch (const ConsumerTagNotFoundException &) {
+      FailConsumer(handlers, ae_consumer_not_found);
+    } catch (const AmqpException &e) {
+      if (!e.is_soft_error()) {
+        throw;
+      }
+      FailConsumer(handlers, CurrentErrorCode());
+    }
+
+    if (handlers.empty()) {
+      m_consumers.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void AsyncChannelImpl::FailConsumer(consume_handler_list_t &handlers,
+                                    const boost::system::error_code &error) {
+  consume_handler_list_t failed;
+  failed.swap(handlers);
+  for (consume_handler_list_t::const_iterator it = failed.begin();
+       it != failed.end(); ++it) {
+    (*it)(error, Envelope::ptr_t());
+  }
+}
+
+void AsyncChannelImpl::FailAll(const boost::system::error_code &error) {
+  m_failure = error;
+
+  pending_rpc_list_t rpcs;
+  rpcs.swap(m_rpcs);
+  for (pending_rpc_list_t::const_iterator it = rpcs.begin(); it != rpcs.end();
+       ++it) {
+    it->on_error(error);
+  }
+
+  consume_handler_map_t consumers;
+  consumers.swap(m_consumers);
+  for (consume_handler_map_t::iterator it = consumers.begin();
+       it != consumers.end(); ++it) {
+    FailConsumer(it->second, error);
+  }
+
+  publish_handler_map_t publishes;
+  publishes.swap(m_publishes);
+  for (publish_handler_map_t::const_iterator it = publishes.begin();
+       it != publishes.end(); ++it) {
+    if (!it->second->empty()) {
+      AsyncChannel::publish_handler_t handler;
+      handler.swap(*it->second);
+      handler(error, Channel::pc_lost);
+    }
+  }
+}
+
+}  // namespace Detail
+
+AsyncChannel::AsyncChannel(boost::asio::io_context &io_context,
+                           Channel::ptr_t channel)
+    : m_impl(boost::make_shared<Detail::AsyncChannelImpl>(
+          boost::ref(io_context), channel)) {}
+
+AsyncChannel::~AsyncChannel() { m_impl->Close(); }
+
+AsyncChannel::executor_type AsyncChannel::get_executor() const {
+  return m_impl->m_io_context.get_executor();
+}
+
+void AsyncChannel::StartPublish(const std::string &exchange_name,
+                                const std::string &routing_key,
+                                const BasicMessage::ptr_t &message,
+                                bool mandatory,
+                                const publish_handler_t &handler) {
+  m_impl->Publish(exchange_name, routing_key, message, mandatory, handler);
+}
+
+void AsyncChannel::StartConsume(const std::string &consumer_tag,
+                                const consume_handler_t &handler) {
+  m_impl->Consume(consumer_tag, handler);
+}
+
+void AsyncChannel::StartDeclareQueue(const std::string &queue_name,
+                                     bool passive, bool durable,
+                                     bool exclusive, bool auto_delete,
+                                     const name_handler_t &handler) {
+  m_impl->DeclareQueue(queue_name, passive, durable, exclusive, auto_delete,
+                       handler);
+}
+
+void AsyncChannel::StartBindQueue(const std::string &queue_name,
+                                  const std::string &exchange_name,
+                                  const std::string &routing_key,
+                                  const error_handler_t &handler) {
+  m_impl->BindQueue(queue_name, exchange_name, routing_key, handler);
+}
+
+void AsyncChannel::StartBasicConsume(const std::string &queue,
+                                     const std::string &consumer_tag,
+                                     bool no_local, bool no_ack,
+                                     bool exclusive,
+                                     boost::uint16_t message_prefetch_count,
+                                     const name_handler_t &handler) {
+  m_impl->BasicConsume(queue, consumer_tag, no_local, no_ack, exclusive,
+                       message_prefetch_count, handler);
+}
+
+}  // namespace AmqpClient
@@ -30,10 +30,15 @@
 #include <amqp.h>
 #include <amqp_framing.h>
 
+#include "SimpleAmqpClient/AmqpLibraryException.h"
 #include "SimpleAmqpClient/BasicMessage.h"
+#include "SimpleAmqpClient/Mutex.h"
 #include "SimpleAmqpClient/TableImpl.h"
 
+#include <cstdlib>
 #include <cstring>
+#include <new>
+#include <stdexcept>
 
 namespace AmqpClient {
 
@@ -41,12 +46,218 @@ namespace Detail {
 
 class BasicMessageImpl {
  public:
-  BasicMessageImpl() : m_properties(), m_body() {}
+  BasicMessageImpl()
+      : m_properties(),
+        m_properties_encoded(false),
+        m_properties_lazy(false),
+        m_body(),
+        m_pooled_flags(0) {
+    init_amqp_pool(&m_property_pool, 1024);
+  }
+
+  ~BasicMessageImpl() { empty_amqp_pool(&m_property_pool); }
+
+  // The properties, decoding them first if that hasn't happened yet. The
+  // const getters of a received message may be called from several threads
+  // at once, so the first decode is done under m_decode_mutex.
+  amqp_basic_properties_t &Properties() {
+    if (m_properties_lazy) {
+      Mutex::scoped_lock lock(m_decode_mutex);
+      if (m_properties_encoded) {
+        DecodeProperties();
+      }
+    }
+    return m_properties;
+  }
+
+  // Keeps a copy of the encoded properties of a received message, they are
+  // decoded the first time any property is accessed. Most consumers only look
+  // at one or two properties, if any, so copying a single block is cheaper
+  // than copying each string property and the header table up front.
+  void SetEncodedProperties(const amqp_bytes_t &encoded) {
+    amqp_bytes_t copy;
+    amqp_pool_alloc_bytes(&m_property_pool, encoded.len, &copy);
+    if (NULL == copy.bytes) {
+      throw std::bad_alloc();
+    }
+    memcpy(copy.bytes, encoded.bytes, encoded.len);
+
+    m_properties = amqp_basic_properties_t();
+    m_encoded_properties = copy;
+    m_properties_encoded = true;
+    m_properties_lazy = true;
+  }
+
+  void DecodeProperties();
+
+  // Copies received properties, the string properties and header table all go
+  // into m_property_pool rather than getting an allocation each
+  void CopyProperties(const amqp_basic_properties_t &properties) {
+    m_properties_encoded = false;
+    m_properties_lazy = false;
+    m_properties = properties;
+    CopyPooledProperty(AMQP_BASIC_CONTENT_TYPE_FLAG, m_properties.content_type);
+    CopyPooledProperty(AMQP_BASIC_CONTENT_ENCODING_FLAG,
+                       m_properties.content_encoding);
+    CopyPooledProperty(AMQP_BASIC_CORRELATION_ID_FLAG,
+                       m_properties.correlation_id);
+    CopyPooledProperty(AMQP_BASIC_REPLY_TO_FLAG, m_properties.reply_to);
+    CopyPooledProperty(AMQP_BASIC_EXPIRATION_FLAG, m_properties.expiration);
+    CopyPooledProperty(AMQP_BASIC_MESSAGE_ID_FLAG, m_properties.message_id);
+    CopyPooledProperty(AMQP_BASIC_TYPE_FLAG, m_properties.type);
+    CopyPooledProperty(AMQP_BASIC_USER_ID_FLAG, m_properties.user_id);
+    CopyPooledProperty(AMQP_BASIC_APP_ID_FLAG, m_properties.app_id);
+    CopyPooledProperty(AMQP_BASIC_CLUSTER_ID_FLAG, m_properties.cluster_id);
+    if (0 != (m_properties._flags & AMQP_BASIC_HEADERS_FLAG)) {
+      m_properties.headers = TableValueImpl::CopyTable(m_properties.headers,
+                                                       m_property_pool);
+    }
+  }
+
+  void CopyPooledProperty(amqp_flags_t flag, amqp_bytes_t &property) {
+    if (0 == (m_properties._flags & flag)) {
+      return;
+    }
+    amqp_bytes_t copy = amqp_empty_bytes;
+    if (0 != property.len) {
+      amqp_pool_alloc_bytes(&m_property_pool, property.len, &copy);
+      if (NULL == copy.bytes) {
+        throw std::bad_alloc();
+      }
+      memcpy(copy.bytes, property.bytes, property.len);
+    }
+    property = copy;
+    m_pooled_flags |= flag;
+  }
+
+  // Releases the storage of a string property that is about to be replaced or
+  // cleared
+  void FreeProperty(amqp_flags_t flag, amqp_bytes_t &property) {
+    if (0 != (m_pooled_flags & flag)) {
+      m_pooled_flags &= ~flag;
+    } else {
+      amqp_bytes_free(property);
+    }
+  }
+
+  // Frees all properties and the body, leaving the message as if it were
+  // newly constructed
+  void Reset();
+
+  // Takes over the contents of body, leaving body empty
+  void SwapBody(std::string &body) {
+    if (m_body_owner) {
+      // The body is held in a foreign buffer, copy it out so body gets it
+      m_body_string.assign(reinterpret_cast<const char *>(m_body.bytes),
+                           m_body.len);
+      m_body_owner.reset();
+    }
+    m_body_string.swap(body);
+    UpdateBodyFromString();
+  }
+
+  // Takes ownership of a buffer allocated with amqp_bytes_malloc
+  void AdoptBody(const amqp_bytes_t &body) {
+    SetForeignBody(boost::shared_ptr<void>(body.bytes, &free), body.bytes,
+                   body.len);
+  }
+
+  // Points the body at memory kept alive by owner
+  void SetForeignBody(const boost::shared_ptr<const void> &owner,
+                      const void *data, std::size_t length) {
+    m_body_owner = owner;
+    std::string().swap(m_body_string);
+    m_body.bytes = const_cast<void *>(data);
+    m_body.len = length;
+  }
+
+  void UpdateBodyFromString() {
+    m_body.bytes = const_cast<char *>(m_body_string.data());
+    m_body.len = m_body_string.length();
+  }
+
+  void ClearContentEncoding() {
+    amqp_basic_properties_t &properties = Properties();
+    if (0 != (properties._flags & AMQP_BASIC_CONTENT_ENCODING_FLAG)) {
+      FreeProperty(AMQP_BASIC_CONTENT_ENCODING_FLAG,
+                   properties.content_encoding);
+      properties._flags &= ~AMQP_BASIC_CONTENT_ENCODING_FLAG;
+    }
+  }
+
   amqp_basic_properties_t m_properties;
+  // When set m_properties hasn't been filled in yet, m_encoded_properties
+  // (allocated from m_property_pool) holds them still in wire format
+  bool m_properties_encoded;
+  // Set for as long as the properties came in encoded, unlike
+  // m_properties_encoded it isn't changed by decoding them, so it can be read
+  // without holding m_decode_mutex
+  bool m_properties_lazy;
+  Mutex m_decode_mutex;
+  amqp_bytes_t m_encoded_properties;
+  // Always describes the current body, which lives either in m_body_string
+  // or, when m_body_owner is set, in memory m_body_owner keeps alive
   amqp_bytes_t m_body;
+  std::string m_body_string;
+  boost::shared_ptr<const void> m_body_owner;
+  // The message whose properties these are, for one made by a MessageTemplate
+  boost::shared_ptr<const void> m_properties_owner;
   amqp_pool_ptr_t m_table_pool;
+  // Holds the properties copied by CopyProperties, recycled by Reset
+  amqp_pool_t m_property_pool;
+  // The string properties whose storage isn't the message's own to free: it
+  // is in m_property_pool, or belongs to m_properties_owner
+  amqp_flags_t m_pooled_flags;
 };
+
+void BasicMessageImpl::DecodeProperties() {
+  void *decoded = NULL;
+  int ret = amqp_decode_properties(AMQP_BASIC_CLASS, &m_property_pool,
+                                   m_encoded_properties, &decoded);
+  if (ret < 0) {
+    throw AmqpLibraryException::CreateException(
+        ret, "while decoding message properties");
+  }
+
+  // Decoded strings and tables point into m_encoded_properties or were
+  // allocated from m_property_pool
+  m_properties = *static_cast<amqp_basic_properties_t *>(decoded);
+  m_pooled_flags = m_properties._flags;
+  m_properties_encoded = false;
+}
+
+void BasicMessageImpl::Reset() {
+  const amqp_flags_t string_flags[] = {
+      AMQP_BASIC_CONTENT_TYPE_FLAG, AMQP_BASIC_CONTENT_ENCODING_FLAG,
+      AMQP_BASIC_CORRELATION_ID_FLAG, AMQP_BASIC_REPLY_TO_FLAG,
+      AMQP_BASIC_EXPIRATION_FLAG, AMQP_BASIC_MESSAGE_ID_FLAG,
+      AMQP_BASIC_TYPE_FLAG, AMQP_BASIC_USER_ID_FLAG, AMQP_BASIC_APP_ID_FLAG,
+      AMQP_BASIC_CLUSTER_ID_FLAG};
+  amqp_bytes_t *const string_properties[] = {
+      &m_properties.content_type, &m_properties.content_encoding,
+      &m_properties.correlation_id, &m_properties.reply_to,
+      &m_properties.expiration, &m_properties.message_id, &m_properties.type,
+      &m_properties.user_id, &m_properties.app_id, &m_properties.cluster_id};
+
+  for (std::size_t i = 0; i < sizeof(string_flags) / sizeof(string_flags[0]);
+       ++i) {
+    if (0 != (m_properties._flags & string_flags[i])) {
+      FreeProperty(string_flags[i], *string_properties[i]);
+    }
+  }
+  m_properties = amqp_basic_properties_t();
+  m_properties_encoded = false;
+  m_properties_lazy = false;
+  m_pooled_flags = 0;
+  m_table_pool.reset();
+  recycle_amqp_pool(&m_property_pool);
+  m_properties_owner.reset();
+
+  m_body_owner.reset();
+  std::string().swap(m_body_string);
+  m_body = amqp_empty_bytes;
 }
+}  // namespace Detail
 
 BasicMessage::BasicMessage() : m_impl(new Detail::BasicMessageImpl) {
   m_impl->m_body.bytes = NULL;
@@ -63,400 +274,493 @@ BasicMessage::BasicMessage(const std::string &body)
 BasicMessage::BasicMessage(const amqp_bytes_t &body,
                            const amqp_basic_properties_t *properties)
     : m_impl(new Detail::BasicMessageImpl) {
-  m_impl->m_body = body;
-  m_impl->m_properties = *properties;
-  if (ContentTypeIsSet())
-    m_impl->m_properties.content_type =
-        amqp_bytes_malloc_dup(m_impl->m_properties.content_type);
-  if (ContentEncodingIsSet())
-    m_impl->m_properties.content_encoding =
-        amqp_bytes_malloc_dup(m_impl->m_properties.content_encoding);
-  if (CorrelationIdIsSet())
-    m_impl->m_properties.correlation_id =
-        amqp_bytes_malloc_dup(m_impl->m_properties.correlation_id);
-  if (ReplyToIsSet())
-    m_impl->m_properties.reply_to =
-        amqp_bytes_malloc_dup(m_impl->m_properties.reply_to);
-  if (ExpirationIsSet())
-    m_impl->m_properties.expiration =
-        amqp_bytes_malloc_dup(m_impl->m_properties.expiration);
-  if (MessageIdIsSet())
-    m_impl->m_properties.message_id =
-        amqp_bytes_malloc_dup(m_impl->m_properties.message_id);
-  if (TypeIsSet())
-    m_impl->m_properties.type =
-        amqp_bytes_malloc_dup(m_impl->m_properties.type);
-  if (UserIdIsSet())
-    m_impl->m_properties.user_id =
-        amqp_bytes_malloc_dup(m_impl->m_properties.user_id);
-  if (AppIdIsSet())
-    m_impl->m_properties.app_id =
-        amqp_bytes_malloc_dup(m_impl->m_properties.app_id);
-  if (ClusterIdIsSet())
-    m_impl->m_properties.cluster_id =
-        amqp_bytes_malloc_dup(m_impl->m_properties.cluster_id);
-  if (HeaderTableIsSet())
-    m_impl->m_properties.headers = Detail::TableValueImpl::CopyTable(
-        m_impl->m_properties.headers, m_impl->m_table_pool);
+  m_impl->AdoptBody(body);
+  m_impl->CopyProperties(*properties);
 }
 
-BasicMessage::~BasicMessage() {
-  amqp_bytes_free(m_impl->m_body);
-  if (ContentTypeIsSet()) amqp_bytes_free(m_impl->m_properties.content_type);
-  if (ContentEncodingIsSet())
-    amqp_bytes_free(m_impl->m_properties.content_encoding);
-  if (CorrelationIdIsSet())
-    amqp_bytes_free(m_impl->m_properties.correlation_id);
-  if (ReplyToIsSet()) amqp_bytes_free(m_impl->m_properties.reply_to);
-  if (ExpirationIsSet()) amqp_bytes_free(m_impl->m_properties.expiration);
-  if (MessageIdIsSet()) amqp_bytes_free(m_impl->m_properties.message_id);
-  if (TypeIsSet()) amqp_bytes_free(m_impl->m_properties.type);
-  if (UserIdIsSet()) amqp_bytes_free(m_impl->m_properties.user_id);
-  if (AppIdIsSet()) amqp_bytes_free(m_impl->m_properties.app_id);
-  if (ClusterIdIsSet()) amqp_bytes_free(m_impl->m_properties.cluster_id);
+BasicMessage::~BasicMessage() { m_impl->Reset(); }
+
+void BasicMessage::Reset() { m_impl->Reset(); }
+
+void BasicMessage::Assign(std::string &body,
+                          const amqp_basic_properties_t *properties,
+                          const amqp_bytes_t *encoded_properties) {
+  if (NULL != encoded_properties && NULL != encoded_properties->bytes) {
+    m_impl->SetEncodedProperties(*encoded_properties);
+  } else {
+    m_impl->CopyProperties(*properties);
+  }
+  m_impl->SwapBody(body);
+}
+
+void BasicMessage::CopyProperties(const BasicMessage &other) {
+  m_impl->CopyProperties(*other.getAmqpProperties());
+}
+
+void BasicMessage::ShareProperties(
+    const boost::shared_ptr<const BasicMessage> &prototype) {
+  // Only the struct is copied, the strings and header table stay where they
+  // are and none of them are freed by this message
+  m_impl->m_properties = prototype->m_impl->m_properties;
+  m_impl->m_properties_encoded = false;
+  m_impl->m_properties_lazy = false;
+  m_impl->m_pooled_flags = m_impl->m_properties._flags;
+  m_impl->m_properties_owner = prototype;
 }
 
 const amqp_basic_properties_t *BasicMessage::getAmqpProperties() const {
-  return &m_impl->m_properties;
+  return &m_impl->Properties();
 }
 
-const amqp_bytes_t &BasicMessage::getAmqpBody() const { return m_impl->m_body; }
+const amqp_bytes_t &BasicMessage::getAmqpBody() const {
+  return m_impl->m_body;
+}
 
 std::string BasicMessage::Body() const {
-  if (m_impl->m_body.bytes == NULL)
+  const amqp_bytes_t &body = m_impl->m_body;
+  if (body.bytes == NULL)
     return std::string();
-  return std::string((char *)m_impl->m_body.bytes, m_impl->m_body.len);
+  return std::string((char *)body.bytes, body.len);
 }
 void BasicMessage::Body(const std::string &body) {
-  if (NULL != m_impl->m_body.bytes) {
-    amqp_bytes_free(m_impl->m_body);
+  m_impl->m_body_owner.reset();
+  m_impl->m_body_string = body;
+  m_impl->UpdateBodyFromString();
+}
+
+const char *BasicMessage::BodyData() const {
+  return reinterpret_cast<const char *>(m_impl->m_body.bytes);
+}
+
+std::size_t BasicMessage::BodyLength() const { return m_impl->m_body.len; }
+
+void BasicMessage::SwapBody(std::string &body) {
+  m_impl->SwapBody(body);
+}
+
+#if !defined(BOOST_NO_CXX11_RVALUE_REFERENCES)
+void BasicMessage::Body(std::string &&body) {
+  m_impl->m_body_owner.reset();
+  m_impl->m_body_string = std::move(body);
+  m_impl->UpdateBodyFromString();
+}
+
+void BasicMessage::Body(std::vector<char> &&body) { AdoptBody(body); }
+#endif
+
+void BasicMessage::AdoptBody(std::vector<char> &body) {
+  boost::shared_ptr<std::vector<char> > owner =
+      boost::make_shared<std::vector<char> >();
+  owner->swap(body);
+  m_impl->SetForeignBody(owner, owner->empty() ? NULL : &(*owner)[0],
+                         owner->size());
+}
+
+void BasicMessage::AdoptBody(void *data, std::size_t length,
+                             const body_deleter_t &deleter) {
+  m_impl->SetForeignBody(boost::shared_ptr<void>(data, deleter), data, length);
+}
+
+namespace {
+struct null_deleter {
+  void operator()(const void *) const {}
+};
+}  // namespace
+
+void BasicMessage::ExternalBody(const void *data, std::size_t length) {
+  m_impl->SetForeignBody(
+      boost::shared_ptr<const void>(data, null_deleter()), data, length);
+}
+
+void BasicMessage::Compress(const Codec &codec) {
+  if (ContentEncodingIsSet()) {
+    throw std::logic_error(
+        "BasicMessage::Compress: the body is already encoded");
+  }
+  const amqp_bytes_t &body = m_impl->m_body;
+  std::string compressed;
+  codec.Compress(static_cast<const char *>(body.bytes), body.len, compressed);
+  // The old body is dropped rather than swapped out, which would copy it
+  // first if it is held in a foreign buffer
+  m_impl->m_body_owner.reset();
+  m_impl->m_body_string.swap(compressed);
+  m_impl->UpdateBodyFromString();
+  ContentEncoding(codec.Name());
+}
+
+void BasicMessage::Decompress(const Codec &codec) {
+  if (!ContentEncodingIsSet() || ContentEncoding() != codec.Name()) {
+    throw std::logic_error(
+        "BasicMessage::Decompress: the body isn't encoded by the codec");
   }
-  amqp_bytes_t body_bytes;
-  body_bytes.bytes = const_cast<char *>(body.data());
-  body_bytes.len = body.length();
-  m_impl->m_body = amqp_bytes_malloc_dup(body_bytes);
+  const amqp_bytes_t &body = m_impl->m_body;
+  std::string decompressed;
+  codec.Decompress(static_cast<const char *>(body.bytes), body.len,
+                   decompressed);
+  // Only once it worked, so a corrupt body is left as it came
+  m_impl->m_body_owner.reset();
+  m_impl->m_body_string.swap(decompressed);
+  m_impl->UpdateBodyFromString();
+  m_impl->ClearContentEncoding();
 }
 
 std::string BasicMessage::ContentType() const {
   if (ContentTypeIsSet())
-    return std::string((char *)m_impl->m_properties.content_type.bytes,
-                       m_impl->m_properties.content_type.len);
+    return std::string((char *)m_impl->Properties().content_type.bytes,
+                       m_impl->Properties().content_type.len);
   return std::string();
 }
 
 void BasicMessage::ContentType(const std::string &content_type) {
-  if (ContentTypeIsSet()) amqp_bytes_free(m_impl->m_properties.content_type);
-  m_impl->m_properties.content_type =
+  if (ContentTypeIsSet())
+    m_impl->FreeProperty(AMQP_BASIC_CONTENT_TYPE_FLAG,
+                         m_impl->Properties().content_type);
+  m_impl->Properties().content_type =
       amqp_bytes_malloc_dup(amqp_cstring_bytes(content_type.c_str()));
-  m_impl->m_properties._flags |= AMQP_BASIC_CONTENT_TYPE_FLAG;
+  m_impl->Properties()._flags |= AMQP_BASIC_CONTENT_TYPE_FLAG;
 }
 
 bool BasicMessage::ContentTypeIsSet() const {
   return AMQP_BASIC_CONTENT_TYPE_FLAG ==
-         (m_impl->m_properties._flags & AMQP_BASIC_CONTENT_TYPE_FLAG);
+         (m_impl->Properties()._flags & AMQP_BASIC_CONTENT_TYPE_FLAG);
 }
 
 void BasicMessage::ContentTypeClear() {
-  if (ContentTypeIsSet()) amqp_bytes_free(m_impl->m_properties.content_type);
-  m_impl->m_properties._flags &= ~AMQP_BASIC_CONTENT_TYPE_FLAG;
+  if (ContentTypeIsSet())
+    m_impl->FreeProperty(AMQP_BASIC_CONTENT_TYPE_FLAG,
+                         m_impl->Properties().content_type);
+  m_impl->Properties()._flags &= ~AMQP_BASIC_CONTENT_TYPE_FLAG;
 }
 
 std::string BasicMessage::ContentEncoding() const {
   if (ContentEncodingIsSet())
-    return std::string((char *)m_impl->m_properties.content_encoding.bytes,
-                       m_impl->m_properties.content_encoding.len);
+    return std::string((char *)m_impl->Properties().content_encoding.bytes,
+                       m_impl->Properties().content_encoding.len);
   return std::string();
 }
 
 void BasicMessage::ContentEncoding(const std::string &content_encoding) {
   if (ContentEncodingIsSet())
-    amqp_bytes_free(m_impl->m_properties.content_encoding);
-  m_impl->m_properties.content_encoding =
+    m_impl->FreeProperty(AMQP_BASIC_CONTENT_ENCODING_FLAG,
+                         m_impl->Properties().content_encoding);
+  m_impl->Properties().content_encoding =
       amqp_bytes_malloc_dup(amqp_cstring_bytes(content_encoding.c_str()));
-  m_impl->m_properties._flags |= AMQP_BASIC_CONTENT_ENCODING_FLAG;
+  m_impl->Properties()._flags |= AMQP_BASIC_CONTENT_ENCODING_FLAG;
 }
 
 bool BasicMessage::ContentEncodingIsSet() const {
   return AMQP_BASIC_CONTENT_ENCODING_FLAG ==
-         (m_impl->m_properties._flags & AMQP_BASIC_CONTENT_ENCODING_FLAG);
+         (m_impl->Properties()._flags & AMQP_BASIC_CONTENT_ENCODING_FLAG);
 }
 
 void BasicMessage::ContentEncodingClear() {
   if (ContentEncodingIsSet())
-    amqp_bytes_free(m_impl->m_properties.content_encoding);
-  m_impl->m_properties._flags &= ~AMQP_BASIC_CONTENT_ENCODING_FLAG;
+    m_impl->FreeProperty(AMQP_BASIC_CONTENT_ENCODING_FLAG,
+                         m_impl->Properties().content_encoding);
+  m_impl->Properties()._flags &= ~AMQP_BASIC_CONTENT_ENCODING_FLAG;
 }
 
 BasicMessage::delivery_mode_t BasicMessage::DeliveryMode() const {
   if (DeliveryModeIsSet())
-    return (delivery_mode_t)m_impl->m_properties.delivery_mode;
+    return (delivery_mode_t)m_impl->Properties().delivery_mode;
   return (delivery_mode_t)0;
 }
 
 void BasicMessage::DeliveryMode(delivery_mode_t delivery_mode) {
-  m_impl->m_properties.delivery_mode = static_cast<uint8_t>(delivery_mode);
-  m_impl->m_properties._flags |= AMQP_BASIC_DELIVERY_MODE_FLAG;
+  m_impl->Properties().delivery_mode = static_cast<uint8_t>(delivery_mode);
+  m_impl->Properties()._flags |= AMQP_BASIC_DELIVERY_MODE_FLAG;
 }
 
 bool BasicMessage::DeliveryModeIsSet() const {
   return AMQP_BASIC_DELIVERY_MODE_FLAG ==
-         (m_impl->m_properties._flags & AMQP_BASIC_DELIVERY_MODE_FLAG);
+         (m_impl->Properties()._flags & AMQP_BASIC_DELIVERY_MODE_FLAG);
 }
 
 void BasicMessage::DeliveryModeClear() {
-  m_impl->m_properties._flags &= ~AMQP_BASIC_DELIVERY_MODE_FLAG;
+  m_impl->Properties()._flags &= ~AMQP_BASIC_DELIVERY_MODE_FLAG;
 }
 
 boost::uint8_t BasicMessage::Priority() const {
   if (PriorityIsSet())
-    return m_impl->m_properties.priority;
+    return m_impl->Properties().priority;
   return 0;
 }
 void BasicMessage::Priority(boost::uint8_t priority) {
-  m_impl->m_properties.priority = priority;
-  m_impl->m_properties._flags |= AMQP_BASIC_PRIORITY_FLAG;
+  m_impl->Properties().priority = priority;
+  m_impl->Properties()._flags |= AMQP_BASIC_PRIORITY_FLAG;
 }
 
 bool BasicMessage::PriorityIsSet() const {
   return AMQP_BASIC_PRIORITY_FLAG ==
-         (m_impl->m_properties._flags & AMQP_BASIC_PRIORITY_FLAG);
+         (m_impl->Properties()._flags & AMQP_BASIC_PRIORITY_FLAG);
 }
 
 void BasicMessage::PriorityClear() {
-  m_impl->m_properties._flags &= ~AMQP_BASIC_PRIORITY_FLAG;
+  m_impl->Properties()._flags &= ~AMQP_BASIC_PRIORITY_FLAG;
 }
 
 std::string BasicMessage::CorrelationId() const {
   if (CorrelationIdIsSet())
-    return std::string((char *)m_impl->m_properties.correlation_id.bytes,
-                       m_impl->m_properties.correlation_id.len);
+    return std::string((char *)m_impl->Properties().correlation_id.bytes,
+                       m_impl->Properties().correlation_id.len);
   return std::string();
 }
 
 void BasicMessage::CorrelationId(const std::string &correlation_id) {
   if (CorrelationIdIsSet())
-    amqp_bytes_free(m_impl->m_properties.correlation_id);
-  m_impl->m_properties.correlation_id =
+    m_impl->FreeProperty(AMQP_BASIC_CORRELATION_ID_FLAG,
+                         m_impl->Properties().correlation_id);
+  m_impl->Properties().correlation_id =
       amqp_bytes_malloc_dup(amqp_cstring_bytes(correlation_id.c_str()));
-  m_impl->m_properties._flags |= AMQP_BASIC_CORRELATION_ID_FLAG;
+  m_impl->Properties()._flags |= AMQP_BASIC_CORRELATION_ID_FLAG;
 }
 
 bool BasicMessage::CorrelationIdIsSet() const {
   return AMQP_BASIC_CORRELATION_ID_FLAG ==
-         (m_impl->m_properties._flags & AMQP_BASIC_CORRELATION_ID_FLAG);
+         (m_impl->Properties()._flags & AMQP_BASIC_CORRELATION_ID_FLAG);
 }
 
 void BasicMessage::CorrelationIdClear() {
   if (CorrelationIdIsSet())
-    amqp_bytes_free(m_impl->m_properties.correlation_id);
-  m_impl->m_properties._flags &= ~AMQP_BASIC_CORRELATION_ID_FLAG;
+    m_impl->FreeProperty(AMQP_BASIC_CORRELATION_ID_FLAG,
+                         m_impl->Properties().correlation_id);
+  m_impl->Properties()._flags &= ~AMQP_BASIC_CORRELATION_ID_FLAG;
 }
 
 std::string BasicMessage::ReplyTo() const {
   if (ReplyToIsSet())
-    return std::string((char *)m_impl->m_properties.reply_to.bytes,
-                       m_impl->m_properties.reply_to.len);
+    return std::string((char *)m_impl->Properties().reply_to.bytes,
+                       m_impl->Properties().reply_to.len);
   return std::string();
 }
 void BasicMessage::ReplyTo(const std::string &reply_to) {
-  if (ReplyToIsSet()) amqp_bytes_free(m_impl->m_properties.reply_to);
-  m_impl->m_properties.reply_to =
+  if (ReplyToIsSet())
+    m_impl->FreeProperty(AMQP_BASIC_REPLY_TO_FLAG,
+                         m_impl->Properties().reply_to);
+  m_impl->Properties().reply_to =
       amqp_bytes_malloc_dup(amqp_cstring_bytes(reply_to.c_str()));
-  m_impl->m_properties._flags |= AMQP_BASIC_REPLY_TO_FLAG;
+  m_impl->Properties()._flags |= AMQP_BASIC_REPLY_TO_FLAG;
 }
 
 bool BasicMessage::ReplyToIsSet() const {
   return AMQP_BASIC_REPLY_TO_FLAG ==
-         (m_impl->m_properties._flags & AMQP_BASIC_REPLY_TO_FLAG);
+         (m_impl->Properties()._flags & AMQP_BASIC_REPLY_TO_FLAG);
 }
 
 void BasicMessage::ReplyToClear() {
-  if (ReplyToIsSet()) amqp_bytes_free(m_impl->m_properties.reply_to);
-  m_impl->m_properties._flags &= ~AMQP_BASIC_REPLY_TO_FLAG;
+  if (ReplyToIsSet())
+    m_impl->FreeProperty(AMQP_BASIC_REPLY_TO_FLAG,
+                         m_impl->Properties().reply_to);
+  m_impl->Properties()._flags &= ~AMQP_BASIC_REPLY_TO_FLAG;
 }
 
 std::string BasicMessage::Expiration() const {
   if (ExpirationIsSet())
-    return std::string((char *)m_impl->m_properties.expiration.bytes,
-                       m_impl->m_properties.expiration.len);
+    return std::string((char *)m_impl->Properties().expiration.bytes,
+                       m_impl->Properties().expiration.len);
   return std::string();
 }
 void BasicMessage::Expiration(const std::string &expiration) {
-  if (ExpirationIsSet()) amqp_bytes_free(m_impl->m_properties.expiration);
-  m_impl->m_properties.expiration =
+  if (ExpirationIsSet())
+    m_impl->FreeProperty(AMQP_BASIC_EXPIRATION_FLAG,
+                         m_impl->Properties().expiration);
+  m_impl->Properties().expiration =
       amqp_bytes_malloc_dup(amqp_cstring_bytes(expiration.c_str()));
-  m_impl->m_properties._flags |= AMQP_BASIC_EXPIRATION_FLAG;
+  m_impl->Properties()._flags |= AMQP_BASIC_EXPIRATION_FLAG;
 }
 
 bool BasicMessage::ExpirationIsSet() const {
   return AMQP_BASIC_EXPIRATION_FLAG ==
-         (m_impl->m_properties._flags & AMQP_BASIC_EXPIRATION_FLAG);
+         (m_impl->Properties()._flags & AMQP_BASIC_EXPIRATION_FLAG);
 }
 
 void BasicMessage::ExpirationClear() {
-  if (ExpirationIsSet()) amqp_bytes_free(m_impl->m_properties.expiration);
-  m_impl->m_properties._flags &= ~AMQP_BASIC_EXPIRATION_FLAG;
+  if (ExpirationIsSet())
+    m_impl->FreeProperty(AMQP_BASIC_EXPIRATION_FLAG,
+                         m_impl->Properties().expiration);
+  m_impl->Properties()._flags &= ~AMQP_BASIC_EXPIRATION_FLAG;
 }
 
 std::string BasicMessage::MessageId() const {
   if (MessageIdIsSet())
-    return std::string((char *)m_impl->m_properties.message_id.bytes,
-                       m_impl->m_properties.message_id.len);
+    return std::string((char *)m_impl->Properties().message_id.bytes,
+                       m_impl->Properties().message_id.len);
   return std::string();
 }
 void BasicMessage::MessageId(const std::string &message_id) {
-  if (MessageIdIsSet()) amqp_bytes_free(m_impl->m_properties.message_id);
-  m_impl->m_properties.message_id =
+  if (MessageIdIsSet())
+    m_impl->FreeProperty(AMQP_BASIC_MESSAGE_ID_FLAG,
+                         m_impl->Properties().message_id);
+  m_impl->Properties().message_id =
       amqp_bytes_malloc_dup(amqp_cstring_bytes(message_id.c_str()));
-  m_impl->m_properties._flags |= AMQP_BASIC_MESSAGE_ID_FLAG;
+  m_impl->Properties()._flags |= AMQP_BASIC_MESSAGE_ID_FLAG;
 }
 
 bool BasicMessage::MessageIdIsSet() const {
   return AMQP_BASIC_MESSAGE_ID_FLAG ==
-         (m_impl->m_properties._flags & AMQP_BASIC_MESSAGE_ID_FLAG);
+         (m_impl->Properties()._flags & AMQP_BASIC_MESSAGE_ID_FLAG);
 }
 
 void BasicMessage::MessageIdClear() {
-  if (MessageIdIsSet()) amqp_bytes_free(m_impl->m_properties.message_id);
-  m_impl->m_properties._flags &= ~AMQP_BASIC_MESSAGE_ID_FLAG;
+  if (MessageIdIsSet())
+    m_impl->FreeProperty(AMQP_BASIC_MESSAGE_ID_FLAG,
+                         m_impl->Properties().message_id);
+  m_impl->Properties()._flags &= ~AMQP_BASIC_MESSAGE_ID_FLAG;
 }
 
 boost::uint64_t BasicMessage::Timestamp() const {
   if (TimestampIsSet())
-    return m_impl->m_properties.timestamp;
+    return m_impl->Properties().timestamp;
   return 0;
 }
 void BasicMessage::Timestamp(boost::uint64_t timestamp) {
-  m_impl->m_properties.timestamp = timestamp;
-  m_impl->m_properties._flags |= AMQP_BASIC_TIMESTAMP_FLAG;
+  m_impl->Properties().timestamp = timestamp;
+  m_impl->Properties()._flags |= AMQP_BASIC_TIMESTAMP_FLAG;
 }
 
 bool BasicMessage::TimestampIsSet() const {
   return AMQP_BASIC_TIMESTAMP_FLAG ==
-         (m_impl->m_properties._flags & AMQP_BASIC_TIMESTAMP_FLAG);
+         (m_impl->Properties()._flags & AMQP_BASIC_TIMESTAMP_FLAG);
 }
 
 void BasicMessage::TimestampClear() {
-  m_impl->m_properties._flags &= ~AMQP_BASIC_TIMESTAMP_FLAG;
+  m_impl->Properties()._flags &= ~AMQP_BASIC_TIMESTAMP_FLAG;
 }
 
 std::string BasicMessage::Type() const {
   if (TypeIsSet())
-    return std::string((char *)m_impl->m_properties.type.bytes,
-                       m_impl->m_properties.type.len);
+    return std::string((char *)m_impl->Properties().type.bytes,
+                       m_impl->Properties().type.len);
   return std::string();
 }
 void BasicMessage::Type(const std::string &type) {
-  if (TypeIsSet()) amqp_bytes_free(m_impl->m_properties.type);
-  m_impl->m_properties.type =
+  if (TypeIsSet())
+    m_impl->FreeProperty(AMQP_BASIC_TYPE_FLAG, m_impl->Properties().type);
+  m_impl->Properties().type =
       amqp_bytes_malloc_dup(amqp_cstring_bytes(type.c_str()));
-  m_impl->m_properties._flags |= AMQP_BASIC_TYPE_FLAG;
+  m_impl->Properties()._flags |= AMQP_BASIC_TYPE_FLAG;
 }
 
 bool BasicMessage::TypeIsSet() const {
   return AMQP_BASIC_TYPE_FLAG ==
-         (m_impl->m_properties._flags & AMQP_BASIC_TYPE_FLAG);
+         (m_impl->Properties()._flags & AMQP_BASIC_TYPE_FLAG);
 }
 
 void BasicMessage::TypeClear() {
-  if (TypeIsSet()) amqp_bytes_free(m_impl->m_properties.type);
-  m_impl->m_properties._flags &= ~AMQP_BASIC_TYPE_FLAG;
+  if (TypeIsSet())
+    m_impl->FreeProperty(AMQP_BASIC_TYPE_FLAG, m_impl->Properties().type);
+  m_impl->Properties()._flags &= ~AMQP_BASIC_TYPE_FLAG;
 }
 
 std::string BasicMessage::UserId() const {
   if (UserIdIsSet())
-    return std::string((char *)m_impl->m_properties.user_id.bytes,
-                       m_impl->m_properties.user_id.len);
+    return std::string((char *)m_impl->Properties().user_id.bytes,
+                       m_impl->Properties().user_id.len);
   return std::string();
 }
 
 void BasicMessage::UserId(const std::string &user_id) {
-  if (UserIdIsSet()) amqp_bytes_free(m_impl->m_properties.user_id);
-  m_impl->m_properties.user_id =
+  if (UserIdIsSet())
+    m_impl->FreeProperty(AMQP_BASIC_USER_ID_FLAG, m_impl->Properties().user_id);
+  m_impl->Properties().user_id =
       amqp_bytes_malloc_dup(amqp_cstring_bytes(user_id.c_str()));
-  m_impl->m_properties._flags |= AMQP_BASIC_USER_ID_FLAG;
+  m_impl->Properties()._flags |= AMQP_BASIC_USER_ID_FLAG;
 }
 
 bool BasicMessage::UserIdIsSet() const {
   return AMQP_BASIC_USER_ID_FLAG ==
-         (m_impl->m_properties._flags & AMQP_BASIC_USER_ID_FLAG);
+         (m_impl->Properties()._flags & AMQP_BASIC_USER_ID_FLAG);
 }
 
 void BasicMessage::UserIdClear() {
-  if (UserIdIsSet()) amqp_bytes_free(m_impl->m_properties.user_id);
-  m_impl->m_properties._flags &= ~AMQP_BASIC_USER_ID_FLAG;
+  if (UserIdIsSet())
+    m_impl->FreeProperty(AMQP_BASIC_USER_ID_FLAG, m_impl->Properties().user_id);
+  m_impl->Properties()._flags &= ~AMQP_BASIC_USER_ID_FLAG;
 }
 
 std::string BasicMessage::AppId() const {
   if (AppIdIsSet())
-    return std::string((char *)m_impl->m_properties.app_id.bytes,
-                       m_impl->m_properties.app_id.len);
+    return std::string((char *)m_impl->Properties().app_id.bytes,
+                       m_impl->Properties().app_id.len);
   return std::string();
 }
 void BasicMessage::AppId(const std::string &app_id) {
-  if (AppIdIsSet()) amqp_bytes_free(m_impl->m_properties.app_id);
-  m_impl->m_properties.app_id =
+  if (AppIdIsSet())
+    m_impl->FreeProperty(AMQP_BASIC_APP_ID_FLAG, m_impl->Properties().app_id);
+  m_impl->Properties().app_id =
       amqp_bytes_malloc_dup(amqp_cstring_bytes(app_id.c_str()));
-  m_impl->m_properties._flags |= AMQP_BASIC_APP_ID_FLAG;
+  m_impl->Properties()._flags |= AMQP_BASIC_APP_ID_FLAG;
 }
 
 bool BasicMessage::AppIdIsSet() const {
   return AMQP_BASIC_APP_ID_FLAG ==
-         (m_impl->m_properties._flags & AMQP_BASIC_APP_ID_FLAG);
+         (m_impl->Properties()._flags & AMQP_BASIC_APP_ID_FLAG);
 }
 
 void BasicMessage::AppIdClear() {
-  if (AppIdIsSet()) amqp_bytes_free(m_impl->m_properties.app_id);
-  m_impl->m_properties._flags &= ~AMQP_BASIC_APP_ID_FLAG;
+  if (AppIdIsSet())
+    m_impl->FreeProperty(AMQP_BASIC_APP_ID_FLAG, m_impl->Properties().app_id);
+  m_impl->Properties()._flags &= ~AMQP_BASIC_APP_ID_FLAG;
 }
 
 std::string BasicMessage::ClusterId() const {
   if (ClusterIdIsSet())
-    return std::string((char *)m_impl->m_properties.cluster_id.bytes,
-                       m_impl->m_properties.cluster_id.len);
+    return std::string((char *)m_impl->Properties().cluster_id.bytes,
+                       m_impl->Properties().cluster_id.len);
   return std::string();
 }
 void BasicMessage::ClusterId(const std::string &cluster_id) {
-  if (ClusterIdIsSet()) amqp_bytes_free(m_impl->m_properties.cluster_id);
-  m_impl->m_properties.cluster_id =
+  if (ClusterIdIsSet())
+    m_impl->FreeProperty(AMQP_BASIC_CLUSTER_ID_FLAG,
+                         m_impl->Properties().cluster_id);
+  m_impl->Properties().cluster_id =
       amqp_bytes_malloc_dup(amqp_cstring_bytes(cluster_id.c_str()));
-  m_impl->m_properties._flags |= AMQP_BASIC_CLUSTER_ID_FLAG;
+  m_impl->Properties()._flags |= AMQP_BASIC_CLUSTER_ID_FLAG;
 }
 
 bool BasicMessage::ClusterIdIsSet() const {
   return AMQP_BASIC_CLUSTER_ID_FLAG ==
-         (m_impl->m_properties._flags & AMQP_BASIC_CLUSTER_ID_FLAG);
+         (m_impl->Properties()._flags & AMQP_BASIC_CLUSTER_ID_FLAG);
 }
 
 void BasicMessage::ClusterIdClear() {
-  if (ClusterIdIsSet()) amqp_bytes_free(m_impl->m_properties.cluster_id);
-  m_impl->m_properties._flags &= ~AMQP_BASIC_CLUSTER_ID_FLAG;
+  if (ClusterIdIsSet())
+    m_impl->FreeProperty(AMQP_BASIC_CLUSTER_ID_FLAG,
+                         m_impl->Properties().cluster_id);
+  m_impl->Properties()._flags &= ~AMQP_BASIC_CLUSTER_ID_FLAG;
 }
 
 Table BasicMessage::HeaderTable() const {
   if (HeaderTableIsSet())
-    return Detail::TableValueImpl::CreateTable(m_impl->m_properties.headers);
+    return Detail::TableValueImpl::CreateTable(m_impl->Properties().headers);
   return Table();
 }
 
-void BasicMessage::HeaderTable(const Table &header_table) {
-  m_impl->m_properties.headers = Detail::TableValueImpl::CreateAmqpTable(
+TableView BasicMessage::HeaderTableView() const {
+  if (HeaderTableIsSet())
+    return Detail::TableValueImpl::CreateTableView(
+        m_impl->Properties().headers, boost::shared_ptr<const void>());
+  return TableView();
+}
+
+void BasicMessage::HeaderTable(const PreparedTable &header_table) {
+  m_impl->Properties().headers = Detail::TableValueImpl::CreateAmqpTable(
       header_table, m_impl->m_table_pool);
-  m_impl->m_properties._flags |= AMQP_BASIC_HEADERS_FLAG;
+  m_impl->Properties()._flags |= AMQP_BASIC_HEADERS_FLAG;
 }
 
 bool BasicMessage::HeaderTableIsSet() const {
   return AMQP_BASIC_HEADERS_FLAG ==
-         (m_impl->m_properties._flags & AMQP_BASIC_HEADERS_FLAG);
+         (m_impl->Properties()._flags & AMQP_BASIC_HEADERS_FLAG);
 }
 
 void BasicMessage::HeaderTableClear() {
   if (HeaderTableIsSet()) {
     m_impl->m_table_pool.reset();
-    m_impl->m_properties.headers.num_entries = 0;
-    m_impl->m_properties.headers.entries = NULL;
+    m_impl->Properties().headers.num_entries = 0;
+    m_impl->Properties().headers.entries = NULL;
   }
-  m_impl->m_properties._flags &= ~AMQP_BASIC_HEADERS_FLAG;
+  m_impl->Properties()._flags &= ~AMQP_BASIC_HEADERS_FLAG;
 }
 
 }  // namespace AmqpClient
@@ -29,23 +29,22 @@
 // Put these first to avoid warnings about INT#_C macro redefinition
 #include <amqp.h>
 #include <amqp_framing.h>
-#include <amqp_tcp_socket.h>
-#ifdef SAC_SSL_SUPPORT_ENABLED
-#include <amqp_ssl_socket.h>
-#endif
 
 #include "SimpleAmqpClient/Channel.h"
 
 #include "SimpleAmqpClient/AmqpLibraryException.h"
 #include "SimpleAmqpClient/AmqpResponseLibraryException.h"
+#include "SimpleAmqpClient/BackPressureException.h"
 #include "SimpleAmqpClient/BadUriException.h"
 #include "SimpleAmqpClient/ChannelImpl.h"
 #include "SimpleAmqpClient/ConsumerCancelledException.h"
 #include "SimpleAmqpClient/ConsumerTagNotFoundException.h"
 #include "SimpleAmqpClient/MessageReturnedException.h"
 #include "SimpleAmqpClient/TableImpl.h"
+#include "SimpleAmqpClient/Topology.h"
 #include "SimpleAmqpClient/Util.h"
 
+#include <deque>
 #include <map>
 #include <new>
 #include <queue>
@@ -58,6 +57,7 @@
 #include <boost/bind.hpp>
 #include <boost/chrono.hpp>
 #include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/limits.hpp>
 
 #include <string.h>
@@ -68,7 +68,46 @@ const std::string Channel::EXCHANGE_TYPE_DIRECT("direct");
 const std::string Channel::EXCHANGE_TYPE_FANOUT("fanout");
 const std::string Channel::EXCHANGE_TYPE_TOPIC("topic");
 
-Channel::ptr_t Channel::CreateFromUri(const std::string &uri, int frame_max) {
+Channel::RecoveryOptions::RecoveryOptions()
+    : initial_delay(100),
+      max_delay(30000),
+      max_attempts(10),
+      republish_unconfirmed(false) {}
+
+Channel::BufferLimits::BufferLimits()
+    : max_channel_bytes(0),
+      max_channel_messages(0),
+      max_bytes(0),
+      max_messages(0),
+      use_channel_flow(false) {}
+
+Channel::ConnectionOptions::ConnectionOptions()
+    : tcp_nodelay(true),
+      receive_buffer_size(0),
+      send_buffer_size(0),
+      keepalive(false),
+      keepalive_idle(0),
+      keepalive_interval(0),
+      keepalive_count(0),
+      connect_timeout(-1),
+      connect_in_parallel(false) {}
+
+Channel::ConnectionOptions Channel::ConnectionOptions::Bulk() {
+  ConnectionOptions options;
+#ifndef __linux__
+  // Linux grows the buffers by itself, setting them turns that off and they
+  // are then capped at net.core.rmem_max/wmem_max
+  options.receive_buffer_size = BULK_SOCKET_BUFFER_SIZE;
+  options.send_buffer_size = BULK_SOCKET_BUFFER_SIZE;
+#endif
+  return options;
+}
+
+const int Channel::BULK_SOCKET_BUFFER_SIZE = 4 * 1024 * 1024;
+
+Channel::ptr_t Channel::CreateFromUri(const std::string &uri, int frame_max,
+                                      int heartbeat,
+                                      const ConnectionOptions &options) {
   amqp_connection_info info;
   amqp_default_connection_info(&info);
 
@@ -80,14 +119,15 @@ Channel::ptr_t Channel::CreateFromUri(const std::string &uri, int frame_max) {
   }
 
   return Create(std::string(info.host), info.port, std::string(info.user),
-                std::string(info.password), std::string(info.vhost), frame_max);
+                std::string(info.password), std::string(info.vhost), frame_max,
+                heartbeat, options);
 }
 
 Channel::ptr_t Channel::CreateSecureFromUri(
     const std::string &uri, const std::string &path_to_ca_cert,
     const std::string &path_to_client_key,
     const std::string &path_to_client_cert, bool verify_hostname,
-    int frame_max) {
+    int frame_max, int heartbeat, const ConnectionOptions &options) {
   amqp_connection_info info;
   amqp_default_connection_info(&info);
 
@@ -102,119 +142,163 @@ Channel::ptr_t Channel::CreateSecureFromUri(
     return CreateSecure(path_to_ca_cert, std::string(info.host),
                         path_to_client_key, path_to_client_cert, info.port,
                         std::string(info.user), std::string(info.password),
-                        std::string(info.vhost), frame_max, verify_hostname);
+                        std::string(info.vhost), frame_max, verify_hostname,
+                        heartbeat, options);
   }
   throw std::runtime_error(
       "CreateSecureFromUri only supports SSL-enabled URIs.");
 }
 
-Channel::Channel(const std::string &host, int port, const std::string &username,
-                 const std::string &password, const std::string &vhost,
-                 int frame_max)
-    : m_impl(new Detail::ChannelImpl) {
-  m_impl->m_connection = amqp_new_connection();
+Channel::ptr_t Channel::CreateSecureFromUri(
+    const std::string &uri, const SslContext::ptr_t &ssl_context,
+    int frame_max, int heartbeat, const ConnectionOptions &options) {
+  amqp_connection_info info;
+  amqp_default_connection_info(&info);
 
-  if (NULL == m_impl->m_connection) {
-    throw std::bad_alloc();
-  }
+  boost::shared_ptr<char> uri_dup =
+      boost::shared_ptr<char>(strdup(uri.c_str()), free);
 
-  try {
-    amqp_socket_t *socket = amqp_tcp_socket_new(m_impl->m_connection);
-    int sock = amqp_socket_open(socket, host.c_str(), port);
-    m_impl->CheckForError(sock);
+  if (0 != amqp_parse_url(uri_dup.get(), &info)) {
+    throw BadUriException();
+  }
 
-    m_impl->DoLogin(username, password, vhost, frame_max);
-  } catch (...) {
-    amqp_destroy_connection(m_impl->m_connection);
-    throw;
+  if (info.ssl) {
+    return CreateSecure(ssl_context, std::string(info.host), info.port,
+                        std::string(info.user), std::string(info.password),
+                        std::string(info.vhost), frame_max, heartbeat,
+                        options);
   }
+  throw std::runtime_error(
+      "CreateSecureFromUri only supports SSL-enabled URIs.");
+}
 
-  m_impl->SetIsConnected(true);
+Channel::ptr_t Channel::CreateBulk(const std::string &host, int port,
+                                   const std::string &username,
+                                   const std::string &password,
+                                   const std::string &vhost, int heartbeat) {
+  // A frame_max of 0 takes whatever the broker offers
+  return Create(host, port, username, password, vhost, 0, heartbeat,
+                ConnectionOptions::Bulk());
 }
 
-#ifdef SAC_SSL_SUPPORT_ENABLED
 Channel::Channel(const std::string &host, int port, const std::string &username,
                  const std::string &password, const std::string &vhost,
-                 int frame_max, const SSLConnectionParams &ssl_params)
-    : m_impl(new Detail::ChannelImpl) {
-  m_impl->m_connection = amqp_new_connection();
-  if (NULL == m_impl->m_connection) {
-    throw std::bad_alloc();
-  }
-
-  amqp_socket_t *socket = amqp_ssl_socket_new(m_impl->m_connection);
-  if (NULL == socket) {
-    throw std::bad_alloc();
-  }
-#if AMQP_VERSION >= 0x00080001
-  amqp_ssl_socket_set_verify_peer(socket, ssl_params.verify_hostname);
-  amqp_ssl_socket_set_verify_hostname(socket, ssl_params.verify_hostname);
-#else
-  amqp_ssl_socket_set_verify(socket, ssl_params.verify_hostname);
-#endif
-
-  try {
-    int status =
-        amqp_ssl_socket_set_cacert(socket, ssl_params.path_to_ca_cert.c_str());
-    if (status) {
-      throw AmqpLibraryException::CreateException(
-          status, "Error setting CA certificate for socket");
-    }
-
-    if (ssl_params.path_to_client_key != "" &&
-        ssl_params.path_to_client_cert != "") {
-      status = amqp_ssl_socket_set_key(socket,
-                                       ssl_params.path_to_client_cert.c_str(),
-                                       ssl_params.path_to_client_key.c_str());
-      if (status) {
-        throw AmqpLibraryException::CreateException(
-            status, "Error setting client certificate for socket");
-      }
-    }
-
-    status = amqp_socket_open(socket, host.c_str(), port);
-    if (status) {
-      throw AmqpLibraryException::CreateException(
-          status, "Error setting client certificate for socket");
-    }
-
-    m_impl->DoLogin(username, password, vhost, frame_max);
-  } catch (...) {
-    amqp_destroy_connection(m_impl->m_connection);
-    throw;
-  }
+                 int frame_max, int heartbeat,
+                 const ConnectionOptions &options)
+    : m_impl(new Detail::ChannelImpl), m_handle(0) {
+  Detail::ChannelImpl::connection_params_t params;
+  params.host = host;
+  params.port = port;
+  params.username = username;
+  params.password = password;
+  params.vhost = vhost;
+  params.frame_max = frame_max;
+  params.heartbeat = heartbeat;
+  params.options = options;
+  params.secure = false;
+  params.verify_hostname = false;
+  m_impl->Connect(params);
+}
 
-  m_impl->SetIsConnected(true);
+#ifdef SAC_SSL_SUPPORT_ENABLED
+Channel::Channel(const std::string &host, int port, const std::string &username,
+                 const std::string &password, const std::string &vhost,
+                 int frame_max, const SSLConnectionParams &ssl_params,
+                 int heartbeat, const ConnectionOptions &options)
+    : m_impl(new Detail::ChannelImpl), m_handle(0) {
+  Detail::ChannelImpl::connection_params_t params;
+  params.host = host;
+  params.port = port;
+  params.username = username;
+  params.password = password;
+  params.vhost = vhost;
+  params.frame_max = frame_max;
+  params.heartbeat = heartbeat;
+  params.options = options;
+  params.secure = true;
+  params.path_to_ca_cert = ssl_params.path_to_ca_cert;
+  params.path_to_client_key = ssl_params.path_to_client_key;
+  params.path_to_client_cert = ssl_params.path_to_client_cert;
+  params.verify_hostname = ssl_params.verify_hostname;
+  m_impl->Connect(params);
 }
 #else
 Channel::Channel(const std::string &, int, const std::string &,
                  const std::string &, const std::string &, int,
-                 const SSLConnectionParams &) {
+                 const SSLConnectionParams &, int, const ConnectionOptions &)
+    : m_handle(0) {
   throw std::logic_error(
       "SSL support has not been compiled into SimpleAmqpClient");
 }
 #endif
 
+Channel::Channel(const std::string &host, int port, const std::string &username,
+                 const std::string &password, const std::string &vhost,
+                 int frame_max, const SslContext::ptr_t &ssl_context,
+                 int heartbeat, const ConnectionOptions &options)
+    : m_impl(new Detail::ChannelImpl), m_handle(0) {
+  Detail::ChannelImpl::connection_params_t params;
+  params.host = host;
+  params.port = port;
+  params.username = username;
+  params.password = password;
+  params.vhost = vhost;
+  params.frame_max = frame_max;
+  params.heartbeat = heartbeat;
+  params.options = options;
+  params.secure = true;
+  params.verify_hostname = false;
+  params.ssl_context = ssl_context;
+  m_impl->Connect(params);
+}
+
+Channel::Channel(const boost::shared_ptr<Detail::ChannelImpl> &impl)
+    : m_impl(impl), m_handle(impl->NewHandleId()) {}
+
 Channel::~Channel() {
-  amqp_connection_close(m_impl->m_connection, AMQP_REPLY_SUCCESS);
-  amqp_destroy_connection(m_impl->m_connection);
+  if (m_impl->IsConnected()) {
+    try {
+      // The consumers of this Channel would otherwise keep receiving
+      // messages nobody is going to ask for
+      if (1 < m_impl.use_count()) {
+        std::vector<std::string> consumer_tags =
+            m_impl->GetConsumerTags(m_handle);
+        for (std::vector<std::string>::const_iterator it =
+                 consumer_tags.begin();
+             it != consumer_tags.end(); ++it) {
+          BasicCancel(*it);
+        }
+      }
+      m_impl->FlushAllAcks();
+    } catch (...) {
+    }
+  }
 }
 
 void Channel::DeclareExchange(const std::string &exchange_name,
                               const std::string &exchange_type, bool passive,
                               bool durable, bool auto_delete) {
   DeclareExchange(exchange_name, exchange_type, passive, durable, auto_delete,
-                  Table());
+                  PreparedTable());
 }
 
 void Channel::DeclareExchange(const std::string &exchange_name,
                               const std::string &exchange_type, bool passive,
                               bool durable, bool auto_delete,
-                              const Table &arguments) {
+                              const PreparedTable &arguments) {
   const boost::array<boost::uint32_t, 1> DECLARE_OK = {
       {AMQP_EXCHANGE_DECLARE_OK_METHOD}};
   m_impl->CheckIsConnected();
 
+  Topology cached;
+  if (m_impl->IsTrackingDeclarations()) {
+    cached.DeclareExchange(exchange_name, exchange_type, passive, durable,
+                           auto_delete, arguments);
+    if (m_impl->IsDeclarationCached(cached.Declarations().front())) {
+      return;
+    }
+  }
+
   amqp_exchange_declare_t declare = {};
   declare.exchange = amqp_cstring_bytes(exchange_name.c_str());
   declare.type = amqp_cstring_bytes(exchange_type.c_str());
@@ -231,12 +315,17 @@ void Channel::DeclareExchange(const std::string &exchange_name,
   amqp_frame_t frame =
       m_impl->DoRpc(AMQP_EXCHANGE_DECLARE_METHOD, &declare, DECLARE_OK);
   m_impl->MaybeReleaseBuffersOnChannel(frame.channel);
+
+  if (!cached.Declarations().empty()) {
+    m_impl->RecordDeclaration(cached.Declarations().front());
+  }
 }
 
 void Channel::DeleteExchange(const std::string &exchange_name, bool if_unused) {
   const boost::array<boost::uint32_t, 1> DELETE_OK = {
       {AMQP_EXCHANGE_DELETE_OK_METHOD}};
   m_impl->CheckIsConnected();
+  m_impl->ForgetExchange(exchange_name);
 
   amqp_exchange_delete_t del = {};
   del.exchange = amqp_cstring_bytes(exchange_name.c_str());
@@ -251,17 +340,25 @@ void Channel::DeleteExchange(const std::string &exchange_name, bool if_unused) {
 void Channel::BindExchange(const std::string &destination,
                            const std::string &source,
                            const std::string &routing_key) {
-  BindExchange(destination, source, routing_key, Table());
+  BindExchange(destination, source, routing_key, PreparedTable());
 }
 
 void Channel::BindExchange(const std::string &destination,
                            const std::string &source,
                            const std::string &routing_key,
-                           const Table &arguments) {
+                           const PreparedTable &arguments) {
   const boost::array<boost::uint32_t, 1> BIND_OK = {
       {AMQP_EXCHANGE_BIND_OK_METHOD}};
   m_impl->CheckIsConnected();
 
+  Topology cached;
+  if (m_impl->IsTrackingDeclarations()) {
+    cached.BindExchange(destination, source, routing_key, arguments);
+    if (m_impl->IsDeclarationCached(cached.Declarations().front())) {
+      return;
+    }
+  }
+
   amqp_exchange_bind_t bind = {};
   bind.destination = amqp_cstring_bytes(destination.c_str());
   bind.source = amqp_cstring_bytes(source.c_str());
@@ -274,21 +371,30 @@ void Channel::BindExchange(const std::string &destination,
 
   amqp_frame_t frame = m_impl->DoRpc(AMQP_EXCHANGE_BIND_METHOD, &bind, BIND_OK);
   m_impl->MaybeReleaseBuffersOnChannel(frame.channel);
+
+  if (!cached.Declarations().empty()) {
+    m_impl->RecordDeclaration(cached.Declarations().front());
+  }
 }
 
 void Channel::UnbindExchange(const std::string &destination,
                              const std::string &source,
                              const std::string &routing_key) {
-  UnbindExchange(destination, source, routing_key, Table());
+  UnbindExchange(destination, source, routing_key, PreparedTable());
 }
 
 void Channel::UnbindExchange(const std::string &destination,
                              const std::string &source,
                              const std::string &routing_key,
-                             const Table &arguments) {
+                             const PreparedTable &arguments) {
   const boost::array<boost::uint32_t, 1> UNBIND_OK = {
       {AMQP_EXCHANGE_UNBIND_OK_METHOD}};
   m_impl->CheckIsConnected();
+  if (m_impl->IsTrackingDeclarations()) {
+    Topology binding;
+    binding.BindExchange(destination, source, routing_key, arguments);
+    m_impl->ForgetDeclaration(binding.Declarations().front());
+  }
 
   amqp_exchange_unbind_t unbind = {};
   unbind.destination = amqp_cstring_bytes(destination.c_str());
@@ -309,12 +415,22 @@ std::string Channel::DeclareQueue(const std::string &queue_name, bool passive,
                                   bool durable, bool exclusive,
                                   bool auto_delete) {
   return DeclareQueue(queue_name, passive, durable, exclusive, auto_delete,
-                      Table());
+                      PreparedTable());
 }
 
 std::string Channel::DeclareQueue(const std::string &queue_name, bool passive,
                                   bool durable, bool exclusive,
-                                  bool auto_delete, const Table &arguments) {
+                                  bool auto_delete,
+                                  const PreparedTable &arguments) {
+  if (m_impl->IsTopologyCacheEnabled()) {
+    Topology cached;
+    cached.DeclareQueue(queue_name, passive, durable, exclusive, auto_delete,
+                        arguments);
+    if (m_impl->IsDeclarationCached(cached.Declarations().front())) {
+      return queue_name;
+    }
+  }
+
   boost::uint32_t message_count;
   boost::uint32_t consumer_count;
   return DeclareQueueWithCounts(queue_name, message_count, consumer_count,
@@ -329,7 +445,7 @@ std::string Channel::DeclareQueueWithCounts(const std::string &queue_name,
                                             bool exclusive, bool auto_delete) {
   return DeclareQueueWithCounts(queue_name, message_count, consumer_count,
                                 passive, durable, exclusive, auto_delete,
-                                Table());
+                                PreparedTable());
 }
 
 std::string Channel::DeclareQueueWithCounts(const std::string &queue_name,
@@ -337,7 +453,7 @@ std::string Channel::DeclareQueueWithCounts(const std::string &queue_name,
                                             boost::uint32_t &consumer_count,
                                             bool passive, bool durable,
                                             bool exclusive, bool auto_delete,
-                                            const Table &arguments) {
+                                            const PreparedTable &arguments) {
   const boost::array<boost::uint32_t, 1> DECLARE_OK = {
       {AMQP_QUEUE_DECLARE_OK_METHOD}};
   m_impl->CheckIsConnected();
@@ -366,6 +482,15 @@ std::string Channel::DeclareQueueWithCounts(const std::string &queue_name,
   consumer_count = declare_ok->consumer_count;
 
   m_impl->MaybeReleaseBuffersOnChannel(response.channel);
+
+  // The counts are always asked of the broker, but a later DeclareQueue
+  // needn't be
+  if (m_impl->IsTrackingDeclarations()) {
+    Topology cached;
+    cached.DeclareQueue(queue_name, passive, durable, exclusive, auto_delete,
+                        arguments);
+    m_impl->RecordDeclaration(cached.Declarations().front(), ret);
+  }
   return ret;
 }
 
@@ -374,6 +499,7 @@ void Channel::DeleteQueue(const std::string &queue_name, bool if_unused,
   const boost::array<boost::uint32_t, 1> DELETE_OK = {
       {AMQP_QUEUE_DELETE_OK_METHOD}};
   m_impl->CheckIsConnected();
+  m_impl->ForgetQueue(queue_name);
 
   amqp_queue_delete_t del = {};
   del.queue = amqp_cstring_bytes(queue_name.c_str());
@@ -388,17 +514,25 @@ void Channel::DeleteQueue(const std::string &queue_name, bool if_unused,
 void Channel::BindQueue(const std::string &queue_name,
                         const std::string &exchange_name,
                         const std::string &routing_key) {
-  BindQueue(queue_name, exchange_name, routing_key, Table());
+  BindQueue(queue_name, exchange_name, routing_key, PreparedTable());
 }
 
 void Channel::BindQueue(const std::string &queue_name,
                         const std::string &exchange_name,
                         const std::string &routing_key,
-                        const Table &arguments) {
+                        const PreparedTable &arguments) {
   const boost::array<boost::uint32_t, 1> BIND_OK = {
       {AMQP_QUEUE_BIND_OK_METHOD}};
   m_impl->CheckIsConnected();
 
+  Topology cached;
+  if (m_impl->IsTrackingDeclarations()) {
+    cached.BindQueue(queue_name, exchange_name, routing_key, arguments);
+    if (m_impl->IsDeclarationCached(cached.Declarations().front())) {
+      return;
+    }
+  }
+
   amqp_queue_bind_t bind = {};
   bind.queue = amqp_cstring_bytes(queue_name.c_str());
   bind.exchange = amqp_cstring_bytes(exchange_name.c_str());
@@ -411,21 +545,30 @@ void Channel::BindQueue(const std::string &queue_name,
 
   amqp_frame_t frame = m_impl->DoRpc(AMQP_QUEUE_BIND_METHOD, &bind, BIND_OK);
   m_impl->MaybeReleaseBuffersOnChannel(frame.channel);
+
+  if (!cached.Declarations().empty()) {
+    m_impl->RecordDeclaration(cached.Declarations().front());
+  }
 }
 
 void Channel::UnbindQueue(const std::string &queue_name,
                           const std::string &exchange_name,
                           const std::string &routing_key) {
-  UnbindQueue(queue_name, exchange_name, routing_key, Table());
+  UnbindQueue(queue_name, exchange_name, routing_key, PreparedTable());
 }
 
 void Channel::UnbindQueue(const std::string &queue_name,
                           const std::string &exchange_name,
                           const std::string &routing_key,
-                          const Table &arguments) {
+                          const PreparedTable &arguments) {
   const boost::array<boost::uint32_t, 1> UNBIND_OK = {
       {AMQP_QUEUE_UNBIND_OK_METHOD}};
   m_impl->CheckIsConnected();
+  if (m_impl->IsTrackingDeclarations()) {
+    Topology binding;
+    binding.BindQueue(queue_name, exchange_name, routing_key, arguments);
+    m_impl->ForgetDeclaration(binding.Declarations().front());
+  }
 
   amqp_queue_unbind_t unbind = {};
   unbind.queue = amqp_cstring_bytes(queue_name.c_str());
@@ -454,11 +597,106 @@ void Channel::PurgeQueue(const std::string &queue_name) {
   m_impl->MaybeReleaseBuffersOnChannel(frame.channel);
 }
 
+std::vector<std::string> Channel::DeclareTopology(const Topology &topology,
+                                                  bool nowait) {
+  // Replies are read once this many methods are waiting for one, so that
+  // neither end stalls on a full socket buffer while the other is writing
+  static const std::size_t MAX_OUTSTANDING = 128;
+  m_impl->CheckIsConnected();
+
+  const Topology::declaration_list_t &declarations = topology.Declarations();
+  std::vector<std::string> queue_names;
+  if (declarations.empty()) {
+    return queue_names;
+  }
+
+  if (nowait) {
+    for (Topology::declaration_list_t::const_iterator it =
+             declarations.begin();
+         it != declarations.end(); ++it) {
+      if (Topology::dk_queue == it->kind && it->name.empty()) {
+        throw std::logic_error(
+            "Channel::DeclareTopology: queues named by the broker can't be "
+            "declared with nowait");
+      }
+    }
+
+    // A fire-and-forget channel, should the broker close it because of a
+    // failed declaration that is dealt with by ChannelImpl::AddToFrameQueue
+    amqp_channel_t channel = m_impl->GetChannel(false);
+    for (Topology::declaration_list_t::const_iterator it =
+             declarations.begin();
+         it != declarations.end(); ++it) {
+      m_impl->SendDeclaration(channel, *it, true);
+      m_impl->RecordForRecovery(*it);
+    }
+    m_impl->ReturnChannel(channel);
+    return queue_names;
+  }
+
+  queue_names.reserve(topology.QueueCount());
+  amqp_channel_t channel = m_impl->GetChannel();
+  const boost::array<amqp_channel_t, 1> channels = {{channel}};
+  std::deque<amqp_method_number_t> expected;
+
+  Topology::declaration_list_t::const_iterator next = declarations.begin();
+  // The declaration that the next reply is for
+  Topology::declaration_list_t::const_iterator replied = declarations.begin();
+  while (declarations.end() != next || !expected.empty()) {
+    if (declarations.end() != next && expected.size() < MAX_OUTSTANDING) {
+      expected.push_back(m_impl->SendDeclaration(channel, *next, false));
+      ++next;
+      continue;
+    }
+
+    const boost::array<amqp_method_number_t, 1> reply = {{expected.front()}};
+    amqp_frame_t response;
+    m_impl->GetMethodOnChannel(channels, response, reply);
+    expected.pop_front();
+
+    std::string declared_name;
+    if (AMQP_QUEUE_DECLARE_OK_METHOD == response.payload.method.id) {
+      amqp_queue_declare_ok_t *declare_ok =
+          (amqp_queue_declare_ok_t *)response.payload.method.decoded;
+      declared_name.assign((char *)declare_ok->queue.bytes,
+                           declare_ok->queue.len);
+      queue_names.push_back(declared_name);
+    }
+    m_impl->MaybeReleaseBuffersOnChannel(channel);
+    m_impl->RecordDeclaration(*replied, declared_name);
+    ++replied;
+  }
+
+  m_impl->ReturnChannel(channel);
+  return queue_names;
+}
+
+namespace {
+// Sends the basic.qos of Channel::SetAdaptivePrefetch when one is due for
+// the consumer on the channel a message was just acked or rejected on
+void TunePrefetch(Channel &channel, Detail::ChannelImpl &impl,
+                  amqp_channel_t delivery_channel) {
+  std::string consumer_tag;
+  boost::uint16_t prefetch_count;
+  if (impl.TunePrefetch(delivery_channel, consumer_tag, prefetch_count)) {
+    channel.BasicQos(consumer_tag, prefetch_count);
+  }
+}
+}  // namespace
+
 void Channel::BasicAck(const Envelope::ptr_t &message) {
   BasicAck(message->GetDeliveryInfo());
 }
 
 void Channel::BasicAck(const Envelope::DeliveryInfo &info) {
+  BasicAck(info, false);
+}
+
+void Channel::BasicAck(const Envelope::ptr_t &message, bool multiple) {
+  BasicAck(message->GetDeliveryInfo(), multiple);
+}
+
+void Channel::BasicAck(const Envelope::DeliveryInfo &info, bool multiple) {
   m_impl->CheckIsConnected();
   // Delivery tag is local to the channel, so its important to use
   // that channel, sadly this can cause the channel to throw an exception
@@ -470,8 +708,24 @@ void Channel::BasicAck(const Envelope::DeliveryInfo &info) {
         "The channel that the message was delivered on has been closed");
   }
 
-  m_impl->CheckForError(
-      amqp_basic_ack(m_impl->m_connection, channel, info.delivery_tag, false));
+  m_impl->Ack(channel, info.delivery_tag, multiple);
+  TunePrefetch(*this, *m_impl, channel);
+}
+
+void Channel::SetAckCoalescing(const std::string &consumer_tag,
+                               std::size_t ack_every, int max_delay) {
+  m_impl->CheckIsConnected();
+  amqp_channel_t channel = m_impl->GetConsumerChannel(consumer_tag);
+
+  boost::chrono::microseconds delay =
+      (max_delay >= 0 ? boost::chrono::milliseconds(max_delay)
+                      : boost::chrono::microseconds::max());
+  m_impl->SetAckCoalescing(channel, ack_every, delay);
+}
+
+void Channel::FlushAcks() {
+  m_impl->CheckIsConnected();
+  m_impl->FlushAllAcks();
 }
 
 void Channel::BasicReject(const Envelope::ptr_t &message, bool requeue,
@@ -491,27 +745,26 @@ void Channel::BasicReject(const Envelope::DeliveryInfo &info, bool requeue,
     throw std::runtime_error(
         "The channel that the message was delivered on has been closed");
   }
-  amqp_basic_nack_t req;
-  req.delivery_tag = info.delivery_tag;
-  req.multiple = multiple;
-  req.requeue = requeue;
-
-  m_impl->CheckForError(amqp_send_method(m_impl->m_connection, channel,
-                                         AMQP_BASIC_NACK_METHOD, &req));
+  m_impl->Reject(channel, info.delivery_tag, requeue, multiple);
+  TunePrefetch(*this, *m_impl, channel);
 }
 
-void Channel::BasicPublish(const std::string &exchange_name,
-                           const std::string &routing_key,
-                           const BasicMessage::ptr_t message, bool mandatory,
-                           bool immediate) {
-  m_impl->CheckIsConnected();
-  amqp_channel_t channel = m_impl->GetChannel();
-
-  m_impl->CheckForError(amqp_basic_publish(
-      m_impl->m_connection, channel, amqp_cstring_bytes(exchange_name.c_str()),
-      amqp_cstring_bytes(routing_key.c_str()), mandatory, immediate,
-      message->getAmqpProperties(), message->getAmqpBody()));
+namespace {
+// For the messages published by BasicPublish and BasicPublishStreaming,
+// which aren't tracked with the ones from BasicPublishAsync
+void CountPublishConfirmed(
+    Detail::ChannelImpl &impl,
+    boost::chrono::steady_clock::time_point published_at) {
+  if (impl.m_metrics) {
+    impl.m_metrics->PublishConfirmed(
+        boost::chrono::duration_cast<boost::chrono::microseconds>(
+            boost::chrono::steady_clock::now() - published_at));
+  }
+}
 
+// Waits for the broker to confirm a message published on a confirm channel,
+// then hands the channel back
+void WaitForPublishAck(Detail::ChannelImpl &impl, amqp_channel_t channel) {
   // If we've done things correctly we can get one of 4 things back from the
   // broker
   // - basic.ack - our channel is in confirm mode, messsage was 'dealt with' by
@@ -525,26 +778,249 @@ void Channel::BasicPublish(const std::string &exchange_name,
       {AMQP_BASIC_ACK_METHOD, AMQP_BASIC_RETURN_METHOD}};
   amqp_frame_t response;
   boost::array<amqp_channel_t, 1> channels = {{channel}};
-  m_impl->GetMethodOnChannel(channels, response, PUBLISH_ACK);
+  impl.GetMethodOnChannel(channels, response, PUBLISH_ACK);
 
   if (AMQP_BASIC_RETURN_METHOD == response.payload.method.id) {
     MessageReturnedException message_returned =
-        m_impl->CreateMessageReturnedException(
+        impl.CreateMessageReturnedException(
             *(reinterpret_cast<amqp_basic_return_t *>(
                 response.payload.method.decoded)),
             channel);
 
     const boost::array<boost::uint32_t, 1> BASIC_ACK = {
         {AMQP_BASIC_ACK_METHOD}};
-    m_impl->GetMethodOnChannel(channels, response, BASIC_ACK);
-    m_impl->ReturnChannel(channel);
-    m_impl->MaybeReleaseBuffersOnChannel(channel);
+    impl.GetMethodOnChannel(channels, response, BASIC_ACK);
+    impl.ReturnChannel(channel);
+    impl.MaybeReleaseBuffersOnChannel(channel);
     throw message_returned;
   }
 
-  m_impl->ReturnChannel(channel);
-  m_impl->MaybeReleaseBuffersOnChannel(channel);
+  impl.ReturnChannel(channel);
+  impl.MaybeReleaseBuffersOnChannel(channel);
 }
+}  // namespace
+
+void Channel::BasicPublish(const std::string &exchange_name,
+                           const std::string &routing_key,
+                           const BasicMessage::ptr_t message, bool mandatory,
+                           bool immediate) {
+  BasicPublish(exchange_name, routing_key, message, mandatory, immediate, true);
+}
+
+void Channel::BasicPublish(const std::string &exchange_name,
+                           const std::string &routing_key,
+                           const BasicMessage::ptr_t message, bool mandatory,
+                           bool immediate, bool confirm) {
+  if (!confirm && (mandatory || immediate)) {
+    throw std::logic_error(
+        "Channel::BasicPublish: mandatory and immediate require confirm");
+  }
+  m_impl->CheckIsConnected();
+
+  if (!confirm) {
+    // Pick up anything the broker has sent, this is where a fire-and-forget
+    // channel closed by the broker gets noticed
+    m_impl->ReadBeforePublish();
+  }
+  amqp_channel_t channel = m_impl->GetChannel(confirm);
+
+  boost::chrono::steady_clock::time_point published_at;
+  if (m_impl->m_metrics) {
+    published_at = boost::chrono::steady_clock::now();
+  }
+  m_impl->PublishMessage(channel, exchange_name, routing_key, mandatory,
+                         immediate, *message);
+
+  if (!confirm) {
+    m_impl->ReturnChannel(channel);
+    return;
+  }
+
+  WaitForPublishAck(*m_impl, channel);
+  CountPublishConfirmed(*m_impl, published_at);
+}
+
+void Channel::BasicPublishStreaming(const std::string &exchange_name,
+                                    const std::string &routing_key,
+                                    const BasicMessage::ptr_t message,
+                                    boost::uint64_t body_size,
+                                    const body_source_t &source,
+                                    bool mandatory) {
+  m_impl->CheckIsConnected();
+  amqp_channel_t channel = m_impl->GetChannel();
+
+  boost::chrono::steady_clock::time_point published_at;
+  if (m_impl->m_metrics) {
+    published_at = boost::chrono::steady_clock::now();
+  }
+  m_impl->PublishStreaming(channel, exchange_name, routing_key, mandatory,
+                           message->getAmqpProperties(), body_size, source);
+  WaitForPublishAck(*m_impl, channel);
+  CountPublishConfirmed(*m_impl, published_at);
+}
+
+boost::uint64_t Channel::BasicPublishAsync(const std::string &exchange_name,
+                                           const std::string &routing_key,
+                                           const BasicMessage::ptr_t message,
+                                           bool mandatory, bool immediate) {
+  return BasicPublishAsync(exchange_name, routing_key, message, mandatory,
+                           immediate, confirm_callback_t());
+}
+
+boost::uint64_t Channel::BasicPublishAsync(const std::string &exchange_name,
+                                           const std::string &routing_key,
+                                           const BasicMessage::ptr_t message,
+                                           bool mandatory, bool immediate,
+                                           const confirm_callback_t &callback) {
+  m_impl->CheckIsConnected();
+  amqp_channel_t channel = m_impl->GetConfirmChannel();
+  if (!m_impl->WaitForPublishRoom()) {
+    return m_impl->DropPublish(callback);
+  }
+
+  m_impl->PublishMessage(channel, exchange_name, routing_key, mandatory,
+                         immediate, *message);
+
+  boost::uint64_t sequence = m_impl->AddPendingConfirm(
+      callback, exchange_name, routing_key, message, mandatory, immediate);
+
+  // Opportunistically handle any confirms that have already arrived so the
+  // pending window doesn't grow without bound between calls to
+  // WaitForConfirms
+  m_impl->ProcessBufferedConfirms();
+  return sequence;
+}
+
+bool Channel::WaitForConfirms(int timeout) {
+  m_impl->CheckIsConnected();
+
+  boost::chrono::microseconds real_timeout =
+      (timeout >= 0 ? boost::chrono::milliseconds(timeout)
+                    : boost::chrono::microseconds::max());
+
+  return m_impl->WaitForConfirms(std::numeric_limits<boost::uint64_t>::max(),
+                                 real_timeout);
+}
+
+void Channel::SetPublishBackPressure(std::size_t max_unconfirmed,
+                                    back_pressure_t policy) {
+  m_impl->SetPublishBackPressure(true, max_unconfirmed, policy);
+}
+
+void Channel::ClearPublishBackPressure() {
+  m_impl->SetPublishBackPressure(false, 0, bp_block);
+}
+
+bool Channel::IsConnectionBlocked() {
+  m_impl->CheckIsConnected();
+  m_impl->ReadAvailableFrames();
+  return m_impl->IsBlocked();
+}
+
+void Channel::SetBlockedCallback(const blocked_callback_t &callback) {
+  m_impl->SetBlockedCallback(callback);
+}
+
+namespace {
+// Collects the outcome of each message in a BasicPublishBatch call. It is
+// shared with the confirm callbacks so it outlives the call if the batch is
+// interrupted.
+struct batch_confirm_state {
+  batch_confirm_state(const Detail::ChannelImpl &impl)
+      : impl(impl), nacked(0), dropped(0) {}
+
+  void record(boost::uint64_t, Channel::publish_confirm_t status) {
+    if (Channel::pc_returned == status && !returned) {
+      returned = impl.GetReturnedMessage();
+    } else if (Channel::pc_nack == status) {
+      ++nacked;
+    } else if (Channel::pc_dropped == status) {
+      ++dropped;
+    }
+  }
+
+  const Detail::ChannelImpl &impl;
+  boost::shared_ptr<MessageReturnedException> returned;
+  std::size_t nacked;
+  std::size_t dropped;
+};
+}  // namespace
+
+void Channel::BasicPublishBatch(
+    const std::string &exchange_name, const std::string &routing_key,
+    const std::vector<BasicMessage::ptr_t> &messages, bool mandatory,
+    bool immediate) {
+  m_impl->CheckIsConnected();
+  if (messages.empty()) {
+    return;
+  }
+  amqp_channel_t channel = m_impl->GetConfirmChannel();
+
+  boost::shared_ptr<batch_confirm_state> state =
+      boost::make_shared<batch_confirm_state>(*m_impl);
+  confirm_callback_t callback =
+      boost::bind(&batch_confirm_state::record, state, _1, _2);
+
+  boost::uint64_t last_sequence = 0;
+  try {
+    for (std::vector<BasicMessage::ptr_t>::const_iterator it =
+             messages.begin();
+         it != messages.end(); ++it) {
+      // Uncorks the socket if it has to wait
+      if (!m_impl->WaitForPublishRoom()) {
+        m_impl->DropPublish(callback);
+        continue;
+      }
+      m_impl->SetSocketCork(true);
+      m_impl->PublishMessage(channel, exchange_name, routing_key, mandatory,
+                             immediate, **it);
+      last_sequence = m_impl->AddPendingConfirm(callback);
+    }
+  } catch (...) {
+    m_impl->SetSocketCork(false);
+    throw;
+  }
+  m_impl->SetSocketCork(false);
+
+  m_impl->WaitForConfirms(last_sequence, boost::chrono::microseconds::max());
+
+  if (state->returned) {
+    throw *state->returned;
+  }
+  if (0 != state->nacked) {
+    throw std::runtime_error(
+        "Channel::BasicPublishBatch: " +
+        boost::lexical_cast<std::string>(state->nacked) +
+        " message(s) were nacked by the broker");
+  }
+  if (0 != state->dropped) {
+    throw BackPressureException(
+        boost::lexical_cast<std::string>(state->dropped) + " of " +
+        boost::lexical_cast<std::string>(messages.size()) +
+        " messages in the batch were dropped");
+  }
+}
+
+namespace {
+// Reads the message a basic.get-ok is followed by
+Envelope::ptr_t ReadGetOk(Detail::ChannelImpl &impl, amqp_channel_t channel,
+                          const amqp_frame_t &response) {
+  amqp_basic_get_ok_t *get_ok =
+      (amqp_basic_get_ok_t *)response.payload.method.decoded;
+  boost::uint64_t delivery_tag = get_ok->delivery_tag;
+  bool redelivered = (get_ok->redelivered == 0 ? false : true);
+  std::string exchange((char *)get_ok->exchange.bytes, get_ok->exchange.len);
+  std::string routing_key((char *)get_ok->routing_key.bytes,
+                          get_ok->routing_key.len);
+
+  BasicMessage::ptr_t message = impl.ReadContent(channel);
+  return impl.CreateEnvelope(message, "", delivery_tag, exchange, redelivered,
+                             routing_key, channel);
+}
+
+// How many basic.get BasicGetBatch has waiting for an answer at most
+const std::size_t MAX_PIPELINED_GETS = 64;
+}  // namespace
 
 bool Channel::BasicGet(Envelope::ptr_t &envelope, const std::string &queue,
                        bool no_ack) {
@@ -566,23 +1042,83 @@ bool Channel::BasicGet(Envelope::ptr_t &envelope, const std::string &queue,
     return false;
   }
 
-  amqp_basic_get_ok_t *get_ok =
-      (amqp_basic_get_ok_t *)response.payload.method.decoded;
-  boost::uint64_t delivery_tag = get_ok->delivery_tag;
-  bool redelivered = (get_ok->redelivered == 0 ? false : true);
-  std::string exchange((char *)get_ok->exchange.bytes, get_ok->exchange.len);
-  std::string routing_key((char *)get_ok->routing_key.bytes,
-                          get_ok->routing_key.len);
-
-  BasicMessage::ptr_t message = m_impl->ReadContent(channel);
-  envelope = Envelope::Create(message, "", delivery_tag, exchange, redelivered,
-                              routing_key, channel);
+  envelope = ReadGetOk(*m_impl, channel, response);
 
   m_impl->ReturnChannel(channel);
   m_impl->MaybeReleaseBuffersOnChannel(channel);
   return true;
 }
 
+std::vector<Envelope::ptr_t> Channel::BasicGetBatch(const std::string &queue,
+                                                    std::size_t max_count,
+                                                    bool no_ack) {
+  const boost::array<boost::uint32_t, 2> GET_RESPONSES = {
+      {AMQP_BASIC_GET_OK_METHOD, AMQP_BASIC_GET_EMPTY_METHOD}};
+  m_impl->CheckIsConnected();
+
+  std::vector<Envelope::ptr_t> envelopes;
+  if (0 == max_count) {
+    return envelopes;
+  }
+
+  amqp_basic_get_t get = {};
+  get.queue = amqp_cstring_bytes(queue.c_str());
+  get.no_ack = no_ack;
+
+  amqp_channel_t channel = m_impl->GetChannel();
+  const boost::array<amqp_channel_t, 1> channels = {{channel}};
+  // The broker answers the requests on a channel in the order they were sent
+  std::deque<boost::chrono::steady_clock::time_point> sent_at;
+  std::size_t sent = 0;
+  std::size_t waiting = 0;
+  bool empty = false;
+  while (true) {
+    // Topped up once half have been answered, so they go out several to a
+    // packet
+    if (!empty && sent < max_count && waiting <= MAX_PIPELINED_GETS / 2) {
+      m_impl->SetSocketCork(true);
+      try {
+        for (; sent < max_count && waiting < MAX_PIPELINED_GETS;
+             ++sent, ++waiting) {
+          m_impl->CheckForError(
+              m_impl->SendMethod(channel, AMQP_BASIC_GET_METHOD, &get));
+          if (m_impl->m_metrics) {
+            sent_at.push_back(boost::chrono::steady_clock::now());
+          }
+        }
+      } catch (...) {
+        m_impl->SetSocketCork(false);
+        throw;
+      }
+      m_impl->SetSocketCork(false);
+    }
+    if (0 == waiting) {
+      break;
+    }
+
+    amqp_frame_t response;
+    m_impl->GetMethodOnChannel(channels, response, GET_RESPONSES);
+    --waiting;
+    if (m_impl->m_metrics) {
+      m_impl->m_metrics->RpcCompleted(
+          AMQP_BASIC_GET_METHOD,
+          boost::chrono::duration_cast<boost::chrono::microseconds>(
+              boost::chrono::steady_clock::now() - sent_at.front()));
+      sent_at.pop_front();
+    }
+
+    if (AMQP_BASIC_GET_EMPTY_METHOD == response.payload.method.id) {
+      empty = true;
+    } else {
+      envelopes.push_back(ReadGetOk(*m_impl, channel, response));
+    }
+    m_impl->MaybeReleaseBuffersOnChannel(channel);
+  }
+
+  m_impl->ReturnChannel(channel);
+  return envelopes;
+}
+
 void Channel::BasicRecover(const std::string &consumer) {
   const boost::array<boost::uint32_t, 1> RECOVER_OK = {
       {AMQP_BASIC_RECOVER_OK_METHOD}};
@@ -603,55 +1139,24 @@ std::string Channel::BasicConsume(const std::string &queue,
                                   bool no_local, bool no_ack, bool exclusive,
                                   boost::uint16_t message_prefetch_count) {
   return BasicConsume(queue, consumer_tag, no_local, no_ack, exclusive,
-                      message_prefetch_count, Table());
+                      message_prefetch_count, PreparedTable());
 }
 std::string Channel::BasicConsume(const std::string &queue,
                                   const std::string &consumer_tag,
                                   bool no_local, bool no_ack, bool exclusive,
                                   boost::uint16_t message_prefetch_count,
-                                  const Table &arguments) {
+                                  const PreparedTable &arguments) {
   m_impl->CheckIsConnected();
-  amqp_channel_t channel = m_impl->GetChannel();
-
-  // Set this before starting the consume as it may have been set by a previous
-  // consumer
-  const boost::array<boost::uint32_t, 1> QOS_OK = {{AMQP_BASIC_QOS_OK_METHOD}};
-
-  amqp_basic_qos_t qos = {};
-  qos.prefetch_size = 0;
-  qos.prefetch_count = message_prefetch_count;
-  qos.global = m_impl->BrokerHasNewQosBehavior();
-
-  m_impl->DoRpcOnChannel(channel, AMQP_BASIC_QOS_METHOD, &qos, QOS_OK);
-  m_impl->MaybeReleaseBuffersOnChannel(channel);
-
-  const boost::array<boost::uint32_t, 1> CONSUME_OK = {
-      {AMQP_BASIC_CONSUME_OK_METHOD}};
-
-  amqp_basic_consume_t consume = {};
-  consume.queue = amqp_cstring_bytes(queue.c_str());
-  consume.consumer_tag = amqp_cstring_bytes(consumer_tag.c_str());
-  consume.no_local = no_local;
-  consume.no_ack = no_ack;
-  consume.exclusive = exclusive;
-  consume.nowait = false;
-
-  Detail::amqp_pool_ptr_t table_pool;
-  consume.arguments =
-      Detail::TableValueImpl::CreateAmqpTable(arguments, table_pool);
-
-  amqp_frame_t response = m_impl->DoRpcOnChannel(
-      channel, AMQP_BASIC_CONSUME_METHOD, &consume, CONSUME_OK);
-
-  amqp_basic_consume_ok_t *consume_ok =
-      (amqp_basic_consume_ok_t *)response.payload.method.decoded;
-  std::string tag((char *)consume_ok->consumer_tag.bytes,
-                  consume_ok->consumer_tag.len);
-  m_impl->MaybeReleaseBuffersOnChannel(channel);
-
-  m_impl->AddConsumer(tag, channel);
 
-  return tag;
+  Detail::ChannelImpl::consume_params_t params;
+  params.queue = queue;
+  params.no_local = no_local;
+  params.no_ack = no_ack;
+  params.exclusive = exclusive;
+  params.prefetch_count = message_prefetch_count;
+  params.arguments = arguments;
+  params.no_confirm = false;
+  return m_impl->StartConsumer(consumer_tag, params, m_handle);
 }
 
 void Channel::BasicQos(const std::string &consumer_tag,
@@ -666,8 +1171,36 @@ void Channel::BasicQos(const std::string &consumer_tag,
   qos.prefetch_count = message_prefetch_count;
   qos.global = m_impl->BrokerHasNewQosBehavior();
 
+  const boost::chrono::steady_clock::time_point sent =
+      boost::chrono::steady_clock::now();
   m_impl->DoRpcOnChannel(channel, AMQP_BASIC_QOS_METHOD, &qos, QOS_OK);
+  m_impl->RecordQos(channel, message_prefetch_count,
+                    boost::chrono::duration_cast<boost::chrono::microseconds>(
+                        boost::chrono::steady_clock::now() - sent));
   m_impl->MaybeReleaseBuffersOnChannel(channel);
+  m_impl->SetConsumerPrefetchCount(consumer_tag, message_prefetch_count);
+}
+
+void Channel::SetAdaptivePrefetch(const std::string &consumer_tag,
+                                  boost::uint16_t max_prefetch_count) {
+  m_impl->CheckIsConnected();
+  amqp_channel_t channel = m_impl->GetConsumerChannel(consumer_tag);
+  m_impl->SetAdaptivePrefetch(channel, max_prefetch_count);
+}
+
+boost::uint16_t Channel::GetPrefetchCount(
+    const std::string &consumer_tag) const {
+  return m_impl->GetConsumerPrefetchCount(consumer_tag);
+}
+
+void Channel::SetConsumerPriority(const std::string &consumer_tag,
+                                  int priority, unsigned int weight) {
+  if (0 == weight) {
+    throw std::invalid_argument("weight must be at least 1");
+  }
+  m_impl->CheckIsConnected();
+  amqp_channel_t channel = m_impl->GetConsumerChannel(consumer_tag);
+  m_impl->SetConsumerPriority(channel, priority, weight);
 }
 
 void Channel::BasicCancel(const std::string &consumer_tag) {
@@ -722,6 +1255,18 @@ bool Channel::BasicConsumeMessage(const std::string &consumer_tag,
   return m_impl->ConsumeMessageOnChannel(channels, message, timeout);
 }
 
+bool Channel::BasicConsumeMessageStreaming(const std::string &consumer_tag,
+                                           Envelope::ptr_t &message,
+                                           const body_sink_t &sink,
+                                           int timeout) {
+  m_impl->CheckIsConnected();
+  amqp_channel_t channel = m_impl->GetConsumerChannel(consumer_tag);
+
+  boost::array<amqp_channel_t, 1> channels = {{channel}};
+
+  return m_impl->ConsumeMessageOnChannel(channels, message, timeout, sink);
+}
+
 bool Channel::BasicConsumeMessage(const std::vector<std::string> &consumer_tags,
                                   Envelope::ptr_t &message, int timeout) {
   m_impl->CheckIsConnected();
@@ -740,13 +1285,143 @@ bool Channel::BasicConsumeMessage(const std::vector<std::string> &consumer_tags,
 bool Channel::BasicConsumeMessage(Envelope::ptr_t &message, int timeout) {
   m_impl->CheckIsConnected();
 
-  std::vector<amqp_channel_t> channels = m_impl->GetAllConsumerChannels();
+  const Detail::ChannelImpl::channel_set_t &channels =
+      m_impl->GetAllConsumerChannels(m_handle);
 
-  if (0 == channels.size()) {
+  if (channels.empty()) {
     throw ConsumerTagNotFoundException();
   }
 
   return m_impl->ConsumeMessageOnChannel(channels, message, timeout);
 }
 
+std::size_t Channel::BasicConsumeMessages(
+    const std::vector<std::string> &consumer_tags,
+    std::vector<Envelope::ptr_t> &envelopes, std::size_t max_count,
+    int timeout) {
+  m_impl->CheckIsConnected();
+
+  std::vector<amqp_channel_t> channels;
+  channels.reserve(consumer_tags.size());
+
+  for (std::vector<std::string>::const_iterator it = consumer_tags.begin();
+       it != consumer_tags.end(); ++it) {
+    channels.push_back(m_impl->GetConsumerChannel(*it));
+  }
+
+  return m_impl->ConsumeMessagesOnChannel(channels, envelopes, max_count,
+                                          timeout);
+}
+
+std::size_t Channel::BasicConsumeAvailable(
+    std::vector<Envelope::ptr_t> &envelopes, std::size_t max_count) {
+  m_impl->CheckIsConnected();
+  m_impl->ReadAvailableFrames();
+  m_impl->ProcessBufferedConfirms();
+
+  const Detail::ChannelImpl::channel_set_t &channels =
+      m_impl->GetAllConsumerChannels(m_handle);
+  std::size_t count =
+      m_impl->TakeDeliveredMessages(channels, envelopes, max_count);
+
+  // Anything else queued whole for a consumer, e.g., a basic.cancel from the
+  // broker, so that nothing here waits on the socket. A basic.cancel is
+  // thrown as soon as it is taken, so channels doesn't change under this
+  // loop.
+  for (Detail::ChannelImpl::channel_set_t::const_iterator it =
+           channels.begin();
+       it != channels.end() && count < max_count; ++it) {
+    boost::array<amqp_channel_t, 1> channel = {{*it}};
+    Envelope::ptr_t envelope;
+    while (count < max_count && m_impl->HasQueuedDeliveryOnChannel(*it) &&
+           m_impl->ConsumeMessageOnChannel(channel, envelope, 0)) {
+      envelopes.push_back(envelope);
+      ++count;
+    }
+  }
+  return count;
+}
+
+void Channel::SetMessagePoolSize(std::size_t max_cached) {
+  if (0 == max_cached) {
+    m_impl->m_message_pool.reset();
+  } else {
+    m_impl->m_message_pool = Detail::MessagePool::Create(max_cached);
+  }
+}
+
+void Channel::SetMetrics(const Metrics::ptr_t &metrics) {
+  m_impl->SetMetrics(metrics);
+}
+
+void Channel::SetFrameTrace(const FrameTrace::ptr_t &trace) {
+  m_impl->m_frame_trace = trace;
+}
+
+void Channel::SetPublishCodec(const Codec::ptr_t &codec,
+                              std::size_t min_body_size) {
+  m_impl->SetPublishCodec(codec, min_body_size);
+}
+
+void Channel::AddCodec(const Codec::ptr_t &codec) {
+  m_impl->m_codecs[codec->Name()] = codec;
+}
+
+void Channel::SetChannelPoolSize(std::size_t min_open) {
+  m_impl->CheckIsConnected();
+  m_impl->SetChannelPoolSize(min_open);
+}
+
+void Channel::SetTopologyCacheEnabled(bool enabled) {
+  m_impl->SetTopologyCacheEnabled(enabled);
+}
+
+void Channel::EnableRecovery(const RecoveryOptions &options) {
+  std::vector<Detail::ChannelImpl::connection_params_t> brokers;
+  brokers.push_back(m_impl->GetConnectionParams());
+  for (std::vector<std::string>::const_iterator it = options.uris.begin();
+       it != options.uris.end(); ++it) {
+    // The frame size, heartbeat, socket options and certificates are the
+    // same for all of them
+    Detail::ChannelImpl::connection_params_t params = brokers.front();
+    Detail::ChannelImpl::ParseUri(*it, params);
+    brokers.push_back(params);
+  }
+  m_impl->EnableRecovery(brokers, options);
+}
+
+void Channel::DisableRecovery() { m_impl->DisableRecovery(); }
+
+void Channel::SetBufferLimits(const BufferLimits &limits) {
+  m_impl->CheckIsConnected();
+  m_impl->SetBufferLimits(limits);
+}
+
+std::size_t Channel::GetBufferedBytes() const {
+  return m_impl->GetBufferedBytes();
+}
+
+std::size_t Channel::GetBufferedMessages() const {
+  return m_impl->GetBufferedMessages();
+}
+
+std::size_t Channel::GetBufferedBytes(const std::string &consumer_tag) const {
+  return m_impl->GetBufferedBytes(m_impl->GetConsumerChannel(consumer_tag));
+}
+
+std::size_t Channel::GetBufferedMessages(
+    const std::string &consumer_tag) const {
+  return m_impl->GetBufferedMessages(m_impl->GetConsumerChannel(consumer_tag));
+}
+
+int Channel::GetFrameMax() const {
+  m_impl->CheckIsConnected();
+  return m_impl->GetFrameMax();
+}
+
+int Channel::GetChannelMax() const {
+  m_impl->CheckIsConnected();
+  return m_impl->GetChannelMax();
+}
+
 }  // namespace AmqpClient
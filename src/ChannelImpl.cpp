@@ -32,40 +32,550 @@
 #define WIN32_LEAN_AND_MEAN
 #endif
 #include <Winsock2.h>
+#include <Ws2tcpip.h>
 #else
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include <amqp_tcp_socket.h>
+#ifdef SAC_SSL_SUPPORT_ENABLED
+#include <amqp_ssl_socket.h>
 #endif
 
 #include "SimpleAmqpClient/AmqpException.h"
 #include "SimpleAmqpClient/AmqpLibraryException.h"
 #include "SimpleAmqpClient/AmqpResponseLibraryException.h"
+#include "SimpleAmqpClient/BackPressureException.h"
+#include "SimpleAmqpClient/BadUriException.h"
 #include "SimpleAmqpClient/ChannelImpl.h"
 #include "SimpleAmqpClient/ConnectionClosedException.h"
 #include "SimpleAmqpClient/ConsumerTagNotFoundException.h"
+#include "SimpleAmqpClient/SslContextImpl.h"
+#include "SimpleAmqpClient/TableImpl.h"
 
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/array.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
 
-#include <string.h>
+#include <new>
+#include <stdexcept>
 
-#define BROKER_HEARTBEAT 0
+#include <stdlib.h>
+#include <string.h>
 
 namespace AmqpClient {
 namespace Detail {
 
-ChannelImpl::ChannelImpl() : m_last_used_channel(0), m_is_connected(false) {
+ChannelImpl::ChannelImpl()
+    : m_connection(NULL),
+      m_next_frame_sequence(0),
+      m_assembling_messages(0),
+      m_consumer_scheduling(false),
+      m_last_handle_id(0),
+      m_channel_pool_size(0),
+      m_topology_cache_enabled(false),
+      m_recovery_enabled(false),
+      m_recovering(false),
+      m_confirm_channel(0),
+      m_next_publish_seq(1),
+      m_next_confirm_tag(1),
+      m_unpolled_publishes(0),
+      m_socket_corked(false),
+      m_publish_back_pressure(false),
+      m_max_unconfirmed(0),
+      m_back_pressure_policy(Channel::bp_block),
+      m_publish_min_body_size(0),
+      m_full_channels(0),
+      m_queued_frames(0),
+      m_queued_envelopes(0),
+      m_is_blocked(false),
+      m_is_connected(false) {
+  const buffered_t none = {0, 0, false};
+  m_buffered_total = none;
+  m_channel_counts.assign(0);
+  // Channel 0 is the connection's
   m_channels.push_back(CS_Used);
+  ++m_channel_counts[CS_Used];
+}
+
+ChannelImpl::~ChannelImpl() {
+  ReportQueueDepth(-static_cast<std::ptrdiff_t>(m_queued_frames),
+                   -static_cast<std::ptrdiff_t>(m_queued_envelopes));
+  // Shared by all of the Channels on the connection, the last one to go away
+  // closes it
+  if (NULL != m_connection) {
+    if (m_is_connected) {
+      amqp_connection_close(m_connection, AMQP_REPLY_SUCCESS);
+    }
+    amqp_destroy_connection(m_connection);
+  }
+}
+
+namespace {
+void CloseSocket(int socket_fd) {
+#ifdef _WIN32
+  closesocket(socket_fd);
+#else
+  close(socket_fd);
+#endif
+}
+
+void SetSocketBlocking(int socket_fd, bool blocking) {
+#ifdef _WIN32
+  u_long non_blocking = blocking ? 0 : 1;
+  ioctlsocket(socket_fd, FIONBIO, &non_blocking);
+#else
+  const int flags = fcntl(socket_fd, F_GETFL, 0);
+  fcntl(socket_fd, F_SETFL,
+        blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK);
+#endif
+}
+
+bool IsConnectInProgress() {
+#ifdef _WIN32
+  return WSAEWOULDBLOCK == WSAGetLastError();
+#else
+  return EINPROGRESS == errno;
+#endif
+}
+
+bool IsInterrupted() {
+#ifdef _WIN32
+  return false;
+#else
+  return EINTR == errno;
+#endif
+}
+
+// Best effort: the system may cap the value or not have the option, and the
+// connection works without it either way
+void SetSocketOption(int socket_fd, int level, int name, int value) {
+  setsockopt(socket_fd, level, name, reinterpret_cast<const char *>(&value),
+             sizeof(value));
+}
+
+void SetBufferSizes(int socket_fd, const Channel::ConnectionOptions &options) {
+  if (0 < options.receive_buffer_size) {
+    SetSocketOption(socket_fd, SOL_SOCKET, SO_RCVBUF,
+                    options.receive_buffer_size);
+  }
+  if (0 < options.send_buffer_size) {
+    SetSocketOption(socket_fd, SOL_SOCKET, SO_SNDBUF,
+                    options.send_buffer_size);
+  }
+}
+
+// The options that can still be set once connected
+void SetConnectedOptions(int socket_fd,
+                         const Channel::ConnectionOptions &options) {
+  SetSocketOption(socket_fd, IPPROTO_TCP, TCP_NODELAY,
+                  options.tcp_nodelay ? 1 : 0);
+  if (!options.keepalive) {
+    return;
+  }
+  SetSocketOption(socket_fd, SOL_SOCKET, SO_KEEPALIVE, 1);
+#if defined(TCP_KEEPIDLE)
+  if (0 < options.keepalive_idle) {
+    SetSocketOption(socket_fd, IPPROTO_TCP, TCP_KEEPIDLE,
+                    options.keepalive_idle);
+  }
+#elif defined(TCP_KEEPALIVE)
+  // What macOS calls TCP_KEEPIDLE
+  if (0 < options.keepalive_idle) {
+    SetSocketOption(socket_fd, IPPROTO_TCP, TCP_KEEPALIVE,
+                    options.keepalive_idle);
+  }
+#endif
+#ifdef TCP_KEEPINTVL
+  if (0 < options.keepalive_interval) {
+    SetSocketOption(socket_fd, IPPROTO_TCP, TCP_KEEPINTVL,
+                    options.keepalive_interval);
+  }
+#endif
+#ifdef TCP_KEEPCNT
+  if (0 < options.keepalive_count) {
+    SetSocketOption(socket_fd, IPPROTO_TCP, TCP_KEEPCNT,
+                    options.keepalive_count);
+  }
+#endif
+}
+
+// Whether the socket has to be set up before it connects, which
+// amqp_socket_open leaves no room for
+bool NeedsOwnSocket(const Channel::ConnectionOptions &options) {
+  return 0 < options.receive_buffer_size || 0 < options.send_buffer_size ||
+         !options.bind_address.empty() || options.connect_in_parallel;
+}
+
+typedef boost::shared_ptr<struct addrinfo> addrinfo_ptr_t;
+
+addrinfo_ptr_t ResolveAddresses(const std::string &host, const char *service,
+                                int flags) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_protocol = IPPROTO_TCP;
+  hints.ai_flags = flags;
+
+  struct addrinfo *addresses = NULL;
+  if (0 != getaddrinfo(host.c_str(), service, &hints, &addresses)) {
+    throw AmqpLibraryException::CreateException(
+        AMQP_STATUS_HOSTNAME_RESOLUTION_FAILED, "Resolving " + host);
+  }
+  return addrinfo_ptr_t(addresses, freeaddrinfo);
+}
+
+// A socket connecting to address without blocking, -1 if that failed
+// straight away
+int StartConnecting(const struct addrinfo *address,
+                    const struct addrinfo *local_addresses,
+                    const Channel::ConnectionOptions &options) {
+  const struct addrinfo *local = NULL;
+  for (; NULL != local_addresses; local_addresses = local_addresses->ai_next) {
+    if (local_addresses->ai_family == address->ai_family) {
+      local = local_addresses;
+      break;
+    }
+  }
+  if (!options.bind_address.empty() && NULL == local) {
+    return -1;
+  }
+
+#ifdef _WIN32
+  // rabbitmq-c keeps the SOCKET in an int
+  const SOCKET native_socket =
+      socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+  if (INVALID_SOCKET == native_socket) {
+    return -1;
+  }
+  const int socket_fd = static_cast<int>(native_socket);
+#else
+  const int socket_fd =
+      socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+  if (-1 == socket_fd) {
+    return -1;
+  }
+#endif
+#ifdef SO_NOSIGPIPE
+  // rabbitmq-c does this for the sockets it opens, elsewhere it passes
+  // MSG_NOSIGNAL to send
+  SetSocketOption(socket_fd, SOL_SOCKET, SO_NOSIGPIPE, 1);
+#endif
+  SetBufferSizes(socket_fd, options);
+  SetSocketBlocking(socket_fd, false);
+  if ((NULL != local &&
+       0 != bind(socket_fd, local->ai_addr, local->ai_addrlen)) ||
+      (0 != connect(socket_fd, address->ai_addr, address->ai_addrlen) &&
+       !IsConnectInProgress())) {
+    CloseSocket(socket_fd);
+    return -1;
+  }
+  return socket_fd;
+}
+
+typedef boost::chrono::steady_clock::time_point deadline_t;
+
+struct timeval ToTimeval(int milliseconds) {
+  struct timeval timeout;
+  timeout.tv_sec = milliseconds / 1000;
+  timeout.tv_usec = (milliseconds % 1000) * 1000;
+  return timeout;
+}
+
+// Milliseconds until deadline, never less than 0, or -1 without a timeout
+int MillisecondsLeft(const deadline_t &deadline, int timeout) {
+  if (0 > timeout) {
+    return -1;
+  }
+  const boost::chrono::milliseconds left =
+      boost::chrono::duration_cast<boost::chrono::milliseconds>(
+          deadline - boost::chrono::steady_clock::now());
+  return static_cast<int>(
+      std::max(boost::chrono::milliseconds::rep(0), left.count()));
+}
+
+// Waits for some of the sockets to finish connecting, one way or the other,
+// flagging those that have in done. Returns the number that have, 0 on
+// timeout or -1 on error.
+int WaitForConnects(const std::vector<int> &connecting, int timeout_ms,
+                    std::vector<bool> &done) {
+  done.assign(connecting.size(), false);
+#ifdef _WIN32
+  // WSAPoll doesn't report failed connects on older Windows. Windows fd_sets
+  // list the sockets rather than being indexed by them, so up to FD_SETSIZE
+  // of any value fit; StartConnecting is held to that.
+  fd_set writable;
+  fd_set failed;
+  FD_ZERO(&writable);
+  FD_ZERO(&failed);
+  for (std::vector<int>::const_iterator it = connecting.begin();
+       it != connecting.end(); ++it) {
+    FD_SET(static_cast<SOCKET>(*it), &writable);
+    FD_SET(static_cast<SOCKET>(*it), &failed);
+  }
+  struct timeval timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_usec = (timeout_ms % 1000) * 1000;
+  // Failed connects are reported as exceptions
+  const int ready =
+      select(0, NULL, &writable, &failed, 0 > timeout_ms ? NULL : &timeout);
+  if (0 < ready) {
+    for (std::size_t i = 0; i < connecting.size(); ++i) {
+      const SOCKET socket_fd = static_cast<SOCKET>(connecting[i]);
+      done[i] = FD_ISSET(socket_fd, &writable) || FD_ISSET(socket_fd, &failed);
+    }
+  }
+  return 0 > ready ? -1 : ready;
+#else
+  std::vector<struct pollfd> fds(connecting.size());
+  for (std::size_t i = 0; i < connecting.size(); ++i) {
+    fds[i].fd = connecting[i];
+    fds[i].events = POLLOUT;
+    fds[i].revents = 0;
+  }
+  const int ready =
+      poll(&fds[0], static_cast<nfds_t>(fds.size()), timeout_ms);
+  if (0 > ready) {
+    // Interrupted, the caller works out how long is left and waits again
+    return EINTR == errno ? 0 : -1;
+  }
+  // Failed connects are reported as writable, or as errors
+  for (std::size_t i = 0; i < fds.size(); ++i) {
+    done[i] = 0 != (fds[i].revents & (POLLOUT | POLLERR | POLLHUP));
+  }
+  return ready;
+#endif
+}
+
+// Connects to one of the addresses host resolves to, one after another or
+// all at once as options asks, taking the first that connects by deadline
+int ConnectSocket(const std::string &host, int port,
+                  const Channel::ConnectionOptions &options,
+                  const deadline_t &deadline) {
+  const addrinfo_ptr_t addresses = ResolveAddresses(
+      host, boost::lexical_cast<std::string>(port).c_str(), 0);
+  addrinfo_ptr_t local_addresses;
+  if (!options.bind_address.empty()) {
+    local_addresses =
+        ResolveAddresses(options.bind_address, NULL, AI_PASSIVE);
+  }
+
+  const struct addrinfo *next = addresses.get();
+  std::vector<int> connecting;
+  std::vector<bool> done;
+  int connected = -1;
+  try {
+    while (-1 == connected) {
+      while (NULL != next &&
+             (connecting.empty() || options.connect_in_parallel)) {
+#ifdef _WIN32
+        if (static_cast<std::size_t>(FD_SETSIZE) <= connecting.size()) {
+          break;
+        }
+#endif
+        const int socket_fd =
+            StartConnecting(next, local_addresses.get(), options);
+        next = next->ai_next;
+        if (-1 != socket_fd) {
+          connecting.push_back(socket_fd);
+        }
+      }
+      if (connecting.empty()) {
+        throw AmqpLibraryException::CreateException(
+            AMQP_STATUS_SOCKET_ERROR, "Connecting to " + host);
+      }
+
+      const int ready = WaitForConnects(
+          connecting, MillisecondsLeft(deadline, options.connect_timeout),
+          done);
+      if (0 > ready) {
+        throw AmqpLibraryException::CreateException(
+            AMQP_STATUS_SOCKET_ERROR, "Connecting to " + host);
+      }
+      if (0 == ready) {
+        if (0 == MillisecondsLeft(deadline, options.connect_timeout)) {
+          throw AmqpLibraryException::CreateException(
+              AMQP_STATUS_TIMEOUT, "Connecting to " + host);
+        }
+        continue;
+      }
+
+      std::vector<bool>::const_iterator is_done = done.begin();
+      for (std::vector<int>::iterator it = connecting.begin();
+           it != connecting.end(); ++is_done) {
+        if (!*is_done) {
+          ++it;
+          continue;
+        }
+        int error = 0;
+        socklen_t error_length = sizeof(error);
+        if (0 == getsockopt(*it, SOL_SOCKET, SO_ERROR,
+                            reinterpret_cast<char *>(&error),
+                            &error_length) &&
+            0 == error && -1 == connected) {
+          connected = *it;
+        } else {
+          CloseSocket(*it);
+        }
+        it = connecting.erase(it);
+      }
+    }
+  } catch (...) {
+    std::for_each(connecting.begin(), connecting.end(), CloseSocket);
+    throw;
+  }
+  // Those that were slower
+  std::for_each(connecting.begin(), connecting.end(), CloseSocket);
+
+#if AMQP_VERSION < 0x00080000
+  // Only from 0.8 on does rabbitmq-c work with non-blocking sockets
+  SetSocketBlocking(connected, true);
+#endif
+  return connected;
+}
+}  // namespace
+
+void ChannelImpl::Connect(const connection_params_t &params) {
+  m_connection = amqp_new_connection();
+  if (NULL == m_connection) {
+    throw std::bad_alloc();
+  }
+
+  try {
+    const Channel::ConnectionOptions &options = params.options;
+    const deadline_t deadline =
+        boost::chrono::steady_clock::now() +
+        boost::chrono::milliseconds(options.connect_timeout);
+    amqp_socket_t *socket = NULL;
+    if (params.secure) {
+#ifdef SAC_SSL_SUPPORT_ENABLED
+      // The SSL socket opens its own connection, and only once it has can
+      // anything be set
+      if (!options.bind_address.empty() || options.connect_in_parallel) {
+        throw std::logic_error(
+            "bind_address and connect_in_parallel are not supported for SSL "
+            "connections");
+      }
+      socket = amqp_ssl_socket_new(m_connection);
+      if (NULL == socket) {
+        throw std::bad_alloc();
+      }
+      if (params.ssl_context) {
+        params.ssl_context->m_impl->Configure(socket, params.host,
+                                               params.port);
+      } else {
+#if AMQP_VERSION >= 0x00080001
+        amqp_ssl_socket_set_verify_peer(socket, params.verify_hostname);
+        amqp_ssl_socket_set_verify_hostname(socket, params.verify_hostname);
+#else
+        amqp_ssl_socket_set_verify(socket, params.verify_hostname);
+#endif
+
+        int status = amqp_ssl_socket_set_cacert(
+            socket, params.path_to_ca_cert.c_str());
+        if (status) {
+          throw AmqpLibraryException::CreateException(
+              status, "Error setting CA certificate for socket");
+        }
+
+        if (params.path_to_client_key != "" &&
+            params.path_to_client_cert != "") {
+          status = amqp_ssl_socket_set_key(socket,
+                                           params.path_to_client_cert.c_str(),
+                                           params.path_to_client_key.c_str());
+          if (status) {
+            throw AmqpLibraryException::CreateException(
+                status, "Error setting client certificate for socket");
+          }
+        }
+      }
+#else
+      throw std::logic_error(
+          "SSL support has not been compiled into SimpleAmqpClient");
+#endif
+    } else {
+      socket = amqp_tcp_socket_new(m_connection);
+    }
+
+    if (!params.secure && NeedsOwnSocket(options)) {
+      amqp_tcp_socket_set_sockfd(
+          socket, ConnectSocket(params.host, params.port, options, deadline));
+    } else if (0 <= options.connect_timeout) {
+      struct timeval timeout = ToTimeval(options.connect_timeout);
+      CheckForError(amqp_socket_open_noblock(socket, params.host.c_str(),
+                                             params.port, &timeout));
+    } else {
+      CheckForError(
+          amqp_socket_open(socket, params.host.c_str(), params.port));
+    }
+    const int socket_fd = amqp_get_sockfd(m_connection);
+    if (params.secure) {
+      SetBufferSizes(socket_fd, options);
+    }
+    SetConnectedOptions(socket_fd, options);
+    if (0 <= options.connect_timeout) {
+      // What is left of it for logging in, rabbitmq-c's own timeout
+      // otherwise. Never negative, which rabbitmq-c could take for no limit,
+      // nor 0: once the deadline has passed there is no point trying.
+      const int left = MillisecondsLeft(deadline, options.connect_timeout);
+      if (0 >= left) {
+        throw AmqpLibraryException::CreateException(
+            AMQP_STATUS_TIMEOUT, "Logging in to " + params.host);
+      }
+#if AMQP_VERSION >= 0x000B0000
+      struct timeval timeout = ToTimeval(left);
+      CheckForError(amqp_set_handshake_timeout(m_connection, &timeout));
+#endif
+    }
+    DoLogin(params.username, params.password, params.vhost, params.frame_max,
+            params.heartbeat);
+  } catch (...) {
+    amqp_destroy_connection(m_connection);
+    m_connection = NULL;
+    throw;
+  }
+
+  m_connection_params = params;
+  SetIsConnected(true);
 }
 
-ChannelImpl::~ChannelImpl() {}
+void ChannelImpl::ParseUri(const std::string &uri,
+                           connection_params_t &params) {
+  amqp_connection_info info;
+  amqp_default_connection_info(&info);
+
+  boost::shared_ptr<char> uri_dup =
+      boost::shared_ptr<char>(strdup(uri.c_str()), free);
+
+  if (0 != amqp_parse_url(uri_dup.get(), &info)) {
+    throw BadUriException();
+  }
+
+  params.host = info.host;
+  params.port = info.port;
+  params.username = info.user;
+  params.password = info.password;
+  params.vhost = info.vhost;
+  params.secure = info.ssl;
+}
 
 void ChannelImpl::DoLogin(const std::string &username,
                           const std::string &password, const std::string &vhost,
-                          int frame_max) {
-  amqp_table_entry_t capabilties[1];
+                          int frame_max, int heartbeat) {
+  amqp_table_entry_t capabilties[2];
   amqp_table_entry_t capability_entry;
   amqp_table_t client_properties;
 
@@ -73,6 +583,11 @@ void ChannelImpl::DoLogin(const std::string &username,
   capabilties[0].value.kind = AMQP_FIELD_KIND_BOOLEAN;
   capabilties[0].value.value.boolean = 1;
 
+  // So that the broker says when it stops reading from the connection
+  capabilties[1].key = amqp_cstring_bytes("connection.blocked");
+  capabilties[1].value.kind = AMQP_FIELD_KIND_BOOLEAN;
+  capabilties[1].value.value.boolean = 1;
+
   capability_entry.key = amqp_cstring_bytes("capabilities");
   capability_entry.value.kind = AMQP_FIELD_KIND_TABLE;
   capability_entry.value.value.table.num_entries =
@@ -84,7 +599,7 @@ void ChannelImpl::DoLogin(const std::string &username,
 
   CheckRpcReply(
       0, amqp_login_with_properties(m_connection, vhost.c_str(), 0, frame_max,
-                                    BROKER_HEARTBEAT, &client_properties,
+                                    heartbeat, &client_properties,
                                     AMQP_SASL_METHOD_PLAIN, username.c_str(),
                                     password.c_str()));
 
@@ -92,26 +607,35 @@ void ChannelImpl::DoLogin(const std::string &username,
 }
 
 amqp_channel_t ChannelImpl::GetNextChannelId() {
-  channel_state_list_t::iterator unused_channel =
-      std::find(m_channels.begin(), m_channels.end(), CS_Closed);
+  amqp_channel_t unused_channel;
+  if (TakeFreeChannel(CS_Closed, unused_channel)) {
+    return unused_channel;
+  }
 
-  if (m_channels.end() == unused_channel) {
-    int max_channels = amqp_get_channel_max(m_connection);
-    if (0 == max_channels) {
-      max_channels = std::numeric_limits<uint16_t>::max();
-    }
-    if (static_cast<size_t>(max_channels) < m_channels.size()) {
+  int max_channels = amqp_get_channel_max(m_connection);
+  if (0 == max_channels) {
+    max_channels = std::numeric_limits<uint16_t>::max();
+  }
+  if (static_cast<size_t>(max_channels) < m_channels.size()) {
+    if (0 == m_channel_counts[CS_Retired]) {
       throw std::runtime_error("Too many channels open");
     }
-
-    m_channels.push_back(CS_Closed);
-    unused_channel = m_channels.end() - 1;
+    // Out of numbers that have never been used on this connection
+    for (std::size_t channel = 1; channel < m_channels.size(); ++channel) {
+      if (CS_Retired == m_channels[channel]) {
+        SetChannelState(channel, CS_Closed);
+      }
+    }
+    TakeFreeChannel(CS_Closed, unused_channel);
+    return unused_channel;
   }
 
-  return unused_channel - m_channels.begin();
+  m_channels.push_back(CS_Closed);
+  ++m_channel_counts[CS_Closed];
+  return m_channels.size() - 1;
 }
 
-amqp_channel_t ChannelImpl::CreateNewChannel() {
+amqp_channel_t ChannelImpl::CreateNewChannel(bool confirm) {
   amqp_channel_t new_channel = GetNextChannelId();
 
   static const boost::array<boost::uint32_t, 1> OPEN_OK = {
@@ -120,57 +644,359 @@ amqp_channel_t ChannelImpl::CreateNewChannel() {
   DoRpcOnChannel<boost::array<boost::uint32_t, 1> >(
       new_channel, AMQP_CHANNEL_OPEN_METHOD, &channel_open, OPEN_OK);
 
+  if (!confirm) {
+    SetChannelState(new_channel, CS_OpenNoConfirm);
+    return new_channel;
+  }
+
   static const boost::array<boost::uint32_t, 1> CONFIRM_OK = {
       {AMQP_CONFIRM_SELECT_OK_METHOD}};
   amqp_confirm_select_t confirm_select = {};
   DoRpcOnChannel<boost::array<boost::uint32_t, 1> >(
       new_channel, AMQP_CONFIRM_SELECT_METHOD, &confirm_select, CONFIRM_OK);
 
-  m_channels.at(new_channel) = CS_Open;
+  SetChannelState(new_channel, CS_Open);
 
   return new_channel;
 }
 
-amqp_channel_t ChannelImpl::GetChannel() {
-  if (CS_Open == m_channels.at(m_last_used_channel)) {
-    m_channels[m_last_used_channel] = CS_Used;
-    return m_last_used_channel;
+void ChannelImpl::SetChannelPoolSize(std::size_t min_open) {
+  m_channel_pool_size = min_open;
+  TopUpChannelPool();
+  WaitForOpeningChannels(false);
+}
+
+void ChannelImpl::TopUpChannelPool() {
+  while (m_channel_counts[CS_Open] + m_channel_counts[CS_Opening] <
+         m_channel_pool_size) {
+    StartOpeningChannel();
   }
+}
 
-  channel_state_list_t::iterator it =
-      std::find(m_channels.begin(), m_channels.end(), CS_Open);
+namespace {
+bool SameDeclaration(const Topology::declaration_t &a,
+                     const Topology::declaration_t &b) {
+  return a.kind == b.kind && a.name == b.name && a.target == b.target &&
+         a.routing_key == b.routing_key && a.passive == b.passive &&
+         a.durable == b.durable && a.exclusive == b.exclusive &&
+         a.auto_delete == b.auto_delete && a.arguments == b.arguments;
+}
+}  // namespace
 
-  if (m_channels.end() == it) {
-    amqp_channel_t new_channel = CreateNewChannel();
-    m_channels.at(new_channel) = CS_Used;
-    return new_channel;
+void ChannelImpl::SetTopologyCacheEnabled(bool enabled) {
+  m_topology_cache_enabled = enabled;
+  if (!enabled) {
+    m_declaration_cache.clear();
+  }
+}
+
+bool ChannelImpl::FindDeclaration(const declaration_cache_t &declarations,
+                                  const Topology::declaration_t &declaration) {
+  std::pair<declaration_cache_t::const_iterator,
+            declaration_cache_t::const_iterator>
+      range = declarations.equal_range(declaration.name);
+  for (declaration_cache_t::const_iterator it = range.first;
+       it != range.second; ++it) {
+    if (SameDeclaration(it->second, declaration)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ChannelImpl::EraseDeclaration(
+    declaration_cache_t &declarations,
+    const Topology::declaration_t &declaration) {
+  std::pair<declaration_cache_t::iterator, declaration_cache_t::iterator>
+      range = declarations.equal_range(declaration.name);
+  for (declaration_cache_t::iterator it = range.first; it != range.second;) {
+    if (SameDeclaration(it->second, declaration)) {
+      declarations.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void ChannelImpl::EraseQueue(declaration_cache_t &declarations,
+                             const std::string &queue_name) {
+  std::pair<declaration_cache_t::iterator, declaration_cache_t::iterator>
+      range = declarations.equal_range(queue_name);
+  for (declaration_cache_t::iterator it = range.first; it != range.second;) {
+    if (Topology::dk_queue == it->second.kind ||
+        Topology::dk_queue_binding == it->second.kind) {
+      declarations.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void ChannelImpl::EraseExchange(declaration_cache_t &declarations,
+                                const std::string &exchange_name) {
+  // Bindings are keyed on the queue or destination exchange, so the ones from
+  // this exchange have to be looked for
+  for (declaration_cache_t::iterator it = declarations.begin();
+       it != declarations.end();) {
+    const Topology::declaration_t &declaration = it->second;
+    const bool is_exchange = Topology::dk_exchange == declaration.kind ||
+                             Topology::dk_exchange_binding == declaration.kind;
+    const bool is_binding = Topology::dk_queue_binding == declaration.kind ||
+                            Topology::dk_exchange_binding == declaration.kind;
+    if ((is_exchange && declaration.name == exchange_name) ||
+        (is_binding && declaration.target == exchange_name)) {
+      declarations.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+bool ChannelImpl::IsDeclarationCached(
+    const Topology::declaration_t &declaration) const {
+  return m_topology_cache_enabled &&
+         FindDeclaration(m_declaration_cache, declaration);
+}
+
+void ChannelImpl::CacheDeclaration(const Topology::declaration_t &declaration) {
+  // A passive declare is asked for to find out whether the exchange or queue
+  // is still there, an auto-delete one may go away without this connection
+  // seeing it, and the name of a broker-named queue isn't known up front
+  if (!m_topology_cache_enabled || declaration.passive ||
+      declaration.auto_delete ||
+      (Topology::dk_queue == declaration.kind && declaration.name.empty()) ||
+      IsDeclarationCached(declaration)) {
+    return;
+  }
+  m_declaration_cache.insert(std::make_pair(declaration.name, declaration));
+}
+
+void ChannelImpl::RecordDeclaration(const Topology::declaration_t &declaration,
+                                    const std::string &declared_name) {
+  CacheDeclaration(declaration);
+  RecordForRecovery(declaration, declared_name);
+}
+
+void ChannelImpl::RecordForRecovery(const Topology::declaration_t &declaration,
+                                    const std::string &declared_name) {
+  // A passive declare only looks for something declared elsewhere
+  if (!m_recovery_enabled || declaration.passive) {
+    return;
+  }
+
+  Topology::declaration_t recorded = declaration;
+  if (Topology::dk_queue == recorded.kind && recorded.name.empty()) {
+    if (declared_name.empty()) {
+      return;
+    }
+    recorded.name = declared_name;
+    m_server_named_queues.insert(declared_name);
+  }
+  if (!FindDeclaration(m_recorded_topology, recorded)) {
+    m_recorded_topology.insert(std::make_pair(recorded.name, recorded));
+  }
+}
+
+void ChannelImpl::ForgetDeclaration(
+    const Topology::declaration_t &declaration) {
+  EraseDeclaration(m_declaration_cache, declaration);
+  EraseDeclaration(m_recorded_topology, declaration);
+}
+
+void ChannelImpl::ForgetQueue(const std::string &queue_name) {
+  EraseQueue(m_declaration_cache, queue_name);
+  EraseQueue(m_recorded_topology, queue_name);
+  m_server_named_queues.erase(queue_name);
+}
+
+void ChannelImpl::ForgetExchange(const std::string &exchange_name) {
+  EraseExchange(m_declaration_cache, exchange_name);
+  EraseExchange(m_recorded_topology, exchange_name);
+}
+
+amqp_method_number_t ChannelImpl::SendDeclaration(
+    amqp_channel_t channel, const Topology::declaration_t &declaration,
+    bool nowait) {
+  amqp_pool_ptr_t table_pool;
+  const amqp_table_t arguments =
+      TableValueImpl::CreateAmqpTable(declaration.arguments, table_pool);
+
+  switch (declaration.kind) {
+    case Topology::dk_exchange: {
+      amqp_exchange_declare_t declare = {};
+      declare.exchange = amqp_cstring_bytes(declaration.name.c_str());
+      declare.type = amqp_cstring_bytes(declaration.target.c_str());
+      declare.passive = declaration.passive;
+      declare.durable = declaration.durable;
+      declare.auto_delete = declaration.auto_delete;
+      declare.internal = false;
+      declare.nowait = nowait;
+      declare.arguments = arguments;
+      CheckForError(SendMethod(channel,
+                               AMQP_EXCHANGE_DECLARE_METHOD, &declare));
+      return AMQP_EXCHANGE_DECLARE_OK_METHOD;
+    }
+    case Topology::dk_queue: {
+      amqp_queue_declare_t declare = {};
+      declare.queue = amqp_cstring_bytes(declaration.name.c_str());
+      declare.passive = declaration.passive;
+      declare.durable = declaration.durable;
+      declare.exclusive = declaration.exclusive;
+      declare.auto_delete = declaration.auto_delete;
+      declare.nowait = nowait;
+      declare.arguments = arguments;
+      CheckForError(SendMethod(channel, AMQP_QUEUE_DECLARE_METHOD, &declare));
+      return AMQP_QUEUE_DECLARE_OK_METHOD;
+    }
+    case Topology::dk_queue_binding: {
+      amqp_queue_bind_t bind = {};
+      bind.queue = amqp_cstring_bytes(declaration.name.c_str());
+      bind.exchange = amqp_cstring_bytes(declaration.target.c_str());
+      bind.routing_key = amqp_cstring_bytes(declaration.routing_key.c_str());
+      bind.nowait = nowait;
+      bind.arguments = arguments;
+      CheckForError(SendMethod(channel, AMQP_QUEUE_BIND_METHOD, &bind));
+      return AMQP_QUEUE_BIND_OK_METHOD;
+    }
+    case Topology::dk_exchange_binding: {
+      amqp_exchange_bind_t bind = {};
+      bind.destination = amqp_cstring_bytes(declaration.name.c_str());
+      bind.source = amqp_cstring_bytes(declaration.target.c_str());
+      bind.routing_key = amqp_cstring_bytes(declaration.routing_key.c_str());
+      bind.nowait = nowait;
+      bind.arguments = arguments;
+      CheckForError(SendMethod(channel, AMQP_EXCHANGE_BIND_METHOD, &bind));
+      return AMQP_EXCHANGE_BIND_OK_METHOD;
+    }
+  }
+  throw std::logic_error("Unknown Topology declaration kind");
+}
+
+void ChannelImpl::StartOpeningChannel() {
+  amqp_channel_t channel = GetNextChannelId();
+
+  // Both are sent without waiting, the replies are picked up by
+  // AddToFrameQueue whenever frames are next read
+  amqp_channel_open_t channel_open = {};
+  CheckForError(SendMethod(channel, AMQP_CHANNEL_OPEN_METHOD, &channel_open));
+  amqp_confirm_select_t confirm_select = {};
+  CheckForError(SendMethod(channel,
+                           AMQP_CONFIRM_SELECT_METHOD, &confirm_select));
+  SetChannelState(channel, CS_Opening);
+}
+
+void ChannelImpl::WaitForOpeningChannels(bool until_one_is_open) {
+  while (0 < m_channel_counts[CS_Opening] &&
+         !(until_one_is_open && 0 < m_channel_counts[CS_Open])) {
+    amqp_frame_t frame;
+    GetNextFrameFromBroker(frame, boost::chrono::microseconds::max());
+    HandleFrameFromBroker(frame);
+  }
+}
+
+bool ChannelImpl::IsOpenState(channel_state_t state) {
+  return CS_Closed != state && CS_Opening != state && CS_Retired != state;
+}
+
+void ChannelImpl::SetChannelState(amqp_channel_t channel,
+                                  channel_state_t state) {
+  channel_state_t &current = m_channels.at(channel);
+  if (state == current) {
+    return;
+  }
+  if (m_metrics && IsOpenState(current) != IsOpenState(state)) {
+    if (IsOpenState(state)) {
+      m_metrics->ChannelOpened();
+    } else {
+      m_metrics->ChannelClosed();
+    }
+  }
+  --m_channel_counts[current];
+  ++m_channel_counts[state];
+  current = state;
+
+  if (CS_Closed == state || CS_Open == state || CS_OpenNoConfirm == state) {
+    m_free_channels[state].push_back(channel);
+  }
+}
+
+bool ChannelImpl::TakeFreeChannel(channel_state_t state,
+                                  amqp_channel_t &channel) {
+  channel_stack_t &free_channels = m_free_channels[state];
+  while (!free_channels.empty()) {
+    channel = free_channels.back();
+    free_channels.pop_back();
+    if (state == m_channels[channel]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+amqp_channel_t ChannelImpl::GetChannel(bool confirm) {
+  const channel_state_t open_state = confirm ? CS_Open : CS_OpenNoConfirm;
+  const channel_state_t used_state = confirm ? CS_Used : CS_UsedNoConfirm;
+
+  // A channel that is already on its way is quicker than opening another
+  if (confirm && 0 == m_channel_counts[CS_Open]) {
+    WaitForOpeningChannels(true);
+  }
+
+  amqp_channel_t channel;
+  if (!TakeFreeChannel(open_state, channel)) {
+    channel = CreateNewChannel(confirm);
   }
+  SetChannelState(channel, used_state);
 
-  *it = CS_Used;
-  return it - m_channels.begin();
+  if (confirm) {
+    TopUpChannelPool();
+  }
+  return channel;
 }
 
 void ChannelImpl::ReturnChannel(amqp_channel_t channel) {
-  m_channels.at(channel) = CS_Open;
-  m_last_used_channel = channel;
+  SetChannelState(channel, CS_UsedNoConfirm == m_channels.at(channel)
+                               ? CS_OpenNoConfirm
+                               : CS_Open);
 }
 
 bool ChannelImpl::IsChannelOpen(amqp_channel_t channel) {
-  return CS_Closed != m_channels.at(channel);
+  const channel_state_t state = m_channels.at(channel);
+  return CS_Closed != state && CS_Retired != state;
+}
+
+void ChannelImpl::RetireChannels() {
+  for (std::size_t channel = 1; channel < m_channels.size(); ++channel) {
+    if (CS_Closed != m_channels[channel]) {
+      SetChannelState(channel, CS_Retired);
+    }
+  }
 }
 
 void ChannelImpl::FinishCloseChannel(amqp_channel_t channel) {
-  m_channels.at(channel) = CS_Closed;
+  SetChannelState(channel, CS_Closed);
+  // Whatever the broker objected to, what it has been told before may no
+  // longer hold (e.g., a queue deleted by another connection), so it'll be
+  // declared again
+  m_declaration_cache.clear();
+  // Unacknowledged deliveries are requeued by the broker when the channel
+  // closes, and delivery tags start over on the next channel with this number
+  m_ack_coalescers.erase(channel);
+  m_prefetch_tuners.erase(channel);
+  m_flow_stopped.erase(channel);
+  if (channel < m_delivery_tags.size()) {
+    m_delivery_tags[channel] = 0;
+  }
 
   amqp_channel_close_ok_t close_ok;
-  CheckForError(amqp_send_method(m_connection, channel,
-                                 AMQP_CHANNEL_CLOSE_OK_METHOD, &close_ok));
+  CheckForError(SendMethod(channel, AMQP_CHANNEL_CLOSE_OK_METHOD, &close_ok));
 }
 
 void ChannelImpl::FinishCloseConnection() {
   SetIsConnected(false);
+  m_declaration_cache.clear();
   amqp_connection_close_ok_t close_ok;
-  amqp_send_method(m_connection, 0, AMQP_CONNECTION_CLOSE_OK_METHOD, &close_ok);
+  SendMethod(0, AMQP_CONNECTION_CLOSE_OK_METHOD, &close_ok);
 }
 
 void ChannelImpl::CheckRpcReply(amqp_channel_t channel,
@@ -182,6 +1008,9 @@ void ChannelImpl::CheckRpcReply(amqp_channel_t channel,
 
     case AMQP_RESPONSE_LIBRARY_EXCEPTION:
       // If we're getting this likely is the socket is already closed
+      if (IsConnectionLost(reply.library_error)) {
+        SetIsConnected(false);
+      }
       throw AmqpResponseLibraryException::CreateException(reply, "");
       break;
 
@@ -201,10 +1030,106 @@ void ChannelImpl::CheckRpcReply(amqp_channel_t channel,
 
 void ChannelImpl::CheckForError(int ret) {
   if (ret < 0) {
+    if (IsConnectionLost(ret)) {
+      SetIsConnected(false);
+    }
     throw AmqpLibraryException::CreateException(ret);
   }
 }
 
+int ChannelImpl::SendMethod(amqp_channel_t channel,
+                            amqp_method_number_t method_id, void *decoded) {
+  int ret = amqp_send_method(m_connection, channel, method_id, decoded);
+  if (AMQP_STATUS_OK == ret) {
+    CountFramesWritten(1);
+  }
+  return ret;
+}
+
+int ChannelImpl::SendFrame(const amqp_frame_t &frame) {
+  int ret = amqp_send_frame(m_connection, &frame);
+  if (AMQP_STATUS_OK == ret) {
+    CountFramesWritten(1);
+  }
+  return ret;
+}
+
+void ChannelImpl::PublishMessage(amqp_channel_t channel,
+                                 const std::string &exchange,
+                                 const std::string &routing_key,
+                                 bool mandatory, bool immediate,
+                                 const BasicMessage &message) {
+  // The body first, it may be one received compressed, which reading
+  // decompresses and takes the content encoding off
+  amqp_bytes_t body = message.getAmqpBody();
+  const amqp_basic_properties_t *properties = message.getAmqpProperties();
+
+  // Bodies already encoded some other way are left as they are
+  if (m_publish_codec && m_publish_min_body_size <= body.len &&
+      0 == (properties->_flags & AMQP_BASIC_CONTENT_ENCODING_FLAG)) {
+    // Compressed straight into the buffer that is sent, leaving the message
+    // as it was so it can be published again
+    m_publish_codec->Compress(static_cast<const char *>(body.bytes), body.len,
+                              m_compressed_body);
+    // Otherwise it isn't worth the receiver decompressing it
+    if (m_compressed_body.size() < body.len) {
+      m_compressed_properties = *properties;
+      m_compressed_properties._flags |= AMQP_BASIC_CONTENT_ENCODING_FLAG;
+      m_compressed_properties.content_encoding =
+          amqp_cstring_bytes(m_publish_encoding.c_str());
+      properties = &m_compressed_properties;
+      body.bytes = &m_compressed_body[0];
+      body.len = m_compressed_body.size();
+    }
+  }
+
+  CheckForError(amqp_basic_publish(
+      m_connection, channel, amqp_cstring_bytes(exchange.c_str()),
+      amqp_cstring_bytes(routing_key.c_str()), mandatory, immediate,
+      properties, body));
+  CountPublish(exchange, body);
+}
+
+void ChannelImpl::SetPublishCodec(const Codec::ptr_t &codec,
+                                  std::size_t min_body_size) {
+  m_publish_codec = codec;
+  m_publish_min_body_size = min_body_size;
+  if (codec) {
+    m_publish_encoding = codec->Name();
+    // Whatever is published with it can be read back on this connection
+    m_codecs[m_publish_encoding] = codec;
+  } else {
+    std::string().swap(m_compressed_body);
+  }
+}
+
+void ChannelImpl::CountPublish(const std::string &exchange,
+                               const amqp_bytes_t &body) {
+  if (!m_metrics) {
+    return;
+  }
+  m_metrics->MessagePublished(exchange, body.len);
+  // basic.publish and the content header, then as many body frames as the
+  // body needs less the 7 byte header and end octet of each
+  const std::size_t body_frame_size = amqp_get_frame_max(m_connection) - 8;
+  m_metrics->FramesWritten(2 + (body.len + body_frame_size - 1) /
+                                   body_frame_size);
+}
+
+bool ChannelImpl::IsConnectionLost(int status) {
+  switch (status) {
+    case AMQP_STATUS_CONNECTION_CLOSED:
+    case AMQP_STATUS_SOCKET_ERROR:
+    case AMQP_STATUS_SOCKET_CLOSED:
+    case AMQP_STATUS_HEARTBEAT_TIMEOUT:
+    case AMQP_STATUS_TCP_ERROR:
+    case AMQP_STATUS_SSL_ERROR:
+      return true;
+    default:
+      return false;
+  }
+}
+
 MessageReturnedException ChannelImpl::CreateMessageReturnedException(
     amqp_basic_return_t &return_method, amqp_channel_t channel) {
   const int reply_code = return_method.reply_code;
@@ -219,7 +1144,8 @@ MessageReturnedException ChannelImpl::CreateMessageReturnedException(
                                   routing_key);
 }
 
-BasicMessage::ptr_t ChannelImpl::ReadContent(amqp_channel_t channel) {
+BasicMessage::ptr_t ChannelImpl::ReadContent(
+    amqp_channel_t channel, const Channel::body_sink_t &sink) {
   amqp_frame_t frame;
 
   GetNextFrameOnChannel(channel, frame);
@@ -231,10 +1157,26 @@ BasicMessage::ptr_t ChannelImpl::ReadContent(amqp_channel_t channel) {
         "expected AMQP_FRAME_HEADER)");
 
   // The memory for this is allocated in a pool associated with the connection
-  // The BasicMessage constructor does a deep copy of the properties structure
+  // BasicMessage keeps its own copy of the raw properties below
   amqp_basic_properties_t *properties =
       reinterpret_cast<amqp_basic_properties_t *>(
           frame.payload.properties.decoded);
+  // The properties as they came off the wire, BasicMessage only decodes them
+  // again if they're accessed
+  const amqp_bytes_t raw_properties = frame.payload.properties.raw;
+  // Compressed by a codec that was added, it is decompressed as soon as the
+  // body has been read
+  Codec::ptr_t codec;
+  if (!m_codecs.empty() &&
+      0 != (properties->_flags & AMQP_BASIC_CONTENT_ENCODING_FLAG)) {
+    codec_map_t::const_iterator found = m_codecs.find(
+        std::string(static_cast<const char *>(
+                        properties->content_encoding.bytes),
+                    properties->content_encoding.len));
+    if (found != m_codecs.end()) {
+      codec = found->second;
+    }
+  }
 
   // size_t could possibly be 32-bit, body_size is always 64-bit
   assert(frame.payload.properties.body_size <
@@ -243,7 +1185,23 @@ BasicMessage::ptr_t ChannelImpl::ReadContent(amqp_channel_t channel) {
   size_t body_size = static_cast<size_t>(frame.payload.properties.body_size);
   size_t received_size = 0;
 
-  amqp_bytes_t body = amqp_bytes_malloc(body_size);
+  if (sink) {
+    // Made first, the properties are in the pool given back as the body is
+    // read
+    BasicMessage::ptr_t message = m_message_pool
+                                      ? m_message_pool->CreateMessage()
+                                      : BasicMessage::Create();
+    std::string no_body;
+    message->Assign(no_body, properties, &raw_properties);
+    StreamContent(channel, body_size, sink);
+    return message;
+  }
+
+  // Frame payloads live in the channel's pool which is recycled as soon as
+  // the message has been read, so the body is copied exactly once: straight
+  // into the buffer handed over to the BasicMessage
+  std::string body;
+  body.reserve(body_size);
 
   // frame #3 and up:
   while (received_size < body_size) {
@@ -255,15 +1213,146 @@ BasicMessage::ptr_t ChannelImpl::ReadContent(amqp_channel_t channel) {
           "Channel::BasicConsumeMessage: received unexpected frame type (was "
           "expecting AMQP_FRAME_BODY)");
 
-    void *body_ptr = reinterpret_cast<char *>(body.bytes) + received_size;
-    memcpy(body_ptr, frame.payload.body_fragment.bytes,
-           frame.payload.body_fragment.len);
+    body.append(
+        reinterpret_cast<const char *>(frame.payload.body_fragment.bytes),
+        frame.payload.body_fragment.len);
     received_size += frame.payload.body_fragment.len;
   }
-  return BasicMessage::Create(body, properties);
-}
 
-void ChannelImpl::CheckFrameForClose(amqp_frame_t &frame,
+  BasicMessage::ptr_t message = m_message_pool
+                                    ? m_message_pool->CreateMessage()
+                                    : BasicMessage::Create();
+  message->Assign(body, properties, &raw_properties);
+  if (codec) {
+    try {
+      message->Decompress(*codec);
+    } catch (const std::runtime_error &) {
+      // A corrupt body is handed over as it came, with its content encoding
+      // still set, rather than losing the message
+    }
+  }
+  return message;
+}
+
+void ChannelImpl::StreamContent(amqp_channel_t channel, std::size_t body_size,
+                                const Channel::body_sink_t &sink) {
+  amqp_frame_t frame;
+  std::size_t received_size = 0;
+  while (received_size < body_size) {
+    GetNextFrameOnChannel(channel, frame);
+
+    if (frame.frame_type != AMQP_FRAME_BODY)
+      throw std::runtime_error(
+          "Channel::BasicConsumeMessageStreaming: received unexpected frame "
+          "type (was expecting AMQP_FRAME_BODY)");
+    received_size += frame.payload.body_fragment.len;
+
+    if (sink) {
+      try {
+        sink(reinterpret_cast<const char *>(frame.payload.body_fragment.bytes),
+             frame.payload.body_fragment.len);
+      } catch (...) {
+        // The rest of the message is still read, or the next frame on the
+        // channel would be taken for the part of it that hasn't
+        try {
+          StreamContent(channel, body_size - received_size,
+                        Channel::body_sink_t());
+        } catch (...) {
+          // Without a sink nothing fails but the connection itself, which
+          // leaves the message half read: nothing more on it can be trusted
+          AbortConnection();
+          throw;
+        }
+        throw;
+      }
+    }
+    MaybeReleaseBuffersOnChannel(channel);
+  }
+}
+
+void ChannelImpl::StreamBody(const BasicMessage::ptr_t &message,
+                             const Channel::body_sink_t &sink) {
+  if (0 != message->BodyLength()) {
+    sink(message->BodyData(), message->BodyLength());
+  }
+  message->Body(std::string());
+}
+
+void ChannelImpl::PublishStreaming(amqp_channel_t channel,
+                                   const std::string &exchange_name,
+                                   const std::string &routing_key,
+                                   bool mandatory,
+                                   const amqp_basic_properties_t *properties,
+                                   boost::uint64_t body_size,
+                                   const Channel::body_source_t &source) {
+  amqp_basic_publish_t publish = {};
+  publish.exchange = amqp_cstring_bytes(exchange_name.c_str());
+  publish.routing_key = amqp_cstring_bytes(routing_key.c_str());
+  publish.mandatory = mandatory;
+  publish.immediate = false;
+  CheckForError(SendMethod(channel, AMQP_BASIC_PUBLISH_METHOD, &publish));
+
+  amqp_frame_t frame;
+  frame.frame_type = AMQP_FRAME_HEADER;
+  frame.channel = channel;
+  frame.payload.properties.class_id = AMQP_BASIC_CLASS;
+  frame.payload.properties.body_size = body_size;
+  frame.payload.properties.decoded = const_cast<amqp_basic_properties_t *>(
+      properties);
+  CheckForError(SendFrame(frame));
+
+  // Less the frame's 7 byte header and its end octet
+  std::vector<char> buffer(amqp_get_frame_max(m_connection) - 8);
+  boost::uint64_t sent_size = 0;
+  while (sent_size < body_size) {
+    const std::size_t wanted = static_cast<std::size_t>(std::min(
+        static_cast<boost::uint64_t>(buffer.size()), body_size - sent_size));
+    std::size_t produced;
+    try {
+      produced = std::min(source(&buffer[0], wanted), wanted);
+    } catch (...) {
+      // Half a message can't be taken back, nor anything else sent on the
+      // channel after it
+      AbortConnection();
+      throw;
+    }
+    if (0 == produced) {
+      AbortConnection();
+      throw std::runtime_error(
+          "Channel::BasicPublishStreaming: the body ended short of its "
+          "size");
+    }
+
+    frame.frame_type = AMQP_FRAME_BODY;
+    frame.payload.body_fragment.bytes = &buffer[0];
+    frame.payload.body_fragment.len = produced;
+    CheckForError(SendFrame(frame));
+    sent_size += produced;
+  }
+  if (m_metrics) {
+    m_metrics->MessagePublished(exchange_name,
+                                static_cast<std::size_t>(body_size));
+  }
+}
+
+Envelope::ptr_t ChannelImpl::CreateEnvelope(
+    const BasicMessage::ptr_t message, const std::string &consumer_tag,
+    const boost::uint64_t delivery_tag, const std::string &exchange,
+    bool redelivered, const std::string &routing_key,
+    const boost::uint16_t delivery_channel) {
+  if (m_metrics) {
+    m_metrics->MessageReceived(consumer_tag, message->BodyLength());
+  }
+  if (m_message_pool) {
+    return m_message_pool->CreateEnvelope(message, consumer_tag, delivery_tag,
+                                          exchange, redelivered, routing_key,
+                                          delivery_channel);
+  }
+  return Envelope::Create(message, consumer_tag, delivery_tag, exchange,
+                          redelivered, routing_key, delivery_channel);
+}
+
+void ChannelImpl::CheckFrameForClose(amqp_frame_t &frame,
                                      amqp_channel_t channel) {
   if (frame.frame_type == AMQP_FRAME_METHOD) {
     switch (frame.payload.method.id) {
@@ -282,88 +1371,279 @@ void ChannelImpl::CheckFrameForClose(amqp_frame_t &frame,
   }
 }
 
+std::string ChannelImpl::StartConsumer(const std::string &consumer_tag,
+                                       const consume_params_t &params,
+                                       handle_id_t handle) {
+  amqp_channel_t channel = GetChannel(!params.no_confirm);
+
+  // Set this before starting the consume as it may have been set by a previous
+  // consumer
+  const boost::array<boost::uint32_t, 1> QOS_OK = {{AMQP_BASIC_QOS_OK_METHOD}};
+
+  amqp_basic_qos_t qos = {};
+  qos.prefetch_size = 0;
+  qos.prefetch_count = params.prefetch_count;
+  qos.global = BrokerHasNewQosBehavior();
+
+  DoRpcOnChannel(channel, AMQP_BASIC_QOS_METHOD, &qos, QOS_OK);
+  MaybeReleaseBuffersOnChannel(channel);
+
+  const boost::array<boost::uint32_t, 1> CONSUME_OK = {
+      {AMQP_BASIC_CONSUME_OK_METHOD}};
+
+  amqp_basic_consume_t consume = {};
+  consume.queue = amqp_cstring_bytes(params.queue.c_str());
+  consume.consumer_tag = amqp_cstring_bytes(consumer_tag.c_str());
+  consume.no_local = params.no_local;
+  consume.no_ack = params.no_ack;
+  consume.exclusive = params.exclusive;
+  consume.nowait = false;
+
+  amqp_pool_ptr_t table_pool;
+  consume.arguments =
+      TableValueImpl::CreateAmqpTable(params.arguments, table_pool);
+
+  amqp_frame_t response = DoRpcOnChannel(channel, AMQP_BASIC_CONSUME_METHOD,
+                                         &consume, CONSUME_OK);
+
+  amqp_basic_consume_ok_t *consume_ok =
+      (amqp_basic_consume_ok_t *)response.payload.method.decoded;
+  std::string tag((char *)consume_ok->consumer_tag.bytes,
+                  consume_ok->consumer_tag.len);
+  MaybeReleaseBuffersOnChannel(channel);
+
+  AddConsumer(tag, channel, handle, params);
+
+  return tag;
+}
+
 void ChannelImpl::AddConsumer(const std::string &consumer_tag,
-                              amqp_channel_t channel) {
-  m_consumer_channel_map.insert(std::make_pair(consumer_tag, channel));
+                              amqp_channel_t channel, handle_id_t handle,
+                              const consume_params_t &params) {
+  consumer_t consumer;
+  consumer.channel = channel;
+  consumer.handle = handle;
+  consumer.params = params;
+  consumer.ack_every = 0;
+  consumer.max_prefetch_count = 0;
+  consumer.priority = 0;
+  consumer.weight = 1;
+  m_consumer_channel_map.insert(std::make_pair(consumer_tag, consumer));
+  m_handle_channels[handle].insert(channel);
+}
+
+void ChannelImpl::SetConsumerPrefetchCount(const std::string &consumer_tag,
+                                           boost::uint16_t prefetch_count) {
+  consumer_map_t::iterator it = m_consumer_channel_map.find(consumer_tag);
+  if (m_consumer_channel_map.end() != it) {
+    it->second.params.prefetch_count = prefetch_count;
+  }
+}
+
+boost::uint16_t ChannelImpl::GetConsumerPrefetchCount(
+    const std::string &consumer_tag) const {
+  consumer_map_t::const_iterator it = m_consumer_channel_map.find(consumer_tag);
+  if (m_consumer_channel_map.end() == it) {
+    throw ConsumerTagNotFoundException();
+  }
+  return it->second.params.prefetch_count;
 }
 
 amqp_channel_t ChannelImpl::RemoveConsumer(const std::string &consumer_tag) {
-  std::map<std::string, amqp_channel_t>::iterator it =
-      m_consumer_channel_map.find(consumer_tag);
+  consumer_map_t::iterator it = m_consumer_channel_map.find(consumer_tag);
   if (it == m_consumer_channel_map.end()) {
     throw ConsumerTagNotFoundException();
   }
 
-  amqp_channel_t result = it->second;
+  amqp_channel_t result = it->second.channel;
 
+  m_handle_channels[it->second.handle].erase(result);
   m_consumer_channel_map.erase(it);
+  if (result < m_consumer_schedules.size()) {
+    const consumer_schedule_t none = {0, 1, 0};
+    m_consumer_schedules[result] = none;
+  }
+
+  FlushAcks(result);
+  m_ack_coalescers.erase(result);
+  m_prefetch_tuners.erase(result);
 
   return result;
 }
 
 amqp_channel_t ChannelImpl::GetConsumerChannel(
     const std::string &consumer_tag) {
-  std::map<std::string, amqp_channel_t>::const_iterator it =
-      m_consumer_channel_map.find(consumer_tag);
+  consumer_map_t::const_iterator it = m_consumer_channel_map.find(consumer_tag);
   if (it == m_consumer_channel_map.end()) {
     throw ConsumerTagNotFoundException();
   }
+  return it->second.channel;
+}
+
+const ChannelImpl::channel_set_t &ChannelImpl::GetAllConsumerChannels(
+    handle_id_t handle) const {
+  handle_channels_map_t::const_iterator it = m_handle_channels.find(handle);
+  if (m_handle_channels.end() == it) {
+    return m_no_channels;
+  }
   return it->second;
 }
 
-std::vector<amqp_channel_t> ChannelImpl::GetAllConsumerChannels() const {
-  std::vector<amqp_channel_t> ret;
+std::vector<std::string> ChannelImpl::GetConsumerTags(
+    handle_id_t handle) const {
+  std::vector<std::string> ret;
   for (consumer_map_t::const_iterator it = m_consumer_channel_map.begin();
        it != m_consumer_channel_map.end(); ++it) {
-    ret.push_back(it->second);
+    if (handle == it->second.handle) {
+      ret.push_back(it->first);
+    }
   }
 
   return ret;
 }
 
-bool ChannelImpl::CheckForQueuedMessageOnChannel(amqp_channel_t channel) const {
-  frame_queue_t::const_iterator it =
-      std::find_if(m_frame_queue.begin(), m_frame_queue.end(),
-                   boost::bind(&ChannelImpl::is_method_on_channel, _1,
-                               AMQP_BASIC_DELIVER_METHOD, channel));
-
-  if (it == m_frame_queue.end()) {
+bool ChannelImpl::PushFrame(const amqp_frame_t &frame) {
+  // Nobody waits for the replies to the channel.flow sent by Buffer
+  if (AMQP_FRAME_METHOD == frame.frame_type &&
+      AMQP_CHANNEL_FLOW_OK_METHOD == frame.payload.method.id) {
     return false;
   }
-
-  it = std::find_if(it + 1, m_frame_queue.end(),
-                    boost::bind(&ChannelImpl::is_on_channel, _1, channel));
-
-  if (it == m_frame_queue.end()) {
-    return false;
+  if (m_frame_queues.size() <= frame.channel) {
+    m_frame_queues.resize(frame.channel + 1);
+    m_assemblies.resize(frame.channel + 1, message_assembly_t());
   }
-  if (it->frame_type != AMQP_FRAME_HEADER) {
-    throw std::runtime_error("Protocol error");
+  const queued_frame_t queued = {m_next_frame_sequence, frame};
+  message_assembly_t &assembly = m_assemblies[frame.channel];
+  const bool was_assembling = AS_Idle != assembly.state;
+  bool complete;
+  try {
+    // Checked before the frame is queued and counted as buffered
+    complete = UpdateAssembly(assembly, queued);
+  } catch (const std::runtime_error &) {
+    // A message's frames out of order, nothing more read from the connection
+    // can be made sense of
+    AbortConnection();
+    throw;
   }
+  CountAssembly(was_assembling, AS_Idle != assembly.state);
+  ++m_next_frame_sequence;
+  m_frame_queues[frame.channel].push_back(queued);
+  TraceFrame(FrameTrace::fe_queued, frame);
+  BufferFrame(frame);
+  return complete;
+}
 
-  uint64_t body_length = it->payload.properties.body_size;
-  uint64_t body_received = 0;
-
-  while (body_received < body_length) {
-    it = std::find_if(it + 1, m_frame_queue.end(),
-                      boost::bind(&ChannelImpl::is_on_channel, _1, channel));
+void ChannelImpl::CountAssembly(bool was_assembling, bool is_assembling) {
+  if (was_assembling != is_assembling) {
+    if (is_assembling) {
+      ++m_assembling_messages;
+    } else {
+      --m_assembling_messages;
+    }
+  }
+}
 
-    if (it == m_frame_queue.end()) {
+bool ChannelImpl::UpdateAssembly(message_assembly_t &assembly,
+                                 const queued_frame_t &queued) {
+  const amqp_frame_t &frame = queued.frame;
+  switch (assembly.state) {
+    case AS_Idle:
+      if (is_method(queued, AMQP_BASIC_DELIVER_METHOD)) {
+        assembly.state = AS_Header;
+        assembly.deliver_sequence = queued.sequence;
+      }
       return false;
+
+    case AS_Header:
+      if (frame.frame_type != AMQP_FRAME_HEADER) {
+        throw std::runtime_error("Protocol error");
+      }
+      assembly.body_remaining = frame.payload.properties.body_size;
+      break;
+
+    case AS_Body:
+      if (frame.frame_type != AMQP_FRAME_BODY ||
+          frame.payload.body_fragment.len > assembly.body_remaining) {
+        throw std::runtime_error("Protocol error");
+      }
+      assembly.body_remaining -= frame.payload.body_fragment.len;
+      break;
+  }
+
+  if (0 == assembly.body_remaining) {
+    assembly.state = AS_Idle;
+    return true;
+  }
+  assembly.state = AS_Body;
+  return false;
+}
+
+void ChannelImpl::ForgetAssembly(const queued_frame_t &taken) {
+  // The rest of a partially queued message is read by whoever took its
+  // basic.deliver, those frames won't pass through the queue.
+  if (taken.frame.channel < m_assemblies.size()) {
+    message_assembly_t &assembly = m_assemblies[taken.frame.channel];
+    if (AS_Idle != assembly.state &&
+        assembly.deliver_sequence == taken.sequence) {
+      assembly.state = AS_Idle;
+      CountAssembly(true, false);
     }
-    if (it->frame_type != AMQP_FRAME_BODY) {
-      throw std::runtime_error("Protocol error");
-    }
-    body_received += it->payload.body_fragment.len;
   }
+}
 
-  return true;
+ChannelImpl::frame_queue_t *ChannelImpl::FindFrameQueue(
+    amqp_channel_t channel) {
+  if (m_frame_queues.size() <= channel || m_frame_queues[channel].empty()) {
+    return NULL;
+  }
+  return &m_frame_queues[channel];
+}
+
+const ChannelImpl::frame_queue_t *ChannelImpl::FindFrameQueue(
+    amqp_channel_t channel) const {
+  if (m_frame_queues.size() <= channel || m_frame_queues[channel].empty()) {
+    return NULL;
+  }
+  return &m_frame_queues[channel];
 }
 
 void ChannelImpl::AddToFrameQueue(const amqp_frame_t &frame) {
-  m_frame_queue.push_back(frame);
+  const channel_state_t state =
+      frame.channel < m_channels.size() ? m_channels[frame.channel] : CS_Used;
+
+  // Nobody waits on an idle fire-and-forget channel, so an error closing it
+  // (e.g., publishing to an exchange that doesn't exist) is acknowledged here
+  // and a new channel will be opened for the next publish. The same goes for
+  // a channel that is still being opened for the pool.
+  if (AMQP_FRAME_METHOD == frame.frame_type &&
+      AMQP_CHANNEL_CLOSE_METHOD == frame.payload.method.id &&
+      (CS_OpenNoConfirm == state || CS_Opening == state)) {
+    FinishCloseChannel(frame.channel);
+    if (frame.channel < m_frame_queues.size()) {
+      frame_queue_t &queue = m_frame_queues[frame.channel];
+      for (frame_queue_t::const_iterator it = queue.begin();
+           it != queue.end(); ++it) {
+        UnbufferFrame(it->frame);
+      }
+      queue.clear();
+      CountAssembly(AS_Idle != m_assemblies[frame.channel].state, false);
+      m_assemblies[frame.channel].state = AS_Idle;
+    }
+    amqp_maybe_release_buffers_on_channel(m_connection, frame.channel);
+    return;
+  }
 
-  if (CheckForQueuedMessageOnChannel(frame.channel)) {
+  // The replies to the methods sent by StartOpeningChannel, the channel is
+  // ready once confirm.select-ok arrives
+  if (AMQP_FRAME_METHOD == frame.frame_type && CS_Opening == state) {
+    if (AMQP_CONFIRM_SELECT_OK_METHOD == frame.payload.method.id) {
+      SetChannelState(frame.channel, CS_Open);
+    }
+    amqp_maybe_release_buffers_on_channel(m_connection, frame.channel);
+    return;
+  }
+
+  if (PushFrame(frame)) {
     boost::array<amqp_channel_t, 1> channel = {{frame.channel}};
     Envelope::ptr_t envelope;
     if (!ConsumeMessageOnChannelInner(channel, envelope, -1)) {
@@ -372,6 +1652,299 @@ void ChannelImpl::AddToFrameQueue(const amqp_frame_t &frame) {
     }
 
     m_delivered_messages.push_back(envelope);
+    BufferEnvelope(envelope);
+  }
+}
+
+void ChannelImpl::SetBufferLimits(const Channel::BufferLimits &limits) {
+  m_buffer_limits = limits;
+  if (!limits.use_channel_flow) {
+    while (!m_flow_stopped.empty()) {
+      SendChannelFlow(*m_flow_stopped.begin(), true);
+    }
+  }
+  for (std::size_t channel = 0; channel < m_buffered.size(); ++channel) {
+    UpdateBufferState(static_cast<amqp_channel_t>(channel));
+  }
+}
+
+std::size_t ChannelImpl::GetBufferedBytes(amqp_channel_t channel) const {
+  return channel < m_buffered.size() ? m_buffered[channel].bytes : 0;
+}
+
+std::size_t ChannelImpl::GetBufferedMessages(amqp_channel_t channel) const {
+  return channel < m_buffered.size() ? m_buffered[channel].messages : 0;
+}
+
+bool ChannelImpl::IsBufferFull() const {
+  return 0 != m_full_channels ||
+         AtLimit(m_buffered_total, m_buffer_limits.max_bytes,
+                 m_buffer_limits.max_messages, 1);
+}
+
+bool ChannelImpl::AtLimit(const buffered_t &buffered, std::size_t max_bytes,
+                          std::size_t max_messages, std::size_t scale) {
+  return (0 != max_bytes && buffered.bytes * scale >= max_bytes) ||
+         (0 != max_messages && buffered.messages * scale >= max_messages);
+}
+
+void ChannelImpl::BufferFrame(const amqp_frame_t &frame) {
+  ++m_queued_frames;
+  ReportQueueDepth(1, 0);
+  if (AMQP_FRAME_BODY == frame.frame_type) {
+    Buffer(frame.channel, frame.payload.body_fragment.len, 0);
+  } else if (AMQP_FRAME_METHOD == frame.frame_type &&
+             AMQP_BASIC_DELIVER_METHOD == frame.payload.method.id) {
+    Buffer(frame.channel, 0, 1);
+  }
+}
+
+void ChannelImpl::UnbufferFrame(const amqp_frame_t &frame) {
+  --m_queued_frames;
+  ReportQueueDepth(-1, 0);
+  if (AMQP_FRAME_BODY == frame.frame_type) {
+    Unbuffer(frame.channel, frame.payload.body_fragment.len, 0);
+  } else if (AMQP_FRAME_METHOD == frame.frame_type &&
+             AMQP_BASIC_DELIVER_METHOD == frame.payload.method.id) {
+    Unbuffer(frame.channel, 0, 1);
+  }
+}
+
+void ChannelImpl::BufferEnvelope(const Envelope::ptr_t &envelope) {
+  ++m_queued_envelopes;
+  ReportQueueDepth(0, 1);
+  Buffer(envelope->DeliveryChannel(), envelope->Message()->BodyLength(), 1);
+}
+
+void ChannelImpl::UnbufferEnvelope(const Envelope::ptr_t &envelope) {
+  --m_queued_envelopes;
+  ReportQueueDepth(0, -1);
+  Unbuffer(envelope->DeliveryChannel(), envelope->Message()->BodyLength(), 1);
+}
+
+void ChannelImpl::RecordFrame(FrameTrace::event_t event,
+                              const amqp_frame_t &frame) {
+  boost::uint32_t method_id = 0;
+  boost::uint64_t delivery_tag = 0;
+  if (AMQP_FRAME_METHOD == frame.frame_type) {
+    method_id = frame.payload.method.id;
+    if (AMQP_BASIC_DELIVER_METHOD == method_id) {
+      delivery_tag = reinterpret_cast<amqp_basic_deliver_t *>(
+                         frame.payload.method.decoded)
+                         ->delivery_tag;
+    }
+  }
+  m_frame_trace->Record(event, frame.channel, frame.frame_type, method_id,
+                        delivery_tag);
+}
+
+void ChannelImpl::ReportQueueDepth(std::ptrdiff_t frames,
+                                   std::ptrdiff_t envelopes) {
+  if (m_metrics) {
+    m_metrics->QueueDepthChanged(frames, envelopes);
+  }
+}
+
+void ChannelImpl::SetMetrics(const Metrics::ptr_t &metrics) {
+  // The old one no longer counts what is queued here, the new one starts to
+  ReportQueueDepth(-static_cast<std::ptrdiff_t>(m_queued_frames),
+                   -static_cast<std::ptrdiff_t>(m_queued_envelopes));
+  m_metrics = metrics;
+  ReportQueueDepth(static_cast<std::ptrdiff_t>(m_queued_frames),
+                   static_cast<std::ptrdiff_t>(m_queued_envelopes));
+}
+
+void ChannelImpl::Buffer(amqp_channel_t channel, std::size_t bytes,
+                         std::size_t messages) {
+  if (m_buffered.size() <= channel) {
+    const buffered_t none = {0, 0, false};
+    m_buffered.resize(channel + 1, none);
+  }
+  buffered_t &buffered = m_buffered[channel];
+  buffered.bytes += bytes;
+  buffered.messages += messages;
+  m_buffered_total.bytes += bytes;
+  m_buffered_total.messages += messages;
+  UpdateBufferState(channel);
+
+  // Only deliveries are stopped by channel.flow, so it is sent to the
+  // consumers' channels
+  if (m_buffer_limits.use_channel_flow && 0 != buffered.messages &&
+      0 == m_flow_stopped.count(channel) &&
+      (buffered.full ||
+       AtLimit(m_buffered_total, m_buffer_limits.max_bytes,
+               m_buffer_limits.max_messages, 1))) {
+    SendChannelFlow(channel, false);
+  }
+}
+
+void ChannelImpl::Unbuffer(amqp_channel_t channel, std::size_t bytes,
+                           std::size_t messages) {
+  if (m_buffered.size() <= channel) {
+    return;
+  }
+  buffered_t &buffered = m_buffered[channel];
+  buffered.bytes -= bytes;
+  buffered.messages -= messages;
+  m_buffered_total.bytes -= bytes;
+  m_buffered_total.messages -= messages;
+  UpdateBufferState(channel);
+
+  if (m_flow_stopped.empty() ||
+      AtLimit(m_buffered_total, m_buffer_limits.max_bytes,
+              m_buffer_limits.max_messages, 2)) {
+    return;
+  }
+  // Started again once down to half of the limits, so channel.flow isn't
+  // sent back and forth for every message
+  std::set<amqp_channel_t>::iterator it = m_flow_stopped.begin();
+  while (it != m_flow_stopped.end()) {
+    const amqp_channel_t stopped = *it++;
+    if (m_buffered.size() <= stopped ||
+        !AtLimit(m_buffered[stopped], m_buffer_limits.max_channel_bytes,
+                 m_buffer_limits.max_channel_messages, 2)) {
+      SendChannelFlow(stopped, true);
+    }
+  }
+}
+
+void ChannelImpl::UpdateBufferState(amqp_channel_t channel) {
+  buffered_t &buffered = m_buffered[channel];
+  const bool full =
+      AtLimit(buffered, m_buffer_limits.max_channel_bytes,
+              m_buffer_limits.max_channel_messages, 1);
+  if (full != buffered.full) {
+    buffered.full = full;
+    if (full) {
+      ++m_full_channels;
+    } else {
+      --m_full_channels;
+    }
+  }
+}
+
+void ChannelImpl::SendChannelFlow(amqp_channel_t channel, bool active) {
+  amqp_channel_flow_t flow;
+  flow.active = active;
+  if (active) {
+    m_flow_stopped.erase(channel);
+  } else {
+    m_flow_stopped.insert(channel);
+  }
+  CheckForError(SendMethod(channel, AMQP_CHANNEL_FLOW_METHOD, &flow));
+}
+
+void ChannelImpl::SetSocketCork(bool cork) {
+  if (cork == m_socket_corked) {
+    return;
+  }
+  m_socket_corked = cork;
+#ifdef __linux__
+  // Holds back partial segments so a run of small publishes leaves in as few
+  // packets as possible, everything is flushed when the cork is removed
+  int value = cork ? 1 : 0;
+  setsockopt(amqp_get_sockfd(m_connection), IPPROTO_TCP, TCP_CORK, &value,
+             sizeof(value));
+#else
+  (void)cork;
+#endif
+}
+
+void ChannelImpl::ReadBeforePublish() {
+  // A channel closed by the broker is noticed at most this many publishes
+  // late
+  const unsigned int PUBLISH_POLL_INTERVAL = 64;
+  if (HasUnreadData() || PUBLISH_POLL_INTERVAL <= ++m_unpolled_publishes) {
+    m_unpolled_publishes = 0;
+    ReadAvailableFrames();
+  }
+}
+
+void ChannelImpl::ReadAvailableFrames(bool awaiting_reply) {
+  // Once the buffers are full what hasn't been read yet is held back by TCP
+  // flow control, until something that needs to read from the socket makes
+  // room
+  if (!WantsToRead(awaiting_reply)) {
+    SendHeartbeatIfDue();
+    return;
+  }
+
+  amqp_frame_t frame;
+  do {
+    if (!GetNextFrameFromBroker(frame, boost::chrono::microseconds(0))) {
+      return;
+    }
+    HandleFrameFromBroker(frame);
+    // A message partway read is always read to the end, even past the
+    // limits, or one larger than them could never be consumed. Reading stops
+    // after it, so no more than the messages in progress go over.
+  } while (0 != m_assembling_messages ||
+           (HasUnreadData() && WantsToRead(awaiting_reply)));
+}
+
+bool ChannelImpl::WantsToRead(bool awaiting_reply) const {
+  // The confirms of BasicPublishAsync and the replies to methods may be
+  // queued behind deliveries, only reading them gets to those
+  return awaiting_reply || !IsBufferFull() || 0 != m_assembling_messages ||
+         !m_pending_confirms.empty();
+}
+
+void ChannelImpl::SendHeartbeatIfDue() {
+  // rabbitmq-c only sends heartbeats while it is reading, which stops while
+  // the buffers are full
+  const boost::chrono::microseconds interval = HeartbeatPollInterval();
+  if (boost::chrono::microseconds::max() == interval || !m_is_connected) {
+    return;
+  }
+  const boost::chrono::steady_clock::time_point now =
+      boost::chrono::steady_clock::now();
+  if (now - m_last_heartbeat_sent < interval) {
+    return;
+  }
+  amqp_frame_t heartbeat;
+  heartbeat.frame_type = AMQP_FRAME_HEARTBEAT;
+  heartbeat.channel = 0;
+  CheckForError(amqp_send_frame(m_connection, &heartbeat));
+  m_last_heartbeat_sent = now;
+}
+
+void ChannelImpl::HandleFrameFromBroker(const amqp_frame_t &frame) {
+  if (frame.channel == 0) {
+    HandleConnectionFrame(frame);
+  } else {
+    AddToFrameQueue(frame);
+  }
+}
+
+void ChannelImpl::HandleConnectionFrame(const amqp_frame_t &frame) {
+  if (AMQP_FRAME_METHOD != frame.frame_type) {
+    return;
+  }
+  switch (frame.payload.method.id) {
+    case AMQP_CONNECTION_CLOSE_METHOD:
+      FinishCloseConnection();
+      AmqpException::Throw(*reinterpret_cast<amqp_connection_close_t *>(
+          frame.payload.method.decoded));
+      break;
+    case AMQP_CONNECTION_BLOCKED_METHOD: {
+      amqp_connection_blocked_t *blocked =
+          reinterpret_cast<amqp_connection_blocked_t *>(
+              frame.payload.method.decoded);
+      m_is_blocked = true;
+      m_blocked_reason.assign((char *)blocked->reason.bytes,
+                              blocked->reason.len);
+      if (m_blocked_callback) {
+        m_blocked_callback(true, m_blocked_reason);
+      }
+      break;
+    }
+    case AMQP_CONNECTION_UNBLOCKED_METHOD:
+      m_is_blocked = false;
+      m_blocked_reason.clear();
+      if (m_blocked_callback) {
+        m_blocked_callback(false, m_blocked_reason);
+      }
+      break;
   }
 }
 
@@ -399,25 +1972,52 @@ bool ChannelImpl::GetNextFrameFromBroker(amqp_frame_t &frame,
     tvp = &tv_timeout;
   }
 
+  // With heartbeats on, rabbitmq-c sends them while it waits here, and wakes
+  // up in time to do so however long the timeout is
+  boost::chrono::steady_clock::time_point wait_start;
+  if (m_metrics) {
+    wait_start = boost::chrono::steady_clock::now();
+  }
   int ret = amqp_simple_wait_frame_noblock(m_connection, &frame, tvp);
+  if (m_metrics) {
+    m_metrics->WaitedForFrame(
+        boost::chrono::duration_cast<boost::chrono::microseconds>(
+            boost::chrono::steady_clock::now() - wait_start),
+        AMQP_STATUS_OK == ret);
+  }
 
   if (AMQP_STATUS_TIMEOUT == ret) {
     return false;
   }
+  if (AMQP_STATUS_HEARTBEAT_TIMEOUT == ret) {
+    // rabbitmq-c has already closed the socket
+    SetIsConnected(false);
+  }
   CheckForError(ret);
+  TraceFrame(FrameTrace::fe_received, frame);
   return true;
 }
 
+boost::chrono::microseconds ChannelImpl::HeartbeatPollInterval() const {
+  const int heartbeat = amqp_get_heartbeat(m_connection);
+  if (0 >= heartbeat) {
+    return boost::chrono::microseconds::max();
+  }
+  // The broker gives up after two intervals without hearing from us
+  return boost::chrono::duration_cast<boost::chrono::microseconds>(
+      boost::chrono::seconds(heartbeat)) / 2;
+}
+
 bool ChannelImpl::GetNextFrameOnChannel(amqp_channel_t channel,
                                         amqp_frame_t &frame,
                                         boost::chrono::microseconds timeout) {
-  frame_queue_t::iterator it =
-      std::find_if(m_frame_queue.begin(), m_frame_queue.end(),
-                   boost::bind(&ChannelImpl::is_on_channel, _1, channel));
+  frame_queue_t *queue = FindFrameQueue(channel);
 
-  if (m_frame_queue.end() != it) {
-    frame = *it;
-    m_frame_queue.erase(it);
+  if (NULL != queue) {
+    frame = queue->front().frame;
+    queue->pop_front();
+    TraceFrame(FrameTrace::fe_dequeued, frame);
+    UnbufferFrame(frame);
 
     if (AMQP_FRAME_METHOD == frame.frame_type &&
         AMQP_CHANNEL_CLOSE_METHOD == frame.payload.method.id) {
@@ -432,20 +2032,944 @@ bool ChannelImpl::GetNextFrameOnChannel(amqp_channel_t channel,
   return GetNextFrameFromBrokerOnChannel(channels, frame, timeout);
 }
 
+void ChannelImpl::SetAckCoalescing(amqp_channel_t channel,
+                                   std::size_t ack_every,
+                                   boost::chrono::microseconds max_delay) {
+  // Kept with the consumer, so it is turned on again after a recovery
+  for (consumer_map_t::iterator it = m_consumer_channel_map.begin();
+       it != m_consumer_channel_map.end(); ++it) {
+    if (channel == it->second.channel) {
+      it->second.ack_every = ack_every;
+      it->second.ack_max_delay = max_delay;
+    }
+  }
+
+  if (0 == ack_every) {
+    FlushAcks(channel);
+    m_ack_coalescers.erase(channel);
+    return;
+  }
+
+  ack_coalescer_map_t::iterator it = m_ack_coalescers.find(channel);
+  if (m_ack_coalescers.end() == it) {
+    // Deliveries already handed out may be acked in any order, so they are
+    // acked one at a time as before
+    const boost::uint64_t base =
+        channel < m_delivery_tags.size() ? m_delivery_tags[channel] : 0;
+    ack_coalescer_t coalescer;
+    coalescer.flushed_tag = base;
+    coalescer.contiguous_tag = base;
+    it = m_ack_coalescers.insert(std::make_pair(channel, coalescer)).first;
+  }
+  it->second.ack_every = ack_every;
+  it->second.max_delay = max_delay;
+}
+
+void ChannelImpl::SettleDelivery(ack_coalescer_t &coalescer,
+                                 boost::uint64_t delivery_tag, bool multiple,
+                                 bool acked) {
+  if (multiple) {
+    coalescer.contiguous_tag = std::max(coalescer.contiguous_tag, delivery_tag);
+  } else if (delivery_tag == coalescer.contiguous_tag + 1) {
+    coalescer.contiguous_tag = delivery_tag;
+  } else if (delivery_tag > coalescer.contiguous_tag) {
+    coalescer.acked_ahead.insert(delivery_tag);
+    if (acked) {
+      coalescer.unsent_ahead.insert(delivery_tag);
+    }
+    return;
+  }
+
+  while (!coalescer.acked_ahead.empty() &&
+         *coalescer.acked_ahead.begin() <= coalescer.contiguous_tag + 1) {
+    coalescer.contiguous_tag =
+        std::max(coalescer.contiguous_tag, *coalescer.acked_ahead.begin());
+    coalescer.acked_ahead.erase(coalescer.acked_ahead.begin());
+  }
+  // Covered by the next multiple ack, if they weren't sent already
+  coalescer.unsent_ahead.erase(
+      coalescer.unsent_ahead.begin(),
+      coalescer.unsent_ahead.upper_bound(coalescer.contiguous_tag));
+}
+
+void ChannelImpl::Ack(amqp_channel_t channel, boost::uint64_t delivery_tag,
+                      bool multiple) {
+  if (m_frame_trace) {
+    m_frame_trace->Record(FrameTrace::fe_acked, channel, AMQP_FRAME_METHOD,
+                          AMQP_BASIC_ACK_METHOD, delivery_tag);
+  }
+  CountSettled(channel, delivery_tag, multiple);
+  ack_coalescer_map_t::iterator it = m_ack_coalescers.find(channel);
+  if (m_ack_coalescers.end() == it || delivery_tag <= it->second.flushed_tag) {
+    CheckForError(
+        amqp_basic_ack(m_connection, channel, delivery_tag, multiple));
+    CountFramesWritten(1);
+    return;
+  }
+
+  ack_coalescer_t &coalescer = it->second;
+  const bool was_flushed = !coalescer.HasPending();
+  if (multiple) {
+    CheckForError(amqp_basic_ack(m_connection, channel, delivery_tag, true));
+    CountFramesWritten(1);
+    SettleDelivery(coalescer, delivery_tag, true, true);
+    coalescer.flushed_tag = delivery_tag;
+    coalescer.settled_ahead.erase(
+        coalescer.settled_ahead.begin(),
+        coalescer.settled_ahead.upper_bound(coalescer.flushed_tag));
+  } else {
+    SettleDelivery(coalescer, delivery_tag, false, true);
+  }
+
+  if (!coalescer.HasPending()) {
+    return;
+  }
+  const boost::chrono::steady_clock::time_point now =
+      boost::chrono::steady_clock::now();
+  if (was_flushed || multiple) {
+    coalescer.oldest_pending = now;
+  }
+  // Acks held back past a gap count too, the gap may be a delivery that is
+  // only acked once more are delivered, which needs them sent
+  if (coalescer.contiguous_tag - coalescer.flushed_tag +
+              coalescer.unsent_ahead.size() >=
+          coalescer.ack_every ||
+      (coalescer.max_delay != boost::chrono::microseconds::max() &&
+       now - coalescer.oldest_pending >= coalescer.max_delay)) {
+    FlushAcks(channel);
+  }
+}
+
+void ChannelImpl::Reject(amqp_channel_t channel, boost::uint64_t delivery_tag,
+                         bool requeue, bool multiple) {
+  CountSettled(channel, delivery_tag, multiple);
+  ack_coalescer_map_t::iterator it = m_ack_coalescers.find(channel);
+  if (m_ack_coalescers.end() != it) {
+    // A multiple nack would otherwise take in deliveries that were acked
+    FlushAcks(channel);
+  }
+
+  amqp_basic_nack_t req;
+  req.delivery_tag = delivery_tag;
+  req.multiple = multiple;
+  req.requeue = requeue;
+
+  CheckForError(SendMethod(channel, AMQP_BASIC_NACK_METHOD, &req));
+
+  if (m_ack_coalescers.end() != it && delivery_tag > it->second.flushed_tag) {
+    ack_coalescer_t &coalescer = it->second;
+    // Moves contiguous_tag on, but is never acked
+    SettleDelivery(coalescer, delivery_tag, multiple, false);
+    if (multiple) {
+      coalescer.flushed_tag = delivery_tag;
+      coalescer.settled_ahead.erase(
+          coalescer.settled_ahead.begin(),
+          coalescer.settled_ahead.upper_bound(coalescer.flushed_tag));
+    } else {
+      coalescer.settled_ahead.insert(delivery_tag);
+    }
+  }
+}
+
+namespace {
+// How often the prefetch count of a consumer is looked at again
+const boost::chrono::seconds PREFETCH_TUNING_INTERVAL(1);
+}  // namespace
+
+void ChannelImpl::SetAdaptivePrefetch(amqp_channel_t channel,
+                                      boost::uint16_t max_prefetch_count) {
+  // Kept with the consumer, so it is turned on again after a recovery
+  std::string consumer_tag;
+  boost::uint16_t prefetch_count = 0;
+  for (consumer_map_t::iterator it = m_consumer_channel_map.begin();
+       it != m_consumer_channel_map.end(); ++it) {
+    if (channel == it->second.channel) {
+      it->second.max_prefetch_count = max_prefetch_count;
+      consumer_tag = it->first;
+      prefetch_count = it->second.params.prefetch_count;
+    }
+  }
+
+  if (0 == max_prefetch_count) {
+    m_prefetch_tuners.erase(channel);
+    return;
+  }
+
+  prefetch_tuner_map_t::iterator it = m_prefetch_tuners.find(channel);
+  if (m_prefetch_tuners.end() == it) {
+    prefetch_tuner_t tuner;
+    tuner.consumer_tag = consumer_tag;
+    tuner.prefetch_count = prefetch_count;
+    tuner.settled = 0;
+    tuner.settled_tag =
+        channel < m_delivery_tags.size() ? m_delivery_tags[channel] : 0;
+    tuner.window_start = boost::chrono::steady_clock::now();
+    tuner.rate = 0.0;
+    tuner.round_trip = boost::chrono::microseconds::zero();
+    it = m_prefetch_tuners.insert(std::make_pair(channel, tuner)).first;
+  }
+  it->second.max_prefetch_count = max_prefetch_count;
+}
+
+void ChannelImpl::SetConsumerPriority(amqp_channel_t channel, int priority,
+                                      unsigned int weight) {
+  // Kept with the consumer, so it is set again after a recovery
+  for (consumer_map_t::iterator it = m_consumer_channel_map.begin();
+       it != m_consumer_channel_map.end(); ++it) {
+    if (channel == it->second.channel) {
+      it->second.priority = priority;
+      it->second.weight = weight;
+    }
+  }
+
+  consumer_schedule_t &schedule = GetSchedule(channel);
+  schedule.priority = priority;
+  schedule.weight = weight;
+  schedule.current_weight = 0;
+  m_consumer_scheduling = true;
+}
+
+ChannelImpl::consumer_schedule_t &ChannelImpl::GetSchedule(
+    amqp_channel_t channel) {
+  if (m_consumer_schedules.size() <= channel) {
+    const consumer_schedule_t none = {0, 1, 0};
+    m_consumer_schedules.resize(channel + 1, none);
+  }
+  return m_consumer_schedules[channel];
+}
+
+void ChannelImpl::CountSettled(amqp_channel_t channel,
+                               boost::uint64_t delivery_tag, bool multiple) {
+  prefetch_tuner_map_t::iterator it = m_prefetch_tuners.find(channel);
+  if (m_prefetch_tuners.end() == it) {
+    return;
+  }
+  prefetch_tuner_t &tuner = it->second;
+  if (!multiple) {
+    ++tuner.settled;
+  } else if (delivery_tag > tuner.settled_tag) {
+    // Tags acked singly out of order before this one are counted again,
+    // which only makes the consumer look faster for a window
+    tuner.settled += delivery_tag - tuner.settled_tag;
+  }
+  tuner.settled_tag = std::max(tuner.settled_tag, delivery_tag);
+}
+
+bool ChannelImpl::TunePrefetch(amqp_channel_t channel,
+                               std::string &consumer_tag,
+                               boost::uint16_t &prefetch_count) {
+  prefetch_tuner_map_t::iterator it = m_prefetch_tuners.find(channel);
+  if (m_prefetch_tuners.end() == it) {
+    return false;
+  }
+  prefetch_tuner_t &tuner = it->second;
+  const boost::chrono::steady_clock::time_point now =
+      boost::chrono::steady_clock::now();
+  if (now - tuner.window_start < PREFETCH_TUNING_INTERVAL) {
+    return false;
+  }
+
+  const double window =
+      boost::chrono::duration<double>(now - tuner.window_start).count();
+  const double window_rate = static_cast<double>(tuner.settled) / window;
+  tuner.rate =
+      (0.0 == tuner.rate ? window_rate : (tuner.rate + window_rate) / 2);
+  tuner.settled = 0;
+  tuner.window_start = now;
+
+  consumer_tag = tuner.consumer_tag;
+  if (boost::chrono::microseconds::zero() == tuner.round_trip) {
+    // Sent with the count there is now to measure the round trip
+    prefetch_count = tuner.prefetch_count;
+    return true;
+  }
+
+  // Messages processed in one round trip, twice over so there are always more
+  // on the way, and the one being processed
+  const double round_trip =
+      boost::chrono::duration<double>(tuner.round_trip).count();
+  const double target = tuner.rate * round_trip * 2 + 1;
+  const boost::uint16_t count =
+      (target >= tuner.max_prefetch_count
+           ? tuner.max_prefetch_count
+           : static_cast<boost::uint16_t>(target));
+  // 0 is no limit at all
+  const boost::uint16_t current =
+      (0 == tuner.prefetch_count ? tuner.max_prefetch_count
+                                 : tuner.prefetch_count);
+  const boost::uint16_t difference =
+      (count > current ? count - current : current - count);
+  if (0 == difference || difference * 4 < current) {
+    return false;
+  }
+  prefetch_count = count;
+  return true;
+}
+
+void ChannelImpl::RecordQos(amqp_channel_t channel,
+                            boost::uint16_t prefetch_count,
+                            boost::chrono::microseconds round_trip) {
+  prefetch_tuner_map_t::iterator it = m_prefetch_tuners.find(channel);
+  if (m_prefetch_tuners.end() != it) {
+    it->second.prefetch_count = prefetch_count;
+    // Never zero, that is taken to be not measured yet
+    it->second.round_trip =
+        std::max(round_trip, boost::chrono::microseconds(1));
+  }
+}
+
+void ChannelImpl::FlushAcks(amqp_channel_t channel) {
+  ack_coalescer_map_t::iterator it = m_ack_coalescers.find(channel);
+  if (m_ack_coalescers.end() == it || !it->second.HasPending()) {
+    return;
+  }
+  ack_coalescer_t &coalescer = it->second;
+  if (coalescer.contiguous_tag != coalescer.flushed_tag) {
+    // The highest tag that still needs acking, those above it are settled
+    boost::uint64_t ack_tag = coalescer.contiguous_tag;
+    while (ack_tag > coalescer.flushed_tag &&
+           0 != coalescer.settled_ahead.count(ack_tag)) {
+      --ack_tag;
+    }
+    if (ack_tag > coalescer.flushed_tag) {
+      CheckForError(amqp_basic_ack(m_connection, channel, ack_tag, true));
+      CountFramesWritten(1);
+    }
+    coalescer.flushed_tag = coalescer.contiguous_tag;
+    coalescer.settled_ahead.erase(
+        coalescer.settled_ahead.begin(),
+        coalescer.settled_ahead.upper_bound(coalescer.flushed_tag));
+  }
+  // Past a gap a multiple ack would take in the unacked deliveries, so these
+  // go one at a time. They stay in acked_ahead so that contiguous_tag still
+  // moves past them once the gap is filled.
+  while (!coalescer.unsent_ahead.empty()) {
+    CheckForError(amqp_basic_ack(m_connection, channel,
+                                 *coalescer.unsent_ahead.begin(), false));
+    CountFramesWritten(1);
+    coalescer.settled_ahead.insert(*coalescer.unsent_ahead.begin());
+    coalescer.unsent_ahead.erase(coalescer.unsent_ahead.begin());
+  }
+}
+
+void ChannelImpl::FlushAllAcks() {
+  for (ack_coalescer_map_t::iterator it = m_ack_coalescers.begin();
+       it != m_ack_coalescers.end(); ++it) {
+    FlushAcks(it->first);
+  }
+}
+
+bool ChannelImpl::HasQueuedFramesOnChannel(amqp_channel_t channel) const {
+  return NULL != FindFrameQueue(channel);
+}
+
+bool ChannelImpl::HasQueuedDeliveryOnChannel(amqp_channel_t channel) const {
+  // Only the last basic.deliver queued can still be missing frames
+  const frame_queue_t *queue = FindFrameQueue(channel);
+  if (NULL == queue || IsAssemblingMessage(channel)) {
+    return false;
+  }
+  for (frame_queue_t::const_iterator it = queue->begin(); it != queue->end();
+       ++it) {
+    if (is_method(*it, AMQP_BASIC_DELIVER_METHOD) ||
+        is_method(*it, AMQP_BASIC_CANCEL_METHOD)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 void ChannelImpl::MaybeReleaseBuffersOnChannel(amqp_channel_t channel) {
-  if (m_frame_queue.end() ==
-      std::find_if(m_frame_queue.begin(), m_frame_queue.end(),
-                   boost::bind(&ChannelImpl::is_on_channel, _1, channel))) {
+  if (!HasQueuedFramesOnChannel(channel)) {
     amqp_maybe_release_buffers_on_channel(m_connection, channel);
   }
 }
 
+amqp_channel_t ChannelImpl::GetConfirmChannel() {
+  if (0 != m_confirm_channel && IsChannelOpen(m_confirm_channel)) {
+    return m_confirm_channel;
+  }
+
+  // The previous channel was closed underneath us, anything outstanding on it
+  // will never be confirmed.
+  FailPendingConfirms();
+
+  // A fresh channel is used as the broker numbers published messages starting
+  // at 1 from when confirm.select is sent.
+  m_confirm_channel = CreateNewChannel();
+  SetChannelState(m_confirm_channel, CS_Used);
+  m_next_confirm_tag = 1;
+  m_returned_message.reset();
+  return m_confirm_channel;
+}
+
+boost::uint64_t ChannelImpl::AddPendingConfirm(
+    const Channel::confirm_callback_t &callback) {
+  return AddPendingConfirm(callback, std::string(), std::string(),
+                           BasicMessage::ptr_t(), false, false);
+}
+
+boost::uint64_t ChannelImpl::AddPendingConfirm(
+    const Channel::confirm_callback_t &callback, const std::string &exchange,
+    const std::string &routing_key, const BasicMessage::ptr_t &message,
+    bool mandatory, bool immediate) {
+  pending_confirm_t pending;
+  pending.sequence = m_next_publish_seq++;
+  pending.callback = callback;
+  pending.mandatory = mandatory;
+  pending.immediate = immediate;
+  if (m_metrics) {
+    pending.published_at = boost::chrono::steady_clock::now();
+  }
+  if (message && m_recovery_enabled &&
+      m_recovery_options.republish_unconfirmed) {
+    pending.message = message;
+    pending.exchange = exchange;
+    pending.routing_key = routing_key;
+  }
+  InsertPendingConfirm(pending);
+  return pending.sequence;
+}
+
+void ChannelImpl::InsertPendingConfirm(const pending_confirm_t &pending) {
+  m_pending_confirms.insert(std::make_pair(m_next_confirm_tag++, pending));
+}
+
+void ChannelImpl::SetPublishBackPressure(bool enabled,
+                                         std::size_t max_unconfirmed,
+                                         Channel::back_pressure_t policy) {
+  m_publish_back_pressure = enabled;
+  m_max_unconfirmed = max_unconfirmed;
+  m_back_pressure_policy = policy;
+}
+
+bool ChannelImpl::WaitForPublishRoom() {
+  if (!m_publish_back_pressure) {
+    return true;
+  }
+
+  // Both connection.blocked and the confirms that make room may be waiting
+  ReadAvailableFrames();
+  ProcessBufferedConfirms();
+
+  for (;;) {
+    const bool full = 0 != m_max_unconfirmed &&
+                      m_pending_confirms.size() >= m_max_unconfirmed;
+    if (!full && !m_is_blocked) {
+      return true;
+    }
+
+    switch (m_back_pressure_policy) {
+      case Channel::bp_fail:
+        throw BackPressureException(
+            m_is_blocked ? "the connection is blocked: " + m_blocked_reason
+                         : "too many messages waiting to be confirmed");
+      case Channel::bp_drop:
+        return false;
+      case Channel::bp_block:
+        break;
+    }
+
+    // Corked messages may be the ones the broker has yet to confirm
+    SetSocketCork(false);
+    if (full) {
+      WaitForConfirms(m_pending_confirms.begin()->second.sequence,
+                      boost::chrono::microseconds::max());
+    } else {
+      amqp_frame_t frame;
+      GetNextFrameFromBroker(frame, boost::chrono::microseconds::max());
+      HandleFrameFromBroker(frame);
+    }
+  }
+}
+
+boost::uint64_t ChannelImpl::DropPublish(
+    const Channel::confirm_callback_t &callback) {
+  boost::uint64_t sequence = m_next_publish_seq++;
+  if (callback) {
+    callback(sequence, Channel::pc_dropped);
+  }
+  return sequence;
+}
+
+void ChannelImpl::ProcessBufferedConfirms() {
+  static const boost::array<boost::uint32_t, 3> CONFIRM_RESPONSES = {
+      {AMQP_BASIC_ACK_METHOD, AMQP_BASIC_NACK_METHOD, AMQP_BASIC_RETURN_METHOD}};
+  boost::array<amqp_channel_t, 1> channels = {{m_confirm_channel}};
+
+  try {
+    // Only look at what has already been read off of the socket or is
+    // waiting in the connection's buffer, this must never block.
+    while (!m_pending_confirms.empty() &&
+           (HasQueuedFramesOnChannel(m_confirm_channel) ||
+            amqp_data_in_buffer(m_connection) ||
+            amqp_frames_enqueued(m_connection))) {
+      amqp_frame_t frame;
+      if (!GetMethodOnChannel(channels, frame, CONFIRM_RESPONSES,
+                              boost::chrono::microseconds(0))) {
+        break;
+      }
+      HandleConfirmFrame(frame);
+    }
+  } catch (...) {
+    CheckConfirmChannelClosed();
+    throw;
+  }
+  MaybeReleaseBuffersOnChannel(m_confirm_channel);
+}
+
+bool ChannelImpl::WaitForConfirms(boost::uint64_t sequence,
+                                  boost::chrono::microseconds timeout) {
+  static const boost::array<boost::uint32_t, 3> CONFIRM_RESPONSES = {
+      {AMQP_BASIC_ACK_METHOD, AMQP_BASIC_NACK_METHOD, AMQP_BASIC_RETURN_METHOD}};
+
+  if (IsConfirmed(sequence)) {
+    return true;
+  }
+  boost::array<amqp_channel_t, 1> channels = {{m_confirm_channel}};
+
+  boost::chrono::steady_clock::time_point end_point;
+  boost::chrono::microseconds timeout_left = timeout;
+  if (timeout != boost::chrono::microseconds::max()) {
+    end_point = boost::chrono::steady_clock::now() + timeout;
+  }
+
+  try {
+    while (!IsConfirmed(sequence)) {
+      amqp_frame_t frame;
+      if (!GetMethodOnChannel(channels, frame, CONFIRM_RESPONSES,
+                              timeout_left)) {
+        break;
+      }
+      HandleConfirmFrame(frame);
+
+      if (timeout != boost::chrono::microseconds::max()) {
+        boost::chrono::steady_clock::time_point now =
+            boost::chrono::steady_clock::now();
+        if (now >= end_point) {
+          break;
+        }
+        timeout_left =
+            boost::chrono::duration_cast<boost::chrono::microseconds>(
+                end_point - now);
+      }
+    }
+  } catch (...) {
+    CheckConfirmChannelClosed();
+    throw;
+  }
+  MaybeReleaseBuffersOnChannel(m_confirm_channel);
+  return IsConfirmed(sequence);
+}
+
+bool ChannelImpl::IsConfirmed(boost::uint64_t sequence) const {
+  // Sequence numbers go up with the delivery tags
+  return m_pending_confirms.empty() ||
+         m_pending_confirms.begin()->second.sequence > sequence;
+}
+
+void ChannelImpl::HandleConfirmFrame(const amqp_frame_t &frame) {
+  switch (frame.payload.method.id) {
+    case AMQP_BASIC_ACK_METHOD: {
+      amqp_basic_ack_t *ack =
+          reinterpret_cast<amqp_basic_ack_t *>(frame.payload.method.decoded);
+      ConfirmPublished(ack->delivery_tag, ack->multiple,
+                       m_returned_message ? Channel::pc_returned
+                                          : Channel::pc_ack);
+      m_returned_message.reset();
+      break;
+    }
+    case AMQP_BASIC_NACK_METHOD: {
+      amqp_basic_nack_t *nack =
+          reinterpret_cast<amqp_basic_nack_t *>(frame.payload.method.decoded);
+      ConfirmPublished(nack->delivery_tag, nack->multiple, Channel::pc_nack);
+      m_returned_message.reset();
+      break;
+    }
+    case AMQP_BASIC_RETURN_METHOD:
+      // Kept until the basic.ack that follows so the confirm callback can get
+      // at the details with GetReturnedMessage()
+      m_returned_message = boost::make_shared<MessageReturnedException>(
+          CreateMessageReturnedException(
+              *reinterpret_cast<amqp_basic_return_t *>(
+                  frame.payload.method.decoded),
+              frame.channel));
+      break;
+  }
+}
+
+void ChannelImpl::ConfirmPublished(boost::uint64_t delivery_tag, bool multiple,
+                                   Channel::publish_confirm_t status) {
+  pending_confirm_map_t::iterator first;
+  pending_confirm_map_t::iterator last;
+  if (multiple) {
+    first = m_pending_confirms.begin();
+    last = m_pending_confirms.upper_bound(delivery_tag);
+  } else {
+    first = m_pending_confirms.find(delivery_tag);
+    if (m_pending_confirms.end() == first) {
+      return;
+    }
+    last = first;
+    ++last;
+  }
+
+  // Remove the confirmed range before invoking any callbacks so that a
+  // callback publishing another message sees consistent state
+  pending_confirm_map_t confirmed(first, last);
+  m_pending_confirms.erase(first, last);
+
+  const boost::chrono::steady_clock::time_point now =
+      m_metrics ? boost::chrono::steady_clock::now()
+                : boost::chrono::steady_clock::time_point();
+  for (pending_confirm_map_t::iterator it = confirmed.begin();
+       it != confirmed.end(); ++it) {
+    if (m_metrics) {
+      m_metrics->PublishConfirmed(
+          boost::chrono::duration_cast<boost::chrono::microseconds>(
+              now - it->second.published_at));
+    }
+    if (it->second.callback) {
+      // Only the message with the confirmed tag was returned, any others
+      // covered by a multiple ack were delivered
+      it->second.callback(it->second.sequence,
+                          (Channel::pc_returned == status &&
+                           it->first != delivery_tag)
+                              ? Channel::pc_ack
+                              : status);
+    }
+  }
+}
+
+void ChannelImpl::FailPendingConfirms() {
+  pending_confirm_map_t lost;
+  lost.swap(m_pending_confirms);
+
+  for (pending_confirm_map_t::iterator it = lost.begin(); it != lost.end();
+       ++it) {
+    if (it->second.callback) {
+      it->second.callback(it->second.sequence, Channel::pc_lost);
+    }
+  }
+}
+
+void ChannelImpl::CheckConfirmChannelClosed() {
+  if (0 != m_confirm_channel &&
+      (!m_is_connected || !IsChannelOpen(m_confirm_channel))) {
+    m_confirm_channel = 0;
+    if (!m_is_connected && m_recovery_enabled) {
+      // Left for RepublishUnconfirmed
+      return;
+    }
+    FailPendingConfirms();
+  }
+}
+
 void ChannelImpl::CheckIsConnected() {
   if (!m_is_connected) {
+    if (m_recovery_enabled && !m_recovering) {
+      Recover();
+      return;
+    }
     throw ConnectionClosedException();
   }
 }
 
+void ChannelImpl::EnableRecovery(
+    const std::vector<connection_params_t> &brokers,
+    const Channel::RecoveryOptions &options) {
+  m_recovery_brokers = brokers;
+  m_recovery_options = options;
+  m_recovery_enabled = true;
+}
+
+void ChannelImpl::DisableRecovery() {
+  m_recovery_enabled = false;
+  m_recovery_brokers.clear();
+  m_recorded_topology.clear();
+  m_server_named_queues.clear();
+  if (!m_is_connected) {
+    // Nothing is going to publish them again now
+    m_confirm_channel = 0;
+    FailPendingConfirms();
+  }
+}
+
+namespace {
+void SleepFor(boost::chrono::milliseconds delay) {
+#ifdef _WIN32
+  Sleep(static_cast<DWORD>(delay.count()));
+#else
+  struct timespec left;
+  left.tv_sec = static_cast<time_t>(delay.count() / 1000);
+  left.tv_nsec = static_cast<long>((delay.count() % 1000) * 1000000);
+  while (-1 == nanosleep(&left, &left) && EINTR == errno) {
+  }
+#endif
+}
+}  // namespace
+
+void ChannelImpl::Recover() {
+  m_recovering = true;
+  const boost::chrono::milliseconds max_delay(
+      std::max(0, m_recovery_options.max_delay));
+  boost::chrono::milliseconds delay(
+      std::max(0, m_recovery_options.initial_delay));
+
+  try {
+    for (int attempt = 0; 0 > m_recovery_options.max_attempts ||
+                          attempt < m_recovery_options.max_attempts;
+         ++attempt) {
+      if (0 != attempt) {
+        SleepFor(delay);
+        delay = std::min(delay * 2, max_delay);
+      }
+
+      for (std::vector<connection_params_t>::const_iterator broker =
+               m_recovery_brokers.begin();
+           broker != m_recovery_brokers.end(); ++broker) {
+        try {
+          ResetConnection();
+          Connect(*broker);
+          ReplayTopology();
+          ReplayConsumers();
+          RepublishUnconfirmed();
+          m_recovering = false;
+          return;
+        } catch (AmqpLibraryException &) {
+          // Each of these means the broker can't be used for now
+        } catch (AmqpResponseLibraryException &) {
+        } catch (ConnectionException &) {
+        }
+      }
+    }
+  } catch (...) {
+    m_recovering = false;
+    throw;
+  }
+
+  ResetConnection();
+  m_recovering = false;
+  throw ConnectionClosedException();
+}
+
+void ChannelImpl::AbortConnection() {
+  if (NULL != m_connection && m_is_connected) {
+    // A connection.close is on channel 0, so it may follow a message left
+    // unfinished on another channel. Whatever it returns, the connection is
+    // thrown away.
+    amqp_connection_close(m_connection, AMQP_INTERNAL_ERROR);
+  }
+  ResetConnection();
+}
+
+void ChannelImpl::ResetConnection() {
+  if (NULL != m_connection) {
+    amqp_destroy_connection(m_connection);
+    m_connection = NULL;
+  }
+  SetIsConnected(false);
+  m_socket_corked = false;
+
+  // Whatever was on its way from the broker will be sent again, messages
+  // that weren't acked are requeued
+  m_frame_queues.clear();
+  m_assemblies.clear();
+  m_assembling_messages = 0;
+  m_delivered_messages.clear();
+  m_buffered.clear();
+  m_buffered_total.bytes = 0;
+  m_buffered_total.messages = 0;
+  m_full_channels = 0;
+  ReportQueueDepth(-static_cast<std::ptrdiff_t>(m_queued_frames),
+                   -static_cast<std::ptrdiff_t>(m_queued_envelopes));
+  m_queued_frames = 0;
+  m_queued_envelopes = 0;
+  m_flow_stopped.clear();
+  m_delivery_tags.clear();
+  m_ack_coalescers.clear();
+  m_prefetch_tuners.clear();
+  m_consumer_schedules.clear();
+  m_declaration_cache.clear();
+  m_returned_message.reset();
+  m_confirm_channel = 0;
+  // A new connection starts out unblocked
+  m_is_blocked = false;
+  m_blocked_reason.clear();
+  RetireChannels();
+}
+
+void ChannelImpl::ReplayTopology() {
+  amqp_channel_t channel = 0;
+  // The same order as they would have been declared in: exchanges and
+  // queues before what binds them
+  for (int kind = Topology::dk_exchange; kind <= Topology::dk_exchange_binding;
+       ++kind) {
+    std::vector<std::pair<std::string, std::string> > renamed;
+    for (declaration_cache_t::iterator it = m_recorded_topology.begin();
+         it != m_recorded_topology.end();) {
+      if (kind != it->second.kind) {
+        ++it;
+        continue;
+      }
+
+      Topology::declaration_t declaration = it->second;
+      const bool server_named =
+          Topology::dk_queue == kind &&
+          0 != m_server_named_queues.count(declaration.name);
+      if (server_named) {
+        declaration.name.clear();
+      }
+
+      if (0 == channel) {
+        channel = GetChannel();
+      }
+      const boost::array<amqp_channel_t, 1> channels = {{channel}};
+      try {
+        const boost::array<amqp_method_number_t, 1> reply = {
+            {SendDeclaration(channel, declaration, false)}};
+        amqp_frame_t response;
+        GetMethodOnChannel(channels, response, reply);
+
+        if (server_named) {
+          amqp_queue_declare_ok_t *declare_ok =
+              (amqp_queue_declare_ok_t *)response.payload.method.decoded;
+          renamed.push_back(std::make_pair(
+              it->first, std::string((char *)declare_ok->queue.bytes,
+                                     declare_ok->queue.len)));
+        }
+        MaybeReleaseBuffersOnChannel(channel);
+        ++it;
+      } catch (ChannelException &) {
+        // Refused by the broker (for example: a binding to an exchange that
+        // has been deleted), which closed the channel. It's dropped.
+        channel = 0;
+        if (server_named) {
+          m_server_named_queues.erase(it->first);
+        }
+        m_recorded_topology.erase(it++);
+      }
+    }
+
+    for (std::vector<std::pair<std::string, std::string> >::const_iterator
+             it = renamed.begin();
+         it != renamed.end(); ++it) {
+      RenameQueue(it->first, it->second);
+    }
+  }
+
+  if (0 != channel) {
+    ReturnChannel(channel);
+  }
+}
+
+void ChannelImpl::RenameQueue(const std::string &old_name,
+                              const std::string &new_name) {
+  std::vector<Topology::declaration_t> moved;
+  std::pair<declaration_cache_t::iterator, declaration_cache_t::iterator>
+      range = m_recorded_topology.equal_range(old_name);
+  for (declaration_cache_t::iterator it = range.first; it != range.second;) {
+    if (Topology::dk_queue == it->second.kind ||
+        Topology::dk_queue_binding == it->second.kind) {
+      moved.push_back(it->second);
+      moved.back().name = new_name;
+      m_recorded_topology.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  for (std::vector<Topology::declaration_t>::const_iterator it = moved.begin();
+       it != moved.end(); ++it) {
+    m_recorded_topology.insert(std::make_pair(new_name, *it));
+  }
+
+  m_server_named_queues.erase(old_name);
+  m_server_named_queues.insert(new_name);
+
+  for (consumer_map_t::iterator it = m_consumer_channel_map.begin();
+       it != m_consumer_channel_map.end(); ++it) {
+    if (old_name == it->second.params.queue) {
+      it->second.params.queue = new_name;
+    }
+  }
+}
+
+void ChannelImpl::ReplayConsumers() {
+  consumer_map_t consumers;
+  consumers.swap(m_consumer_channel_map);
+  for (handle_channels_map_t::iterator it = m_handle_channels.begin();
+       it != m_handle_channels.end(); ++it) {
+    it->second.clear();
+  }
+
+  for (consumer_map_t::const_iterator it = consumers.begin();
+       it != consumers.end(); ++it) {
+    try {
+      StartConsumer(it->first, it->second.params, it->second.handle);
+      if (0 != it->second.ack_every) {
+        SetAckCoalescing(GetConsumerChannel(it->first), it->second.ack_every,
+                         it->second.ack_max_delay);
+      }
+      if (0 != it->second.max_prefetch_count) {
+        SetAdaptivePrefetch(GetConsumerChannel(it->first),
+                            it->second.max_prefetch_count);
+      }
+      if (0 != it->second.priority || 1 != it->second.weight) {
+        SetConsumerPriority(GetConsumerChannel(it->first),
+                            it->second.priority, it->second.weight);
+      }
+    } catch (ChannelException &) {
+      // Refused by the broker (for example: its queue has been deleted), the
+      // consumer is gone
+    } catch (...) {
+      // Those not started yet are started on the next attempt
+      for (consumer_map_t::const_iterator rest = it; rest != consumers.end();
+           ++rest) {
+        m_consumer_channel_map.insert(*rest);
+        m_handle_channels[rest->second.handle].insert(rest->second.channel);
+      }
+      throw;
+    }
+  }
+}
+
+void ChannelImpl::RepublishUnconfirmed() {
+  if (m_pending_confirms.empty()) {
+    return;
+  }
+
+  // Left as they are until all of them have been published, should the
+  // connection be lost again partway through
+  pending_confirm_map_t lost;
+  pending_confirm_map_t republished;
+  boost::uint64_t confirm_tag = 1;
+  for (pending_confirm_map_t::const_iterator it = m_pending_confirms.begin();
+       it != m_pending_confirms.end(); ++it) {
+    if (!it->second.message) {
+      lost.insert(*it);
+      continue;
+    }
+    if (0 == m_confirm_channel) {
+      m_confirm_channel = CreateNewChannel();
+      SetChannelState(m_confirm_channel, CS_Used);
+    }
+    PublishMessage(m_confirm_channel, it->second.exchange,
+                   it->second.routing_key, it->second.mandatory,
+                   it->second.immediate, *it->second.message);
+    republished.insert(std::make_pair(confirm_tag++, it->second));
+  }
+
+  m_pending_confirms.swap(republished);
+  m_next_confirm_tag = confirm_tag;
+
+  for (pending_confirm_map_t::iterator it = lost.begin(); it != lost.end();
+       ++it) {
+    if (it->second.callback) {
+      it->second.callback(it->second.sequence, Channel::pc_lost);
+    }
+  }
+}
+
 namespace {
 bool bytesEqual(amqp_bytes_t r, amqp_bytes_t l) {
   if (r.len == l.len) {
@@ -0,0 +1,255 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// Put these first to avoid warnings about INT#_C macro redefinition
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Winsock2.h>
+#else
+#include <errno.h>
+#include <poll.h>
+#endif
+
+#include "SimpleAmqpClient/ChannelSelector.h"
+
+#include "SimpleAmqpClient/ChannelImpl.h"
+
+#include <boost/chrono.hpp>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <vector>
+
+namespace AmqpClient {
+namespace Detail {
+
+#ifdef _WIN32
+typedef WSAPOLLFD pollfd_t;
+#else
+typedef struct pollfd pollfd_t;
+#endif
+
+class ChannelSelectorImpl : boost::noncopyable {
+ public:
+  typedef std::vector<Channel::ptr_t> channel_list_t;
+
+  // Appends the Channels that have a message waiting, or whose connection
+  // has unread data or is closed, without waiting
+  std::size_t FindReady(channel_list_t &ready) const;
+  // Appends the Channels on the connections whose sockets are readable,
+  // waiting for up to timeout. When the shortest heartbeat interval is
+  // sooner and passes first, appends those on connections with heartbeats.
+  std::size_t PollSockets(channel_list_t &ready,
+                          boost::chrono::microseconds timeout);
+
+  channel_list_t m_channels;
+
+ private:
+  static int Poll(std::vector<pollfd_t> &fds, int timeout_ms);
+  void AppendChannelsOn(const ChannelImpl *impl, channel_list_t &ready) const;
+};
+
+std::size_t ChannelSelectorImpl::FindReady(channel_list_t &ready) const {
+  std::size_t count = 0;
+  for (channel_list_t::const_iterator it = m_channels.begin();
+       it != m_channels.end(); ++it) {
+    const ChannelImpl &impl = *(*it)->m_impl;
+    // A Channel on a lost connection is reported, it throws the error when
+    // it is next used
+    if (!impl.IsConnected() || (impl.HasUnreadData() && impl.WantsToRead()) ||
+        impl.HasDeliveryReady(impl.GetAllConsumerChannels((*it)->m_handle))) {
+      ready.push_back(*it);
+      ++count;
+    }
+  }
+  return count;
+}
+
+std::size_t ChannelSelectorImpl::PollSockets(
+    channel_list_t &ready, boost::chrono::microseconds timeout) {
+  // Channels sharing a connection share its socket, which is only polled once
+  std::vector<pollfd_t> fds;
+  std::vector<const ChannelImpl *> polled;
+  // The connections fds are for, in the same order
+  std::vector<const ChannelImpl *> watched;
+  boost::chrono::microseconds heartbeat_interval =
+      boost::chrono::microseconds::max();
+  for (channel_list_t::const_iterator it = m_channels.begin();
+       it != m_channels.end(); ++it) {
+    const ChannelImpl *impl = (*it)->m_impl.get();
+    if (polled.end() != std::find(polled.begin(), polled.end(), impl)) {
+      continue;
+    }
+    polled.push_back(impl);
+    heartbeat_interval = std::min(heartbeat_interval,
+                                  impl->HeartbeatPollInterval());
+    // At its buffer limits a connection's socket stays readable until
+    // deliveries are consumed, it is only woken up for heartbeats
+    if (!impl->WantsToRead()) {
+      continue;
+    }
+    watched.push_back(impl);
+    pollfd_t fd = {};
+    fd.fd = amqp_get_sockfd(impl->m_connection);
+    fd.events = POLLIN;
+    fds.push_back(fd);
+  }
+
+  const bool heartbeat_first = heartbeat_interval < timeout;
+  const boost::chrono::microseconds wait =
+      heartbeat_first ? heartbeat_interval : timeout;
+  int timeout_ms = -1;
+  if (boost::chrono::microseconds::max() != wait) {
+    // Rounded up, so a short wait doesn't become a busy loop
+    timeout_ms = static_cast<int>(std::min<boost::chrono::microseconds::rep>(
+        (wait.count() + 999) / 1000, std::numeric_limits<int>::max()));
+  }
+
+  if (0 >= Poll(fds, timeout_ms)) {
+    if (!heartbeat_first) {
+      return 0;
+    }
+    // Heartbeats are sent by rabbitmq-c as the Channel reads
+    const std::size_t before = ready.size();
+    for (std::vector<const ChannelImpl *>::const_iterator it = polled.begin();
+         it != polled.end(); ++it) {
+      if (boost::chrono::microseconds::max() !=
+          (*it)->HeartbeatPollInterval()) {
+        AppendChannelsOn(*it, ready);
+      }
+    }
+    return ready.size() - before;
+  }
+
+  const std::size_t before = ready.size();
+  for (std::size_t i = 0; i < fds.size(); ++i) {
+    if (0 != fds[i].revents) {
+      AppendChannelsOn(watched[i], ready);
+    }
+  }
+  return ready.size() - before;
+}
+
+int ChannelSelectorImpl::Poll(std::vector<pollfd_t> &fds, int timeout_ms) {
+#ifdef _WIN32
+  if (fds.empty()) {
+    // WSAPoll fails straight away without any sockets
+    Sleep(0 > timeout_ms ? INFINITE : static_cast<DWORD>(timeout_ms));
+    return 0;
+  }
+  return WSAPoll(&fds[0], static_cast<ULONG>(fds.size()), timeout_ms);
+#else
+  int ret = poll(fds.empty() ? NULL : &fds[0],
+                 static_cast<nfds_t>(fds.size()), timeout_ms);
+  // Interrupted, the caller works out how long is left and waits again
+  if (0 > ret && EINTR == errno) {
+    return 0;
+  }
+  return ret;
+#endif
+}
+
+void ChannelSelectorImpl::AppendChannelsOn(const ChannelImpl *impl,
+                                           channel_list_t &ready) const {
+  for (channel_list_t::const_iterator it = m_channels.begin();
+       it != m_channels.end(); ++it) {
+    if (impl == (*it)->m_impl.get()) {
+      ready.push_back(*it);
+    }
+  }
+}
+
+}  // namespace Detail
+
+ChannelSelector::ChannelSelector()
+    : m_impl(new Detail::ChannelSelectorImpl) {}
+
+ChannelSelector::~ChannelSelector() {}
+
+void ChannelSelector::Add(const Channel::ptr_t &channel) {
+  Detail::ChannelSelectorImpl::channel_list_t &channels = m_impl->m_channels;
+  if (channels.end() == std::find(channels.begin(), channels.end(), channel)) {
+    channels.push_back(channel);
+  }
+}
+
+void ChannelSelector::Remove(const Channel::ptr_t &channel) {
+  Detail::ChannelSelectorImpl::channel_list_t &channels = m_impl->m_channels;
+  channels.erase(std::remove(channels.begin(), channels.end(), channel),
+                 channels.end());
+}
+
+std::size_t ChannelSelector::Size() const { return m_impl->m_channels.size(); }
+
+std::size_t ChannelSelector::Wait(std::vector<Channel::ptr_t> &ready,
+                                  int timeout) {
+  boost::chrono::steady_clock::time_point end_point;
+  if (0 <= timeout) {
+    end_point =
+        boost::chrono::steady_clock::now() + boost::chrono::milliseconds(timeout);
+  }
+
+  // Nothing would ever wake it up
+  if (m_impl->m_channels.empty()) {
+    return 0;
+  }
+
+  for (;;) {
+    std::size_t count = m_impl->FindReady(ready);
+    if (0 < count) {
+      return count;
+    }
+
+    boost::chrono::microseconds timeout_left =
+        boost::chrono::microseconds::max();
+    if (0 <= timeout) {
+      const boost::chrono::steady_clock::time_point now =
+          boost::chrono::steady_clock::now();
+      timeout_left = now < end_point
+                         ? boost::chrono::duration_cast<
+                               boost::chrono::microseconds>(end_point - now)
+                         : boost::chrono::microseconds(0);
+    }
+
+    count = m_impl->PollSockets(ready, timeout_left);
+    if (0 < count || (0 <= timeout && boost::chrono::steady_clock::now() >=
+                                          end_point)) {
+      return count;
+    }
+  }
+}
+
+}  // namespace AmqpClient
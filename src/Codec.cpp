@@ -0,0 +1,265 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/Codec.h"
+
+#ifdef SAC_LZ4_SUPPORT_ENABLED
+#include <lz4.h>
+#endif
+#ifdef SAC_ZSTD_SUPPORT_ENABLED
+#include <zstd.h>
+#endif
+
+#include <boost/cstdint.hpp>
+#include <boost/make_shared.hpp>
+
+#include <new>
+#include <stdexcept>
+
+namespace AmqpClient {
+
+const std::size_t Codec::DEFAULT_MAX_BODY_SIZE = 128 * 1024 * 1024;
+
+Codec::~Codec() {}
+
+namespace {
+
+#ifdef SAC_LZ4_SUPPORT_ENABLED
+// The uncompressed length goes before the block, which doesn't record it
+const std::size_t LZ4_LENGTH_SIZE = 4;
+
+class Lz4Codec : public Codec {
+ public:
+  Lz4Codec(const std::string &dictionary, std::size_t max_body_size)
+      : m_dictionary(dictionary), m_max_body_size(max_body_size) {}
+  virtual ~Lz4Codec() {}
+
+  // Not "lz4", which would be taken for the LZ4 frame format
+  virtual std::string Name() const { return "x-lz4-block"; }
+
+  virtual void Compress(const char *data, std::size_t length,
+                        std::string &compressed) const {
+    if (length > static_cast<std::size_t>(LZ4_MAX_INPUT_SIZE)) {
+      throw std::runtime_error("Codec: body too large for LZ4");
+    }
+    const int input_size = static_cast<int>(length);
+    const int bound = LZ4_compressBound(input_size);
+    compressed.resize(LZ4_LENGTH_SIZE + bound);
+    for (std::size_t i = 0; i < LZ4_LENGTH_SIZE; ++i) {
+      compressed[i] = static_cast<char>((length >> (8 * i)) & 0xff);
+    }
+
+    char *block = &compressed[LZ4_LENGTH_SIZE];
+    int written;
+    if (m_dictionary.empty()) {
+      written = LZ4_compress_default(data, block, input_size, bound);
+    } else {
+      // Only the stream can be given a dictionary, one per call keeps the
+      // codec usable from several threads
+      LZ4_stream_t *stream = LZ4_createStream();
+      if (NULL == stream) {
+        throw std::bad_alloc();
+      }
+      LZ4_loadDict(stream, m_dictionary.data(),
+                   static_cast<int>(m_dictionary.size()));
+      written = LZ4_compress_fast_continue(stream, data, block, input_size,
+                                           bound, 1);
+      LZ4_freeStream(stream);
+    }
+    if (written <= 0) {
+      throw std::runtime_error("Codec: LZ4 compression failed");
+    }
+    compressed.resize(LZ4_LENGTH_SIZE + written);
+  }
+
+  virtual void Decompress(const char *data, std::size_t length,
+                          std::string &body) const {
+    if (length < LZ4_LENGTH_SIZE) {
+      throw std::runtime_error("Codec: truncated LZ4 body");
+    }
+    boost::uint32_t size = 0;
+    for (std::size_t i = 0; i < LZ4_LENGTH_SIZE; ++i) {
+      size |= static_cast<boost::uint32_t>(
+                  static_cast<unsigned char>(data[i]))
+              << (8 * i);
+    }
+    const std::size_t block_size = length - LZ4_LENGTH_SIZE;
+    // LZ4 can't do better than 255 to 1, a larger size is corrupt and
+    // shouldn't get as far as being allocated
+    if (size > static_cast<std::size_t>(LZ4_MAX_INPUT_SIZE) ||
+        size / 255 > block_size) {
+      throw std::runtime_error("Codec: corrupt LZ4 body");
+    }
+    if (size > m_max_body_size) {
+      throw std::runtime_error("Codec: LZ4 body too large to decompress");
+    }
+
+    body.resize(size);
+    if (0 == size) {
+      return;
+    }
+    const int output_size = static_cast<int>(size);
+    const int read =
+        m_dictionary.empty()
+            ? LZ4_decompress_safe(data + LZ4_LENGTH_SIZE, &body[0],
+                                  static_cast<int>(block_size), output_size)
+            : LZ4_decompress_safe_usingDict(
+                  data + LZ4_LENGTH_SIZE, &body[0],
+                  static_cast<int>(block_size), output_size,
+                  m_dictionary.data(), static_cast<int>(m_dictionary.size()));
+    if (read != output_size) {
+      throw std::runtime_error("Codec: corrupt LZ4 body");
+    }
+  }
+
+ private:
+  const std::string m_dictionary;
+  const std::size_t m_max_body_size;
+};
+#endif
+
+#ifdef SAC_ZSTD_SUPPORT_ENABLED
+class ZstdCodec : public Codec {
+ public:
+  ZstdCodec(int level, const std::string &dictionary,
+            std::size_t max_body_size)
+      : m_level(level),
+        m_max_body_size(max_body_size),
+        m_cdict(NULL),
+        m_ddict(NULL) {
+    if (dictionary.empty()) {
+      return;
+    }
+    // Digested once, the digested dictionaries are only read from after this
+    m_cdict =
+        ZSTD_createCDict(dictionary.data(), dictionary.size(), m_level);
+    m_ddict = ZSTD_createDDict(dictionary.data(), dictionary.size());
+    if (NULL == m_cdict || NULL == m_ddict) {
+      Release();
+      throw std::bad_alloc();
+    }
+  }
+  virtual ~ZstdCodec() { Release(); }
+
+  virtual std::string Name() const { return "zstd"; }
+
+  virtual void Compress(const char *data, std::size_t length,
+                        std::string &compressed) const {
+    compressed.resize(ZSTD_compressBound(length));
+    ZSTD_CCtx *context = ZSTD_createCCtx();
+    if (NULL == context) {
+      throw std::bad_alloc();
+    }
+    const std::size_t written =
+        NULL == m_cdict
+            ? ZSTD_compressCCtx(context, &compressed[0], compressed.size(),
+                                data, length, m_level)
+            : ZSTD_compress_usingCDict(context, &compressed[0],
+                                       compressed.size(), data, length,
+                                       m_cdict);
+    ZSTD_freeCCtx(context);
+    if (ZSTD_isError(written)) {
+      throw std::runtime_error(std::string("Codec: zstd compression failed: ") +
+                               ZSTD_getErrorName(written));
+    }
+    compressed.resize(written);
+  }
+
+  virtual void Decompress(const char *data, std::size_t length,
+                          std::string &body) const {
+    const unsigned long long size = ZSTD_getFrameContentSize(data, length);
+    if (ZSTD_CONTENTSIZE_ERROR == size || ZSTD_CONTENTSIZE_UNKNOWN == size ||
+        size > body.max_size()) {
+      throw std::runtime_error("Codec: corrupt zstd body");
+    }
+    // The frame's word for it, which is only checked once it has been
+    // allocated and decompressed into
+    if (size > m_max_body_size) {
+      throw std::runtime_error("Codec: zstd body too large to decompress");
+    }
+
+    body.resize(static_cast<std::size_t>(size));
+    ZSTD_DCtx *context = ZSTD_createDCtx();
+    if (NULL == context) {
+      throw std::bad_alloc();
+    }
+    char *output = body.empty() ? NULL : &body[0];
+    const std::size_t read =
+        NULL == m_ddict
+            ? ZSTD_decompressDCtx(context, output, body.size(), data, length)
+            : ZSTD_decompress_usingDDict(context, output, body.size(), data,
+                                         length, m_ddict);
+    ZSTD_freeDCtx(context);
+    if (ZSTD_isError(read) || read != body.size()) {
+      throw std::runtime_error("Codec: corrupt zstd body");
+    }
+  }
+
+ private:
+  void Release() {
+    ZSTD_freeCDict(m_cdict);
+    m_cdict = NULL;
+    ZSTD_freeDDict(m_ddict);
+    m_ddict = NULL;
+  }
+
+  const int m_level;
+  const std::size_t m_max_body_size;
+  ZSTD_CDict *m_cdict;
+  ZSTD_DDict *m_ddict;
+};
+#endif
+
+}  // namespace
+
+Codec::ptr_t Codec::CreateLz4(const std::string &dictionary,
+                             std::size_t max_body_size) {
+#ifdef SAC_LZ4_SUPPORT_ENABLED
+  return boost::make_shared<Lz4Codec>(dictionary, max_body_size);
+#else
+  (void)dictionary;
+  (void)max_body_size;
+  throw std::logic_error(
+      "LZ4 support has not been compiled into SimpleAmqpClient");
+#endif
+}
+
+Codec::ptr_t Codec::CreateZstd(int level, const std::string &dictionary,
+                              std::size_t max_body_size) {
+#ifdef SAC_ZSTD_SUPPORT_ENABLED
+  return boost::make_shared<ZstdCodec>(level, dictionary, max_body_size);
+#else
+  (void)level;
+  (void)dictionary;
+  (void)max_body_size;
+  throw std::logic_error(
+      "Zstandard support has not been compiled into SimpleAmqpClient");
+#endif
+}
+
+}  // namespace AmqpClient
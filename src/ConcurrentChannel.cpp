@@ -0,0 +1,763 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// Put these first to avoid warnings about INT#_C macro redefinition
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Winsock2.h>
+#else
+#include <fcntl.h>
+#include <sys/select.h>
+#include <unistd.h>
+#endif
+
+#include "SimpleAmqpClient/ConcurrentChannel.h"
+
+#include "SimpleAmqpClient/AmqpException.h"
+#include "SimpleAmqpClient/AmqpLibraryException.h"
+#include "SimpleAmqpClient/AmqpResponseLibraryException.h"
+#include "SimpleAmqpClient/ChannelImpl.h"
+#include "SimpleAmqpClient/ConsumerCancelledException.h"
+#include "SimpleAmqpClient/ConsumerTagNotFoundException.h"
+
+#include <boost/bind.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+namespace AmqpClient {
+namespace Detail {
+
+class ConcurrentChannelImpl : boost::noncopyable {
+ public:
+  ConcurrentChannelImpl(Channel::ptr_t channel, std::size_t worker_threads);
+  ~ConcurrentChannelImpl();
+
+  void Execute(const ConcurrentChannel::operation_t &operation);
+  void Post(const ConcurrentChannel::operation_t &operation);
+
+  // Both must be called from within Execute
+  void AddConsumer(const std::string &consumer_tag,
+                   const ConcurrentChannel::message_handler_t &handler);
+  void RemoveConsumer(const std::string &consumer_tag);
+
+  bool ConsumeMessage(const std::string &consumer_tag,
+                      Envelope::ptr_t &envelope, int timeout);
+
+ private:
+  // Deliveries for one consumer, waited on by application threads
+  struct delivery_queue_t {
+    delivery_queue_t() : cancelled(false), scheduled(false) {}
+
+    boost::mutex mutex;
+    boost::condition_variable available;
+    std::deque<Envelope::ptr_t> envelopes;
+    bool cancelled;
+    // Set when the consumer stopped because of an error
+    std::string error;
+    // When set envelopes are passed to handler by the worker threads instead
+    ConcurrentChannel::message_handler_t handler;
+    // Set while the queue is waiting for, or being handled by, a worker
+    bool scheduled;
+  };
+  typedef boost::shared_ptr<delivery_queue_t> delivery_queue_ptr_t;
+  typedef std::map<std::string, delivery_queue_ptr_t> delivery_queue_map_t;
+
+  void Run();
+  void RunCommands(std::vector<ConcurrentChannel::operation_t> &commands);
+  bool ReadDeliveries();
+  void Deliver(const std::vector<Envelope::ptr_t> &envelopes);
+  void WaitForActivity();
+  void Wakeup();
+
+  void StartWorkers();
+  void StopWorkers();
+  void RunWorker();
+  void Schedule(const delivery_queue_ptr_t &queue);
+
+  void CloseDeliveryQueue(const std::string &consumer_tag,
+                          const std::string &error);
+  void CloseDeadConsumers(const std::string &error);
+  void Fail(const std::string &error);
+  void CheckFailed();
+
+  Channel::ptr_t m_channel;
+
+  // Held by whichever thread is using m_channel
+  boost::mutex m_io_mutex;
+  // Consumers of m_channel, only used with m_io_mutex held
+  std::vector<std::string> m_consumer_tags;
+
+  // Guards the members up to m_failure
+  boost::mutex m_command_mutex;
+  boost::condition_variable m_executors_done;
+  std::vector<ConcurrentChannel::operation_t> m_commands;
+  int m_waiting_executors;
+  bool m_stopping;
+  bool m_failed;
+  std::string m_failure;
+
+  boost::mutex m_consumers_mutex;
+  delivery_queue_map_t m_consumers;
+
+  // Consumers with messages for their handler, in the order they are due to
+  // get a worker
+  boost::mutex m_ready_mutex;
+  boost::condition_variable m_ready;
+  std::deque<delivery_queue_ptr_t> m_ready_queues;
+  bool m_workers_stopping;
+  std::size_t m_worker_count;
+  boost::thread_group m_workers;
+
+#ifndef _WIN32
+  int m_wakeup_pipe[2];
+#endif
+  boost::thread m_thread;
+};
+
+ConcurrentChannelImpl::ConcurrentChannelImpl(Channel::ptr_t channel,
+                                             std::size_t worker_threads)
+    : m_channel(channel),
+      m_waiting_executors(0),
+      m_stopping(false),
+      m_failed(false),
+      m_workers_stopping(false),
+      m_worker_count(worker_threads) {
+  if (!m_channel) {
+    throw std::invalid_argument("ConcurrentChannel requires a Channel");
+  }
+#ifndef _WIN32
+  if (0 != pipe(m_wakeup_pipe)) {
+    throw std::runtime_error("Unable to create the I/O thread's wakeup pipe");
+  }
+  for (int i = 0; i < 2; ++i) {
+    fcntl(m_wakeup_pipe[i], F_SETFL,
+          fcntl(m_wakeup_pipe[i], F_GETFL) | O_NONBLOCK);
+  }
+#endif
+
+  m_thread = boost::thread(boost::bind(&ConcurrentChannelImpl::Run, this));
+}
+
+ConcurrentChannelImpl::~ConcurrentChannelImpl() {
+  // Handlers may still hand work to the I/O thread until they are stopped
+  StopWorkers();
+
+  {
+    boost::lock_guard<boost::mutex> lock(m_command_mutex);
+    m_stopping = true;
+  }
+  Wakeup();
+  m_thread.join();
+
+#ifndef _WIN32
+  close(m_wakeup_pipe[0]);
+  close(m_wakeup_pipe[1]);
+#endif
+}
+
+void ConcurrentChannelImpl::Execute(
+    const ConcurrentChannel::operation_t &operation) {
+  if (boost::this_thread::get_id() == m_thread.get_id()) {
+    // From a confirm callback, the I/O thread already has the channel
+    operation(*m_channel);
+    return;
+  }
+
+  {
+    boost::lock_guard<boost::mutex> lock(m_command_mutex);
+    CheckFailed();
+    ++m_waiting_executors;
+  }
+  Wakeup();
+
+  {
+    boost::lock_guard<boost::mutex> io_lock(m_io_mutex);
+    {
+      boost::lock_guard<boost::mutex> lock(m_command_mutex);
+      --m_waiting_executors;
+      m_executors_done.notify_all();
+    }
+    operation(*m_channel);
+  }
+
+  // The operation may have read deliveries the I/O thread needs to hand out
+  Wakeup();
+}
+
+void ConcurrentChannelImpl::Post(
+    const ConcurrentChannel::operation_t &operation) {
+  {
+    boost::lock_guard<boost::mutex> lock(m_command_mutex);
+    CheckFailed();
+    m_commands.push_back(operation);
+    if (1 < m_commands.size()) {
+      // The I/O thread has already been woken for the earlier commands
+      return;
+    }
+  }
+  Wakeup();
+}
+
+void ConcurrentChannelImpl::AddConsumer(
+    const std::string &consumer_tag,
+    const ConcurrentChannel::message_handler_t &handler) {
+  delivery_queue_ptr_t queue = boost::make_shared<delivery_queue_t>();
+  queue->handler = handler;
+  if (handler) {
+    StartWorkers();
+  }
+  {
+    boost::lock_guard<boost::mutex> lock(m_consumers_mutex);
+    m_consumers[consumer_tag] = queue;
+  }
+  m_consumer_tags.push_back(consumer_tag);
+}
+
+void ConcurrentChannelImpl::RemoveConsumer(const std::string &consumer_tag) {
+  m_consumer_tags.erase(std::remove(m_consumer_tags.begin(),
+                                    m_consumer_tags.end(), consumer_tag),
+                        m_consumer_tags.end());
+  CloseDeliveryQueue(consumer_tag, std::string());
+}
+
+bool ConcurrentChannelImpl::ConsumeMessage(const std::string &consumer_tag,
+                                           Envelope::ptr_t &envelope,
+                                           int timeout) {
+  delivery_queue_ptr_t queue;
+  {
+    boost::lock_guard<boost::mutex> lock(m_consumers_mutex);
+    delivery_queue_map_t::const_iterator it = m_consumers.find(consumer_tag);
+    if (m_consumers.end() == it) {
+      throw ConsumerTagNotFoundException();
+    }
+    queue = it->second;
+  }
+  if (queue->handler) {
+    throw std::logic_error(
+        "Messages for this consumer are passed to its handler");
+  }
+
+  boost::unique_lock<boost::mutex> lock(queue->mutex);
+  if (0 < timeout) {
+    const boost::chrono::steady_clock::time_point end_point =
+        boost::chrono::steady_clock::now() +
+        boost::chrono::milliseconds(timeout);
+    while (queue->envelopes.empty() && !queue->cancelled) {
+      if (boost::cv_status::timeout ==
+          queue->available.wait_until(lock, end_point)) {
+        break;
+      }
+    }
+  } else if (0 > timeout) {
+    while (queue->envelopes.empty() && !queue->cancelled) {
+      queue->available.wait(lock);
+    }
+  }
+
+  if (!queue->envelopes.empty()) {
+    envelope = queue->envelopes.front();
+    queue->envelopes.pop_front();
+    return true;
+  }
+  if (queue->cancelled) {
+    if (!queue->error.empty()) {
+      throw std::runtime_error(queue->error);
+    }
+    throw ConsumerCancelledException(consumer_tag);
+  }
+  return false;
+}
+
+void ConcurrentChannelImpl::Run() {
+  boost::unique_lock<boost::mutex> io_lock(m_io_mutex);
+  std::vector<ConcurrentChannel::operation_t> commands;
+  for (;;) {
+    bool stopping;
+    {
+      boost::unique_lock<boost::mutex> lock(m_command_mutex);
+      if (0 < m_waiting_executors) {
+        // Let Execute callers have the channel first
+        io_lock.unlock();
+        while (0 < m_waiting_executors) {
+          m_executors_done.wait(lock);
+        }
+        lock.unlock();
+        io_lock.lock();
+        continue;
+      }
+      commands.swap(m_commands);
+      stopping = m_stopping;
+    }
+
+    try {
+      RunCommands(commands);
+      if (stopping) {
+        return;
+      }
+      if (ReadDeliveries()) {
+        continue;
+      }
+    } catch (const ConsumerCancelledException &e) {
+      m_consumer_tags.erase(
+          std::remove(m_consumer_tags.begin(), m_consumer_tags.end(),
+                      e.GetConsumerTag()),
+          m_consumer_tags.end());
+      CloseDeliveryQueue(e.GetConsumerTag(), std::string());
+      continue;
+    } catch (const AmqpException &e) {
+      if (!e.is_soft_error()) {
+        Fail(e.what());
+        return;
+      }
+      CloseDeadConsumers(e.what());
+      continue;
+    } catch (const std::exception &e) {
+      Fail(e.what());
+      return;
+    }
+
+    io_lock.unlock();
+    WaitForActivity();
+    io_lock.lock();
+  }
+}
+
+void ConcurrentChannelImpl::RunCommands(
+    std::vector<ConcurrentChannel::operation_t> &commands) {
+  for (std::vector<ConcurrentChannel::operation_t>::iterator it =
+           commands.begin();
+       it != commands.end(); ++it) {
+    try {
+      (*it)(*m_channel);
+    } catch (const AmqpException &e) {
+      if (!e.is_soft_error()) {
+        throw;
+      }
+      CloseDeadConsumers(e.what());
+    } catch (const AmqpLibraryException &) {
+      throw;
+    } catch (const AmqpResponseLibraryException &) {
+      throw;
+    } catch (const std::exception &) {
+      // Nobody is waiting to hear about it, e.g., an ack for a message
+      // delivered on a channel that has since been closed
+    }
+  }
+  commands.clear();
+}
+
+bool ConcurrentChannelImpl::ReadDeliveries() {
+  ChannelImpl &impl = *m_channel->m_impl;
+  impl.ReadAvailableFrames();
+  impl.ProcessBufferedConfirms();
+
+  if (m_consumer_tags.empty()) {
+    return false;
+  }
+
+  std::vector<Envelope::ptr_t> envelopes;
+  impl.TakeDeliveredMessages(
+      impl.GetAllConsumerChannels(m_channel->m_handle), envelopes,
+      std::numeric_limits<std::size_t>::max());
+  Deliver(envelopes);
+
+  // Anything else queued for a consumer, e.g., a basic.cancel from the
+  // broker. Only what is queued whole is taken: with nothing to take from the
+  // queue BasicConsumeMessage would read the socket, and could block there
+  // in the middle of a delivery. Messages still arriving are picked up once
+  // complete, so the I/O thread never waits on the socket here.
+  bool delivered = !envelopes.empty();
+  std::vector<std::string> tags(m_consumer_tags);
+  for (std::vector<std::string>::const_iterator it = tags.begin();
+       it != tags.end(); ++it) {
+    const amqp_channel_t channel = impl.GetConsumerChannel(*it);
+    Envelope::ptr_t envelope;
+    while (impl.HasQueuedDeliveryOnChannel(channel) &&
+           m_channel->BasicConsumeMessage(*it, envelope, 0)) {
+      Deliver(std::vector<Envelope::ptr_t>(1, envelope));
+      delivered = true;
+    }
+  }
+  return delivered;
+}
+
+void ConcurrentChannelImpl::Deliver(
+    const std::vector<Envelope::ptr_t> &envelopes) {
+  if (envelopes.empty()) {
+    return;
+  }
+
+  boost::lock_guard<boost::mutex> lock(m_consumers_mutex);
+  for (std::vector<Envelope::ptr_t>::const_iterator it = envelopes.begin();
+       it != envelopes.end(); ++it) {
+    delivery_queue_map_t::const_iterator queue =
+        m_consumers.find((*it)->ConsumerTag());
+    if (m_consumers.end() == queue) {
+      continue;
+    }
+    bool schedule = false;
+    {
+      boost::lock_guard<boost::mutex> queue_lock(queue->second->mutex);
+      queue->second->envelopes.push_back(*it);
+      if (queue->second->handler && !queue->second->scheduled) {
+        queue->second->scheduled = true;
+        schedule = true;
+      }
+    }
+    if (schedule) {
+      Schedule(queue->second);
+    } else {
+      queue->second->available.notify_one();
+    }
+  }
+}
+
+void ConcurrentChannelImpl::StartWorkers() {
+  if (0 < m_workers.size()) {
+    return;
+  }
+  for (std::size_t i = 0; i < std::max(m_worker_count, std::size_t(1)); ++i) {
+    m_workers.create_thread(
+        boost::bind(&ConcurrentChannelImpl::RunWorker, this));
+  }
+}
+
+void ConcurrentChannelImpl::StopWorkers() {
+  {
+    boost::lock_guard<boost::mutex> lock(m_ready_mutex);
+    m_workers_stopping = true;
+  }
+  m_ready.notify_all();
+  m_workers.join_all();
+}
+
+void ConcurrentChannelImpl::Schedule(const delivery_queue_ptr_t &queue) {
+  {
+    boost::lock_guard<boost::mutex> lock(m_ready_mutex);
+    m_ready_queues.push_back(queue);
+  }
+  m_ready.notify_one();
+}
+
+void ConcurrentChannelImpl::RunWorker() {
+  // A busy consumer goes to the back of the line after this many messages so
+  // it can't hold up the others
+  static const int HANDLED_PER_TURN = 16;
+
+  for (;;) {
+    delivery_queue_ptr_t queue;
+    {
+      boost::unique_lock<boost::mutex> lock(m_ready_mutex);
+      while (m_ready_queues.empty() && !m_workers_stopping) {
+        m_ready.wait(lock);
+      }
+      if (m_workers_stopping) {
+        return;
+      }
+      queue = m_ready_queues.front();
+      m_ready_queues.pop_front();
+    }
+
+    // Only one worker has the queue at a time, which keeps its messages in
+    // order
+    bool more = true;
+    for (int handled = 0; more && handled < HANDLED_PER_TURN; ++handled) {
+      Envelope::ptr_t envelope;
+      {
+        boost::lock_guard<boost::mutex> lock(queue->mutex);
+        if (queue->envelopes.empty()) {
+          queue->scheduled = false;
+          more = false;
+          break;
+        }
+        envelope = queue->envelopes.front();
+        queue->envelopes.pop_front();
+      }
+
+      try {
+        queue->handler(envelope);
+      } catch (...) {
+      }
+    }
+    if (more) {
+      Schedule(queue);
+    }
+  }
+}
+
+void ConcurrentChannelImpl::WaitForActivity() {
+  // At the buffer limits the socket, and what rabbitmq-c has read ahead,
+  // stay unread until deliveries are consumed by the handed over work
+  const bool wants_to_read = m_channel->m_impl->WantsToRead();
+  if (wants_to_read && m_channel->m_impl->HasUnreadData()) {
+    return;
+  }
+  const int socket_fd = amqp_get_sockfd(m_channel->m_impl->m_connection);
+
+  fd_set fds;
+  FD_ZERO(&fds);
+  if (wants_to_read) {
+    FD_SET(socket_fd, &fds);
+  }
+#ifdef _WIN32
+  // No pipes to wake up from, so check for handed over work regularly
+  if (!wants_to_read) {
+    // Winsock's select fails straight away without any sockets
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+    return;
+  }
+  struct timeval poll_interval = {0, 1000};
+  select(0, &fds, NULL, NULL, &poll_interval);
+#else
+  // Wake up in time for ReadDeliveries to have rabbitmq-c send a heartbeat
+  struct timeval heartbeat_interval = {0, 0};
+  struct timeval *timeout = NULL;
+  const boost::chrono::microseconds interval =
+      m_channel->m_impl->HeartbeatPollInterval();
+  if (boost::chrono::microseconds::max() != interval) {
+    heartbeat_interval.tv_sec = static_cast<long>(interval.count() / 1000000);
+    heartbeat_interval.tv_usec = static_cast<long>(interval.count() % 1000000);
+    timeout = &heartbeat_interval;
+  }
+
+  FD_SET(m_wakeup_pipe[0], &fds);
+  select((wants_to_read ? std::max(socket_fd, m_wakeup_pipe[0])
+                        : m_wakeup_pipe[0]) + 1,
+         &fds, NULL, NULL, timeout);
+
+  if (FD_ISSET(m_wakeup_pipe[0], &fds)) {
+    char buffer[64];
+    while (0 < read(m_wakeup_pipe[0], buffer, sizeof(buffer))) {
+    }
+  }
+#endif
+}
+
+void ConcurrentChannelImpl::Wakeup() {
+#ifndef _WIN32
+  // When the pipe is full the I/O thread is already due to wake up
+  const char byte = 0;
+  ssize_t written = write(m_wakeup_pipe[1], &byte, 1);
+  (void)written;
+#endif
+}
+
+void ConcurrentChannelImpl::CloseDeliveryQueue(const std::string &consumer_tag,
+                                               const std::string &error) {
+  delivery_queue_ptr_t queue;
+  {
+    boost::lock_guard<boost::mutex> lock(m_consumers_mutex);
+    delivery_queue_map_t::iterator it = m_consumers.find(consumer_tag);
+    if (m_consumers.end() == it) {
+      return;
+    }
+    queue = it->second;
+  }
+
+  {
+    boost::lock_guard<boost::mutex> lock(queue->mutex);
+    queue->cancelled = true;
+    queue->error = error;
+  }
+  queue->available.notify_all();
+}
+
+void ConcurrentChannelImpl::CloseDeadConsumers(const std::string &error) {
+  ChannelImpl &impl = *m_channel->m_impl;
+  std::vector<std::string>::iterator it = m_consumer_tags.begin();
+  while (it != m_consumer_tags.end()) {
+    if (impl.IsChannelOpen(impl.GetConsumerChannel(*it))) {
+      ++it;
+    } else {
+      CloseDeliveryQueue(*it, error);
+      it = m_consumer_tags.erase(it);
+    }
+  }
+}
+
+void ConcurrentChannelImpl::Fail(const std::string &error) {
+  {
+    boost::lock_guard<boost::mutex> lock(m_command_mutex);
+    m_failed = true;
+    m_failure = error;
+  }
+  for (std::vector<std::string>::const_iterator it = m_consumer_tags.begin();
+       it != m_consumer_tags.end(); ++it) {
+    CloseDeliveryQueue(*it, error);
+  }
+}
+
+void ConcurrentChannelImpl::CheckFailed() {
+  if (m_failed) {
+    throw std::runtime_error("ConcurrentChannel I/O thread stopped: " +
+                             m_failure);
+  }
+}
+
+}  // namespace Detail
+
+namespace {
+void basic_publish(Channel &channel, const std::string &exchange_name,
+                   const std::string &routing_key,
+                   const BasicMessage::ptr_t message, bool mandatory,
+                   const Channel::confirm_callback_t &callback) {
+  if (callback) {
+    channel.BasicPublishAsync(exchange_name, routing_key, message, mandatory,
+                              false, callback);
+  } else {
+    channel.BasicPublishAsync(exchange_name, routing_key, message, mandatory,
+                              false);
+  }
+}
+
+struct consume_request_t {
+  std::string queue;
+  std::string consumer_tag;
+  bool no_local;
+  bool no_ack;
+  bool exclusive;
+  boost::uint16_t message_prefetch_count;
+  ConcurrentChannel::message_handler_t handler;
+};
+
+void basic_consume(Channel &channel, Detail::ConcurrentChannelImpl &impl,
+                   consume_request_t &request) {
+  request.consumer_tag = channel.BasicConsume(
+      request.queue, request.consumer_tag, request.no_local, request.no_ack,
+      request.exclusive, request.message_prefetch_count);
+  impl.AddConsumer(request.consumer_tag, request.handler);
+}
+
+void basic_cancel(Channel &channel, Detail::ConcurrentChannelImpl &impl,
+                  const std::string &consumer_tag) {
+  channel.BasicCancel(consumer_tag);
+  impl.RemoveConsumer(consumer_tag);
+}
+
+void basic_ack(Channel &channel, const Envelope::DeliveryInfo &info,
+               bool multiple) {
+  channel.BasicAck(info, multiple);
+}
+
+void basic_reject(Channel &channel, const Envelope::DeliveryInfo &info,
+                  bool requeue, bool multiple) {
+  channel.BasicReject(info, requeue, multiple);
+}
+}  // namespace
+
+ConcurrentChannel::ConcurrentChannel(Channel::ptr_t channel,
+                                     std::size_t worker_threads)
+    : m_impl(new Detail::ConcurrentChannelImpl(channel, worker_threads)) {}
+
+ConcurrentChannel::~ConcurrentChannel() {}
+
+void ConcurrentChannel::Execute(const operation_t &operation) {
+  m_impl->Execute(operation);
+}
+
+void ConcurrentChannel::BasicPublish(const std::string &exchange_name,
+                                     const std::string &routing_key,
+                                     const BasicMessage::ptr_t message,
+                                     bool mandatory) {
+  BasicPublish(exchange_name, routing_key, message, mandatory,
+               Channel::confirm_callback_t());
+}
+
+void ConcurrentChannel::BasicPublish(
+    const std::string &exchange_name, const std::string &routing_key,
+    const BasicMessage::ptr_t message, bool mandatory,
+    const Channel::confirm_callback_t &callback) {
+  m_impl->Post(boost::bind(&basic_publish, _1, exchange_name, routing_key,
+                           message, mandatory, callback));
+}
+
+std::string ConcurrentChannel::BasicConsume(
+    const std::string &queue, const std::string &consumer_tag, bool no_local,
+    bool no_ack, bool exclusive, boost::uint16_t message_prefetch_count) {
+  return BasicConsumeWithHandler(queue, message_handler_t(), consumer_tag,
+                                 no_local, no_ack, exclusive,
+                                 message_prefetch_count);
+}
+
+std::string ConcurrentChannel::BasicConsumeWithHandler(
+    const std::string &queue, const message_handler_t &handler,
+    const std::string &consumer_tag, bool no_local, bool no_ack,
+    bool exclusive, boost::uint16_t message_prefetch_count) {
+  consume_request_t request;
+  request.queue = queue;
+  request.consumer_tag = consumer_tag;
+  request.no_local = no_local;
+  request.no_ack = no_ack;
+  request.exclusive = exclusive;
+  request.message_prefetch_count = message_prefetch_count;
+  request.handler = handler;
+
+  m_impl->Execute(boost::bind(&basic_consume, _1, boost::ref(*m_impl),
+                              boost::ref(request)));
+  return request.consumer_tag;
+}
+
+void ConcurrentChannel::BasicCancel(const std::string &consumer_tag) {
+  m_impl->Execute(
+      boost::bind(&basic_cancel, _1, boost::ref(*m_impl), consumer_tag));
+}
+
+bool ConcurrentChannel::BasicConsumeMessage(const std::string &consumer_tag,
+                                            Envelope::ptr_t &envelope,
+                                            int timeout) {
+  return m_impl->ConsumeMessage(consumer_tag, envelope, timeout);
+}
+
+void ConcurrentChannel::BasicAck(const Envelope::DeliveryInfo &info,
+                                 bool multiple) {
+  m_impl->Post(boost::bind(&basic_ack, _1, info, multiple));
+}
+
+void ConcurrentChannel::BasicReject(const Envelope::DeliveryInfo &info,
+                                    bool requeue, bool multiple) {
+  m_impl->Post(boost::bind(&basic_reject, _1, info, requeue, multiple));
+}
+
+}  // namespace AmqpClient
@@ -0,0 +1,114 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// Put these first to avoid warnings about INT#_C macro redefinition
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#include "SimpleAmqpClient/FrameTrace.h"
+
+namespace AmqpClient {
+
+namespace {
+std::size_t RoundUpToPowerOf2(std::size_t capacity) {
+  std::size_t rounded = 1;
+  while (rounded < capacity) {
+    rounded <<= 1;
+  }
+  return rounded;
+}
+
+const char *EventName(FrameTrace::event_t event) {
+  switch (event) {
+    case FrameTrace::fe_received:
+      return "received";
+    case FrameTrace::fe_queued:
+      return "queued";
+    case FrameTrace::fe_dequeued:
+      return "dequeued";
+    case FrameTrace::fe_delivered:
+      return "delivered";
+    case FrameTrace::fe_acked:
+      return "acked";
+  }
+  return "unknown";
+}
+
+const char *FrameTypeName(boost::uint8_t frame_type) {
+  switch (frame_type) {
+    case AMQP_FRAME_METHOD:
+      return "method";
+    case AMQP_FRAME_HEADER:
+      return "header";
+    case AMQP_FRAME_BODY:
+      return "body";
+    case AMQP_FRAME_HEARTBEAT:
+      return "heartbeat";
+  }
+  return "unknown";
+}
+}  // namespace
+
+FrameTrace::FrameTrace(std::size_t capacity)
+    : m_events(RoundUpToPowerOf2(capacity)),
+      m_mask(m_events.size() - 1),
+      m_recorded(0) {}
+
+FrameTrace::~FrameTrace() {}
+
+std::vector<FrameTrace::Event> FrameTrace::GetEvents() const {
+  const boost::uint64_t kept =
+      m_recorded < m_events.size() ? m_recorded : m_events.size();
+  std::vector<Event> events;
+  events.reserve(static_cast<std::size_t>(kept));
+  for (boost::uint64_t i = m_recorded - kept; i < m_recorded; ++i) {
+    events.push_back(m_events[i & m_mask]);
+  }
+  return events;
+}
+
+void FrameTrace::Dump(std::ostream &out) const {
+  const std::vector<Event> events = GetEvents();
+  for (std::vector<Event>::const_iterator it = events.begin();
+       it != events.end(); ++it) {
+    out << boost::chrono::duration_cast<boost::chrono::microseconds>(
+               it->time - events.front().time)
+               .count()
+        << "us " << EventName(it->event) << " channel " << it->channel << ' '
+        << FrameTypeName(it->frame_type);
+    if (0 != it->method_id) {
+      out << ' ' << amqp_method_name(it->method_id);
+    }
+    if (0 != it->delivery_tag) {
+      out << " delivery_tag " << it->delivery_tag;
+    }
+    out << '\n';
+  }
+}
+
+}  // namespace AmqpClient
@@ -0,0 +1,296 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// Put these first to avoid warnings about INT#_C macro redefinition
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#include "SimpleAmqpClient/MessagePool.h"
+#include "SimpleAmqpClient/Mutex.h"
+
+#include <boost/make_shared.hpp>
+
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace AmqpClient {
+namespace Detail {
+
+class MessagePool::State : boost::noncopyable {
+ public:
+  typedef Mutex mutex_t;
+
+  explicit State(std::size_t max_cached) : m_max_cached(max_cached) {}
+
+  ~State() {
+    for (std::vector<BasicMessage *>::iterator it = m_messages.begin();
+         it != m_messages.end(); ++it) {
+      delete *it;
+    }
+    for (std::vector<Envelope *>::iterator it = m_envelopes.begin();
+         it != m_envelopes.end(); ++it) {
+      delete *it;
+    }
+    for (block_list_t::iterator list = m_blocks.begin();
+         list != m_blocks.end(); ++list) {
+      for (std::vector<void *>::iterator it = list->second.begin();
+           it != list->second.end(); ++it) {
+        ::operator delete(*it);
+      }
+    }
+  }
+
+  BasicMessage *TakeMessage() {
+    mutex_t::scoped_lock lock(m_mutex);
+    if (m_messages.empty()) {
+      return NULL;
+    }
+    BasicMessage *message = m_messages.back();
+    m_messages.pop_back();
+    return message;
+  }
+
+  void ReleaseMessage(BasicMessage *message) {
+    {
+      mutex_t::scoped_lock lock(m_mutex);
+      if (m_messages.size() < m_max_cached) {
+        m_messages.push_back(message);
+        return;
+      }
+    }
+    delete message;
+  }
+
+  Envelope *TakeEnvelope() {
+    mutex_t::scoped_lock lock(m_mutex);
+    if (m_envelopes.empty()) {
+      return NULL;
+    }
+    Envelope *envelope = m_envelopes.back();
+    m_envelopes.pop_back();
+    return envelope;
+  }
+
+  void ReleaseEnvelope(Envelope *envelope) {
+    {
+      mutex_t::scoped_lock lock(m_mutex);
+      if (m_envelopes.size() < m_max_cached) {
+        m_envelopes.push_back(envelope);
+        return;
+      }
+    }
+    delete envelope;
+  }
+
+  // Storage for shared_ptr control blocks. There are only ever a couple of
+  // distinct sizes requested so the free lists are searched linearly.
+  void *AllocateBlock(std::size_t size) {
+    {
+      mutex_t::scoped_lock lock(m_mutex);
+      std::vector<void *> &blocks = GetBlockList(size);
+      if (!blocks.empty()) {
+        void *block = blocks.back();
+        blocks.pop_back();
+        return block;
+      }
+    }
+    return ::operator new(size);
+  }
+
+  void DeallocateBlock(void *block, std::size_t size) {
+    {
+      mutex_t::scoped_lock lock(m_mutex);
+      std::vector<void *> &blocks = GetBlockList(size);
+      if (blocks.size() < m_max_cached) {
+        blocks.push_back(block);
+        return;
+      }
+    }
+    ::operator delete(block);
+  }
+
+ private:
+  typedef std::vector<std::pair<std::size_t, std::vector<void *> > >
+      block_list_t;
+
+  std::vector<void *> &GetBlockList(std::size_t size) {
+    for (block_list_t::iterator it = m_blocks.begin(); it != m_blocks.end();
+         ++it) {
+      if (size == it->first) {
+        return it->second;
+      }
+    }
+    m_blocks.push_back(std::make_pair(size, std::vector<void *>()));
+    return m_blocks.back().second;
+  }
+
+  const std::size_t m_max_cached;
+  mutex_t m_mutex;
+  std::vector<BasicMessage *> m_messages;
+  std::vector<Envelope *> m_envelopes;
+  block_list_t m_blocks;
+};
+
+namespace {
+
+// Hands shared_ptr the recycled storage for its control block. Each copy
+// keeps the pool state alive, as the control block is freed after the
+// deleter has run.
+template <class T>
+class recycling_allocator {
+ public:
+  typedef T value_type;
+  typedef T *pointer;
+  typedef const T *const_pointer;
+  typedef T &reference;
+  typedef const T &const_reference;
+  typedef std::size_t size_type;
+  typedef std::ptrdiff_t difference_type;
+
+  template <class U>
+  struct rebind {
+    typedef recycling_allocator<U> other;
+  };
+
+  explicit recycling_allocator(const boost::shared_ptr<MessagePool::State> &s)
+      : state(s) {}
+
+  template <class U>
+  recycling_allocator(const recycling_allocator<U> &other)
+      : state(other.state) {}
+
+  pointer address(reference x) const { return &x; }
+  const_pointer address(const_reference x) const { return &x; }
+
+  pointer allocate(size_type n, const void * = 0) {
+    return static_cast<pointer>(state->AllocateBlock(n * sizeof(T)));
+  }
+
+  void deallocate(pointer p, size_type n) {
+    state->DeallocateBlock(p, n * sizeof(T));
+  }
+
+  size_type max_size() const { return size_type(-1) / sizeof(T); }
+
+  void construct(pointer p, const T &value) { new (p) T(value); }
+  void destroy(pointer p) { p->~T(); }
+
+  template <class U>
+  bool operator==(const recycling_allocator<U> &other) const {
+    return state == other.state;
+  }
+
+  template <class U>
+  bool operator!=(const recycling_allocator<U> &other) const {
+    return state != other.state;
+  }
+
+  boost::shared_ptr<MessagePool::State> state;
+};
+
+struct recycle_message {
+  explicit recycle_message(const boost::shared_ptr<MessagePool::State> &s)
+      : state(s) {}
+
+  void operator()(BasicMessage *message) const {
+    MessagePool::ResetMessage(message);
+    state->ReleaseMessage(message);
+  }
+
+  boost::shared_ptr<MessagePool::State> state;
+};
+
+struct recycle_envelope {
+  explicit recycle_envelope(const boost::shared_ptr<MessagePool::State> &s)
+      : state(s) {}
+
+  void operator()(Envelope *envelope) const {
+    MessagePool::ResetEnvelope(envelope);
+    state->ReleaseEnvelope(envelope);
+  }
+
+  boost::shared_ptr<MessagePool::State> state;
+};
+
+}  // namespace
+
+MessagePool::ptr_t MessagePool::Create(std::size_t max_cached) {
+  return boost::make_shared<MessagePool>(max_cached);
+}
+
+MessagePool::MessagePool(std::size_t max_cached)
+    : m_state(boost::make_shared<State>(max_cached)) {}
+
+MessagePool::~MessagePool() {}
+
+void MessagePool::ResetMessage(BasicMessage *message) {
+  // Gives back the body and any properties before the message sits idle
+  message->Reset();
+}
+
+void MessagePool::ResetEnvelope(Envelope *envelope) {
+  envelope->m_message.reset();
+}
+
+BasicMessage::ptr_t MessagePool::CreateMessage() {
+  BasicMessage *raw_message = m_state->TakeMessage();
+  if (NULL == raw_message) {
+    raw_message = new BasicMessage();
+  }
+
+  return BasicMessage::ptr_t(raw_message, recycle_message(m_state),
+                             recycling_allocator<BasicMessage>(m_state));
+}
+
+Envelope::ptr_t MessagePool::CreateEnvelope(
+    const BasicMessage::ptr_t message, const std::string &consumer_tag,
+    const boost::uint64_t delivery_tag, const std::string &exchange,
+    bool redelivered, const std::string &routing_key,
+    const boost::uint16_t delivery_channel) {
+  Envelope *raw_envelope = m_state->TakeEnvelope();
+  if (NULL == raw_envelope) {
+    raw_envelope =
+        new Envelope(message, consumer_tag, delivery_tag, exchange,
+                     redelivered, routing_key, delivery_channel);
+  } else {
+    raw_envelope->m_message = message;
+    raw_envelope->m_consumerTag.assign(consumer_tag);
+    raw_envelope->m_deliveryTag = delivery_tag;
+    raw_envelope->m_exchange.assign(exchange);
+    raw_envelope->m_redelivered = redelivered;
+    raw_envelope->m_routingKey.assign(routing_key);
+    raw_envelope->m_deliveryChannel = delivery_channel;
+  }
+
+  return Envelope::ptr_t(raw_envelope, recycle_envelope(m_state),
+                         recycling_allocator<Envelope>(m_state));
+}
+
+}  // namespace Detail
+}  // namespace AmqpClient
@@ -0,0 +1,388 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// Put these first to avoid warnings about INT#_C macro redefinition
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#include "SimpleAmqpClient/Metrics.h"
+#include "SimpleAmqpClient/AtomicCounter.h"
+#include "SimpleAmqpClient/Mutex.h"
+
+#include <iomanip>
+#include <sstream>
+
+namespace AmqpClient {
+
+Metrics::~Metrics() {}
+
+void Metrics::RpcCompleted(boost::uint32_t, boost::chrono::microseconds) {}
+
+void Metrics::PublishConfirmed(boost::chrono::microseconds) {}
+
+void Metrics::FramesWritten(std::size_t) {}
+
+void Metrics::WaitedForFrame(boost::chrono::microseconds, bool) {}
+
+void Metrics::QueueDepthChanged(std::ptrdiff_t, std::ptrdiff_t) {}
+
+void Metrics::MessagePublished(const std::string &, std::size_t) {}
+
+void Metrics::MessageReceived(const std::string &, std::size_t) {}
+
+void Metrics::ChannelOpened() {}
+
+void Metrics::ChannelClosed() {}
+
+CountingMetrics::Timing::Timing() : count(0), total(0), max(0) {}
+
+CountingMetrics::Traffic::Traffic() : messages(0), bytes(0) {}
+
+CountingMetrics::Counters::Counters()
+    : frames_written(0),
+      frames_read(0),
+      frame_wait(0),
+      queued_frames(0),
+      delivered_messages(0),
+      channels_opened(0),
+      channels_closed(0) {}
+
+namespace Detail {
+
+struct AtomicTiming : boost::noncopyable {
+  void Add(boost::chrono::microseconds elapsed) {
+    const AtomicCounter::value_type micros =
+        static_cast<AtomicCounter::value_type>(elapsed.count());
+    count.Add(1);
+    total.Add(micros);
+    max.StoreMax(micros);
+  }
+
+  CountingMetrics::Timing Load() const {
+    CountingMetrics::Timing timing;
+    timing.count = count.Load();
+    timing.total = boost::chrono::microseconds(total.Load());
+    timing.max = boost::chrono::microseconds(max.Load());
+    return timing;
+  }
+
+  AtomicCounter count;
+  AtomicCounter total;
+  AtomicCounter max;
+};
+
+struct AtomicTraffic : boost::noncopyable {
+  void Add(std::size_t body_bytes) {
+    messages.Add(1);
+    bytes.Add(body_bytes);
+  }
+
+  CountingMetrics::Traffic Load() const {
+    CountingMetrics::Traffic traffic;
+    traffic.messages = messages.Load();
+    traffic.bytes = bytes.Load();
+    return traffic;
+  }
+
+  AtomicCounter messages;
+  AtomicCounter bytes;
+};
+
+// Counters by key, where the map is only ever replaced by a copy with the
+// new key added. Finding a key takes no lock, adding one takes m_mutex; the
+// keys (methods, exchanges and consumer tags) are few and soon all seen.
+template <typename Key, typename Value>
+class CounterMap : boost::noncopyable {
+ public:
+  typedef boost::shared_ptr<Value> value_ptr_t;
+  typedef std::map<Key, value_ptr_t> map_t;
+  typedef boost::shared_ptr<const map_t> map_ptr_t;
+
+  CounterMap() : m_map(boost::make_shared<map_t>()) {}
+
+  value_ptr_t Get(const Key &key) {
+    value_ptr_t value = Find(boost::atomic_load(&m_map), key);
+    if (value) {
+      return value;
+    }
+    Mutex::scoped_lock lock(m_mutex);
+    // Only replaced while holding m_mutex
+    value = Find(m_map, key);
+    if (!value) {
+      boost::shared_ptr<map_t> added = boost::make_shared<map_t>(*m_map);
+      value = boost::make_shared<Value>();
+      added->insert(std::make_pair(key, value));
+      boost::atomic_store(&m_map, map_ptr_t(added));
+    }
+    return value;
+  }
+
+  template <typename Loaded>
+  void Load(std::map<Key, Loaded> &loaded) const {
+    const map_ptr_t map = boost::atomic_load(&m_map);
+    for (typename map_t::const_iterator it = map->begin(); it != map->end();
+         ++it) {
+      loaded[it->first] = it->second->Load();
+    }
+  }
+
+  void Clear() {
+    Mutex::scoped_lock lock(m_mutex);
+    boost::atomic_store(&m_map, map_ptr_t(boost::make_shared<map_t>()));
+  }
+
+ private:
+  static value_ptr_t Find(const map_ptr_t &map, const Key &key) {
+    typename map_t::const_iterator it = map->find(key);
+    return map->end() == it ? value_ptr_t() : it->second;
+  }
+
+  Mutex m_mutex;
+  map_ptr_t m_map;
+};
+
+class CountingMetricsImpl : boost::noncopyable {
+ public:
+  CounterMap<boost::uint32_t, AtomicTiming> m_rpcs;
+  AtomicTiming m_publish_confirms;
+  AtomicCounter m_frames_written;
+  AtomicCounter m_frames_read;
+  AtomicCounter m_frame_wait;
+  // Summed from the changes each connection reports
+  AtomicCounter m_queued_frames;
+  AtomicCounter m_delivered_messages;
+  CounterMap<std::string, AtomicTraffic> m_published;
+  CounterMap<std::string, AtomicTraffic> m_received;
+  AtomicCounter m_channels_opened;
+  AtomicCounter m_channels_closed;
+};
+
+}  // namespace Detail
+
+namespace {
+std::string EscapeLabel(const std::string &value) {
+  std::string escaped;
+  escaped.reserve(value.size());
+  for (std::string::const_iterator it = value.begin(); it != value.end();
+       ++it) {
+    switch (*it) {
+      case '\\':
+        escaped += "\\\\";
+        break;
+      case '"':
+        escaped += "\\\"";
+        break;
+      case '\n':
+        escaped += "\\n";
+        break;
+      default:
+        escaped += *it;
+    }
+  }
+  return escaped;
+}
+
+void WriteHeader(std::ostream &out, const std::string &name,
+                 const char *type, const char *help) {
+  out << "# HELP " << name << ' ' << help << '\n'
+      << "# TYPE " << name << ' ' << type << '\n';
+}
+
+void WriteSeconds(std::ostream &out, boost::chrono::microseconds elapsed) {
+  out << elapsed.count() / 1000000 << '.' << std::setw(6)
+      << std::setfill('0') << elapsed.count() % 1000000 << '\n';
+}
+
+void WriteSummary(std::ostream &out, const std::string &name,
+                  const std::string &labels,
+                  const CountingMetrics::Timing &timing) {
+  out << name << "_sum" << labels << ' ';
+  WriteSeconds(out, timing.total);
+  out << name << "_count" << labels << ' ' << timing.count << '\n';
+}
+
+void WriteTraffic(
+    std::ostream &out, const std::string &prefix, const std::string &what,
+    const char *label,
+    const std::map<std::string, CountingMetrics::Traffic> &traffic) {
+  const std::string messages = prefix + "_" + what + "_messages_total";
+  const std::string bytes = prefix + "_" + what + "_bytes_total";
+  WriteHeader(out, messages, "counter", ("Messages " + what).c_str());
+  for (std::map<std::string, CountingMetrics::Traffic>::const_iterator it =
+           traffic.begin();
+       it != traffic.end(); ++it) {
+    out << messages << '{' << label << "=\"" << EscapeLabel(it->first)
+        << "\"} " << it->second.messages << '\n';
+  }
+  WriteHeader(out, bytes, "counter", ("Message body bytes " + what).c_str());
+  for (std::map<std::string, CountingMetrics::Traffic>::const_iterator it =
+           traffic.begin();
+       it != traffic.end(); ++it) {
+    out << bytes << '{' << label << "=\"" << EscapeLabel(it->first)
+        << "\"} " << it->second.bytes << '\n';
+  }
+}
+
+void WriteValue(std::ostream &out, const std::string &name, const char *type,
+                const char *help, boost::uint64_t value) {
+  WriteHeader(out, name, type, help);
+  out << name << ' ' << value << '\n';
+}
+}  // namespace
+
+CountingMetrics::CountingMetrics()
+    : m_impl(new Detail::CountingMetricsImpl) {}
+
+CountingMetrics::~CountingMetrics() {}
+
+CountingMetrics::Counters CountingMetrics::GetCounters() const {
+  Counters counters;
+  m_impl->m_rpcs.Load(counters.rpcs);
+  counters.publish_confirms = m_impl->m_publish_confirms.Load();
+  counters.frames_written = m_impl->m_frames_written.Load();
+  counters.frames_read = m_impl->m_frames_read.Load();
+  counters.frame_wait =
+      boost::chrono::microseconds(m_impl->m_frame_wait.Load());
+  counters.queued_frames =
+      static_cast<std::size_t>(m_impl->m_queued_frames.Load());
+  counters.delivered_messages =
+      static_cast<std::size_t>(m_impl->m_delivered_messages.Load());
+  m_impl->m_published.Load(counters.published);
+  m_impl->m_received.Load(counters.received);
+  counters.channels_opened = m_impl->m_channels_opened.Load();
+  counters.channels_closed = m_impl->m_channels_closed.Load();
+  return counters;
+}
+
+void CountingMetrics::Reset() {
+  m_impl->m_rpcs.Clear();
+  m_impl->m_publish_confirms.count.Store(0);
+  m_impl->m_publish_confirms.total.Store(0);
+  m_impl->m_publish_confirms.max.Store(0);
+  m_impl->m_frames_written.Store(0);
+  m_impl->m_frames_read.Store(0);
+  m_impl->m_frame_wait.Store(0);
+  m_impl->m_published.Clear();
+  m_impl->m_received.Clear();
+  m_impl->m_channels_opened.Store(0);
+  m_impl->m_channels_closed.Store(0);
+}
+
+std::string CountingMetrics::ToPrometheusText(
+    const std::string &prefix) const {
+  const Counters counters = GetCounters();
+  std::ostringstream out;
+
+  const std::string rpc = prefix + "_rpc_duration_seconds";
+  WriteHeader(out, rpc, "summary",
+              "Time from sending a method to reading its reply");
+  for (std::map<boost::uint32_t, Timing>::const_iterator it =
+           counters.rpcs.begin();
+       it != counters.rpcs.end(); ++it) {
+    WriteSummary(out, rpc,
+                 std::string("{method=\"") + amqp_method_name(it->first) +
+                     "\"}",
+                 it->second);
+  }
+
+  const std::string confirm = prefix + "_publish_confirm_duration_seconds";
+  WriteHeader(out, confirm, "summary",
+              "Time from publishing a message to its confirm");
+  WriteSummary(out, confirm, std::string(), counters.publish_confirms);
+
+  WriteValue(out, prefix + "_frames_written_total", "counter",
+             "Frames sent to the broker", counters.frames_written);
+  WriteValue(out, prefix + "_frames_read_total", "counter",
+             "Frames read from the broker", counters.frames_read);
+  const std::string wait = prefix + "_frame_wait_seconds_total";
+  WriteHeader(out, wait, "counter", "Time spent waiting for frames");
+  out << wait << ' ';
+  WriteSeconds(out, counters.frame_wait);
+  WriteValue(out, prefix + "_queued_frames", "gauge",
+             "Frames read that are waiting to be handled",
+             counters.queued_frames);
+  WriteValue(out, prefix + "_delivered_messages", "gauge",
+             "Messages read that are waiting to be consumed",
+             counters.delivered_messages);
+
+  WriteTraffic(out, prefix, "published", "exchange", counters.published);
+  WriteTraffic(out, prefix, "received", "consumer_tag", counters.received);
+
+  WriteValue(out, prefix + "_channels_opened_total", "counter",
+             "AMQP channels opened", counters.channels_opened);
+  WriteValue(out, prefix + "_channels_closed_total", "counter",
+             "AMQP channels closed", counters.channels_closed);
+  return out.str();
+}
+
+void CountingMetrics::RpcCompleted(boost::uint32_t method_id,
+                                   boost::chrono::microseconds elapsed) {
+  m_impl->m_rpcs.Get(method_id)->Add(elapsed);
+}
+
+void CountingMetrics::PublishConfirmed(boost::chrono::microseconds elapsed) {
+  m_impl->m_publish_confirms.Add(elapsed);
+}
+
+void CountingMetrics::FramesWritten(std::size_t count) {
+  m_impl->m_frames_written.Add(count);
+}
+
+void CountingMetrics::WaitedForFrame(boost::chrono::microseconds elapsed,
+                                     bool frame_read) {
+  m_impl->m_frame_wait.Add(
+      static_cast<Detail::AtomicCounter::value_type>(elapsed.count()));
+  if (frame_read) {
+    m_impl->m_frames_read.Add(1);
+  }
+}
+
+void CountingMetrics::QueueDepthChanged(std::ptrdiff_t queued_frames,
+                                        std::ptrdiff_t delivered_messages) {
+  // A decrease wraps around to the same effect
+  m_impl->m_queued_frames.Add(
+      static_cast<Detail::AtomicCounter::value_type>(queued_frames));
+  m_impl->m_delivered_messages.Add(
+      static_cast<Detail::AtomicCounter::value_type>(delivered_messages));
+}
+
+void CountingMetrics::MessagePublished(const std::string &exchange,
+                                       std::size_t body_bytes) {
+  m_impl->m_published.Get(exchange)->Add(body_bytes);
+}
+
+void CountingMetrics::MessageReceived(const std::string &consumer_tag,
+                                      std::size_t body_bytes) {
+  m_impl->m_received.Get(consumer_tag)->Add(body_bytes);
+}
+
+void CountingMetrics::ChannelOpened() { m_impl->m_channels_opened.Add(1); }
+
+void CountingMetrics::ChannelClosed() { m_impl->m_channels_closed.Add(1); }
+
+}  // namespace AmqpClient
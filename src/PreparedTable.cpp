@@ -0,0 +1,80 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// Put these first to avoid warnings about INT#_C macro redefinition
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#include "SimpleAmqpClient/PreparedTable.h"
+
+#include "SimpleAmqpClient/TableImpl.h"
+
+#include <boost/make_shared.hpp>
+
+namespace AmqpClient {
+
+PreparedTable::PreparedTable() {}
+
+PreparedTable::PreparedTable(const Table &table) {
+  if (table.empty()) {
+    return;
+  }
+  boost::shared_ptr<Detail::PreparedTableImpl> impl =
+      boost::make_shared<Detail::PreparedTableImpl>();
+  impl->table = Detail::TableValueImpl::CreateAmqpTable(table, impl->pool);
+  m_impl = impl;
+}
+
+Table PreparedTable::GetTable() const {
+  if (!m_impl) {
+    return Table();
+  }
+  return Detail::TableValueImpl::CreateTable(m_impl->table);
+}
+
+TableView PreparedTable::View() const {
+  if (!m_impl) {
+    return TableView();
+  }
+  return Detail::TableValueImpl::CreateTableView(m_impl->table, m_impl);
+}
+
+bool PreparedTable::IsEmpty() const { return !m_impl; }
+
+bool PreparedTable::operator==(const PreparedTable &other) const {
+  if (m_impl == other.m_impl) {
+    return true;
+  }
+  if (!m_impl || !other.m_impl ||
+      m_impl->table.num_entries != other.m_impl->table.num_entries) {
+    return false;
+  }
+  return GetTable() == other.GetTable();
+}
+
+}  // namespace AmqpClient
@@ -0,0 +1,308 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// Put these first to avoid warnings about INT#_C macro redefinition
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#include "SimpleAmqpClient/RpcClient.h"
+
+#include "SimpleAmqpClient/ChannelImpl.h"
+
+#include <boost/chrono.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/unordered_map.hpp>
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+namespace AmqpClient {
+namespace Detail {
+
+class RpcClientImpl : boost::noncopyable {
+ public:
+  explicit RpcClientImpl(Channel::ptr_t channel);
+  ~RpcClientImpl();
+
+  std::string SendRequest(const std::string &exchange_name,
+                          const std::string &routing_key,
+                          const BasicMessage::ptr_t &request,
+                          const RpcClient::reply_callback_t &callback,
+                          int timeout);
+  bool WaitForReply(const std::string &correlation_id,
+                    BasicMessage::ptr_t &reply);
+  std::size_t ProcessReplies(int timeout);
+  std::size_t PendingCalls() const { return m_calls.size(); }
+
+ private:
+  typedef boost::chrono::steady_clock::time_point time_point_t;
+  // Calls that haven't had a reply yet, soonest to time out first
+  typedef std::multimap<time_point_t, std::string> deadline_map_t;
+
+  struct pending_call_t {
+    RpcClient::reply_callback_t callback;
+    // Kept for WaitForReply, calls with a callback never have one
+    BasicMessage::ptr_t reply;
+    // m_deadlines.end() when the call doesn't time out or has its reply
+    deadline_map_t::iterator deadline;
+  };
+  typedef boost::unordered_map<std::string, pending_call_t> call_map_t;
+
+  bool HandleReply(const Envelope::ptr_t &envelope);
+  std::size_t ExpireCalls();
+  // How long BasicConsumeMessage may wait for a reply before the next call
+  // times out, or wait if that is sooner. -1 is no limit.
+  int ConsumeTimeout(int wait) const;
+
+  Channel::ptr_t m_channel;
+  std::string m_consumer_tag;
+  boost::uint64_t m_next_correlation_id;
+  call_map_t m_calls;
+  deadline_map_t m_deadlines;
+};
+
+namespace {
+const std::string DIRECT_REPLY_TO("amq.rabbitmq.reply-to");
+
+int MillisecondsUntil(boost::chrono::steady_clock::time_point then) {
+  const boost::chrono::steady_clock::time_point now =
+      boost::chrono::steady_clock::now();
+  if (then <= now) {
+    return 0;
+  }
+  // Rounded up, so the wait doesn't end just short of it
+  return static_cast<int>(
+      boost::chrono::ceil<boost::chrono::milliseconds>(then - now).count());
+}
+}  // namespace
+
+RpcClientImpl::RpcClientImpl(Channel::ptr_t channel)
+    : m_channel(channel), m_next_correlation_id(1) {
+  ChannelImpl &impl = *m_channel->m_impl;
+  impl.CheckIsConnected();
+
+  // Replies to the pseudo-queue must be consumed without acks. The requests
+  // are published on the consumer's channel, without confirms there are no
+  // basic.acks to read past.
+  ChannelImpl::consume_params_t params;
+  params.queue = DIRECT_REPLY_TO;
+  params.no_local = false;
+  params.no_ack = true;
+  params.exclusive = false;
+  params.prefetch_count = 0;
+  params.no_confirm = true;
+  m_consumer_tag = impl.StartConsumer("", params, m_channel->m_handle);
+}
+
+RpcClientImpl::~RpcClientImpl() {
+  try {
+    m_channel->BasicCancel(m_consumer_tag);
+  } catch (...) {
+    // The channel or the connection is gone, there's nothing left to cancel
+  }
+}
+
+std::string RpcClientImpl::SendRequest(
+    const std::string &exchange_name, const std::string &routing_key,
+    const BasicMessage::ptr_t &request,
+    const RpcClient::reply_callback_t &callback, int timeout) {
+  ChannelImpl &impl = *m_channel->m_impl;
+  impl.CheckIsConnected();
+
+  const std::string correlation_id =
+      boost::lexical_cast<std::string>(m_next_correlation_id++);
+  // Whatever the caller set is replaced, as documented on RpcClient
+  request->ReplyTo(DIRECT_REPLY_TO);
+  request->CorrelationId(correlation_id);
+
+  // The broker only sends replies to the channel the request was published
+  // on, which has to be the one the consumer is on
+  const amqp_channel_t channel = impl.GetConsumerChannel(m_consumer_tag);
+  impl.PublishMessage(channel, exchange_name, routing_key, false, false,
+                      *request);
+
+  pending_call_t call;
+  call.callback = callback;
+  call.deadline = m_deadlines.end();
+  if (timeout >= 0) {
+    call.deadline = m_deadlines.insert(std::make_pair(
+        boost::chrono::steady_clock::now() +
+            boost::chrono::milliseconds(timeout),
+        correlation_id));
+  }
+  m_calls.insert(std::make_pair(correlation_id, call));
+  return correlation_id;
+}
+
+bool RpcClientImpl::WaitForReply(const std::string &correlation_id,
+                                 BasicMessage::ptr_t &reply) {
+  for (;;) {
+    call_map_t::iterator it = m_calls.find(correlation_id);
+    if (m_calls.end() == it) {
+      return false;
+    }
+    if (it->second.callback) {
+      throw std::logic_error(
+          "RpcClient::WaitForReply: the reply goes to a callback");
+    }
+    if (it->second.reply) {
+      reply = it->second.reply;
+      m_calls.erase(it);
+      return true;
+    }
+    ProcessReplies(-1);
+  }
+}
+
+std::size_t RpcClientImpl::ProcessReplies(int timeout) {
+  const time_point_t end =
+      boost::chrono::steady_clock::now() +
+      boost::chrono::milliseconds(std::max(timeout, 0));
+
+  std::size_t handled = ExpireCalls();
+  for (;;) {
+    // Once something has been handled, only what has already come in
+    int wait = 0;
+    if (0 == handled) {
+      wait = ConsumeTimeout(timeout < 0 ? -1 : MillisecondsUntil(end));
+    }
+
+    Envelope::ptr_t envelope;
+    if (m_channel->BasicConsumeMessage(m_consumer_tag, envelope, wait)) {
+      if (HandleReply(envelope)) {
+        ++handled;
+      }
+      continue;
+    }
+
+    handled += ExpireCalls();
+    if (0 != handled ||
+        (timeout >= 0 && boost::chrono::steady_clock::now() >= end)) {
+      return handled;
+    }
+  }
+}
+
+bool RpcClientImpl::HandleReply(const Envelope::ptr_t &envelope) {
+  const BasicMessage::ptr_t reply = envelope->Message();
+  if (!reply->CorrelationIdIsSet()) {
+    return false;
+  }
+  call_map_t::iterator it = m_calls.find(reply->CorrelationId());
+  // Unknown when it comes after the call timed out
+  if (m_calls.end() == it || it->second.reply) {
+    return false;
+  }
+
+  if (m_deadlines.end() != it->second.deadline) {
+    m_deadlines.erase(it->second.deadline);
+    it->second.deadline = m_deadlines.end();
+  }
+  if (!it->second.callback) {
+    it->second.reply = reply;
+    return true;
+  }
+
+  // Forgotten first, the callback may make other calls
+  const RpcClient::reply_callback_t callback = it->second.callback;
+  m_calls.erase(it);
+  callback(reply);
+  return true;
+}
+
+std::size_t RpcClientImpl::ExpireCalls() {
+  std::size_t expired = 0;
+  const time_point_t now = boost::chrono::steady_clock::now();
+  while (!m_deadlines.empty() && m_deadlines.begin()->first <= now) {
+    const std::string correlation_id = m_deadlines.begin()->second;
+    m_deadlines.erase(m_deadlines.begin());
+
+    call_map_t::iterator it = m_calls.find(correlation_id);
+    const RpcClient::reply_callback_t callback = it->second.callback;
+    m_calls.erase(it);
+    ++expired;
+    if (callback) {
+      callback(BasicMessage::ptr_t());
+    }
+  }
+  return expired;
+}
+
+int RpcClientImpl::ConsumeTimeout(int wait) const {
+  if (m_deadlines.empty()) {
+    return wait;
+  }
+  const int next = MillisecondsUntil(m_deadlines.begin()->first);
+  return wait < 0 ? next : std::min(wait, next);
+}
+
+}  // namespace Detail
+
+RpcClient::RpcClient(Channel::ptr_t channel)
+    : m_impl(new Detail::RpcClientImpl(channel)) {}
+
+RpcClient::~RpcClient() {}
+
+bool RpcClient::Call(const std::string &exchange_name,
+                     const std::string &routing_key,
+                     const BasicMessage::ptr_t request,
+                     BasicMessage::ptr_t &reply, int timeout) {
+  const std::string correlation_id =
+      SendRequest(exchange_name, routing_key, request, timeout);
+  return WaitForReply(correlation_id, reply);
+}
+
+std::string RpcClient::SendRequest(const std::string &exchange_name,
+                                   const std::string &routing_key,
+                                   const BasicMessage::ptr_t request,
+                                   int timeout) {
+  return m_impl->SendRequest(exchange_name, routing_key, request,
+                             reply_callback_t(), timeout);
+}
+
+std::string RpcClient::SendRequest(const std::string &exchange_name,
+                                   const std::string &routing_key,
+                                   const BasicMessage::ptr_t request,
+                                   const reply_callback_t &callback,
+                                   int timeout) {
+  return m_impl->SendRequest(exchange_name, routing_key, request, callback,
+                             timeout);
+}
+
+bool RpcClient::WaitForReply(const std::string &correlation_id,
+                             BasicMessage::ptr_t &reply) {
+  return m_impl->WaitForReply(correlation_id, reply);
+}
+
+std::size_t RpcClient::ProcessReplies(int timeout) {
+  return m_impl->ProcessReplies(timeout);
+}
+
+std::size_t RpcClient::PendingCalls() const { return m_impl->PendingCalls(); }
+
+}  // namespace AmqpClient
@@ -0,0 +1,412 @@
+#ifndef SIMPLEAMQPCLIENT_ASYNCCHANNEL_H
+#define SIMPLEAMQPCLIENT_ASYNCCHANNEL_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/BasicMessage.h"
+#include "SimpleAmqpClient/Channel.h"
+#include "SimpleAmqpClient/Envelope.h"
+#include "SimpleAmqpClient/Util.h"
+
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/ref.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/utility.hpp>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251 4275)
+#endif
+
+namespace AmqpClient {
+
+/**
+ * Errors reported by AsyncChannel that don't come from the broker or
+ * rabbitmq-c, in AmqpErrorCategory
+ */
+enum async_error_t {
+  ae_consumer_cancelled = 1,  //< the consumer was cancelled by the broker
+  ae_consumer_not_found       //< there is no consumer with the given tag
+};
+
+/**
+ * The error category of errors passed to AsyncChannel handlers
+ *
+ * Positive values are AMQP reply codes sent by the broker when it closes a
+ * channel or the connection (e.g., 404 for NOT_FOUND), negative values are
+ * rabbitmq-c status codes (amqp_status_enum) and small positive values are
+ * async_error_t.
+ */
+SIMPLEAMQPCLIENT_EXPORT const boost::system::error_category &
+AmqpErrorCategory();
+
+namespace Detail {
+class AsyncChannelImpl;
+
+// Adapts an Asio completion handler to a copyable function object, the
+// handler is always invoked through its associated executor
+template <class Handler, class... Args>
+class posted_handler {
+ public:
+  typedef typename boost::asio::associated_executor<
+      Handler, boost::asio::io_context::executor_type>::type executor_type;
+
+  posted_handler(Handler handler,
+                 const boost::asio::io_context::executor_type &io_executor)
+      : m_handler(std::make_shared<Handler>(std::move(handler))),
+        m_executor(
+            boost::asio::get_associated_executor(*m_handler, io_executor)) {}
+
+  void operator()(Args... args) const {
+    std::shared_ptr<Handler> handler = m_handler;
+    boost::asio::post(m_executor, [handler, args...]() mutable {
+      std::move(*handler)(std::move(args)...);
+    });
+  }
+
+ private:
+  std::shared_ptr<Handler> m_handler;
+  executor_type m_executor;
+};
+
+template <class... Args, class Handler>
+boost::function<void(Args...)> post_to_handler(
+    Handler &&handler,
+    const boost::asio::io_context::executor_type &io_executor) {
+  return posted_handler<typename std::decay<Handler>::type, Args...>(
+      std::forward<Handler>(handler), io_executor);
+}
+}  // namespace Detail
+
+/**
+ * An asynchronous front end to a Channel for use with Boost.Asio
+ *
+ * Instead of blocking, the operations below start the work and return
+ * straight away, and the socket of the Channel is watched by the
+ * io_context for the replies. Each operation takes an Asio completion
+ * token, so it completes through a handler, a std::future
+ * (boost::asio::use_future) or a C++20 coroutine
+ * (boost::asio::use_awaitable). Handlers are never invoked from within the
+ * call that starts the operation.
+ *
+ * Like Channel, an AsyncChannel is not thread safe: start operations from
+ * the thread running the io_context, or through a strand. The Channel may
+ * still be used directly from the same thread, its calls block as usual.
+ * Opening a new AMQP channel is still done synchronously, which only
+ * happens when there isn't a free one to reuse.
+ *
+ * Only available when SimpleAmqpClient is built with ENABLE_ASIO_SUPPORT.
+ */
+class SIMPLEAMQPCLIENT_EXPORT AsyncChannel : boost::noncopyable {
+ public:
+  typedef boost::shared_ptr<AsyncChannel> ptr_t;
+
+  /**
+   * Creates an asynchronous front end to a Channel
+   *
+   * @param io_context the io_context to watch the Channel's socket from
+   * @param channel the Channel to use
+   * @returns a new AsyncChannel object pointer
+   */
+  static ptr_t Create(boost::asio::io_context &io_context,
+                      Channel::ptr_t channel) {
+    return boost::make_shared<AsyncChannel>(boost::ref(io_context), channel);
+  }
+
+  AsyncChannel(boost::asio::io_context &io_context, Channel::ptr_t channel);
+
+  /**
+   * Handlers of operations that haven't completed are passed
+   * boost::asio::error::operation_aborted
+   */
+  virtual ~AsyncChannel();
+
+  typedef boost::asio::io_context::executor_type executor_type;
+  executor_type get_executor() const;
+
+  /**
+   * Publishes a message and completes once the broker has confirmed it
+   *
+   * The completion signature is void(boost::system::error_code,
+   * Channel::publish_confirm_t).
+   *
+   * @see Channel::BasicPublishAsync
+   * @param exchange_name The name of the exchange to publish the message to
+   * @param routing_key The routing key to publish with
+   * @param message the BasicMessage object to publish
+   * @param mandatory requires the message to be routed to a queue
+   * @param token the completion token
+   */
+  template <class CompletionToken>
+  typename boost::asio::async_result<
+      typename std::decay<CompletionToken>::type,
+      void(boost::system::error_code, Channel::publish_confirm_t)>::return_type
+  async_publish(const std::string &exchange_name,
+                const std::string &routing_key,
+                const BasicMessage::ptr_t &message, bool mandatory,
+                CompletionToken &&token) {
+    return boost::asio::async_initiate<
+        CompletionToken,
+        void(boost::system::error_code, Channel::publish_confirm_t)>(
+        initiate_publish(this), token, exchange_name, routing_key, message,
+        mandatory);
+  }
+
+  /**
+   * Waits for the next message delivered to a consumer
+   *
+   * The completion signature is void(boost::system::error_code,
+   * Envelope::ptr_t). Several waits for the same consumer complete in the
+   * order they were started.
+   *
+   * @param consumer_tag the consumer to wait for a message from
+   * @param token the completion token
+   */
+  template <class CompletionToken>
+  typename boost::asio::async_result<
+      typename std::decay<CompletionToken>::type,
+      void(boost::system::error_code, Envelope::ptr_t)>::return_type
+  async_consume(const std::string &consumer_tag, CompletionToken &&token) {
+    return boost::asio::async_initiate<
+        CompletionToken, void(boost::system::error_code, Envelope::ptr_t)>(
+        initiate_consume(this), token, consumer_tag);
+  }
+
+  /**
+   * Declares a queue
+   *
+   * The completion signature is void(boost::system::error_code,
+   * std::string), with the name of the queue.
+   *
+   * @see Channel::DeclareQueue
+   */
+  template <class CompletionToken>
+  typename boost::asio::async_result<
+      typename std::decay<CompletionToken>::type,
+      void(boost::system::error_code, std::string)>::return_type
+  async_declare_queue(const std::string &queue_name, bool passive,
+                      bool durable, bool exclusive, bool auto_delete,
+                      CompletionToken &&token) {
+    return boost::asio::async_initiate<
+        CompletionToken, void(boost::system::error_code, std::string)>(
+        initiate_declare_queue(this), token, queue_name, passive, durable,
+        exclusive, auto_delete);
+  }
+
+  /**
+   * Binds a queue to an exchange
+   *
+   * The completion signature is void(boost::system::error_code).
+   *
+   * @see Channel::BindQueue
+   */
+  template <class CompletionToken>
+  typename boost::asio::async_result<
+      typename std::decay<CompletionToken>::type,
+      void(boost::system::error_code)>::return_type
+  async_bind_queue(const std::string &queue_name,
+                   const std::string &exchange_name,
+                   const std::string &routing_key, CompletionToken &&token) {
+    return boost::asio::async_initiate<CompletionToken,
+                                       void(boost::system::error_code)>(
+        initiate_bind_queue(this), token, queue_name, exchange_name,
+        routing_key);
+  }
+
+  /**
+   * Starts a consumer
+   *
+   * The completion signature is void(boost::system::error_code,
+   * std::string), with the consumer tag.
+   *
+   * @see Channel::BasicConsume
+   */
+  template <class CompletionToken>
+  typename boost::asio::async_result<
+      typename std::decay<CompletionToken>::type,
+      void(boost::system::error_code, std::string)>::return_type
+  async_basic_consume(const std::string &queue,
+                      const std::string &consumer_tag, bool no_local,
+                      bool no_ack, bool exclusive,
+                      boost::uint16_t message_prefetch_count,
+                      CompletionToken &&token) {
+    return boost::asio::async_initiate<
+        CompletionToken, void(boost::system::error_code, std::string)>(
+        initiate_basic_consume(this), token, queue, consumer_tag, no_local,
+        no_ack, exclusive, message_prefetch_count);
+  }
+
+  typedef boost::function<void(boost::system::error_code,
+                               Channel::publish_confirm_t)>
+      publish_handler_t;
+  typedef boost::function<void(boost::system::error_code, Envelope::ptr_t)>
+      consume_handler_t;
+  typedef boost::function<void(boost::system::error_code, std::string)>
+      name_handler_t;
+  typedef boost::function<void(boost::system::error_code)> error_handler_t;
+
+ private:
+  void StartPublish(const std::string &exchange_name,
+                    const std::string &routing_key,
+                    const BasicMessage::ptr_t &message, bool mandatory,
+                    const publish_handler_t &handler);
+  void StartConsume(const std::string &consumer_tag,
+                    const consume_handler_t &handler);
+  void StartDeclareQueue(const std::string &queue_name, bool passive,
+                         bool durable, bool exclusive, bool auto_delete,
+                         const name_handler_t &handler);
+  void StartBindQueue(const std::string &queue_name,
+                      const std::string &exchange_name,
+                      const std::string &routing_key,
+                      const error_handler_t &handler);
+  void StartBasicConsume(const std::string &queue,
+                         const std::string &consumer_tag, bool no_local,
+                         bool no_ack, bool exclusive,
+                         boost::uint16_t message_prefetch_count,
+                         const name_handler_t &handler);
+
+  struct initiate_publish {
+    explicit initiate_publish(AsyncChannel *channel) : m_channel(channel) {}
+
+    template <class Handler>
+    void operator()(Handler &&handler, const std::string &exchange_name,
+                    const std::string &routing_key,
+                    const BasicMessage::ptr_t &message, bool mandatory) const {
+      m_channel->StartPublish(
+          exchange_name, routing_key, message, mandatory,
+          Detail::post_to_handler<boost::system::error_code,
+                                  Channel::publish_confirm_t>(
+              std::forward<Handler>(handler), m_channel->get_executor()));
+    }
+
+    AsyncChannel *m_channel;
+  };
+
+  struct initiate_consume {
+    explicit initiate_consume(AsyncChannel *channel) : m_channel(channel) {}
+
+    template <class Handler>
+    void operator()(Handler &&handler, const std::string &consumer_tag) const {
+      m_channel->StartConsume(
+          consumer_tag,
+          Detail::post_to_handler<boost::system::error_code, Envelope::ptr_t>(
+              std::forward<Handler>(handler), m_channel->get_executor()));
+    }
+
+    AsyncChannel *m_channel;
+  };
+
+  struct initiate_declare_queue {
+    explicit initiate_declare_queue(AsyncChannel *channel)
+        : m_channel(channel) {}
+
+    template <class Handler>
+    void operator()(Handler &&handler, const std::string &queue_name,
+                    bool passive, bool durable, bool exclusive,
+                    bool auto_delete) const {
+      m_channel->StartDeclareQueue(
+          queue_name, passive, durable, exclusive, auto_delete,
+          Detail::post_to_handler<boost::system::error_code, std::string>(
+              std::forward<Handler>(handler), m_channel->get_executor()));
+    }
+
+    AsyncChannel *m_channel;
+  };
+
+  struct initiate_bind_queue {
+    explicit initiate_bind_queue(AsyncChannel *channel) : m_channel(channel) {}
+
+    template <class Handler>
+    void operator()(Handler &&handler, const std::string &queue_name,
+                    const std::string &exchange_name,
+                    const std::string &routing_key) const {
+      m_channel->StartBindQueue(
+          queue_name, exchange_name, routing_key,
+          Detail::post_to_handler<boost::system::error_code>(
+              std::forward<Handler>(handler), m_channel->get_executor()));
+    }
+
+    AsyncChannel *m_channel;
+  };
+
+  struct initiate_basic_consume {
+    explicit initiate_basic_consume(AsyncChannel *channel)
+        : m_channel(channel) {}
+
+    template <class Handler>
+    void operator()(Handler &&handler, const std::string &queue,
+                    const std::string &consumer_tag, bool no_local,
+                    bool no_ack, bool exclusive,
+                    boost::uint16_t message_prefetch_count) const {
+      m_channel->StartBasicConsume(
+          queue, consumer_tag, no_local, no_ack, exclusive,
+          message_prefetch_count,
+          Detail::post_to_handler<boost::system::error_code, std::string>(
+              std::forward<Handler>(handler), m_channel->get_executor()));
+    }
+
+    AsyncChannel *m_channel;
+  };
+
+  boost::shared_ptr<Detail::AsyncChannelImpl> m_impl;
+};
+
+}  // namespace AmqpClient
+
+namespace boost {
+namespace system {
+template <>
+struct is_error_code_enum<AmqpClient::async_error_t> {
+  static const bool value = true;
+};
+}  // namespace system
+}  // namespace boost
+
+namespace AmqpClient {
+inline boost::system::error_code make_error_code(async_error_t error) {
+  return boost::system::error_code(static_cast<int>(error),
+                                   AmqpErrorCategory());
+}
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif  // SIMPLEAMQPCLIENT_ASYNCCHANNEL_H
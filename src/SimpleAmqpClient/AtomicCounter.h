@@ -0,0 +1,108 @@
+#ifndef SIMPLEAMQPCLIENT_ATOMICCOUNTER_H
+#define SIMPLEAMQPCLIENT_ATOMICCOUNTER_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+#include <boost/cstdint.hpp>
+#include <boost/utility.hpp>
+
+namespace AmqpClient {
+namespace Detail {
+
+// A 64 bit count that threads can add to without locking, for C++03 where
+// there is no std::atomic. Adding the two's complement of a value takes it
+// away.
+class AtomicCounter : boost::noncopyable {
+ public:
+  typedef boost::uint64_t value_type;
+
+  AtomicCounter() : m_value(0) {}
+
+#ifdef _WIN32
+  value_type Load() const {
+    return static_cast<value_type>(InterlockedCompareExchange64(
+        const_cast<volatile LONGLONG *>(&m_value), 0, 0));
+  }
+  void Store(value_type value) {
+    InterlockedExchange64(&m_value, static_cast<LONGLONG>(value));
+  }
+  void Add(value_type value) {
+    InterlockedExchangeAdd64(&m_value, static_cast<LONGLONG>(value));
+  }
+  bool CompareExchange(value_type expected, value_type desired) {
+    return static_cast<LONGLONG>(expected) ==
+           InterlockedCompareExchange64(&m_value,
+                                        static_cast<LONGLONG>(desired),
+                                        static_cast<LONGLONG>(expected));
+  }
+#else
+  value_type Load() const {
+    return __atomic_load_n(&m_value, __ATOMIC_RELAXED);
+  }
+  void Store(value_type value) {
+    __atomic_store_n(&m_value, value, __ATOMIC_RELAXED);
+  }
+  void Add(value_type value) {
+    __atomic_fetch_add(&m_value, value, __ATOMIC_RELAXED);
+  }
+  bool CompareExchange(value_type expected, value_type desired) {
+    return __atomic_compare_exchange_n(&m_value, &expected, desired, false,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+  }
+#endif
+
+  // Raises the count to value if it is lower
+  void StoreMax(value_type value) {
+    value_type current = Load();
+    while (current < value && !CompareExchange(current, value)) {
+      current = Load();
+    }
+  }
+
+ private:
+#ifdef _WIN32
+  volatile LONGLONG m_value;
+#else
+  value_type m_value;
+#endif
+};
+
+}  // namespace Detail
+}  // namespace AmqpClient
+
+#endif  // SIMPLEAMQPCLIENT_ATOMICCOUNTER_H
@@ -0,0 +1,49 @@
+#ifndef SIMPLEAMQPCLIENT_BACKPRESSUREEXCEPTION_H
+#define SIMPLEAMQPCLIENT_BACKPRESSUREEXCEPTION_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <stdexcept>
+#include <string>
+
+namespace AmqpClient {
+
+/**
+ * Thrown by Channel::BasicPublishAsync when the message can't be published
+ * straight away and the back-pressure policy is Channel::bp_fail
+ */
+class BackPressureException : public std::runtime_error {
+ public:
+  explicit BackPressureException(const std::string &reason) throw()
+      : std::runtime_error(
+            std::string("Message not published: ").append(reason)) {}
+
+  virtual ~BackPressureException() throw() {}
+};
+}  // namespace AmqpClient
+#endif  // SIMPLEAMQPCLIENT_BACKPRESSUREEXCEPTION_H
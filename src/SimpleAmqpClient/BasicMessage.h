@@ -28,15 +28,21 @@
  * ***** END LICENSE BLOCK *****
  */
 
+#include "SimpleAmqpClient/Codec.h"
+#include "SimpleAmqpClient/PreparedTable.h"
 #include "SimpleAmqpClient/Table.h"
+#include "SimpleAmqpClient/TableView.h"
 #include "SimpleAmqpClient/Util.h"
 
 #include <boost/cstdint.hpp>
+#include <boost/function.hpp>
 #include <boost/make_shared.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp>
+#include <cstddef>
 #include <string>
+#include <vector>
 
 #ifdef _MSC_VER
 #pragma warning(push)
@@ -50,8 +56,12 @@ namespace AmqpClient {
 
 namespace Detail {
 class BasicMessageImpl;
+class ChannelImpl;
+class MessagePool;
 }
 
+class MessageTemplate;
+
 class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
  public:
   typedef boost::shared_ptr<BasicMessage> ptr_t;
@@ -73,6 +83,21 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
     return boost::make_shared<BasicMessage>(body);
   }
 
+#if !defined(BOOST_NO_CXX11_RVALUE_REFERENCES)
+  /**
+    * Create a new BasicMessage object
+    * Creates a new BasicMessage object that takes over the given body
+    * without copying it
+    * @param body the message body.
+    * @returns a new BasicMessage object
+    */
+  static ptr_t Create(std::string &&body) {
+    ptr_t message = boost::make_shared<BasicMessage>();
+    message->Body(std::move(body));
+    return message;
+  }
+#endif
+
   /**
     * Create a new BasicMessage object
     * Creates a new BasicMessage object with a given body, properties
@@ -126,6 +151,106 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
     */
   void Body(const std::string &body);
 
+  /**
+    * Gets a pointer to the message body without copying it
+    *
+    * The pointer remains valid until the body is changed or the message is
+    * destructed. The body is not NUL terminated, use BodyLength().
+    * @returns a pointer to the first byte of the body, may be NULL when the
+    * body is empty
+    */
+  const char *BodyData() const;
+
+  /**
+    * Gets the length of the message body in bytes
+    */
+  std::size_t BodyLength() const;
+
+  /**
+    * Exchanges the message body with the contents of a std::string
+    *
+    * For messages received from the broker, and for bodies previously set
+    * with SwapBody, this doesn't copy the body. This makes it the cheapest
+    * way to take a large body out of a message, or to set one.
+    * @param body [in,out] the new body. On return it holds the old body.
+    */
+  void SwapBody(std::string &body);
+
+#if !defined(BOOST_NO_CXX11_RVALUE_REFERENCES)
+  /**
+    * Sets the message body, taking over the string without copying it
+    */
+  void Body(std::string &&body);
+
+  /**
+    * Sets the message body, taking over the vector without copying it
+    */
+  void Body(std::vector<char> &&body);
+#endif
+
+  /**
+    * Sets the message body, taking over the contents of a std::vector<char>
+    *
+    * No copy is made, body is left empty.
+    * @param body [in,out] the new body
+    */
+  void AdoptBody(std::vector<char> &body);
+
+  /**
+    * Called to release a buffer passed to AdoptBody
+    */
+  typedef boost::function<void(void *)> body_deleter_t;
+
+  /**
+    * Sets the message body, taking ownership of a raw buffer
+    *
+    * No copy is made. deleter is called with data once the message no longer
+    * needs the buffer: when the body is replaced or the message is destructed.
+    * @param data the buffer holding the body
+    * @param length the length of the body in bytes
+    * @param deleter called to release data
+    */
+  void AdoptBody(void *data, std::size_t length,
+                 const body_deleter_t &deleter);
+
+  /**
+    * Sets the message body to a buffer owned by the caller
+    *
+    * No copy is made and the buffer is never written to or freed. The caller
+    * must keep it alive and unchanged until the body is replaced or the
+    * message is destructed, in particular until any publish of the message
+    * has returned.
+    * @param data the buffer holding the body
+    * @param length the length of the body in bytes
+    */
+  void ExternalBody(const void *data, std::size_t length);
+
+  /**
+    * Compresses the message body
+    *
+    * The body is compressed straight into its replacement and the content
+    * encoding property is set to the codec's name. Channels that codec has
+    * been added to (see Channel::AddCodec) decompress it on receipt.
+    * @param codec the codec to compress the body with
+    * @throws std::logic_error if the content encoding property is already
+    * set, i.e., the body is already encoded
+    */
+  void Compress(const Codec &codec);
+
+  /**
+    * Decompresses the message body
+    *
+    * Undoes Compress: the body is replaced with the decompressed one and the
+    * content encoding property is cleared. Messages received on a Channel the
+    * codec has been added to are already decompressed.
+    * @param codec the codec the body was compressed with
+    * @throws std::logic_error if the content encoding property isn't the
+    * codec's name
+    * @throws std::runtime_error if the body is corrupt, the message is left
+    * as it was
+    */
+  void Decompress(const Codec &codec);
+
   /**
     * Gets the content type property
     */
@@ -352,9 +477,20 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
     */
   Table HeaderTable() const;
   /**
-    * Sets the custer id property
+    * Gets the header table without copying it
+    *
+    * Much cheaper than HeaderTable() for reading a few headers of a received
+    * message. The view is valid until the header table is next set or
+    * cleared, and no longer than the message.
     */
-  void HeaderTable(const Table &header_table);
+  TableView HeaderTableView() const;
+  /**
+    * Sets the header table
+    *
+    * A PreparedTable is shared with the message rather than copied into it,
+    * so the same headers can be set on many messages cheaply.
+    */
+  void HeaderTable(const PreparedTable &header_table);
   /**
     * Is there a header table associated with the message
     */
@@ -366,6 +502,23 @@ class SIMPLEAMQPCLIENT_EXPORT BasicMessage : boost::noncopyable {
 
  protected:
   boost::scoped_ptr<Detail::BasicMessageImpl> m_impl;
+
+ private:
+  friend class Detail::ChannelImpl;
+  friend class Detail::MessagePool;
+  friend class MessageTemplate;
+
+  // Used by MessagePool to recycle the message
+  void Reset();
+  // Fills in a received message. When encoded_properties is given the
+  // properties are kept encoded until first accessed.
+  void Assign(std::string &body, const amqp_basic_properties_t_ *properties,
+              const amqp_bytes_t_ *encoded_properties);
+  // Used by MessageTemplate: copies the properties of another message, and
+  // points this new message's properties at those of prototype, which is
+  // kept alive while they are in use
+  void CopyProperties(const BasicMessage &other);
+  void ShareProperties(const boost::shared_ptr<const BasicMessage> &prototype);
 };
 
 }  // namespace AmqpClient
@@ -29,15 +29,21 @@
  */
 
 #include "SimpleAmqpClient/BasicMessage.h"
+#include "SimpleAmqpClient/Codec.h"
 #include "SimpleAmqpClient/Envelope.h"
+#include "SimpleAmqpClient/FrameTrace.h"
+#include "SimpleAmqpClient/Metrics.h"
+#include "SimpleAmqpClient/PreparedTable.h"
+#include "SimpleAmqpClient/SslContext.h"
 #include "SimpleAmqpClient/Table.h"
 #include "SimpleAmqpClient/Util.h"
 
 #include <boost/cstdint.hpp>
+#include <boost/function.hpp>
 #include <boost/make_shared.hpp>
-#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp>
+#include <limits>
 #include <string>
 #include <vector>
 
@@ -48,8 +54,15 @@
 
 namespace AmqpClient {
 
+class Connection;
+class Topology;
+
 namespace Detail {
+class AsyncChannelImpl;
 class ChannelImpl;
+class ChannelSelectorImpl;
+class ConcurrentChannelImpl;
+class RpcClientImpl;
 }
 
 /**
@@ -64,6 +77,135 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
   static const std::string EXCHANGE_TYPE_FANOUT;
   static const std::string EXCHANGE_TYPE_TOPIC;
 
+  /**
+   * The outcome of a message published using BasicPublishAsync
+   */
+  enum publish_confirm_t {
+    pc_ack = 0,   //< the broker has taken responsibility for the message
+    pc_nack,      //< the broker could not take responsibility for the message
+    pc_returned,  //< the message was returned as unroutable, then confirmed
+    pc_lost,      //< the channel closed before the message was confirmed
+    pc_dropped    //< not published, see SetPublishBackPressure
+  };
+
+  /**
+   * Callback invoked when the broker confirms a message published using
+   * BasicPublishAsync. It is passed the sequence number returned by
+   * BasicPublishAsync and the outcome of the publish.
+   */
+  typedef boost::function<void(boost::uint64_t, publish_confirm_t)>
+      confirm_callback_t;
+
+  /**
+   * Callback invoked when the broker blocks or unblocks the connection. It
+   * is passed true and the reason given by the broker when blocked, false
+   * and an empty string when unblocked.
+   */
+  typedef boost::function<void(bool, const std::string &)> blocked_callback_t;
+
+  /**
+   * Passed each piece of a message body as it is read, see
+   * BasicConsumeMessageStreaming. It is given the piece and its length.
+   */
+  typedef boost::function<void(const char *, std::size_t)> body_sink_t;
+
+  /**
+   * Produces the next piece of a message body, see BasicPublishStreaming. It
+   * is given a buffer and its length, and returns how much of it it filled.
+   */
+  typedef boost::function<std::size_t(char *, std::size_t)> body_source_t;
+
+  /**
+   * What BasicPublishAsync does with a message it can't publish straight
+   * away, see SetPublishBackPressure
+   */
+  enum back_pressure_t {
+    bp_block = 0,  //< wait until it can be published
+    bp_fail,       //< throw BackPressureException
+    bp_drop        //< don't publish it, it is reported as pc_dropped
+  };
+
+  /**
+   * How a lost connection is recovered, see EnableRecovery
+   */
+  struct SIMPLEAMQPCLIENT_EXPORT RecoveryOptions {
+    RecoveryOptions();
+
+    // Brokers to try after the one the Channel was created for, in order, as
+    // amqp:// or amqps:// URIs. amqps URIs use the certificates the Channel
+    // was created with.
+    std::vector<std::string> uris;
+    // Milliseconds to wait after every broker has been tried once, doubled
+    // after each round up to max_delay
+    int initial_delay;
+    int max_delay;
+    // Rounds of trying every broker before giving up, -1 never gives up
+    int max_attempts;
+    // Publish the messages from BasicPublishAsync that weren't confirmed
+    // again, rather than reporting them as pc_lost
+    bool republish_unconfirmed;
+  };
+
+  /**
+   * Limits on the messages read from the broker that haven't been consumed
+   * yet, see SetBufferLimits. A limit of 0 is no limit.
+   */
+  struct SIMPLEAMQPCLIENT_EXPORT BufferLimits {
+    BufferLimits();
+
+    // Message body bytes and messages buffered for any one consumer
+    std::size_t max_channel_bytes;
+    std::size_t max_channel_messages;
+    // Message body bytes and messages buffered for the whole connection
+    std::size_t max_bytes;
+    std::size_t max_messages;
+    // Also send channel.flow to stop the broker delivering to a consumer with
+    // too much buffered, until half of it has been consumed. Not every
+    // broker allows this: RabbitMQ 3.3 and later close the connection.
+    bool use_channel_flow;
+  };
+
+  /**
+   * Settings for the socket a connection is made over, see Create. The
+   * defaults connect the way rabbitmq-c does.
+   */
+  struct SIMPLEAMQPCLIENT_EXPORT ConnectionOptions {
+    ConnectionOptions();
+
+    // What CreateBulk uses: socket buffers of BULK_SOCKET_BUFFER_SIZE,
+    // except on Linux where the system's defaults are left alone
+    static ConnectionOptions Bulk();
+
+    // TCP_NODELAY, sending each frame straight away rather than waiting for
+    // more to fill a packet. On by default.
+    bool tcp_nodelay;
+    // SO_RCVBUF and SO_SNDBUF in bytes, 0 leaves the system's default. They
+    // are set before connecting, so that the window scale negotiated on the
+    // handshake allows a TCP window to match. On Linux setting either turns
+    // off the system's tuning of that buffer to the connection, and is
+    // capped by net.core.rmem_max or wmem_max; the default usually does
+    // better there.
+    int receive_buffer_size;
+    int send_buffer_size;
+    // SO_KEEPALIVE, and where the system allows setting them the seconds
+    // idle before the first probe, the seconds between probes and how many
+    // may go unanswered. 0 leaves the system's default.
+    bool keepalive;
+    int keepalive_idle;
+    int keepalive_interval;
+    int keepalive_count;
+    // The local address to connect from, empty for any
+    std::string bind_address;
+    // Milliseconds to wait for the TCP connection, and the SSL handshake of
+    // a secure one, over all of the host's addresses, and then for logging
+    // in (with rabbitmq-c 0.11 or later, earlier ones wait for the broker
+    // as long as it takes). -1 waits as long as the system does.
+    int connect_timeout;
+    // Connect to every address the host resolves to at once, keeping the
+    // first connection made, rather than trying them one after another
+    bool connect_in_parallel;
+  };
+
   /**
     * Creates a new channel object
     * Creates a new connection to an AMQP broker using the supplied parameters
@@ -81,16 +223,69 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
    * broker-supplied value
     * @param frame_max Request that the server limit the maximum size of any
    * frame to this value
+    * @param heartbeat Request heartbeats every this many seconds, 0 turns
+    * them off. See the note on heartbeats below.
+    * @param options settings for the socket, see ConnectionOptions
     * @return a new Channel object pointer
+    *
+    * With heartbeats on, a broker that goes away without closing the socket
+    * is noticed within about twice the interval (the call waiting on it
+    * throws, and the Channel is disconnected) rather than when TCP gives up,
+    * which can take many minutes. Heartbeats are sent and checked whenever
+    * the Channel waits on the broker, however long the timeout, and all the
+    * time by a ConcurrentChannel or AsyncChannel. A Channel that isn't used
+    * at all for longer than twice the interval is disconnected by the
+    * broker. The broker can ask for a shorter interval than requested, but
+    * not turn heartbeats on when they are requested off.
     */
   static ptr_t Create(const std::string &host = "127.0.0.1", int port = 5672,
                       const std::string &username = "guest",
                       const std::string &password = "guest",
-                      const std::string &vhost = "/", int frame_max = 131072) {
+                      const std::string &vhost = "/", int frame_max = 131072,
+                      int heartbeat = 0,
+                      const ConnectionOptions &options = ConnectionOptions()) {
     return boost::make_shared<Channel>(host, port, username, password, vhost,
-                                       frame_max);
+                                       frame_max, heartbeat, options);
   }
 
+  /**
+   * Creates a new channel object for queues carrying large messages
+   *
+   * Connects like Create, except that the largest frame the broker allows
+   * is negotiated (131072 bytes is the limit by default, RabbitMQ's own
+   * default) so that a message body takes fewer frames, and the socket's
+   * send and receive buffers are enlarged to BULK_SOCKET_BUFFER_SIZE before
+   * connecting so that each read or write to the socket moves more of it.
+   * On Linux the buffers are left to the system, which grows them to suit
+   * the connection (net.core.rmem_max would cap them otherwise, and often
+   * below its own tuning). TCP_NODELAY is left on. The same as Create with
+   * a frame_max of 0 and ConnectionOptions::Bulk(); the settings are kept
+   * when the connection is recovered, see EnableRecovery.
+   *
+   * Larger frames only pay off for bodies well over 128 KB; consumers get
+   * no message until all of its body has arrived either way.
+   *
+   * @param host The hostname or IP address of the AMQP broker
+   * @param port The port to connect to the AMQP broker on
+   * @param username The username used to authenticate with the AMQP broker
+   * @param password The password corresponding to the username
+   * @param vhost The virtual host on the AMQP we should connect to
+   * @param heartbeat Request heartbeats every this many seconds, 0 turns
+   * them off, see Create
+   * @return a new Channel object pointer
+   */
+  static ptr_t CreateBulk(const std::string &host = "127.0.0.1",
+                          int port = 5672,
+                          const std::string &username = "guest",
+                          const std::string &password = "guest",
+                          const std::string &vhost = "/", int heartbeat = 0);
+
+  /**
+   * The size in bytes of the socket buffers CreateBulk asks for, other than
+   * on Linux
+   */
+  static const int BULK_SOCKET_BUFFER_SIZE;
+
  protected:
   struct SSLConnectionParams {
     std::string path_to_ca_cert;
@@ -121,6 +316,11 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
   * to this value
   * @param verify_host Verify the hostname against the certificate when
   * opening the SSL connection.
+  * @param heartbeat Request heartbeats every this many seconds, 0 turns them
+  * off. See Create.
+  * @param options settings for the socket, see ConnectionOptions. A secure
+  * connection can't have a bind_address or connect_in_parallel, it throws
+  * std::logic_error.
   *
   * @return a new Channel object pointer
   */
@@ -134,7 +334,9 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
                             const std::string &password = "guest",
                             const std::string &vhost = "/",
                             int frame_max = 131072,
-                            bool verify_hostname = true) {
+                            bool verify_hostname = true, int heartbeat = 0,
+                            const ConnectionOptions &options =
+                                ConnectionOptions()) {
     SSLConnectionParams ssl_params;
     ssl_params.path_to_ca_cert = path_to_ca_cert;
     ssl_params.path_to_client_key = path_to_client_key;
@@ -142,7 +344,41 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
     ssl_params.verify_hostname = verify_hostname;
 
     return boost::make_shared<Channel>(host, port, username, password, vhost,
-                                       frame_max, ssl_params);
+                                       frame_max, ssl_params, heartbeat,
+                                       options);
+  }
+
+  /**
+   * Creates a new channel object over an SSL connection set up by an
+   * SslContext
+   *
+   * Creating many Channels with the same SslContext loads the certificates
+   * once, and resumes the TLS session of an earlier connection to the same
+   * broker rather than making a full handshake, see SslContext.
+   *
+   * @param ssl_context the certificates and TLS sessions to use
+   * @param host The hostname or IP address of the AMQP broker
+   * @param port The port to connect to the AMQP broker on
+   * @param username The username used to authenticate with the AMQP broker
+   * @param password The password corresponding to the username
+   * @param vhost The virtual host on the AMQP we should connect to
+   * @param frame_max Request that the server limit the maximum size of any
+   * frame to this value
+   * @param heartbeat Request heartbeats every this many seconds, 0 turns them
+   * off. See Create.
+   * @param options settings for the socket, see CreateSecure
+   * @return a new Channel object pointer
+   */
+  static ptr_t CreateSecure(
+      const SslContext::ptr_t &ssl_context,
+      const std::string &host = "127.0.0.1", int port = 5671,
+      const std::string &username = "guest",
+      const std::string &password = "guest", const std::string &vhost = "/",
+      int frame_max = 131072, int heartbeat = 0,
+      const ConnectionOptions &options = ConnectionOptions()) {
+    return boost::make_shared<Channel>(host, port, username, password, vhost,
+                                       frame_max, ssl_context, heartbeat,
+                                       options);
   }
 
   /**
@@ -152,9 +388,14 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
    * amqp://[username:password@]{HOSTNAME}[:PORT][/VHOST]
    * @param frame_max [in] requests that the broker limit the maximum size of
    * any frame to this value
+   * @param heartbeat [in] requests heartbeats every this many seconds, 0
+   * turns them off. See Create.
+   * @param options [in] settings for the socket, see ConnectionOptions
    * @returns a new Channel object
    */
-  static ptr_t CreateFromUri(const std::string &uri, int frame_max = 131072);
+  static ptr_t CreateFromUri(
+      const std::string &uri, int frame_max = 131072, int heartbeat = 0,
+      const ConnectionOptions &options = ConnectionOptions());
 
   /**
    * Create a new Channel object from an AMQP URI, secured with SSL.
@@ -170,23 +411,53 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
    * opening the SSL connection.
    * @param frame_max [in] requests that the broker limit the maximum size of
    * any frame to this value
+   * @param heartbeat [in] requests heartbeats every this many seconds, 0
+   * turns them off. See Create.
+   * @param options [in] settings for the socket, see CreateSecure
+   * @returns a new Channel object
+   */
+  static ptr_t CreateSecureFromUri(
+      const std::string &uri, const std::string &path_to_ca_cert,
+      const std::string &path_to_client_key = "",
+      const std::string &path_to_client_cert = "", bool verify_hostname = true,
+      int frame_max = 131072, int heartbeat = 0,
+      const ConnectionOptions &options = ConnectionOptions());
+
+  /**
+   * Create a new Channel object from an amqps:// URI, over an SSL
+   * connection set up by an SslContext
+   *
+   * @param uri [in] a URI of the form:
+   * amqps://[username:password@]{HOSTNAME}[:PORT][/VHOST]
+   * @param ssl_context [in] the certificates and TLS sessions to use
+   * @param frame_max [in] requests that the broker limit the maximum size of
+   * any frame to this value
+   * @param heartbeat [in] requests heartbeats every this many seconds, 0
+   * turns them off. See Create.
+   * @param options [in] settings for the socket, see CreateSecure
    * @returns a new Channel object
    */
-  static ptr_t CreateSecureFromUri(const std::string &uri,
-                                   const std::string &path_to_ca_cert,
-                                   const std::string &path_to_client_key = "",
-                                   const std::string &path_to_client_cert = "",
-                                   bool verify_hostname = true,
-                                   int frame_max = 131072);
+  static ptr_t CreateSecureFromUri(
+      const std::string &uri, const SslContext::ptr_t &ssl_context,
+      int frame_max = 131072, int heartbeat = 0,
+      const ConnectionOptions &options = ConnectionOptions());
+
+  explicit Channel(const std::string &host, int port,
+                   const std::string &username, const std::string &password,
+                   const std::string &vhost, int frame_max, int heartbeat = 0,
+                   const ConnectionOptions &options = ConnectionOptions());
 
   explicit Channel(const std::string &host, int port,
                    const std::string &username, const std::string &password,
-                   const std::string &vhost, int frame_max);
+                   const std::string &vhost, int frame_max,
+                   const SSLConnectionParams &ssl_params, int heartbeat = 0,
+                   const ConnectionOptions &options = ConnectionOptions());
 
   explicit Channel(const std::string &host, int port,
                    const std::string &username, const std::string &password,
                    const std::string &vhost, int frame_max,
-                   const SSLConnectionParams &ssl_params);
+                   const SslContext::ptr_t &ssl_context, int heartbeat = 0,
+                   const ConnectionOptions &options = ConnectionOptions());
 
  public:
   virtual ~Channel();
@@ -239,7 +510,8 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
     */
   void DeclareExchange(const std::string &exchange_name,
                        const std::string &exchange_type, bool passive,
-                       bool durable, bool auto_delete, const Table &arguments);
+                       bool durable, bool auto_delete,
+                       const PreparedTable &arguments);
 
   /**
     * Deletes an exachange on the AMQP broker
@@ -268,7 +540,8 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
    * binding
     */
   void BindExchange(const std::string &destination, const std::string &source,
-                    const std::string &routing_key, const Table &arguments);
+                    const std::string &routing_key,
+                    const PreparedTable &arguments);
 
   /**
     * Unbind an existing exchange-exchange binding
@@ -290,7 +563,8 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
    * exchange
     */
   void UnbindExchange(const std::string &destination, const std::string &source,
-                      const std::string &routing_key, const Table &arguments);
+                      const std::string &routing_key,
+                      const PreparedTable &arguments);
   /**
     * Declares a queue
     * Creates a queue on the AMQP broker if it does not already exist
@@ -352,7 +626,7 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
     */
   std::string DeclareQueue(const std::string &queue_name, bool passive,
                            bool durable, bool exclusive, bool auto_delete,
-                           const Table &arguments);
+                           const PreparedTable &arguments);
 
   /**
     * Declares a queue and returns current message- and consumer counts
@@ -433,7 +707,8 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
                                      boost::uint32_t &message_count,
                                      boost::uint32_t &consumer_count,
                                      bool passive, bool durable, bool exclusive,
-                                     bool auto_delete, const Table &arguments);
+                                     bool auto_delete,
+                                     const PreparedTable &arguments);
 
   /**
     * Deletes a queue
@@ -474,7 +749,8 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
     */
   void BindQueue(const std::string &queue_name,
                  const std::string &exchange_name,
-                 const std::string &routing_key, const Table &arguments);
+                 const std::string &routing_key,
+                 const PreparedTable &arguments);
 
   /**
     * Unbinds a queue from an exchange
@@ -501,7 +777,8 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
     */
   void UnbindQueue(const std::string &queue_name,
                    const std::string &exchange_name,
-                   const std::string &routing_key, const Table &arguments);
+                   const std::string &routing_key,
+                   const PreparedTable &arguments);
 
   /**
     * Purges a queue
@@ -510,6 +787,28 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
     */
   void PurgeQueue(const std::string &queue_name);
 
+  /**
+    * Declares a list of exchanges, queues and bindings
+    *
+    * All of the methods are written to the broker back to back and the
+    * replies read in order afterwards, so the whole list takes about one
+    * round trip instead of one per declaration. If a declaration fails its
+    * exception is thrown once the replies before it have been read: those
+    * declarations have been made, none of the ones after it have.
+    *
+    * With nowait the broker is asked not to reply at all and this returns as
+    * soon as the methods have been written. Failures are not reported, so
+    * this is meant for declaring again what is known to exist already.
+    * Queues named by the broker can't be declared this way.
+    *
+    * @param topology the declarations to make
+    * @param nowait don't wait for, or ask for, replies from the broker
+    * @returns the names of the queues declared, one per queue in topology in
+    * order. Empty when nowait is set.
+    */
+  std::vector<std::string> DeclareTopology(const Topology &topology,
+                                           bool nowait = false);
+
   /**
     * Acknowledges a Basic message
     * Acknowledges a message delievered using BasicGet or BasicConsume
@@ -526,6 +825,54 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
    */
   void BasicAck(const Envelope::DeliveryInfo &info);
 
+  /**
+   * Acknowledges a Basic message, optionally with all earlier ones
+   * @param message the message that is being ack'ed
+   * @param multiple when true every unacknowledged message delivered on the
+   * same channel up to and including this one is acknowledged
+   */
+  void BasicAck(const Envelope::ptr_t &message, bool multiple);
+
+  /**
+   * Acknowledges a Basic message, optionally with all earlier ones
+   * This overload doesn't require the Envelope object to Acknowledge
+   * @param info the delivery info of the message being ack'ed
+   * @param multiple when true every unacknowledged message delivered on the
+   * same channel up to and including this one is acknowledged
+   */
+  void BasicAck(const Envelope::DeliveryInfo &info, bool multiple);
+
+  /**
+   * Coalesces the acknowledgements of a consumer
+   *
+   * Once turned on, single acks (BasicAck with multiple false) of messages
+   * delivered to the consumer are not sent straight away. Instead the highest
+   * delivery tag for which every earlier message has also been acked is
+   * tracked and acknowledged with one multiple ack once ack_every messages
+   * are covered, or from the next BasicAck after max_delay has passed.
+   * Acks past a gap, of messages delivered after one that is not acked yet,
+   * are sent one at a time when pending acks are sent.
+   * Pending acks are also sent when a BasicConsumeMessage for the consumer
+   * would have to wait for a delivery, when the consumer is cancelled, from
+   * FlushAcks, and when the Channel is destroyed.
+   *
+   * Make sure the consumer's prefetch count is not smaller than ack_every,
+   * or the broker stops delivering before an ack is due.
+   *
+   * @param consumer_tag the consumer to coalesce acks for
+   * @param ack_every the most acked messages to hold back, 0 turns coalescing
+   * off and sends any pending ack
+   * @param max_delay the longest in milliseconds to hold back an ack, -1 for
+   * no limit
+   */
+  void SetAckCoalescing(const std::string &consumer_tag, std::size_t ack_every,
+                        int max_delay = -1);
+
+  /**
+   * Sends any acknowledgements held back by SetAckCoalescing
+   */
+  void FlushAcks();
+
   /**
     * Reject a Basic message
     * Rejects a message delievered using BasicGet or BasicConsume
@@ -567,6 +914,201 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
                     const BasicMessage::ptr_t message, bool mandatory = false,
                     bool immediate = false);
 
+  /**
+   * Publishes a Basic message, optionally without publisher confirms
+   *
+   * With confirm set to false the message is published on a channel that was
+   * opened without confirm.select and this function returns as soon as the
+   * frames are written to the socket. Errors from the broker (for example:
+   * the exchange not existing) are not reported, the channel is closed and
+   * a new one is opened on a later publish (the socket is only checked for
+   * the broker closing it every 64 publishes). Messages may be lost without
+   * notice, use this only when that is acceptable.
+   * Confirm and non-confirm channels are pooled separately.
+   *
+   * @param exchange_name The name of the exchange to publish the message to
+   * @param routing_key The routing key to publish with
+   * @param message the BasicMessage object to publish
+   * @param mandatory requires the message to be routed to a queue. Must be
+   * false when confirm is false, or std::logic_error is thrown.
+   * @param immediate requires the message to be delivered to a consumer.
+   * Must be false when confirm is false, or std::logic_error is thrown.
+   * @param confirm when true this behaves exactly like the above BasicPublish
+   */
+  void BasicPublish(const std::string &exchange_name,
+                    const std::string &routing_key,
+                    const BasicMessage::ptr_t message, bool mandatory,
+                    bool immediate, bool confirm);
+
+  /**
+   * Publishes a Basic message with a body produced a piece at a time
+   *
+   * The body frames are written as source fills them, from one buffer the
+   * size of a frame, so a large body never has to be held in memory at once.
+   * Otherwise this behaves like BasicPublish, waiting for the broker to
+   * confirm the message.
+   *
+   * source is called until it has produced body_size bytes. If it throws,
+   * or returns 0 before then, the message can't be finished: the connection
+   * is closed (or recovered, see EnableRecovery) and the exception passed
+   * on, or std::runtime_error thrown.
+   *
+   * @param exchange_name The name of the exchange to publish the message to
+   * @param routing_key The routing key to publish with
+   * @param message the properties to publish with, its body is not sent
+   * @param body_size the length of the body
+   * @param source produces the body
+   * @param mandatory requires the message to be routed to a queue. A
+   * MessageReturnedException is thrown if it can't be.
+   */
+  void BasicPublishStreaming(const std::string &exchange_name,
+                             const std::string &routing_key,
+                             const BasicMessage::ptr_t message,
+                             boost::uint64_t body_size,
+                             const body_source_t &source,
+                             bool mandatory = false);
+
+  /**
+   * Publishes a Basic message without waiting for the broker to confirm it
+   *
+   * The message is written to a channel reserved for asynchronous publishing
+   * and this function returns as soon as the frames are sent. Confirmations
+   * are processed as they arrive: during later calls to BasicPublishAsync
+   * and in WaitForConfirms. A single basic.ack with multiple set confirms a
+   * whole range of outstanding messages. If the channel is closed by the
+   * broker (for example: when publishing to an exchange that doesn't exist)
+   * the ChannelException is thrown from the call that notices the close and
+   * all outstanding messages are reported as pc_lost. SetPublishBackPressure
+   * limits how many messages may be outstanding.
+   *
+   * @param exchange_name The name of the exchange to publish the message to
+   * @param routing_key The routing key to publish with
+   * @param message the BasicMessage object to publish
+   * @param mandatory requires the message to be routed to a queue. If it
+   * cannot be routed the message is reported as pc_returned.
+   * @param immediate requires the message to be delivered to a consumer
+   * immediately. If it cannot be the message is reported as pc_returned.
+   * @returns the sequence number assigned to the message, this is the value
+   * passed to the confirm callback.
+   */
+  boost::uint64_t BasicPublishAsync(const std::string &exchange_name,
+                                    const std::string &routing_key,
+                                    const BasicMessage::ptr_t message,
+                                    bool mandatory = false,
+                                    bool immediate = false);
+
+  /**
+   * Publishes a Basic message without waiting for the broker to confirm it
+   *
+   * @see BasicPublishAsync
+   * @param exchange_name The name of the exchange to publish the message to
+   * @param routing_key The routing key to publish with
+   * @param message the BasicMessage object to publish
+   * @param mandatory requires the message to be routed to a queue.
+   * @param immediate requires the message to be delivered to a consumer
+   * immediately.
+   * @param callback invoked exactly once with the outcome of the publish. It
+   * is called from within a SimpleAmqpClient call on this Channel, so it must
+   * not throw.
+   * @returns the sequence number assigned to the message
+   */
+  boost::uint64_t BasicPublishAsync(const std::string &exchange_name,
+                                    const std::string &routing_key,
+                                    const BasicMessage::ptr_t message,
+                                    bool mandatory, bool immediate,
+                                    const confirm_callback_t &callback);
+
+  /**
+   * Publishes a batch of Basic messages and waits for all of them to be
+   * confirmed
+   *
+   * All messages are written to the socket back-to-back on the channel used
+   * by BasicPublishAsync and the broker's confirms are waited on once, up to
+   * the last message in the batch, rather than once per message. On Linux the
+   * socket is corked while the batch is written so that small messages are
+   * coalesced into as few TCP segments as possible.
+   *
+   * Each message is subject to SetPublishBackPressure in turn, as if it were
+   * published by BasicPublishAsync. With bp_fail the messages before the one
+   * that could not be published have been sent but are not waited for. With
+   * bp_drop the rest of the batch is still published and confirmed before
+   * BackPressureException is thrown.
+   *
+   * @param exchange_name The name of the exchange to publish the messages to
+   * @param routing_key The routing key to publish with
+   * @param messages the BasicMessage objects to publish, in order
+   * @param mandatory requires each message to be routed to a queue. If one
+   * or more cannot be routed, a MessageReturnedException is thrown for the
+   * first one after the whole batch has been confirmed.
+   * @param immediate requires each message to be delivered to a consumer
+   * immediately. Handled the same as mandatory.
+   * @throws std::runtime_error if the broker nacked any of the messages
+   * @throws BackPressureException if a message could not be published, see
+   * above
+   */
+  void BasicPublishBatch(const std::string &exchange_name,
+                         const std::string &routing_key,
+                         const std::vector<BasicMessage::ptr_t> &messages,
+                         bool mandatory = false, bool immediate = false);
+
+  /**
+   * Waits for the broker to confirm all messages published using
+   * BasicPublishAsync
+   *
+   * @param timeout [in] the timeout in milliseconds. 0 processes confirmations
+   * that have already arrived without waiting, -1 is an infinite timeout.
+   * @returns true if there are no unconfirmed messages left, false if the
+   * timeout expired first.
+   */
+  bool WaitForConfirms(int timeout = -1);
+
+  /**
+   * Limits how far ahead of the broker BasicPublishAsync can get
+   *
+   * A message can't be published straight away when max_unconfirmed
+   * messages are waiting to be confirmed, or while the broker has blocked
+   * the connection (see IsConnectionBlocked). policy decides what happens
+   * to it then. BasicPublishAsync reads whatever the broker has sent before
+   * deciding, which takes a non-blocking poll of the socket per message.
+   * Not limited by default, and BasicPublishAsync then writes to the socket
+   * however long the broker takes to read from it.
+   *
+   * @param max_unconfirmed how many messages may be waiting for a confirm,
+   * 0 for any number
+   * @param policy whether to wait, throw or drop the message
+   */
+  void SetPublishBackPressure(std::size_t max_unconfirmed,
+                              back_pressure_t policy = bp_block);
+
+  /**
+   * Turns the limit set with SetPublishBackPressure off
+   */
+  void ClearPublishBackPressure();
+
+  /**
+   * Whether the broker has stopped reading from the connection
+   *
+   * A broker short of memory or disk space blocks connections that publish
+   * until it has recovered (see
+   * https://www.rabbitmq.com/connection-blocked.html). Anything the broker
+   * has already sent is read first.
+   *
+   * @returns true if the connection is blocked
+   */
+  bool IsConnectionBlocked();
+
+  /**
+   * Sets the callback invoked when the broker blocks or unblocks the
+   * connection
+   *
+   * It is called from within a SimpleAmqpClient call on a Channel sharing
+   * the connection, whichever one is reading from the broker at the time,
+   * so it must not throw.
+   *
+   * @param callback the callback, an empty one turns it off
+   */
+  void SetBlockedCallback(const blocked_callback_t &callback);
+
   /**
     * Attempts to get a message from a queue in a synchronous manner
     *
@@ -588,6 +1130,28 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
   bool BasicGet(Envelope::ptr_t &message, const std::string &queue,
                 bool no_ack = true);
 
+  /**
+    * Gets up to max_count messages from a queue
+    *
+    * Like calling BasicGet up to max_count times, without waiting for the
+    * answer to each basic.get before sending the next: up to 64 are sent
+    * ahead, so draining a queue isn't held up by a round trip per message.
+    * No more are sent once the broker answers that the queue is empty.
+    *
+    * Messages got for the basic.get requests already sent by then are still
+    * returned, in the order the broker handed them out, so a few more may be
+    * returned than were in the queue when it was found empty.
+    *
+    * @param queue the name of the queue to get the messages from
+    * @param max_count the most messages to get
+    * @param no_ack if the messages do not need to be ack'ed. Default true
+    *  (messages do not need to be acked)
+    * @returns the messages got, empty if the queue was empty
+    */
+  std::vector<Envelope::ptr_t> BasicGetBatch(const std::string &queue,
+                                             std::size_t max_count,
+                                             bool no_ack = true);
+
   /**
     * Redeliver any unacknowledged messages delivered from the broker
     * @param consumer the consumer to recover message from
@@ -657,7 +1221,7 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
                            const std::string &consumer_tag, bool no_local,
                            bool no_ack, bool exclusive,
                            boost::uint16_t message_prefetch_count,
-                           const Table &arguments);
+                           const PreparedTable &arguments);
 
   /**
     * Sets the number of unacknowledged messages that will be delivered
@@ -670,6 +1234,59 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
   void BasicQos(const std::string &consumer_tag,
                 boost::uint16_t message_prefetch_count);
 
+  /**
+    * Lets the prefetch count of a consumer follow how fast it is processing
+    * messages
+    *
+    * Once turned on, the messages acked or rejected each second and the time
+    * a basic.qos takes to be answered by the broker are measured. About once
+    * a second the prefetch count is changed with BasicQos to twice the number
+    * of messages processed in one round trip, so the broker has more on the
+    * way while the ones delivered are worked on, but a slow consumer doesn't
+    * have more buffered on its behalf than it gets through in a round trip
+    * or two. Small changes are left out so basic.qos isn't sent needlessly.
+    *
+    * The measuring and the basic.qos are done from BasicAck and BasicReject,
+    * so this only has an effect on consumers with no_ack set to false.
+    *
+    * @param consumer_tag the consumer to adjust the prefetch count of
+    * @param max_prefetch_count the most the prefetch count is raised to, 0
+    * turns adjusting off and leaves the prefetch count as it is
+    */
+  void SetAdaptivePrefetch(const std::string &consumer_tag,
+                           boost::uint16_t max_prefetch_count);
+
+  /**
+    * The prefetch count of a consumer, as last set by BasicConsume, BasicQos
+    * or SetAdaptivePrefetch
+    * @param consumer_tag the consumer
+    * @throws ConsumerTagNotFoundException if the consumer doesn't exist
+    */
+  boost::uint16_t GetPrefetchCount(const std::string &consumer_tag) const;
+
+  /**
+    * Sets which of the consumers waited on together is handed a message first
+    *
+    * When BasicConsumeMessage or BasicConsumeMessages wait on more than one
+    * consumer and several have messages ready, one from the consumer with the
+    * highest priority is returned. Consumers with the same priority take
+    * turns, in proportion to their weights: with weights 3 and 1, three
+    * messages are taken from the first for each one from the second.
+    *
+    * This is done by the client among messages that have already arrived, it
+    * is not the broker's x-priority consumer argument, which picks which
+    * consumer of a queue the broker delivers to. Until it is first called,
+    * messages are handed over in the order they arrived.
+    *
+    * @param consumer_tag the consumer to set the priority of
+    * @param priority higher is served first, consumers start out at 0
+    * @param weight the consumer's share among those with the same priority,
+    * must be at least 1
+    * @throws std::invalid_argument if weight is 0
+    */
+  void SetConsumerPriority(const std::string &consumer_tag, int priority,
+                           unsigned int weight = 1);
+
   /**
     * Cancels a previously created Consumer
     * Unsubscribes as a consumer to a queue. In otherwords undoes what
@@ -729,6 +1346,37 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
   bool BasicConsumeMessage(const std::string &consumer_tag,
                            Envelope::ptr_t &envelope, int timeout = -1);
 
+  /**
+   * Consumes a single message, passing its body to sink a piece at a time
+   *
+   * The body is passed to sink as each frame of it is read, and the memory
+   * of the frame is given back straight after, so a large body never has to
+   * be held in memory at once. The envelope has the message's properties but
+   * an empty body. A message that had already been read whole, while
+   * waiting for something else, is passed to sink in one piece.
+   *
+   * Should sink throw, the rest of the body is read and dropped, then the
+   * exception is passed on. Should reading the rest fail, the connection is
+   * closed and that error is thrown instead.
+   *
+   * The codecs added with AddCodec aren't applied to a body as it streams:
+   * a compressed body reaches sink as it was sent, with the envelope's
+   * content encoding still set to say so. One that had already been read
+   * whole was decompressed then, as any other, and its content encoding
+   * cleared. Check ContentEncodingIsSet on the envelope's message to tell.
+   *
+   * @param consumer_tag [in] the consumer to wait for a message from
+   * @param envelope [out] the message that is delivered, without its body
+   * @param sink [in] passed the body
+   * @param timeout [in] the timeout in milliseconds for the message to be
+   * delivered. 0 works like a non-blocking read, -1 is an infinite timeout.
+   * @returns true if a message was delivered before the timeout, false
+   * otherwise
+   */
+  bool BasicConsumeMessageStreaming(const std::string &consumer_tag,
+                                    Envelope::ptr_t &envelope,
+                                    const body_sink_t &sink, int timeout = -1);
+
   /**
    * Consumes a single message with a timeout from a list of consumers
    *
@@ -767,8 +1415,299 @@ class SIMPLEAMQPCLIENT_EXPORT Channel : boost::noncopyable {
    */
   bool BasicConsumeMessage(Envelope::ptr_t &envelope, int timeout = -1);
 
+  /**
+   * Consumes a batch of messages from a list of consumers
+   *
+   * Waits for a message to be delivered to one of the listed consumer tags,
+   * or for the timeout to expire. Once there is a message, every other
+   * message for those consumers that has already arrived, or can be read
+   * without waiting, is returned with it, up to max_count messages. Useful
+   * for processing a whole prefetch window in one go.
+   *
+   * @param consumer_tags [in] a list of the consumer tags to wait for messages
+   * from
+   * @param envelopes [out] the delivered messages are appended to this
+   * @param max_count [in] the most messages to return
+   * @param timeout [in] the timeout in milliseconds for the first message to
+   * be delivered. 0 works like a non-blocking read, -1 is an infinite timeout.
+   * @returns the number of messages appended to envelopes, 0 if the timeout
+   * expired
+   */
+  std::size_t BasicConsumeMessages(
+      const std::vector<std::string> &consumer_tags,
+      std::vector<Envelope::ptr_t> &envelopes, std::size_t max_count,
+      int timeout = -1);
+
+  /**
+   * Consumes the messages that have already arrived for this Channel's
+   * consumers, without waiting
+   *
+   * Reads whatever can be read from the socket without blocking, which also
+   * sends a heartbeat if one is due, then hands back the complete messages
+   * delivered to any of the consumers opened on this Channel object. A
+   * message that has only partly arrived is left for a later call. Meant to
+   * be called on the Channels reported by ChannelSelector::Wait.
+   *
+   * @param envelopes [out] the delivered messages are appended to this
+   * @param max_count [in] the most messages to return
+   * @returns the number of messages appended to envelopes, which may be 0
+   */
+  std::size_t BasicConsumeAvailable(
+      std::vector<Envelope::ptr_t> &envelopes,
+      std::size_t max_count = (std::numeric_limits<std::size_t>::max)());
+
+  /**
+    * Turns recycling of received messages on or off
+    *
+    * When on, the Envelope and BasicMessage objects for deliveries (from
+    * BasicConsumeMessage and BasicGet) are returned to a pool owned by this
+    * Channel once the last reference to them is dropped, and reused for later
+    * deliveries. This avoids most of the memory allocation per message at
+    * high message rates. Envelopes and messages may be released from any
+    * thread and may outlive the Channel. Off by default.
+    *
+    * @param max_cached the most idle envelopes and messages to keep for
+    * reuse. 0 turns recycling off.
+    */
+  void SetMessagePoolSize(std::size_t max_cached);
+
+  /**
+    * Registers hooks that measure what the connection is doing
+    *
+    * The Metrics is told about RPC round trips, publisher confirms, frames
+    * sent and read, time spent waiting for the broker, the frames and
+    * messages read but not yet consumed, the messages published and
+    * received, and AMQP channels being opened and closed. Nothing is measured
+    * while none is registered. See CountingMetrics for one that adds it all
+    * up and writes it out for Prometheus.
+    *
+    * It is shared by all of the Channels on the connection, see Connection.
+    *
+    * @param metrics the hooks to call, an empty pointer turns them off
+    */
+  void SetMetrics(const Metrics::ptr_t &metrics);
+
+  /**
+    * Records what happens to each frame read from the broker
+    *
+    * Frames are recorded as they are read from the socket, put in and taken
+    * from the queue of frames that arrived while something else was being
+    * waited for, and messages as they are handed to the application and
+    * acked. Comparing the times tells whether a message was late from the
+    * broker or held up behind something else on the connection. Nothing is
+    * recorded while no FrameTrace is set.
+    *
+    * It is shared by all of the Channels on the connection, see Connection.
+    *
+    * @param trace where the events are recorded, an empty pointer turns
+    * tracing off
+    */
+  void SetFrameTrace(const FrameTrace::ptr_t &trace);
+
+  /**
+    * Compresses the bodies of the messages published
+    *
+    * The body of each message published with BasicPublish, BasicPublishAsync
+    * or BasicPublishBatch is compressed straight into the buffer it is sent
+    * from, and sent with the content encoding set to the codec's name. The
+    * message itself is left as it is. Messages are sent as they are when the
+    * body is smaller than min_body_size, when compressing doesn't make it any
+    * smaller, or when their content encoding is already set. Bodies sent by
+    * BasicPublishStreaming aren't compressed.
+    *
+    * The codec is also added as with AddCodec, so compressed messages
+    * consumed on the connection are decompressed.
+    *
+    * It is shared by all of the Channels on the connection, see Connection.
+    *
+    * @param codec the codec to compress with, an empty pointer turns
+    * compression off
+    * @param min_body_size the smallest body to compress, in bytes
+    */
+  void SetPublishCodec(const Codec::ptr_t &codec,
+                       std::size_t min_body_size = 0);
+
+  /**
+    * Decompresses the messages received with the codec's content encoding
+    *
+    * This applies to messages from BasicConsumeMessage, BasicGet and the
+    * other ways of receiving messages, except the streaming ones which hand
+    * over the body as it arrives. The body is decompressed as the message is
+    * read from the connection and its content encoding cleared, so the
+    * message can be read from any thread and published again as it is.
+    *
+    * A body the codec can't decompress, corrupt or larger than it allows,
+    * doesn't raise an error, as that would lose the message: it is handed
+    * over as it came with the content encoding still set. So a received
+    * message whose ContentEncodingIsSet has a body that is still encoded,
+    * which can be checked before using it. BasicMessage::Decompress throws
+    * the codec's error, should it be wanted.
+    *
+    * It is shared by all of the Channels on the connection, see Connection.
+    *
+    * @param codec the codec to decompress with, replacing any added before
+    * with the same name
+    */
+  void AddCodec(const Codec::ptr_t &codec);
+
+  /**
+    * Keeps a number of AMQP channels open ahead of time
+    *
+    * Opening an AMQP channel takes two round trips to the broker, which
+    * BasicConsume and any other operation that needs a fresh channel would
+    * otherwise wait for. The channels are opened by this call, all at once,
+    * and whenever one of them is taken a replacement is requested from the
+    * broker without waiting for the reply. It joins the pool once the reply
+    * has been read while waiting for something else. Off by default.
+    *
+    * The channels are shared by all of the Channels on the connection, see
+    * Connection.
+    *
+    * @param min_open the number of unused channels to keep open. 0 turns it
+    * off, channels that are already open are kept.
+    */
+  void SetChannelPoolSize(std::size_t min_open);
+
+  /**
+    * Turns remembering of declarations on or off
+    *
+    * When on, an exchange, queue or binding that the broker has accepted is
+    * remembered, and declaring exactly the same thing again (the same name,
+    * type, flags, and arguments) returns straight away without asking the
+    * broker. This is for code that declares what it uses before every
+    * publish. DeclareQueueWithCounts and passive declares always go to the
+    * broker, as do auto-delete exchanges and queues and queues named by the
+    * broker, since they can't be known to still be there.
+    *
+    * DeleteExchange, DeleteQueue, UnbindExchange and UnbindQueue forget what
+    * they remove, and everything is forgotten whenever the broker closes a
+    * channel or the connection. Changes made by other connections aren't
+    * seen, so something that another connection deletes won't be declared
+    * again until then. Declarations are shared by all of the Channels on
+    * the connection, see Connection. Off by default.
+    *
+    * @param enabled true to turn it on, false to turn it off and forget
+    * everything remembered so far
+    */
+  void SetTopologyCacheEnabled(bool enabled);
+
+  /**
+    * Turns on reconnecting when the connection is lost
+    *
+    * The call that finds the connection gone (the socket failed, heartbeats
+    * were missed, or the broker closed the connection) throws as it would
+    * otherwise. The next call on the Channel reconnects before going ahead,
+    * trying the broker the Channel was created for then those in
+    * options.uris, round after round with a growing delay between rounds.
+    * Once connected it declares again the exchanges, queues and bindings
+    * declared since recovery was turned on, starts every consumer again with
+    * the same consumer tag, prefetch count and ack coalescing, and deals
+    * with the messages from BasicPublishAsync that weren't confirmed. A
+    * queue named by the broker gets a new name, which is used for its
+    * bindings and consumers. What the new broker refuses (for example: a
+    * binding to an exchange that another client deleted) is skipped.
+    * ConnectionClosedException is thrown if every attempt fails, the next
+    * call starts over.
+    *
+    * Messages delivered before the connection was lost are requeued by the
+    * broker and will be delivered again, acking them throws. Declarations
+    * sent with DeclareTopology and nowait are replayed in the same way.
+    * Recovery is for the connection and all of the Channels sharing it, see
+    * Connection. A ConcurrentChannel or AsyncChannel doesn't recover.
+    *
+    * @param options the brokers to try and how to go about it
+    * @throws BadUriException if one of options.uris can't be parsed
+    */
+  void EnableRecovery(const RecoveryOptions &options = RecoveryOptions());
+
+  /**
+    * Turns off reconnecting, forgetting what was recorded to replay
+    */
+  void DisableRecovery();
+
+  /**
+    * Limits how much is read from the broker ahead of being consumed
+    *
+    * Messages for a consumer are buffered when they are read from the socket
+    * while waiting for something else: a message for another consumer, or
+    * the reply to a method such as DeclareQueue. Once a limit is reached,
+    * frames are only read from the socket by a call that is waiting for
+    * something, not in passing (when publishing, from IsConnectionBlocked,
+    * or by an AsyncChannel or ChannelSelector waiting on the socket), so
+    * the rest is held back by TCP flow control. With use_channel_flow the
+    * broker is also asked to stop delivering to the consumer that is over
+    * the limit.
+    *
+    * The limits are not exact: a message partway read is always read to the
+    * end, and reading in passing goes on while publisher confirms from
+    * BasicPublishAsync or AsyncChannel replies are outstanding, as those may
+    * be queued behind deliveries.
+    *
+    * A ConcurrentChannel moves each delivery for its consumers into their
+    * own queues as soon as it is read, so those aren't bounded by the
+    * limits.
+    *
+    * Consumers that ack their messages are better limited with a prefetch
+    * count, see BasicQos, this is for no_ack consumers and those without a
+    * prefetch count.
+    *
+    * @param limits what to limit the buffered messages to
+    */
+  void SetBufferLimits(const BufferLimits &limits);
+
+  /**
+    * The bytes of message bodies read from the broker but not consumed yet
+    */
+  std::size_t GetBufferedBytes() const;
+
+  /**
+    * The number of messages read from the broker but not consumed yet
+    */
+  std::size_t GetBufferedMessages() const;
+
+  /**
+    * The bytes of message bodies buffered for a consumer
+    * @param consumer_tag the consumer
+    * @throws ConsumerTagNotFoundException if the consumer doesn't exist
+    */
+  std::size_t GetBufferedBytes(const std::string &consumer_tag) const;
+
+  /**
+    * The number of messages buffered for a consumer
+    * @param consumer_tag the consumer
+    * @throws ConsumerTagNotFoundException if the consumer doesn't exist
+    */
+  std::size_t GetBufferedMessages(const std::string &consumer_tag) const;
+
+  /**
+    * The largest frame the broker agreed to when the connection was opened
+    *
+    * Message bodies larger than this less 8 bytes are sent in several
+    * frames.
+    * @returns the size in bytes
+    */
+  int GetFrameMax() const;
+
+  /**
+    * The highest channel number the broker agreed to when the connection
+    * was opened, 0 if it set no limit
+    */
+  int GetChannelMax() const;
+
  protected:
-  boost::scoped_ptr<Detail::ChannelImpl> m_impl;
+  friend class Connection;
+  friend class Detail::AsyncChannelImpl;
+  friend class Detail::ChannelSelectorImpl;
+  friend class Detail::ConcurrentChannelImpl;
+  friend class Detail::RpcClientImpl;
+
+  // Another handle on a connection that is already open, see Connection
+  explicit Channel(const boost::shared_ptr<Detail::ChannelImpl> &impl);
+
+  boost::shared_ptr<Detail::ChannelImpl> m_impl;
+  // Tells the consumers of this Channel apart from those of the other
+  // Channels sharing the connection
+  boost::uint32_t m_handle;
 };
 
 }  // namespace AmqpClient
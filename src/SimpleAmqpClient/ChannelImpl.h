@@ -34,16 +34,29 @@
 
 #include "SimpleAmqpClient/AmqpException.h"
 #include "SimpleAmqpClient/BasicMessage.h"
+#include "SimpleAmqpClient/Channel.h"
+#include "SimpleAmqpClient/Codec.h"
 #include "SimpleAmqpClient/ConsumerCancelledException.h"
 #include "SimpleAmqpClient/Envelope.h"
+#include "SimpleAmqpClient/FrameTrace.h"
+#include "SimpleAmqpClient/MessagePool.h"
 #include "SimpleAmqpClient/MessageReturnedException.h"
+#include "SimpleAmqpClient/Metrics.h"
+#include "SimpleAmqpClient/PreparedTable.h"
+#include "SimpleAmqpClient/Topology.h"
 
 #include <boost/array.hpp>
 #include <boost/bind.hpp>
 #include <boost/chrono.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/ref.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
 
+#include <algorithm>
+#include <deque>
 #include <map>
+#include <set>
 #include <vector>
 
 namespace AmqpClient {
@@ -55,24 +68,121 @@ class ChannelImpl : boost::noncopyable {
   virtual ~ChannelImpl();
 
   typedef std::vector<amqp_channel_t> channel_list_t;
-  typedef std::vector<amqp_frame_t> frame_queue_t;
-  typedef std::map<amqp_channel_t, frame_queue_t> channel_map_t;
-  typedef channel_map_t::iterator channel_map_iterator_t;
 
+  // A list of channels that can also be checked for a channel without a
+  // search, used for the channels of each Channel's consumers
+  class channel_set_t {
+   public:
+    typedef channel_list_t::const_iterator const_iterator;
+    const_iterator begin() const { return m_list.begin(); }
+    const_iterator end() const { return m_list.end(); }
+    std::size_t size() const { return m_list.size(); }
+    bool empty() const { return m_list.empty(); }
+    bool contains(amqp_channel_t channel) const {
+      return channel < m_members.size() && m_members[channel];
+    }
+    void insert(amqp_channel_t channel) {
+      if (contains(channel)) {
+        return;
+      }
+      if (m_members.size() <= channel) {
+        m_members.resize(channel + 1, false);
+      }
+      m_members[channel] = true;
+      m_list.push_back(channel);
+    }
+    void erase(amqp_channel_t channel) {
+      if (!contains(channel)) {
+        return;
+      }
+      m_members[channel] = false;
+      m_list.erase(std::find(m_list.begin(), m_list.end(), channel));
+    }
+    void clear() {
+      m_list.clear();
+      m_members.clear();
+    }
+
+   private:
+    channel_list_t m_list;
+    // Indexed by channel number
+    std::vector<bool> m_members;
+  };
+
+  template <class ChannelListType>
+  static bool ContainsChannel(const ChannelListType &channels,
+                              amqp_channel_t channel) {
+    return channels.end() !=
+           std::find(channels.begin(), channels.end(), channel);
+  }
+  static bool ContainsChannel(const channel_set_t &channels,
+                              amqp_channel_t channel) {
+    return channels.contains(channel);
+  }
+
+  // A frame read from the broker that hasn't been handled yet, tagged with the
+  // order it arrived in so that waiting on several channels at once still
+  // hands back the oldest frame first.
+  struct queued_frame_t {
+    boost::uint64_t sequence;
+    amqp_frame_t frame;
+  };
+  // Frames are queued per channel, indexed by channel number
+  typedef std::deque<queued_frame_t> frame_queue_t;
+  typedef std::vector<frame_queue_t> frame_queue_list_t;
+
+  // Everything needed to open the connection again, see Recover
+  struct connection_params_t {
+    std::string host;
+    int port;
+    std::string username;
+    std::string password;
+    std::string vhost;
+    int frame_max;
+    int heartbeat;
+    Channel::ConnectionOptions options;
+    bool secure;
+    std::string path_to_ca_cert;
+    std::string path_to_client_key;
+    std::string path_to_client_cert;
+    bool verify_hostname;
+    // Loaded certificates and kept TLS sessions, these take the place of
+    // the paths above when set
+    SslContext::ptr_t ssl_context;
+  };
+
+  // Opens the socket and logs in, m_connection is left NULL if that fails
+  void Connect(const connection_params_t &params);
   void DoLogin(const std::string &username, const std::string &password,
-               const std::string &vhost, int frame_max);
-  amqp_channel_t GetChannel();
+               const std::string &vhost, int frame_max, int heartbeat);
+  // How long whoever waits on the socket without calling into rabbitmq-c may
+  // go before calling ReadAvailableFrames, so that heartbeats are sent and
+  // checked in time. microseconds::max() with heartbeats off.
+  boost::chrono::microseconds HeartbeatPollInterval() const;
+  amqp_channel_t GetChannel(bool confirm = true);
   void ReturnChannel(amqp_channel_t channel);
   bool IsChannelOpen(amqp_channel_t channel);
 
   bool GetNextFrameFromBroker(amqp_frame_t &frame,
                               boost::chrono::microseconds timeout);
 
-  bool CheckForQueuedMessageOnChannel(amqp_channel_t message_on_channel) const;
   void AddToFrameQueue(const amqp_frame_t &frame);
+  bool PushFrame(const amqp_frame_t &frame);
+  void ForgetAssembly(const queued_frame_t &taken);
+  frame_queue_t *FindFrameQueue(amqp_channel_t channel);
+  const frame_queue_t *FindFrameQueue(amqp_channel_t channel) const;
+  // Reads what can be read without waiting. Once a buffer limit is reached
+  // only a message partway read is finished, unless awaiting_reply says the
+  // caller is waiting on a reply that may be queued behind deliveries.
+  void ReadAvailableFrames(bool awaiting_reply = false);
+  // False when ReadAvailableFrames would leave the socket alone, whoever
+  // waits for it to become readable should then stop doing so until
+  // deliveries are consumed, or they would spin
+  bool WantsToRead(bool awaiting_reply = false) const;
+  void HandleFrameFromBroker(const amqp_frame_t &frame);
 
   template <class ChannelListType>
-  bool GetNextFrameFromBrokerOnChannel(const ChannelListType channels,
+  bool GetNextFrameFromBrokerOnChannel(const ChannelListType &channels,
                                        amqp_frame_t &frame_out,
                                        boost::chrono::microseconds timeout =
                                            boost::chrono::microseconds::max()) {
@@ -84,24 +194,12 @@ class ChannelImpl : boost::noncopyable {
 
     amqp_frame_t frame;
     while (GetNextFrameFromBroker(frame, timeout_left)) {
-      if (channels.end() !=
-          std::find(channels.begin(), channels.end(), frame.channel)) {
+      if (ContainsChannel(channels, frame.channel)) {
         frame_out = frame;
         return true;
       }
 
-      if (frame.channel == 0) {
-        // Only thing we care to handle on the channel0 is the connection.close
-        // method
-        if (AMQP_FRAME_METHOD == frame.frame_type &&
-            AMQP_CONNECTION_CLOSE_METHOD == frame.payload.method.id) {
-          FinishCloseConnection();
-          AmqpException::Throw(*reinterpret_cast<amqp_connection_close_t *>(
-              frame.payload.method.decoded));
-        }
-      } else {
-        AddToFrameQueue(frame);
-      }
+      HandleFrameFromBroker(frame);
 
       if (timeout != boost::chrono::microseconds::max()) {
         boost::chrono::steady_clock::time_point now =
@@ -121,29 +219,26 @@ class ChannelImpl : boost::noncopyable {
       amqp_channel_t channel, amqp_frame_t &frame,
       boost::chrono::microseconds timeout = boost::chrono::microseconds::max());
 
-  static bool is_on_channel(const amqp_frame_t frame, amqp_channel_t channel) {
-    return channel == frame.channel;
-  }
-
-  static bool is_frame_type_on_channel(const amqp_frame_t frame,
-                                       uint8_t frame_type,
-                                       amqp_channel_t channel) {
-    return frame.frame_type == frame_type && frame.channel == channel;
+  static bool is_method(const queued_frame_t &queued,
+                        amqp_method_number_t method) {
+    return queued.frame.frame_type == AMQP_FRAME_METHOD &&
+           queued.frame.payload.method.id == method;
   }
 
-  static bool is_method_on_channel(const amqp_frame_t frame,
-                                   amqp_method_number_t method,
-                                   amqp_channel_t channel) {
-    return frame.channel == channel && frame.frame_type == AMQP_FRAME_METHOD &&
-           frame.payload.method.id == method;
+  template <class ResponseListType>
+  static bool is_expected_method(const queued_frame_t &queued,
+                                 const ResponseListType &expected_responses) {
+    return AMQP_FRAME_METHOD == queued.frame.frame_type &&
+           expected_responses.end() != std::find(expected_responses.begin(),
+                                                 expected_responses.end(),
+                                                 queued.frame.payload.method.id);
   }
 
   template <class ChannelListType, class ResponseListType>
   static bool is_expected_method_on_channel(
-      const amqp_frame_t &frame, const ChannelListType channels,
+      const amqp_frame_t &frame, const ChannelListType &channels,
       const ResponseListType &expected_responses) {
-    return channels.end() !=
-               std::find(channels.begin(), channels.end(), frame.channel) &&
+    return ContainsChannel(channels, frame.channel) &&
            AMQP_FRAME_METHOD == frame.frame_type &&
            expected_responses.end() != std::find(expected_responses.begin(),
                                                  expected_responses.end(),
@@ -151,20 +246,35 @@ class ChannelImpl : boost::noncopyable {
   }
 
   template <class ChannelListType, class ResponseListType>
-  bool GetMethodOnChannel(const ChannelListType channels, amqp_frame_t &frame,
+  bool GetMethodOnChannel(const ChannelListType &channels, amqp_frame_t &frame,
                           const ResponseListType &expected_responses,
                           boost::chrono::microseconds timeout =
                               boost::chrono::microseconds::max()) {
-    frame_queue_t::iterator desired_frame = std::find_if(
-        m_frame_queue.begin(), m_frame_queue.end(),
-        boost::bind(
-            &ChannelImpl::is_expected_method_on_channel<ChannelListType,
-                                                        ResponseListType>,
-            _1, channels, expected_responses));
-
-    if (m_frame_queue.end() != desired_frame) {
-      frame = *desired_frame;
-      m_frame_queue.erase(desired_frame);
+    frame_queue_t *desired_queue = NULL;
+    frame_queue_t::iterator desired_frame;
+    for (typename ChannelListType::const_iterator channel = channels.begin();
+         channel != channels.end(); ++channel) {
+      frame_queue_t *queue = FindFrameQueue(*channel);
+      if (NULL == queue) {
+        continue;
+      }
+      frame_queue_t::iterator it = std::find_if(
+          queue->begin(), queue->end(),
+          boost::bind(&ChannelImpl::is_expected_method<ResponseListType>, _1,
+                      expected_responses));
+      if (queue->end() != it &&
+          (NULL == desired_queue || it->sequence < desired_frame->sequence)) {
+        desired_queue = queue;
+        desired_frame = it;
+      }
+    }
+
+    if (NULL != desired_queue) {
+      frame = desired_frame->frame;
+      TraceFrame(FrameTrace::fe_dequeued, frame);
+      ForgetAssembly(*desired_frame);
+      UnbufferFrame(frame);
+      desired_queue->erase(desired_frame);
       return true;
     }
 
@@ -193,7 +303,7 @@ class ChannelImpl : boost::noncopyable {
           throw;
         }
       }
-      m_frame_queue.push_back(incoming_frame);
+      PushFrame(incoming_frame);
 
       if (timeout != boost::chrono::microseconds::max()) {
         boost::chrono::steady_clock::time_point now =
@@ -213,12 +323,21 @@ class ChannelImpl : boost::noncopyable {
   amqp_frame_t DoRpcOnChannel(amqp_channel_t channel, boost::uint32_t method_id,
                               void *decoded,
                               const ResponseListType &expected_responses) {
-    CheckForError(amqp_send_method(m_connection, channel, method_id, decoded));
+    boost::chrono::steady_clock::time_point sent_at;
+    if (m_metrics) {
+      sent_at = boost::chrono::steady_clock::now();
+    }
+    CheckForError(SendMethod(channel, method_id, decoded));
 
     amqp_frame_t response;
     boost::array<amqp_channel_t, 1> channels = {{channel}};
 
     GetMethodOnChannel(channels, response, expected_responses);
+    if (m_metrics) {
+      m_metrics->RpcCompleted(
+          method_id, boost::chrono::duration_cast<boost::chrono::microseconds>(
+                         boost::chrono::steady_clock::now() - sent_at));
+    }
     return response;
   }
 
@@ -234,31 +353,179 @@ class ChannelImpl : boost::noncopyable {
 
   template <class ChannelListType>
   static bool envelope_on_channel(const Envelope::ptr_t &envelope,
-                                  const ChannelListType channels) {
-    return channels.end() != std::find(channels.begin(), channels.end(),
-                                       envelope->DeliveryChannel());
+                                  const ChannelListType &channels) {
+    return ContainsChannel(channels, envelope->DeliveryChannel());
   }
 
   template <class ChannelListType>
-  bool ConsumeMessageOnChannel(const ChannelListType channels,
-                               Envelope::ptr_t &message, int timeout) {
+  bool ConsumeMessageOnChannel(
+      const ChannelListType &channels, Envelope::ptr_t &message, int timeout,
+      const Channel::body_sink_t &sink = Channel::body_sink_t()) {
+    if (m_consumer_scheduling && 1 < channels.size()) {
+      amqp_channel_t channel;
+      if (PickScheduledChannel(channels, channel)) {
+        boost::array<amqp_channel_t, 1> picked = {{channel}};
+        if (ConsumeMessageOnChannel(picked, message, 0, sink)) {
+          return true;
+        }
+      }
+    }
+
     envelope_list_t::iterator it = std::find_if(
         m_delivered_messages.begin(), m_delivered_messages.end(),
         boost::bind(ChannelImpl::envelope_on_channel<ChannelListType>, _1,
-                    channels));
+                    boost::cref(channels)));
 
     if (it != m_delivered_messages.end()) {
       message = *it;
+      UnbufferEnvelope(message);
       m_delivered_messages.erase(it);
+      TraceDelivered(message);
+      if (sink) {
+        StreamBody(message->Message(), sink);
+      }
       return true;
     }
 
-    return ConsumeMessageOnChannelInner(channels, message, timeout);
+    if (0 != timeout && HasPendingAcks(channels)) {
+      if (ConsumeMessageOnChannelInner(channels, message, 0, sink)) {
+        TraceDelivered(message);
+        return true;
+      }
+      FlushAcks(channels);
+    }
+    if (!ConsumeMessageOnChannelInner(channels, message, timeout, sink)) {
+      return false;
+    }
+    TraceDelivered(message);
+    return true;
   }
 
+  // Appends up to max_count messages already delivered to channels to
+  // messages, waiting up to timeout for the first one only
   template <class ChannelListType>
-  bool ConsumeMessageOnChannelInner(const ChannelListType channels,
-                                    Envelope::ptr_t &message, int timeout) {
+  std::size_t ConsumeMessagesOnChannel(const ChannelListType &channels,
+                                       std::vector<Envelope::ptr_t> &messages,
+                                       std::size_t max_count, int timeout) {
+    Envelope::ptr_t envelope;
+    if (m_consumer_scheduling && 1 < channels.size()) {
+      // One at a time, so the batch is made up in the scheduled order
+      std::size_t count = 0;
+      while (count < max_count &&
+             ConsumeMessageOnChannel(channels, envelope,
+                                     0 == count ? timeout : 0)) {
+        messages.push_back(envelope);
+        ++count;
+      }
+      return count;
+    }
+
+    std::size_t count = TakeDeliveredMessages(channels, messages, max_count);
+
+    if (0 == count && 0 < max_count) {
+      if (!ConsumeMessageOnChannel(channels, envelope, timeout)) {
+        return 0;
+      }
+      messages.push_back(envelope);
+      ++count;
+    }
+
+    // Anything else already queued or readable without blocking
+    while (count < max_count &&
+           ConsumeMessageOnChannelInner(channels, envelope, 0)) {
+      TraceDelivered(envelope);
+      messages.push_back(envelope);
+      ++count;
+    }
+    return count;
+  }
+
+  // Prioritised and weighted delivery across consumers, see
+  // Channel::SetConsumerPriority. Reads what it can without waiting, then
+  // picks which of channels with a delivery ready should go next: the highest
+  // priority, sharing between those of equal priority by smooth weighted round
+  // robin. False when none of them has a delivery ready.
+  template <class ChannelListType>
+  bool PickScheduledChannel(const ChannelListType &channels,
+                            amqp_channel_t &picked) {
+    if (m_is_connected) {
+      ReadAvailableFrames();
+    }
+
+    m_ready_channels.clear();
+    for (envelope_list_t::const_iterator it = m_delivered_messages.begin();
+         it != m_delivered_messages.end(); ++it) {
+      if (ContainsChannel(channels, (*it)->DeliveryChannel())) {
+        m_ready_channels.insert((*it)->DeliveryChannel());
+      }
+    }
+    for (typename ChannelListType::const_iterator it = channels.begin();
+         it != channels.end(); ++it) {
+      if (HasQueuedDeliveryOnChannel(*it)) {
+        m_ready_channels.insert(*it);
+      }
+    }
+    if (m_ready_channels.empty()) {
+      return false;
+    }
+
+    int priority = GetSchedule(*m_ready_channels.begin()).priority;
+    for (channel_set_t::const_iterator it = m_ready_channels.begin();
+         it != m_ready_channels.end(); ++it) {
+      priority = std::max(priority, GetSchedule(*it).priority);
+    }
+
+    consumer_schedule_t *chosen = NULL;
+    long total_weight = 0;
+    for (channel_set_t::const_iterator it = m_ready_channels.begin();
+         it != m_ready_channels.end(); ++it) {
+      consumer_schedule_t &schedule = GetSchedule(*it);
+      if (priority != schedule.priority) {
+        continue;
+      }
+      schedule.current_weight += static_cast<long>(schedule.weight);
+      total_weight += static_cast<long>(schedule.weight);
+      if (NULL == chosen || schedule.current_weight > chosen->current_weight) {
+        chosen = &schedule;
+        picked = *it;
+      }
+    }
+    chosen->current_weight -= total_weight;
+    return true;
+  }
+
+  // Appends up to max_count of the complete messages for channels picked up
+  // while waiting for something else, never reads from the socket
+  template <class ChannelListType>
+  std::size_t TakeDeliveredMessages(const ChannelListType &channels,
+                                    std::vector<Envelope::ptr_t> &messages,
+                                    std::size_t max_count) {
+    std::size_t count = 0;
+
+    // Single pass, keeping the messages for other channels in order
+    envelope_list_t::iterator kept = m_delivered_messages.begin();
+    for (envelope_list_t::iterator it = m_delivered_messages.begin();
+         it != m_delivered_messages.end(); ++it) {
+      if (count < max_count && envelope_on_channel(*it, channels)) {
+        UnbufferEnvelope(*it);
+        TraceDelivered(*it);
+        messages.push_back(*it);
+        ++count;
+      } else {
+        if (kept != it) {
+          *kept = *it;
+        }
+        ++kept;
+      }
+    }
+    m_delivered_messages.erase(kept, m_delivered_messages.end());
+    return count;
+  }
+
+  template <class ChannelListType>
+  bool ConsumeMessageOnChannelInner(
+      const ChannelListType &channels, Envelope::ptr_t &message, int timeout,
+      const Channel::body_sink_t &sink = Channel::body_sink_t()) {
     const boost::array<boost::uint32_t, 2> DELIVER_OR_CANCEL = {
         {AMQP_BASIC_DELIVER_METHOD, AMQP_BASIC_CANCEL_METHOD}};
 
@@ -300,17 +567,65 @@ class ChannelImpl : boost::noncopyable {
     const boost::uint64_t delivery_tag = deliver_method->delivery_tag;
     const bool redelivered = (deliver_method->redelivered == 0 ? false : true);
     MaybeReleaseBuffersOnChannel(deliver.channel);
+    if (m_delivery_tags.size() <= deliver.channel) {
+      m_delivery_tags.resize(deliver.channel + 1, 0);
+    }
+    m_delivery_tags[deliver.channel] = delivery_tag;
 
-    BasicMessage::ptr_t content = ReadContent(deliver.channel);
+    BasicMessage::ptr_t content = ReadContent(deliver.channel, sink);
     MaybeReleaseBuffersOnChannel(deliver.channel);
 
-    message = Envelope::Create(content, in_consumer_tag, delivery_tag, exchange,
-                               redelivered, routing_key, deliver.channel);
+    message = CreateEnvelope(content, in_consumer_tag, delivery_tag, exchange,
+                             redelivered, routing_key, deliver.channel);
     return true;
   }
 
-  amqp_channel_t CreateNewChannel();
+  amqp_channel_t CreateNewChannel(bool confirm = true);
   amqp_channel_t GetNextChannelId();
+  // Keeps at least min_open confirm channels open and unused, opening them
+  // ahead of time
+  void SetChannelPoolSize(std::size_t min_open);
+  void TopUpChannelPool();
+
+  // Declarations the broker has accepted on this connection, see
+  // Channel::SetTopologyCacheEnabled
+  void SetTopologyCacheEnabled(bool enabled);
+  bool IsTopologyCacheEnabled() const { return m_topology_cache_enabled; }
+  // True when successful declarations have to be passed to RecordDeclaration
+  bool IsTrackingDeclarations() const {
+    return m_topology_cache_enabled || m_recovery_enabled;
+  }
+  bool IsDeclarationCached(const Topology::declaration_t &declaration) const;
+  void CacheDeclaration(const Topology::declaration_t &declaration);
+  // Caches the declaration and records it to be replayed by Recover.
+  // declared_name is the name the broker gave a declared queue.
+  void RecordDeclaration(const Topology::declaration_t &declaration,
+                         const std::string &declared_name = std::string());
+  // Only records it to be replayed, for declarations sent with nowait
+  void RecordForRecovery(const Topology::declaration_t &declaration,
+                         const std::string &declared_name = std::string());
+  void ForgetDeclaration(const Topology::declaration_t &declaration);
+  // Forgets the queue and its bindings
+  void ForgetQueue(const std::string &queue_name);
+  // Forgets the exchange and every binding to or from it
+  void ForgetExchange(const std::string &exchange_name);
+
+  // Sends the method for one declaration, returning the reply expected for it
+  amqp_method_number_t SendDeclaration(
+      amqp_channel_t channel, const Topology::declaration_t &declaration,
+      bool nowait);
+
+  // Reconnecting after the connection is lost, see Channel::EnableRecovery
+  void EnableRecovery(const std::vector<connection_params_t> &brokers,
+                      const Channel::RecoveryOptions &options);
+  void DisableRecovery();
+  bool IsRecoveryEnabled() const { return m_recovery_enabled; }
+  // Parses an amqp:// or amqps:// URI into params, keeping the rest of what
+  // is in it
+  static void ParseUri(const std::string &uri, connection_params_t &params);
+  const connection_params_t &GetConnectionParams() const {
+    return m_connection_params;
+  }
 
   void CheckRpcReply(amqp_channel_t channel, const amqp_rpc_reply_t &reply);
   void CheckForError(int ret);
@@ -321,16 +636,223 @@ class ChannelImpl : boost::noncopyable {
 
   MessageReturnedException CreateMessageReturnedException(
       amqp_basic_return_t &return_method, amqp_channel_t channel);
-  AmqpClient::BasicMessage::ptr_t ReadContent(amqp_channel_t channel);
+  // With a sink, the body is passed to it instead of being kept in the
+  // message, see Channel::BasicConsumeMessageStreaming
+  AmqpClient::BasicMessage::ptr_t ReadContent(
+      amqp_channel_t channel,
+      const Channel::body_sink_t &sink = Channel::body_sink_t());
+  void StreamContent(amqp_channel_t channel, std::size_t body_size,
+                     const Channel::body_sink_t &sink);
+  // Passes the body of an already read message to sink, and empties it
+  static void StreamBody(const BasicMessage::ptr_t &message,
+                         const Channel::body_sink_t &sink);
+  // Writes a basic.publish and its content frames, the body as source
+  // produces it. See Channel::BasicPublishStreaming.
+  void PublishStreaming(amqp_channel_t channel,
+                        const std::string &exchange_name,
+                        const std::string &routing_key, bool mandatory,
+                        const amqp_basic_properties_t *properties,
+                        boost::uint64_t body_size,
+                        const Channel::body_source_t &source);
+  Envelope::ptr_t CreateEnvelope(const BasicMessage::ptr_t message,
+                                 const std::string &consumer_tag,
+                                 const boost::uint64_t delivery_tag,
+                                 const std::string &exchange, bool redelivered,
+                                 const std::string &routing_key,
+                                 const boost::uint16_t delivery_channel);
+
+  // Every Channel sharing the connection has its own handle, the consumers
+  // started from it belong to it. The first Channel made for a connection is
+  // handle 0. See Connection.
+  typedef boost::uint32_t handle_id_t;
+  handle_id_t NewHandleId() { return ++m_last_handle_id; }
 
-  void AddConsumer(const std::string &consumer_tag, amqp_channel_t channel);
+  // What a consumer was started with, so that it can be started again after
+  // a recovery
+  struct consume_params_t {
+    std::string queue;
+    bool no_local;
+    bool no_ack;
+    bool exclusive;
+    boost::uint16_t prefetch_count;
+    PreparedTable arguments;
+    // Started on a channel without confirm.select, for a consumer whose
+    // channel is also published on (see RpcClient)
+    bool no_confirm;
+  };
+
+  // Sends basic.qos and basic.consume on a channel of its own, returning the
+  // consumer tag
+  std::string StartConsumer(const std::string &consumer_tag,
+                            const consume_params_t &params,
+                            handle_id_t handle);
+  void AddConsumer(const std::string &consumer_tag, amqp_channel_t channel,
+                   handle_id_t handle,
+                   const consume_params_t &params = consume_params_t());
+  void SetConsumerPrefetchCount(const std::string &consumer_tag,
+                                boost::uint16_t prefetch_count);
+  boost::uint16_t GetConsumerPrefetchCount(
+      const std::string &consumer_tag) const;
   amqp_channel_t RemoveConsumer(const std::string &consumer_tag);
   amqp_channel_t GetConsumerChannel(const std::string &consumer_tag);
-  std::vector<amqp_channel_t> GetAllConsumerChannels() const;
+  // Kept up to date as consumers are added and removed, so waiting on all of
+  // a Channel's consumers copies nothing
+  const channel_set_t &GetAllConsumerChannels(handle_id_t handle) const;
+  std::vector<std::string> GetConsumerTags(handle_id_t handle) const;
+
+  // Publisher confirm tracking used by BasicPublishAsync. Messages are
+  // published on a dedicated channel so the sequence numbers the broker uses
+  // in basic.ack/basic.nack match the ones handed out here.
+  amqp_channel_t GetConfirmChannel();
+  boost::uint64_t AddPendingConfirm(
+      const Channel::confirm_callback_t &callback);
+  // Also keeps the message, should it need publishing again after a recovery
+  boost::uint64_t AddPendingConfirm(const Channel::confirm_callback_t &callback,
+                                    const std::string &exchange,
+                                    const std::string &routing_key,
+                                    const BasicMessage::ptr_t &message,
+                                    bool mandatory, bool immediate);
+  void ProcessBufferedConfirms();
+  // Waits until every message up to and including sequence is confirmed
+  bool WaitForConfirms(boost::uint64_t sequence,
+                       boost::chrono::microseconds timeout);
+  bool IsConfirmed(boost::uint64_t sequence) const;
+  // Applies the Channel::SetPublishBackPressure policy before a message is
+  // published to the confirm channel, false when it is to be dropped
+  void SetPublishBackPressure(bool enabled, std::size_t max_unconfirmed,
+                              Channel::back_pressure_t policy);
+  bool WaitForPublishRoom();
+  // Reports a message that wasn't published as pc_dropped
+  boost::uint64_t DropPublish(const Channel::confirm_callback_t &callback);
 
+  // Deliveries read from the socket that haven't been handed to the
+  // application yet, in m_frame_queues and m_delivered_messages. Frames and
+  // envelopes are counted as they are added to and taken from those, see
+  // Channel::SetBufferLimits.
+  void SetBufferLimits(const Channel::BufferLimits &limits);
+  std::size_t GetBufferedBytes() const { return m_buffered_total.bytes; }
+  std::size_t GetBufferedMessages() const {
+    return m_buffered_total.messages;
+  }
+  std::size_t GetBufferedBytes(amqp_channel_t channel) const;
+  std::size_t GetBufferedMessages(amqp_channel_t channel) const;
+  bool IsBufferFull() const;
+  void BufferFrame(const amqp_frame_t &frame);
+  void UnbufferFrame(const amqp_frame_t &frame);
+  void BufferEnvelope(const Envelope::ptr_t &envelope);
+  void UnbufferEnvelope(const Envelope::ptr_t &envelope);
+
+  // Flow control of the whole connection by the broker
+  bool IsBlocked() const { return m_is_blocked; }
+  void SetBlockedCallback(const Channel::blocked_callback_t &callback) {
+    m_blocked_callback = callback;
+  }
+  // Set from a basic.return until the basic.ack that confirms the returned
+  // message has been handled
+  const boost::shared_ptr<MessageReturnedException> &GetReturnedMessage()
+      const {
+    return m_returned_message;
+  }
+  void SetSocketCork(bool cork);
+  // ReadAvailableFrames for fire-and-forget publishes: straight away when
+  // something has already been read into rabbitmq-c's buffer, otherwise only
+  // every PUBLISH_POLL_INTERVAL publishes, keeping a poll() per message off
+  // the publish path
+  void ReadBeforePublish();
+
+  // Acknowledgements of consumed messages, single acks on a channel with
+  // coalescing turned on are held back and sent as one multiple ack covering
+  // everything acked so far. See Channel::SetAckCoalescing.
+  void SetAckCoalescing(amqp_channel_t channel, std::size_t ack_every,
+                        boost::chrono::microseconds max_delay);
+  void Ack(amqp_channel_t channel, boost::uint64_t delivery_tag,
+           bool multiple);
+  void Reject(amqp_channel_t channel, boost::uint64_t delivery_tag,
+              bool requeue, bool multiple);
+  void FlushAcks(amqp_channel_t channel);
+  void FlushAllAcks();
+
+  // Prefetch count tuning of a consumer, see Channel::SetAdaptivePrefetch.
+  // Acks and rejects are counted by Ack and Reject, TunePrefetch says when
+  // the consumer on the channel is due a basic.qos and with what count, and
+  // RecordQos is told of each basic.qos sent and how long it took.
+  void SetAdaptivePrefetch(amqp_channel_t channel,
+                           boost::uint16_t max_prefetch_count);
+  bool TunePrefetch(amqp_channel_t channel, std::string &consumer_tag,
+                    boost::uint16_t &prefetch_count);
+  void RecordQos(amqp_channel_t channel, boost::uint16_t prefetch_count,
+                 boost::chrono::microseconds round_trip);
+
+  // How the consumer on the channel is served when several are waited on at
+  // once, see Channel::SetConsumerPriority
+  void SetConsumerPriority(amqp_channel_t channel, int priority,
+                           unsigned int weight);
+
+  template <class ChannelListType>
+  bool HasPendingAcks(const ChannelListType &channels) const {
+    if (m_ack_coalescers.empty()) {
+      return false;
+    }
+    for (typename ChannelListType::const_iterator it = channels.begin();
+         it != channels.end(); ++it) {
+      ack_coalescer_map_t::const_iterator coalescer =
+          m_ack_coalescers.find(*it);
+      if (m_ack_coalescers.end() != coalescer &&
+          coalescer->second.HasPending()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  template <class ChannelListType>
+  void FlushAcks(const ChannelListType &channels) {
+    for (typename ChannelListType::const_iterator it = channels.begin();
+         it != channels.end(); ++it) {
+      FlushAcks(*it);
+    }
+  }
+
+  bool HasQueuedFramesOnChannel(amqp_channel_t channel) const;
+  // True when a whole message or a basic.cancel is queued for channel, so
+  // that consuming from it won't read from the socket
+  bool HasQueuedDeliveryOnChannel(amqp_channel_t channel) const;
+  // True when a message or basic.cancel for one of channels can be consumed
+  // without reading from the socket
+  template <class ChannelListType>
+  bool HasDeliveryReady(const ChannelListType &channels) const {
+    for (envelope_list_t::const_iterator it = m_delivered_messages.begin();
+         it != m_delivered_messages.end(); ++it) {
+      if (envelope_on_channel(*it, channels)) {
+        return true;
+      }
+    }
+    for (typename ChannelListType::const_iterator it = channels.begin();
+         it != channels.end(); ++it) {
+      if (HasQueuedDeliveryOnChannel(*it)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  // rabbitmq-c may have read more than it has handed back, the socket won't
+  // become readable for that
+  bool HasUnreadData() const {
+    return amqp_data_in_buffer(m_connection) ||
+           amqp_frames_enqueued(m_connection);
+  }
+  // True while some, but not all, of a delivered message has been queued
+  bool IsAssemblingMessage(amqp_channel_t channel) const {
+    return channel < m_assemblies.size() &&
+           AS_Idle != m_assemblies[channel].state;
+  }
   void MaybeReleaseBuffersOnChannel(amqp_channel_t channel);
   void CheckIsConnected();
   void SetIsConnected(bool state) { m_is_connected = state; }
+  bool IsConnected() const { return m_is_connected; }
+  // What the broker agreed to in connection.tune
+  int GetFrameMax() const { return amqp_get_frame_max(m_connection); }
+  int GetChannelMax() const { return amqp_get_channel_max(m_connection); }
 
   // The RabbitMQ broker changed the way that basic.qos worked as of v3.3.0.
   // See: http://www.rabbitmq.com/consumer-prefetch.html
@@ -339,27 +861,345 @@ class ChannelImpl : boost::noncopyable {
   // channel (not connection).
   bool BrokerHasNewQosBehavior() const { return 0x030300 <= m_brokerVersion; }
 
+  // amqp_send_method and amqp_send_frame, counting the frame sent
+  int SendMethod(amqp_channel_t channel, amqp_method_number_t method_id,
+                 void *decoded);
+  int SendFrame(const amqp_frame_t &frame);
+  // Reports a message published with amqp_basic_publish, and the frames it
+  // was sent in
+  void CountPublish(const std::string &exchange, const amqp_bytes_t &body);
+  // amqp_basic_publish of message, counted. It is compressed first when the
+  // codec set by Channel::SetPublishCodec applies to it.
+  void PublishMessage(amqp_channel_t channel, const std::string &exchange,
+                      const std::string &routing_key, bool mandatory,
+                      bool immediate, const BasicMessage &message);
+  void SetPublishCodec(const Codec::ptr_t &codec, std::size_t min_body_size);
+  void CountFramesWritten(std::size_t count) {
+    if (m_metrics) {
+      m_metrics->FramesWritten(count);
+    }
+  }
+
+  // Adds an event to the trace set by Channel::SetFrameTrace, if any
+  void TraceFrame(FrameTrace::event_t event, const amqp_frame_t &frame) {
+    if (m_frame_trace) {
+      RecordFrame(event, frame);
+    }
+  }
+  void TraceDelivered(const Envelope::ptr_t &envelope) {
+    if (m_frame_trace) {
+      m_frame_trace->Record(FrameTrace::fe_delivered,
+                            envelope->DeliveryChannel(), AMQP_FRAME_METHOD,
+                            AMQP_BASIC_DELIVER_METHOD, envelope->DeliveryTag());
+    }
+  }
+  void RecordFrame(FrameTrace::event_t event, const amqp_frame_t &frame);
+
   amqp_connection_state_t m_connection;
+  // Set when recycling of delivered messages has been turned on
+  MessagePool::ptr_t m_message_pool;
+  // Set by Channel::SetMetrics, through SetMetrics
+  void SetMetrics(const Metrics::ptr_t &metrics);
+  Metrics::ptr_t m_metrics;
+  // Set by Channel::SetFrameTrace
+  FrameTrace::ptr_t m_frame_trace;
+  // Added by Channel::AddCodec, by content encoding
+  typedef boost::unordered_map<std::string, Codec::ptr_t> codec_map_t;
+  codec_map_t m_codecs;
 
  private:
   static boost::uint32_t ComputeBrokerVersion(
       const amqp_connection_state_t state);
 
-  frame_queue_t m_frame_queue;
+  void HandleConfirmFrame(const amqp_frame_t &frame);
+  void ConfirmPublished(boost::uint64_t delivery_tag, bool multiple,
+                        Channel::publish_confirm_t status);
+  void FailPendingConfirms();
+  void CheckConfirmChannelClosed();
+  void HandleConnectionFrame(const amqp_frame_t &frame);
+
+  static bool IsConnectionLost(int status);
+  // Reconnects with backoff, replaying what was recorded. Throws
+  // ConnectionClosedException after RecoveryOptions::max_attempts.
+  void Recover();
+  // Throws away everything there was of the lost connection
+  void ResetConnection();
+  // For a connection that is still up but can't be used any more: closes it
+  // with connection.close first, so the broker isn't left to notice the
+  // socket going away
+  void AbortConnection();
+  void ReplayTopology();
+  void ReplayConsumers();
+  void RepublishUnconfirmed();
+  // Gives a recorded queue named by the broker the name it has now
+  void RenameQueue(const std::string &old_name, const std::string &new_name);
+
+  frame_queue_list_t m_frame_queues;
+  boost::uint64_t m_next_frame_sequence;
+
+  // Tracks the basic.deliver that is partway through arriving on a channel so
+  // a complete message is spotted as soon as its last frame is queued
+  enum assembly_state_t { AS_Idle = 0, AS_Header, AS_Body };
+  struct message_assembly_t {
+    assembly_state_t state;
+    // The queued_frame_t::sequence of the basic.deliver being assembled
+    boost::uint64_t deliver_sequence;
+    boost::uint64_t body_remaining;
+  };
+  typedef std::vector<message_assembly_t> message_assembly_list_t;
+  // Throws std::runtime_error, leaving assembly as it was, for a frame out of
+  // place in the message
+  static bool UpdateAssembly(message_assembly_t &assembly,
+                             const queued_frame_t &queued);
+  // Indexed by channel number, same as m_frame_queues
+  message_assembly_list_t m_assemblies;
+  // How many of m_assemblies aren't AS_Idle
+  std::size_t m_assembling_messages;
+  void CountAssembly(bool was_assembling, bool is_assembling);
 
   typedef std::vector<Envelope::ptr_t> envelope_list_t;
   envelope_list_t m_delivered_messages;
+  // The last delivery tag handed out on each channel, indexed by channel
+  std::vector<boost::uint64_t> m_delivery_tags;
 
-  typedef std::map<std::string, amqp_channel_t> consumer_map_t;
+  struct ack_coalescer_t {
+    std::size_t ack_every;
+    boost::chrono::microseconds max_delay;
+    // Every tag up to here has been acknowledged to the broker
+    boost::uint64_t flushed_tag;
+    // Every tag up to here has been acked by the application
+    boost::uint64_t contiguous_tag;
+    // Tags acked or rejected by the application past a gap after
+    // contiguous_tag
+    std::set<boost::uint64_t> acked_ahead;
+    // The acked tags in acked_ahead not yet acknowledged to the broker one by
+    // one, a rejected tag is never sent in an ack
+    std::set<boost::uint64_t> unsent_ahead;
+    // Tags past flushed_tag already settled with the broker, acked one by one
+    // or rejected. The broker closes the channel on an ack naming one of
+    // them, so a multiple ack stops short of them.
+    std::set<boost::uint64_t> settled_ahead;
+    // When the first ack still to be sent was held back
+    boost::chrono::steady_clock::time_point oldest_pending;
+
+    bool HasPending() const {
+      return contiguous_tag != flushed_tag || !unsent_ahead.empty();
+    }
+  };
+  typedef std::map<amqp_channel_t, ack_coalescer_t> ack_coalescer_map_t;
+  static void SettleDelivery(ack_coalescer_t &coalescer,
+                             boost::uint64_t delivery_tag, bool multiple,
+                             bool acked);
+  ack_coalescer_map_t m_ack_coalescers;
+
+  struct prefetch_tuner_t {
+    std::string consumer_tag;
+    boost::uint16_t max_prefetch_count;
+    boost::uint16_t prefetch_count;
+    // Messages acked or rejected since window_start
+    boost::uint64_t settled;
+    // The highest delivery tag acked or rejected, for counting multiple acks
+    boost::uint64_t settled_tag;
+    boost::chrono::steady_clock::time_point window_start;
+    // Messages settled per second, averaged over the windows so far
+    double rate;
+    // Of the last basic.qos, zero until one has been sent
+    boost::chrono::microseconds round_trip;
+  };
+  typedef std::map<amqp_channel_t, prefetch_tuner_t> prefetch_tuner_map_t;
+  void CountSettled(amqp_channel_t channel, boost::uint64_t delivery_tag,
+                    bool multiple);
+  prefetch_tuner_map_t m_prefetch_tuners;
+
+  struct consumer_schedule_t {
+    int priority;
+    unsigned int weight;
+    // Of the smooth weighted round robin, see PickScheduledChannel
+    long current_weight;
+  };
+  consumer_schedule_t &GetSchedule(amqp_channel_t channel);
+  // Indexed by channel number, the consumer on each channel
+  std::vector<consumer_schedule_t> m_consumer_schedules;
+  // Set once any consumer has been given a priority or weight, until then
+  // messages are handed out in the order they arrived
+  bool m_consumer_scheduling;
+  // Scratch space for PickScheduledChannel
+  channel_set_t m_ready_channels;
+
+  struct consumer_t {
+    amqp_channel_t channel;
+    handle_id_t handle;
+    consume_params_t params;
+    // See SetAckCoalescing, ack_every is 0 when it is off
+    std::size_t ack_every;
+    boost::chrono::microseconds ack_max_delay;
+    // See SetAdaptivePrefetch, 0 when it is off
+    boost::uint16_t max_prefetch_count;
+    // See SetConsumerPriority
+    int priority;
+    unsigned int weight;
+  };
+  typedef boost::unordered_map<std::string, consumer_t> consumer_map_t;
   consumer_map_t m_consumer_channel_map;
+  // The channels of the consumers in m_consumer_channel_map, by the handle
+  // they belong to. Entries are never removed, so references to them stay
+  // valid.
+  typedef boost::unordered_map<handle_id_t, channel_set_t>
+      handle_channels_map_t;
+  handle_channels_map_t m_handle_channels;
+  // Handed out for a handle without consumers
+  channel_set_t m_no_channels;
+  handle_id_t m_last_handle_id;
 
-  enum channel_state_t { CS_Closed = 0, CS_Open, CS_Used };
+  // Channels opened without confirm.select are tracked with their own states
+  // so a confirm channel is never handed out for a fire-and-forget publish and
+  // vice versa
+  enum channel_state_t {
+    CS_Closed = 0,
+    CS_Open,
+    CS_Used,
+    CS_OpenNoConfirm,
+    CS_UsedNoConfirm,
+    // channel.open and confirm.select have been sent, see TopUpChannelPool
+    CS_Opening,
+    // Was open on a connection that has since been recovered. Its number
+    // isn't used again while others are free, so that acking a message
+    // delivered before the recovery can't ack another one.
+    CS_Retired,
+    CS_StateCount
+  };
   typedef std::vector<channel_state_t> channel_state_list_t;
 
+  // Counted by Metrics::ChannelOpened and Metrics::ChannelClosed
+  static bool IsOpenState(channel_state_t state);
+  void SetChannelState(amqp_channel_t channel, channel_state_t state);
+  bool TakeFreeChannel(channel_state_t state, amqp_channel_t &channel);
+  void StartOpeningChannel();
+  void WaitForOpeningChannels(bool until_one_is_open);
+  void RetireChannels();
+
   channel_state_list_t m_channels;
+  // How many channels are in each state
+  boost::array<std::size_t, CS_StateCount> m_channel_counts;
+  // The channels that were last put in the CS_Closed, CS_Open and
+  // CS_OpenNoConfirm states, most recent last, so a free channel is found
+  // without a scan. An entry goes stale when its channel changes state again
+  // and is skipped over when it comes up.
+  typedef std::vector<amqp_channel_t> channel_stack_t;
+  boost::array<channel_stack_t, CS_StateCount> m_free_channels;
+  // Free confirm channels to keep open, see Channel::SetChannelPoolSize
+  std::size_t m_channel_pool_size;
   boost::uint32_t m_brokerVersion;
-  // A channel that is likely to be an CS_Open state
-  amqp_channel_t m_last_used_channel;
+
+  // Keyed on the name of the exchange or queue declared or bound
+  typedef std::multimap<std::string, Topology::declaration_t>
+      declaration_cache_t;
+  static bool FindDeclaration(const declaration_cache_t &declarations,
+                              const Topology::declaration_t &declaration);
+  static void EraseDeclaration(declaration_cache_t &declarations,
+                               const Topology::declaration_t &declaration);
+  static void EraseQueue(declaration_cache_t &declarations,
+                         const std::string &queue_name);
+  static void EraseExchange(declaration_cache_t &declarations,
+                            const std::string &exchange_name);
+  declaration_cache_t m_declaration_cache;
+  bool m_topology_cache_enabled;
+
+  // What is replayed by Recover, unlike the cache this includes auto-delete
+  // and exclusive queues and exchanges
+  declaration_cache_t m_recorded_topology;
+  // Recorded queues that were named by the broker, they get a new name when
+  // replayed
+  std::set<std::string> m_server_named_queues;
+
+  connection_params_t m_connection_params;
+  // The broker first connected to, then any others to try
+  std::vector<connection_params_t> m_recovery_brokers;
+  Channel::RecoveryOptions m_recovery_options;
+  bool m_recovery_enabled;
+  bool m_recovering;
+
+  struct pending_confirm_t {
+    // As returned by BasicPublishAsync
+    boost::uint64_t sequence;
+    Channel::confirm_callback_t callback;
+    // Only set when the message is to be published again after a recovery
+    BasicMessage::ptr_t message;
+    std::string exchange;
+    std::string routing_key;
+    bool mandatory;
+    bool immediate;
+    // Only set when there is a Metrics to report the confirm to
+    boost::chrono::steady_clock::time_point published_at;
+  };
+  // Keyed on the delivery tag the broker confirms the message with
+  typedef std::map<boost::uint64_t, pending_confirm_t> pending_confirm_map_t;
+  void InsertPendingConfirm(const pending_confirm_t &pending);
+  pending_confirm_map_t m_pending_confirms;
+  // 0 when no channel has been reserved for asynchronous publishing yet
+  amqp_channel_t m_confirm_channel;
+  boost::uint64_t m_next_publish_seq;
+  // The broker numbers the messages on each confirm channel from 1
+  boost::uint64_t m_next_confirm_tag;
+  // Fire-and-forget publishes since the socket was last polled
+  unsigned int m_unpolled_publishes;
+  // Whether SetSocketCork last corked the socket
+  bool m_socket_corked;
+  // Set after a basic.return: the broker confirms a returned message right
+  // after returning it
+  boost::shared_ptr<MessageReturnedException> m_returned_message;
+
+  bool m_publish_back_pressure;
+  std::size_t m_max_unconfirmed;
+  Channel::back_pressure_t m_back_pressure_policy;
+
+  // See Channel::SetPublishCodec
+  Codec::ptr_t m_publish_codec;
+  std::string m_publish_encoding;
+  std::size_t m_publish_min_body_size;
+  // What PublishMessage sends instead of a message's body and properties
+  // when it compresses the body, kept to reuse the buffer
+  std::string m_compressed_body;
+  amqp_basic_properties_t m_compressed_properties;
+
+  struct buffered_t {
+    std::size_t bytes;
+    std::size_t messages;
+    // At one of the channel limits, or at a connection limit when it is the
+    // total
+    bool full;
+  };
+  static bool AtLimit(const buffered_t &buffered, std::size_t max_bytes,
+                      std::size_t max_messages, std::size_t scale);
+  void Buffer(amqp_channel_t channel, std::size_t bytes,
+              std::size_t messages);
+  void Unbuffer(amqp_channel_t channel, std::size_t bytes,
+                std::size_t messages);
+  void UpdateBufferState(amqp_channel_t channel);
+  void SendChannelFlow(amqp_channel_t channel, bool active);
+  void ReportQueueDepth(std::ptrdiff_t frames, std::ptrdiff_t envelopes);
+  Channel::BufferLimits m_buffer_limits;
+  // Indexed by channel number, same as m_frame_queues
+  std::vector<buffered_t> m_buffered;
+  buffered_t m_buffered_total;
+  // How many of m_buffered are full
+  std::size_t m_full_channels;
+  // All of the frames in m_frame_queues, and the envelopes in
+  // m_delivered_messages, as reported to Metrics::QueueDepthChanged
+  std::size_t m_queued_frames;
+  std::size_t m_queued_envelopes;
+  // Sent channel.flow with active false, for use_channel_flow
+  std::set<amqp_channel_t> m_flow_stopped;
+
+  // rabbitmq-c only sends heartbeats as it reads, so ReadAvailableFrames
+  // sends them itself while it leaves the socket alone
+  void SendHeartbeatIfDue();
+  boost::chrono::steady_clock::time_point m_last_heartbeat_sent;
+
+  // Between connection.blocked and connection.unblocked
+  bool m_is_blocked;
+  std::string m_blocked_reason;
+  Channel::blocked_callback_t m_blocked_callback;
 
   bool m_is_connected;
 };
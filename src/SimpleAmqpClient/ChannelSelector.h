@@ -0,0 +1,128 @@
+#ifndef SIMPLEAMQPCLIENT_CHANNELSELECTOR_H
+#define SIMPLEAMQPCLIENT_CHANNELSELECTOR_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/Channel.h"
+#include "SimpleAmqpClient/Util.h"
+
+#include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <cstddef>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251 4275)
+#endif
+
+namespace AmqpClient {
+
+namespace Detail {
+class ChannelSelectorImpl;
+}
+
+/**
+ * Waits on many Channels at once, from one thread
+ *
+ * The sockets of all of the connections the registered Channels use are
+ * waited on in a single poll() (WSAPoll() on Windows) call, so one thread can
+ * consume from any number of brokers without polling each Channel in turn.
+ * Wait reports the Channels that are worth calling
+ * Channel::BasicConsumeAvailable on, which then takes what has arrived
+ * without waiting.
+ *
+ * Readiness is level triggered, as with poll(): a Channel is reported for as
+ * long as a message for one of its consumers is waiting, and whenever its
+ * socket is readable. A reported Channel may have nothing to consume, e.g.,
+ * when only part of a message has arrived, when the broker sent something
+ * other than a message, or when a heartbeat is due to be sent. Errors, such
+ * as the connection being lost, are thrown by the Channel once it is called.
+ *
+ * Like Channel, a ChannelSelector isn't thread safe, and the Channels on it
+ * must be used from the thread that waits on it.
+ */
+class SIMPLEAMQPCLIENT_EXPORT ChannelSelector : boost::noncopyable {
+ public:
+  typedef boost::shared_ptr<ChannelSelector> ptr_t;
+
+  /**
+   * Creates a new ChannelSelector with no Channels
+   */
+  static ptr_t Create() { return boost::make_shared<ChannelSelector>(); }
+
+  ChannelSelector();
+  virtual ~ChannelSelector();
+
+  /**
+   * Registers a Channel to be waited on, does nothing if it already is
+   *
+   * Channels sharing a connection, see Connection, may all be registered,
+   * the socket is only waited on once.
+   */
+  void Add(const Channel::ptr_t &channel);
+
+  /**
+   * Stops waiting on a Channel, does nothing if it isn't registered
+   */
+  void Remove(const Channel::ptr_t &channel);
+
+  /**
+   * The number of Channels registered
+   */
+  std::size_t Size() const;
+
+  /**
+   * Waits for at least one of the Channels to be ready
+   *
+   * Returns straight away if a message for one of them has already been
+   * read, otherwise waits for one of the sockets to be readable. With
+   * heartbeats on, also returns the Channels on a connection due to send one.
+   *
+   * @param ready [out] the ready Channels are appended to this, in the order
+   * they were added
+   * @param timeout the timeout in milliseconds, 0 checks without waiting and
+   * -1 waits for as long as it takes
+   * @returns the number of Channels appended to ready, 0 if the timeout
+   * expired or no Channels are registered
+   */
+  std::size_t Wait(std::vector<Channel::ptr_t> &ready, int timeout = -1);
+
+ private:
+  boost::scoped_ptr<Detail::ChannelSelectorImpl> m_impl;
+};
+
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif  // SIMPLEAMQPCLIENT_CHANNELSELECTOR_H
@@ -0,0 +1,139 @@
+#ifndef SIMPLEAMQPCLIENT_CODEC_H
+#define SIMPLEAMQPCLIENT_CODEC_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/Util.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <cstddef>
+#include <string>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251 4275)
+#endif
+
+namespace AmqpClient {
+
+/**
+ * Compresses and decompresses message bodies
+ *
+ * A codec is identified by the content encoding it marks the messages it
+ * compressed with, see Channel::SetPublishCodec, Channel::AddCodec and
+ * BasicMessage::Compress. Other codecs can be plugged in by deriving from
+ * Codec.
+ *
+ * Compress and Decompress may be called from several threads at once, as a
+ * message received on one thread may be read on another.
+ */
+class SIMPLEAMQPCLIENT_EXPORT Codec : boost::noncopyable {
+ public:
+  typedef boost::shared_ptr<Codec> ptr_t;
+
+  /**
+   * The largest body the built in codecs decompress unless told otherwise,
+   * 128 MiB, RabbitMQ's own default limit on a message
+   */
+  static const std::size_t DEFAULT_MAX_BODY_SIZE;
+
+  /**
+   * Creates an LZ4 codec, with the content encoding "x-lz4-block"
+   *
+   * Bodies are an LZ4 block, after the length of the uncompressed body as a
+   * 32-bit little-endian number. This is SimpleAmqpClient's own format, not
+   * the LZ4 frame format that the lz4 tool and other clients read, hence
+   * the name. LZ4 is fast enough to be worth it even on a fast network.
+   *
+   * @param dictionary data like that of the bodies, which lets small bodies
+   * be compressed well. Both ends must use the same dictionary.
+   * @param max_body_size the largest body to decompress, in bytes. A body
+   * claiming to be larger is taken to be corrupt rather than allocated.
+   * @throws std::logic_error if SimpleAmqpClient was built without LZ4
+   * support (ENABLE_LZ4_SUPPORT)
+   */
+  static ptr_t CreateLz4(const std::string &dictionary = std::string(),
+                         std::size_t max_body_size = DEFAULT_MAX_BODY_SIZE);
+
+  /**
+   * Creates a Zstandard codec, with the content encoding "zstd"
+   *
+   * Bodies are a Zstandard frame holding the uncompressed size. Zstandard
+   * compresses better than LZ4, at more of a cost.
+   *
+   * @param level the compression level, 1 to 22, higher is smaller and slower
+   * @param dictionary a dictionary trained with zstd --train, or raw data like
+   * that of the bodies, which lets small bodies be compressed well. Both ends
+   * must use the same dictionary.
+   * @param max_body_size the largest body to decompress, in bytes. A body
+   * claiming to be larger is taken to be corrupt rather than allocated.
+   * @throws std::logic_error if SimpleAmqpClient was built without Zstandard
+   * support (ENABLE_ZSTD_SUPPORT)
+   */
+  static ptr_t CreateZstd(int level = 3,
+                          const std::string &dictionary = std::string(),
+                          std::size_t max_body_size = DEFAULT_MAX_BODY_SIZE);
+
+  virtual ~Codec();
+
+  /**
+   * The content encoding of the bodies this compresses, e.g., "zstd"
+   */
+  virtual std::string Name() const = 0;
+
+  /**
+   * Compresses a body
+   *
+   * @param data the body
+   * @param length the length of the body in bytes
+   * @param compressed [out] replaced with the compressed body
+   */
+  virtual void Compress(const char *data, std::size_t length,
+                        std::string &compressed) const = 0;
+
+  /**
+   * Decompresses a body
+   *
+   * @param data the compressed body
+   * @param length the length of the compressed body in bytes
+   * @param body [out] replaced with the body
+   * @throws std::runtime_error if data isn't something Compress made, or
+   * would be too large
+   */
+  virtual void Decompress(const char *data, std::size_t length,
+                          std::string &body) const = 0;
+};
+
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif  // SIMPLEAMQPCLIENT_CODEC_H
@@ -0,0 +1,241 @@
+#ifndef SIMPLEAMQPCLIENT_CONCURRENTCHANNEL_H
+#define SIMPLEAMQPCLIENT_CONCURRENTCHANNEL_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/BasicMessage.h"
+#include "SimpleAmqpClient/Channel.h"
+#include "SimpleAmqpClient/Envelope.h"
+#include "SimpleAmqpClient/Util.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <cstddef>
+#include <string>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251 4275)
+#endif
+
+namespace AmqpClient {
+
+namespace Detail {
+class ConcurrentChannelImpl;
+}
+
+/**
+ * A Channel that may be used from several threads at once
+ *
+ * Wraps a Channel that is then driven by a dedicated I/O thread. The I/O
+ * thread reads from the socket as soon as it becomes readable, sorting
+ * deliveries into a queue per consumer so they can be waited on from any
+ * number of threads, and sends the publishes and acks that application
+ * threads hand over without waiting for the connection. This lets several
+ * cores share one connection to the broker.
+ *
+ * Any other Channel operation can be run with Execute, which waits until the
+ * I/O thread is idle and then gives the calling thread sole use of the
+ * Channel.
+ *
+ * Only available when SimpleAmqpClient is built with ENABLE_THREAD_SUPPORT.
+ */
+class SIMPLEAMQPCLIENT_EXPORT ConcurrentChannel : boost::noncopyable {
+ public:
+  typedef boost::shared_ptr<ConcurrentChannel> ptr_t;
+  typedef boost::function<void(Channel &)> operation_t;
+  /**
+   * Called for each message delivered to a consumer started with
+   * BasicConsumeWithHandler
+   */
+  typedef boost::function<void(const Envelope::ptr_t &)> message_handler_t;
+
+  /**
+   * Starts driving a Channel from an I/O thread
+   *
+   * @param channel the Channel to take over. It must not be used directly
+   * once handed over, other than from within Execute.
+   * @param worker_threads the number of threads to call message handlers
+   * from, they are started with the first BasicConsumeWithHandler
+   * @returns a new ConcurrentChannel object pointer
+   */
+  static ptr_t Create(Channel::ptr_t channel, std::size_t worker_threads = 1) {
+    return boost::make_shared<ConcurrentChannel>(channel, worker_threads);
+  }
+
+  explicit ConcurrentChannel(Channel::ptr_t channel,
+                             std::size_t worker_threads = 1);
+
+  /**
+   * Stops the worker threads, then the I/O thread. Messages waiting for a
+   * handler are dropped (and redelivered by the broker if they weren't
+   * acked). Publishes and acks that were handed over are sent first.
+   */
+  virtual ~ConcurrentChannel();
+
+  /**
+   * Runs an operation on the Channel
+   *
+   * Waits for the I/O thread to be idle, then runs operation on the calling
+   * thread with sole use of the Channel. Exceptions thrown by operation are
+   * passed on to the caller. Work handed over with BasicPublish, BasicAck and
+   * BasicReject before this call may be sent after operation has run.
+   *
+   * @param operation the operation to run
+   */
+  void Execute(const operation_t &operation);
+
+  /**
+   * Publishes a Basic message without waiting for it to be sent
+   *
+   * The message is published from the I/O thread using
+   * Channel::BasicPublishAsync, the message must not be changed afterwards.
+   *
+   * @param exchange_name The name of the exchange to publish the message to
+   * @param routing_key The routing key to publish with
+   * @param message the BasicMessage object to publish
+   * @param mandatory requires the message to be routed to a queue
+   */
+  void BasicPublish(const std::string &exchange_name,
+                    const std::string &routing_key,
+                    const BasicMessage::ptr_t message, bool mandatory = false);
+
+  /**
+   * Publishes a Basic message without waiting for it to be sent
+   *
+   * @see Channel::BasicPublishAsync
+   * @param exchange_name The name of the exchange to publish the message to
+   * @param routing_key The routing key to publish with
+   * @param message the BasicMessage object to publish
+   * @param mandatory requires the message to be routed to a queue
+   * @param callback invoked on the I/O thread when the broker confirms the
+   * message. It must not call Execute or any of the other operations that
+   * wait for the I/O thread.
+   */
+  void BasicPublish(const std::string &exchange_name,
+                    const std::string &routing_key,
+                    const BasicMessage::ptr_t message, bool mandatory,
+                    const Channel::confirm_callback_t &callback);
+
+  /**
+   * Starts consuming Basic messages on a queue
+   *
+   * @see Channel::BasicConsume
+   * @returns the consumer tag
+   */
+  std::string BasicConsume(const std::string &queue,
+                           const std::string &consumer_tag = "",
+                           bool no_local = true, bool no_ack = true,
+                           bool exclusive = true,
+                           boost::uint16_t message_prefetch_count = 1);
+
+  /**
+   * Starts consuming Basic messages on a queue, passing them to a handler
+   *
+   * Messages are passed to handler from the worker threads. Messages for the
+   * same consumer are handled one at a time and in the order they were
+   * delivered, while different consumers are handled in parallel. The
+   * handler may ack messages, publish, or call any other method of this
+   * object. Exceptions thrown by the handler are ignored, the message is
+   * left as it is.
+   *
+   * @see Channel::BasicConsume
+   * @param queue the name of the queue to subscribe to
+   * @param handler called for each message delivered to the consumer
+   * @returns the consumer tag
+   */
+  std::string BasicConsumeWithHandler(
+      const std::string &queue, const message_handler_t &handler,
+      const std::string &consumer_tag = "", bool no_local = true,
+      bool no_ack = true, bool exclusive = true,
+      boost::uint16_t message_prefetch_count = 1);
+
+  /**
+   * Cancels a previously created Consumer
+   *
+   * Threads waiting for a message from the consumer are woken and get a
+   * ConsumerCancelledException, as do later calls to BasicConsumeMessage.
+   *
+   * @param consumer_tag the consumer to cancel
+   */
+  void BasicCancel(const std::string &consumer_tag);
+
+  /**
+   * Consumes a single message
+   *
+   * May be called from any number of threads at once, each message is given
+   * to one of them.
+   *
+   * @param consumer_tag [in] the consumer to wait for a message from
+   * @param envelope [out] the message object that is delivered
+   * @param timeout [in] the timeout in milliseconds for the message to be
+   * delivered. 0 works like a non-blocking read, -1 is an infinite timeout.
+   * @throws ConsumerCancelledException if the consumer was cancelled
+   * @throws std::logic_error if the consumer was started with
+   * BasicConsumeWithHandler
+   * @returns true if a message was delivered before the timeout, false
+   * otherwise
+   */
+  bool BasicConsumeMessage(const std::string &consumer_tag,
+                           Envelope::ptr_t &envelope, int timeout = -1);
+
+  /**
+   * Acknowledges a message without waiting for the ack to be sent
+   *
+   * @param info the delivery info of the message being ack'ed
+   * @param multiple also acknowledges every earlier message delivered on the
+   * same channel
+   */
+  void BasicAck(const Envelope::DeliveryInfo &info, bool multiple = false);
+
+  /**
+   * Rejects a message without waiting for the reject to be sent
+   *
+   * @param info the delivery info of the message being rejected
+   * @param requeue tells the broker to requeue the message or not
+   * @param multiple also rejects every earlier message delivered on the same
+   * channel
+   */
+  void BasicReject(const Envelope::DeliveryInfo &info, bool requeue,
+                   bool multiple = false);
+
+ private:
+  boost::scoped_ptr<Detail::ConcurrentChannelImpl> m_impl;
+};
+
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif  // SIMPLEAMQPCLIENT_CONCURRENTCHANNEL_H
@@ -0,0 +1,195 @@
+#ifndef SIMPLEAMQPCLIENT_CONNECTION_H
+#define SIMPLEAMQPCLIENT_CONNECTION_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/Channel.h"
+#include "SimpleAmqpClient/Util.h"
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <string>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251 4275)
+#endif
+
+namespace AmqpClient {
+
+/**
+ * A connection to an AMQP broker shared by several Channel objects
+ *
+ * Each Channel created with Channel::Create opens its own socket and logs in
+ * to the broker. The Channels leased from a Connection with CreateChannel
+ * all use the one socket instead, and the AMQP channels they open are
+ * numbered from the same pool. The connection is closed once the Connection
+ * and every Channel leased from it have been destroyed.
+ *
+ * The consumers started through a leased Channel belong to it: the
+ * BasicConsumeMessage overloads that don't take consumer tags only wait for
+ * its own consumers, and they are cancelled when the Channel is destroyed.
+ * Everything else, including publisher confirms, is shared by the
+ * connection.
+ *
+ * Like Channel, neither the Connection nor its Channels are thread safe: all
+ * of the Channels on a connection must be used from one thread at a time.
+ * The same applies when one of them is wrapped in a ConcurrentChannel or an
+ * AsyncChannel, which then reads the socket for the whole connection.
+ */
+class SIMPLEAMQPCLIENT_EXPORT Connection : boost::noncopyable {
+ public:
+  typedef boost::shared_ptr<Connection> ptr_t;
+
+  /**
+   * Opens a connection to an AMQP broker
+   *
+   * @see Channel::Create
+   * @returns a new Connection object pointer
+   */
+  static ptr_t Create(const std::string &host = "127.0.0.1", int port = 5672,
+                      const std::string &username = "guest",
+                      const std::string &password = "guest",
+                      const std::string &vhost = "/", int frame_max = 131072,
+                      int heartbeat = 0,
+                      const Channel::ConnectionOptions &options =
+                          Channel::ConnectionOptions()) {
+    return boost::make_shared<Connection>(Channel::Create(
+        host, port, username, password, vhost, frame_max, heartbeat, options));
+  }
+
+  /**
+   * Opens an SSL connection to an AMQP broker
+   *
+   * @see Channel::CreateSecure
+   * @returns a new Connection object pointer
+   */
+  static ptr_t CreateSecure(const std::string &path_to_ca_cert = "",
+                            const std::string &host = "127.0.0.1",
+                            const std::string &path_to_client_key = "",
+                            const std::string &path_to_client_cert = "",
+                            int port = 5671,
+                            const std::string &username = "guest",
+                            const std::string &password = "guest",
+                            const std::string &vhost = "/",
+                            int frame_max = 131072,
+                            bool verify_hostname = true, int heartbeat = 0,
+                            const Channel::ConnectionOptions &options =
+                                Channel::ConnectionOptions()) {
+    return boost::make_shared<Connection>(Channel::CreateSecure(
+        path_to_ca_cert, host, path_to_client_key, path_to_client_cert, port,
+        username, password, vhost, frame_max, verify_hostname, heartbeat,
+        options));
+  }
+
+  /**
+   * Opens an SSL connection to an AMQP broker set up by an SslContext
+   *
+   * @see Channel::CreateSecure
+   * @returns a new Connection object pointer
+   */
+  static ptr_t CreateSecure(const SslContext::ptr_t &ssl_context,
+                            const std::string &host = "127.0.0.1",
+                            int port = 5671,
+                            const std::string &username = "guest",
+                            const std::string &password = "guest",
+                            const std::string &vhost = "/",
+                            int frame_max = 131072, int heartbeat = 0,
+                            const Channel::ConnectionOptions &options =
+                                Channel::ConnectionOptions()) {
+    return boost::make_shared<Connection>(
+        Channel::CreateSecure(ssl_context, host, port, username, password,
+                              vhost, frame_max, heartbeat, options));
+  }
+
+  /**
+   * Opens a connection to an AMQP broker from an AMQP URI
+   *
+   * @see Channel::CreateFromUri
+   * @returns a new Connection object pointer
+   */
+  static ptr_t CreateFromUri(const std::string &uri, int frame_max = 131072,
+                             int heartbeat = 0,
+                             const Channel::ConnectionOptions &options =
+                                 Channel::ConnectionOptions()) {
+    return boost::make_shared<Connection>(
+        Channel::CreateFromUri(uri, frame_max, heartbeat, options));
+  }
+
+  /**
+   * Opens an SSL connection to an AMQP broker from an amqps:// URI
+   *
+   * @see Channel::CreateSecureFromUri
+   * @returns a new Connection object pointer
+   */
+  static ptr_t CreateSecureFromUri(const std::string &uri,
+                                   const std::string &path_to_ca_cert,
+                                   const std::string &path_to_client_key = "",
+                                   const std::string &path_to_client_cert = "",
+                                   bool verify_hostname = true,
+                                   int frame_max = 131072, int heartbeat = 0,
+                                   const Channel::ConnectionOptions &options =
+                                       Channel::ConnectionOptions()) {
+    return boost::make_shared<Connection>(Channel::CreateSecureFromUri(
+        uri, path_to_ca_cert, path_to_client_key, path_to_client_cert,
+        verify_hostname, frame_max, heartbeat, options));
+  }
+
+  /**
+   * Shares the connection of an existing Channel
+   *
+   * The Channel keeps working as before, and is one of the Channels sharing
+   * the connection.
+   *
+   * @param channel the Channel whose connection is shared
+   */
+  explicit Connection(Channel::ptr_t channel);
+  virtual ~Connection();
+
+  /**
+   * Leases a new Channel on this connection
+   *
+   * No socket is opened and nothing is sent to the broker, the AMQP channels
+   * the Channel needs are opened as it uses them.
+   *
+   * @returns a new Channel object pointer
+   */
+  Channel::ptr_t CreateChannel();
+
+ protected:
+  boost::shared_ptr<Detail::ChannelImpl> m_impl;
+};
+
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif  // SIMPLEAMQPCLIENT_CONNECTION_H
@@ -45,6 +45,10 @@
 
 namespace AmqpClient {
 
+namespace Detail {
+class MessagePool;
+}
+
 class SIMPLEAMQPCLIENT_EXPORT Envelope : boost::noncopyable {
  public:
   typedef boost::shared_ptr<Envelope> ptr_t;
@@ -88,6 +92,10 @@ class SIMPLEAMQPCLIENT_EXPORT Envelope : boost::noncopyable {
   /**
     * Get the payload of the envelope
     *
+    * When the message's content encoding is set its body is still encoded,
+    * such as by a codec that wasn't added to the Channel (see
+    * Channel::AddCodec) or that found the body corrupt.
+    *
     * @returns the message
     */
   inline BasicMessage::ptr_t Message() const { return m_message; }
@@ -153,13 +161,15 @@ class SIMPLEAMQPCLIENT_EXPORT Envelope : boost::noncopyable {
   }
 
  private:
-  const BasicMessage::ptr_t m_message;
-  const std::string m_consumerTag;
-  const boost::uint64_t m_deliveryTag;
-  const std::string m_exchange;
-  const bool m_redelivered;
-  const std::string m_routingKey;
-  const boost::uint16_t m_deliveryChannel;
+  friend class Detail::MessagePool;
+
+  BasicMessage::ptr_t m_message;
+  std::string m_consumerTag;
+  boost::uint64_t m_deliveryTag;
+  std::string m_exchange;
+  bool m_redelivered;
+  std::string m_routingKey;
+  boost::uint16_t m_deliveryChannel;
 };
 
 }  // namespace AmqpClient
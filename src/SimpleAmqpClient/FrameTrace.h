@@ -0,0 +1,163 @@
+#ifndef SIMPLEAMQPCLIENT_FRAMETRACE_H
+#define SIMPLEAMQPCLIENT_FRAMETRACE_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/Util.h"
+
+#include <boost/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251 4275)
+#endif
+
+namespace AmqpClient {
+
+/**
+ * A record of the last frames a connection handled, for finding out where a
+ * delivery was held up, see Channel::SetFrameTrace
+ *
+ * Events are kept in a ring of a fixed size, the oldest being overwritten
+ * once it is full, so recording one costs a clock read and a few stores and
+ * never allocates. Only the thread using the connection writes to the ring
+ * and nothing is locked: the events are to be read from that same thread,
+ * e.g., in the catch block of an exception it threw, or while the connection
+ * isn't in use.
+ */
+class SIMPLEAMQPCLIENT_EXPORT FrameTrace : boost::noncopyable {
+ public:
+  typedef boost::shared_ptr<FrameTrace> ptr_t;
+
+  /**
+   * What happened to a frame
+   */
+  enum event_t {
+    /// Read from the socket
+    fe_received = 0,
+    /// Put in its channel's queue, to wait for whoever will handle it
+    fe_queued,
+    /// Taken from its channel's queue
+    fe_dequeued,
+    /// The message it started was handed to the application
+    fe_delivered,
+    /// The application acked the message
+    fe_acked
+  };
+
+  /**
+   * One event, numbers are as in the AMQP frame
+   */
+  struct Event {
+    boost::chrono::steady_clock::time_point time;
+    event_t event;
+    boost::uint16_t channel;
+    // AMQP_FRAME_METHOD, AMQP_FRAME_HEADER or AMQP_FRAME_BODY
+    boost::uint8_t frame_type;
+    // For a method frame, 0 otherwise
+    boost::uint32_t method_id;
+    // Of a basic.deliver, a delivered message or an ack, 0 otherwise
+    boost::uint64_t delivery_tag;
+  };
+
+  /**
+   * Creates a new FrameTrace
+   *
+   * @param capacity how many events are kept, rounded up to a power of 2
+   */
+  static ptr_t Create(std::size_t capacity = 4096) {
+    return boost::make_shared<FrameTrace>(capacity);
+  }
+
+  explicit FrameTrace(std::size_t capacity);
+  virtual ~FrameTrace();
+
+  /**
+   * Adds an event, overwriting the oldest when the ring is full
+   */
+  void Record(event_t event, boost::uint16_t channel,
+              boost::uint8_t frame_type, boost::uint32_t method_id,
+              boost::uint64_t delivery_tag) {
+    Event &slot = m_events[m_recorded & m_mask];
+    slot.time = boost::chrono::steady_clock::now();
+    slot.event = event;
+    slot.channel = channel;
+    slot.frame_type = frame_type;
+    slot.method_id = method_id;
+    slot.delivery_tag = delivery_tag;
+    ++m_recorded;
+  }
+
+  /**
+   * Copies the events kept, oldest first
+   */
+  std::vector<Event> GetEvents() const;
+
+  /**
+   * How many events have been recorded, including those overwritten since
+   */
+  boost::uint64_t GetRecordedCount() const { return m_recorded; }
+
+  /**
+   * How many events can be kept
+   */
+  std::size_t GetCapacity() const { return m_events.size(); }
+
+  /**
+   * Throws away the events kept
+   */
+  void Clear() { m_recorded = 0; }
+
+  /**
+   * Writes the events kept, oldest first, one per line
+   *
+   * Each line has the time of the event in microseconds after the oldest,
+   * what happened, and the channel, frame and delivery tag it happened to.
+   */
+  void Dump(std::ostream &out) const;
+
+ private:
+  std::vector<Event> m_events;
+  std::size_t m_mask;
+  boost::uint64_t m_recorded;
+};
+
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif  // SIMPLEAMQPCLIENT_FRAMETRACE_H
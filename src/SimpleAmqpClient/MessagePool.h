@@ -0,0 +1,93 @@
+#ifndef SIMPLEAMQPCLIENT_MESSAGEPOOL_H
+#define SIMPLEAMQPCLIENT_MESSAGEPOOL_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/BasicMessage.h"
+#include "SimpleAmqpClient/Envelope.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <cstddef>
+#include <string>
+
+namespace AmqpClient {
+namespace Detail {
+
+/**
+ * Recycles the BasicMessage and Envelope objects handed out for deliveries
+ *
+ * Objects are returned to the pool when the last ptr_t referring to them is
+ * dropped, along with the storage for the shared_ptr bookkeeping. A recycled
+ * BasicMessage keeps the pool its properties are copied into, and a recycled
+ * Envelope keeps the capacity of its strings, so in the steady state a
+ * delivery needs no allocations beyond its body.
+ *
+ * Objects may be released from any thread. The pool may be destroyed while
+ * objects it handed out are still alive.
+ */
+class MessagePool : boost::noncopyable {
+ public:
+  typedef boost::shared_ptr<MessagePool> ptr_t;
+
+  /**
+   * @param max_cached the most idle objects of each kind to keep around
+   */
+  static ptr_t Create(std::size_t max_cached);
+
+  explicit MessagePool(std::size_t max_cached);
+  virtual ~MessagePool();
+
+  /**
+   * Gets an empty message
+   */
+  BasicMessage::ptr_t CreateMessage();
+
+  Envelope::ptr_t CreateEnvelope(const BasicMessage::ptr_t message,
+                                 const std::string &consumer_tag,
+                                 const boost::uint64_t delivery_tag,
+                                 const std::string &exchange, bool redelivered,
+                                 const std::string &routing_key,
+                                 const boost::uint16_t delivery_channel);
+
+  // Return an object to its freshly constructed state before it is cached
+  static void ResetMessage(BasicMessage *message);
+  static void ResetEnvelope(Envelope *envelope);
+
+  class State;
+
+ private:
+  boost::shared_ptr<State> m_state;
+};
+
+}  // namespace Detail
+}  // namespace AmqpClient
+
+#endif  // SIMPLEAMQPCLIENT_MESSAGEPOOL_H
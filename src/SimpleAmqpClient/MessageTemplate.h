@@ -0,0 +1,100 @@
+#ifndef SIMPLEAMQPCLIENT_MESSAGETEMPLATE_H
+#define SIMPLEAMQPCLIENT_MESSAGETEMPLATE_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/BasicMessage.h"
+#include "SimpleAmqpClient/Util.h"
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <string>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251 4275)
+#endif
+
+namespace AmqpClient {
+
+/**
+ * The properties of many messages, set up once
+ *
+ * Setting each property of a BasicMessage allocates a copy of it, and
+ * setting the header table converts it. When a producer sends a lot of
+ * messages with the same properties, a MessageTemplate does that once: the
+ * messages it creates share its copy of the properties and header table,
+ * and only a property that is then set on a message, such as its message id
+ * or timestamp, is copied into that message.
+ *
+ * A MessageTemplate can't be changed once created, and may be shared by
+ * messages used from different threads.
+ */
+class SIMPLEAMQPCLIENT_EXPORT MessageTemplate : boost::noncopyable {
+ public:
+  typedef boost::shared_ptr<const MessageTemplate> ptr_t;
+
+  /**
+   * Creates a MessageTemplate
+   *
+   * @param prototype a message with the properties and header table to give
+   * the messages created, its body is ignored
+   */
+  static ptr_t Create(const BasicMessage &prototype) {
+    return boost::make_shared<MessageTemplate>(prototype);
+  }
+
+  explicit MessageTemplate(const BasicMessage &prototype);
+  virtual ~MessageTemplate();
+
+  /**
+   * Creates a message with the template's properties and an empty body
+   *
+   * The body can then be set without copying it, with SwapBody, AdoptBody
+   * or ExternalBody.
+   */
+  BasicMessage::ptr_t CreateMessage() const;
+
+  /**
+   * Creates a message with the template's properties and the given body
+   */
+  BasicMessage::ptr_t CreateMessage(const std::string &body) const;
+
+ private:
+  // Holds the properties, shared by the messages created
+  boost::shared_ptr<BasicMessage> m_prototype;
+};
+
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif  // SIMPLEAMQPCLIENT_MESSAGETEMPLATE_H
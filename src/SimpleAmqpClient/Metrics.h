@@ -0,0 +1,258 @@
+#ifndef SIMPLEAMQPCLIENT_METRICS_H
+#define SIMPLEAMQPCLIENT_METRICS_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/Util.h"
+
+#include <boost/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <cstddef>
+#include <map>
+#include <string>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251 4275)
+#endif
+
+namespace AmqpClient {
+
+/**
+ * Receives measurements of what a connection is doing, see
+ * Channel::SetMetrics
+ *
+ * Each hook is called from within the SimpleAmqpClient call it measures, on
+ * the thread making it, so it should be quick and must not throw. The
+ * default implementations do nothing, a subclass overrides the hooks it is
+ * interested in. A Metrics registered on more than one connection is called
+ * from each of the threads using them. CountingMetrics is a ready made one.
+ */
+class SIMPLEAMQPCLIENT_EXPORT Metrics : boost::noncopyable {
+ public:
+  typedef boost::shared_ptr<Metrics> ptr_t;
+
+  virtual ~Metrics();
+
+  /**
+   * A method that the broker replies to, such as queue.declare, got its
+   * reply
+   *
+   * @param method_id the method sent, e.g., AMQP_QUEUE_DECLARE_METHOD
+   * @param elapsed from sending the method to reading the reply
+   */
+  virtual void RpcCompleted(boost::uint32_t method_id,
+                            boost::chrono::microseconds elapsed);
+
+  /**
+   * The broker confirmed, or refused, a published message
+   *
+   * @param elapsed from publishing the message to reading its basic.ack or
+   * basic.nack
+   */
+  virtual void PublishConfirmed(boost::chrono::microseconds elapsed);
+
+  /**
+   * Frames were sent to the broker, not counting the heartbeats sent by
+   * rabbitmq-c
+   */
+  virtual void FramesWritten(std::size_t count);
+
+  /**
+   * The connection waited for a frame from the broker
+   *
+   * @param elapsed how long it was blocked waiting
+   * @param frame_read false when the wait timed out
+   */
+  virtual void WaitedForFrame(boost::chrono::microseconds elapsed,
+                              bool frame_read);
+
+  /**
+   * What has been read from the broker without being handed to the
+   * application changed
+   *
+   * Each connection reports how its own depths changed, so that adding up
+   * the changes gives the depths over all of the connections the Metrics is
+   * set on. Setting another Metrics, or the connection going away, takes
+   * back what was reported.
+   *
+   * @param queued_frames the change in frames held while waiting for
+   * something else
+   * @param delivered_messages the change in complete messages held for
+   * BasicConsumeMessage
+   */
+  virtual void QueueDepthChanged(std::ptrdiff_t queued_frames,
+                                 std::ptrdiff_t delivered_messages);
+
+  /**
+   * A message was published
+   *
+   * @param exchange the exchange it was published to
+   * @param body_bytes the size of its body
+   */
+  virtual void MessagePublished(const std::string &exchange,
+                                std::size_t body_bytes);
+
+  /**
+   * A message was received, from a consumer or BasicGet
+   *
+   * @param consumer_tag the consumer it was delivered to, empty for a message
+   * from BasicGet
+   * @param body_bytes the size of its body
+   */
+  virtual void MessageReceived(const std::string &consumer_tag,
+                               std::size_t body_bytes);
+
+  /**
+   * An AMQP channel was opened
+   */
+  virtual void ChannelOpened();
+
+  /**
+   * An AMQP channel was closed, by the broker or because the connection was
+   * lost
+   */
+  virtual void ChannelClosed();
+};
+
+namespace Detail {
+class CountingMetricsImpl;
+}
+
+/**
+ * Metrics that adds up what it is told
+ *
+ * The totals can be read, or written out in the Prometheus text exposition
+ * format, from any thread while the connections it is registered on are in
+ * use. They are counted without locking, so each is read on its own and
+ * they may be a moment apart from one another.
+ */
+class SIMPLEAMQPCLIENT_EXPORT CountingMetrics : public Metrics {
+ public:
+  typedef boost::shared_ptr<CountingMetrics> ptr_t;
+
+  /**
+   * How long something took, added up
+   */
+  struct SIMPLEAMQPCLIENT_EXPORT Timing {
+    Timing();
+
+    boost::uint64_t count;
+    boost::chrono::microseconds total;
+    boost::chrono::microseconds max;
+  };
+
+  /**
+   * Messages and their body bytes
+   */
+  struct SIMPLEAMQPCLIENT_EXPORT Traffic {
+    Traffic();
+
+    boost::uint64_t messages;
+    boost::uint64_t bytes;
+  };
+
+  /**
+   * The totals at the time GetCounters was called
+   */
+  struct SIMPLEAMQPCLIENT_EXPORT Counters {
+    Counters();
+
+    // Keyed on the method sent
+    std::map<boost::uint32_t, Timing> rpcs;
+    Timing publish_confirms;
+    boost::uint64_t frames_written;
+    boost::uint64_t frames_read;
+    // Time spent waiting for frames, including waits that timed out
+    boost::chrono::microseconds frame_wait;
+    // The depths now, over all of the connections
+    std::size_t queued_frames;
+    std::size_t delivered_messages;
+    // Keyed on the exchange
+    std::map<std::string, Traffic> published;
+    // Keyed on the consumer tag, empty for BasicGet
+    std::map<std::string, Traffic> received;
+    boost::uint64_t channels_opened;
+    boost::uint64_t channels_closed;
+  };
+
+  static ptr_t Create() { return boost::make_shared<CountingMetrics>(); }
+
+  CountingMetrics();
+  virtual ~CountingMetrics();
+
+  /**
+   * Copies the totals
+   */
+  Counters GetCounters() const;
+
+  /**
+   * Sets all of the totals back to 0, other than the queue depths which
+   * stay as they are
+   */
+  void Reset();
+
+  /**
+   * Writes the totals in the Prometheus text exposition format
+   *
+   * @param prefix the start of each metric name
+   * @returns the metrics, one per line, with their HELP and TYPE lines
+   */
+  std::string ToPrometheusText(
+      const std::string &prefix = "simpleamqpclient") const;
+
+  virtual void RpcCompleted(boost::uint32_t method_id,
+                            boost::chrono::microseconds elapsed);
+  virtual void PublishConfirmed(boost::chrono::microseconds elapsed);
+  virtual void FramesWritten(std::size_t count);
+  virtual void WaitedForFrame(boost::chrono::microseconds elapsed,
+                              bool frame_read);
+  virtual void QueueDepthChanged(std::ptrdiff_t queued_frames,
+                                 std::ptrdiff_t delivered_messages);
+  virtual void MessagePublished(const std::string &exchange,
+                                std::size_t body_bytes);
+  virtual void MessageReceived(const std::string &consumer_tag,
+                               std::size_t body_bytes);
+  virtual void ChannelOpened();
+  virtual void ChannelClosed();
+
+ private:
+  boost::scoped_ptr<Detail::CountingMetricsImpl> m_impl;
+};
+
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif  // SIMPLEAMQPCLIENT_METRICS_H
@@ -0,0 +1,84 @@
+#ifndef SIMPLEAMQPCLIENT_MUTEX_H
+#define SIMPLEAMQPCLIENT_MUTEX_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <boost/utility.hpp>
+
+namespace AmqpClient {
+namespace Detail {
+
+// A plain mutex for the few places the library locks without needing
+// Boost.Thread, which is only linked with ENABLE_THREAD_SUPPORT
+class Mutex : boost::noncopyable {
+ public:
+#ifdef _WIN32
+  Mutex() { InitializeCriticalSection(&m_mutex); }
+  ~Mutex() { DeleteCriticalSection(&m_mutex); }
+  void lock() { EnterCriticalSection(&m_mutex); }
+  void unlock() { LeaveCriticalSection(&m_mutex); }
+#else
+  Mutex() { pthread_mutex_init(&m_mutex, NULL); }
+  ~Mutex() { pthread_mutex_destroy(&m_mutex); }
+  void lock() { pthread_mutex_lock(&m_mutex); }
+  void unlock() { pthread_mutex_unlock(&m_mutex); }
+#endif
+
+  class scoped_lock : boost::noncopyable {
+   public:
+    explicit scoped_lock(Mutex &mutex) : m_mutex(mutex) { m_mutex.lock(); }
+    ~scoped_lock() { m_mutex.unlock(); }
+
+   private:
+    Mutex &m_mutex;
+  };
+
+ private:
+#ifdef _WIN32
+  CRITICAL_SECTION m_mutex;
+#else
+  pthread_mutex_t m_mutex;
+#endif
+};
+
+}  // namespace Detail
+}  // namespace AmqpClient
+
+#endif  // SIMPLEAMQPCLIENT_MUTEX_H
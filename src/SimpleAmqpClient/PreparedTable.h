@@ -0,0 +1,112 @@
+#ifndef SIMPLEAMQPCLIENT_PREPAREDTABLE_H
+#define SIMPLEAMQPCLIENT_PREPAREDTABLE_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/Table.h"
+#include "SimpleAmqpClient/TableView.h"
+#include "SimpleAmqpClient/Util.h"
+
+#include <boost/shared_ptr.hpp>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251)
+#endif
+
+namespace AmqpClient {
+
+namespace Detail {
+struct PreparedTableImpl;
+}  // namespace Detail
+
+/**
+ * A field table that has already been converted for sending
+ *
+ * Every Table handed to the library is converted to the form rabbitmq-c
+ * sends, which means an allocation per entry and a walk over the whole
+ * table on every call. A PreparedTable is converted once, when it is made,
+ * and can then be passed to any number of calls, e.g., the same
+ * x-message-ttl argument to every DeclareQueue or the same headers on every
+ * message. It can't be changed once made. Copies are cheap and share the
+ * converted table, and may be used from several threads at once.
+ *
+ * Everything taking a PreparedTable also takes a Table, which is then
+ * converted for just that call.
+ */
+class SIMPLEAMQPCLIENT_EXPORT PreparedTable {
+ public:
+  /**
+   * Makes an empty table
+   */
+  PreparedTable();
+
+  /**
+   * Converts a table
+   *
+   * Not explicit, so a Table can be passed wherever a PreparedTable is
+   * taken.
+   */
+  PreparedTable(const Table &table);
+
+  /**
+   * Converts the table back into a Table
+   */
+  Table GetTable() const;
+
+  /**
+   * A view of the table, it keeps the table alive
+   */
+  TableView View() const;
+
+  /**
+   * Is the table empty
+   */
+  bool IsEmpty() const;
+
+  /**
+   * Holds the same fields and values as another table
+   */
+  bool operator==(const PreparedTable &other) const;
+  bool operator!=(const PreparedTable &other) const {
+    return !(*this == other);
+  }
+
+ private:
+  friend class Detail::TableValueImpl;
+  // NULL for an empty table
+  boost::shared_ptr<const Detail::PreparedTableImpl> m_impl;
+};
+
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif  // SIMPLEAMQPCLIENT_PREPAREDTABLE_H
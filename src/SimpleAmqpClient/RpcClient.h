@@ -0,0 +1,200 @@
+#ifndef SIMPLEAMQPCLIENT_RPCCLIENT_H
+#define SIMPLEAMQPCLIENT_RPCCLIENT_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/BasicMessage.h"
+#include "SimpleAmqpClient/Channel.h"
+#include "SimpleAmqpClient/Util.h"
+
+#include <boost/function.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <cstddef>
+#include <string>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251 4275)
+#endif
+
+namespace AmqpClient {
+
+namespace Detail {
+class RpcClientImpl;
+}
+
+/**
+ * Makes request/response calls to services listening on a queue
+ *
+ * Requests are published with a ReplyTo of RabbitMQ's direct reply-to
+ * pseudo-queue, amq.rabbitmq.reply-to, and a CorrelationId unique to the
+ * call. The replies come back to a consumer on the same channel and are
+ * matched to their call by CorrelationId. So there is no reply queue to
+ * declare, requests are published without waiting for a confirm, and any
+ * number of calls may be outstanding at once, each with its own timeout.
+ *
+ * A ReplyTo or CorrelationId already set on a request is replaced, as the
+ * reply has to come back through the direct reply-to consumer. The same
+ * request message may be sent again, it gets a new CorrelationId each time.
+ *
+ * The service replies by publishing to the default exchange with the
+ * request's ReplyTo as the routing key and its CorrelationId copied over.
+ * A request that can't be routed, or a reply sent after the call has timed
+ * out, is dropped. Requires RabbitMQ 3.4 or later.
+ *
+ * Like the Channel it is created on, an RpcClient must not be used from more
+ * than one thread at a time.
+ */
+class SIMPLEAMQPCLIENT_EXPORT RpcClient : boost::noncopyable {
+ public:
+  typedef boost::shared_ptr<RpcClient> ptr_t;
+  /**
+   * Called with the reply to a call made by SendRequest, or an empty pointer
+   * if the call timed out
+   */
+  typedef boost::function<void(const BasicMessage::ptr_t &)> reply_callback_t;
+
+  /**
+   * Starts consuming replies on a Channel
+   *
+   * @param channel the Channel to make calls on, it may still be used for
+   * anything else
+   * @returns a new RpcClient object pointer
+   */
+  static ptr_t Create(Channel::ptr_t channel) {
+    return boost::make_shared<RpcClient>(channel);
+  }
+
+  explicit RpcClient(Channel::ptr_t channel);
+
+  /**
+   * Cancels the reply consumer, outstanding calls are dropped without their
+   * callbacks being called
+   */
+  virtual ~RpcClient();
+
+  /**
+   * Makes a call and waits for its reply
+   *
+   * @param exchange_name the exchange to publish the request to
+   * @param routing_key the routing key to publish the request with
+   * @param request the request, its ReplyTo and CorrelationId are
+   * overwritten with those of the call
+   * @param reply [out] the reply
+   * @param timeout the most in milliseconds to wait for the reply, -1 for no
+   * limit
+   * @returns true when a reply came back, false if the call timed out
+   */
+  bool Call(const std::string &exchange_name, const std::string &routing_key,
+            const BasicMessage::ptr_t request, BasicMessage::ptr_t &reply,
+            int timeout = -1);
+
+  /**
+   * Makes a call without waiting for its reply
+   *
+   * Wait for the reply with WaitForReply. Until then it's kept, along with
+   * the replies to other calls that come in meanwhile.
+   *
+   * @param exchange_name the exchange to publish the request to
+   * @param routing_key the routing key to publish the request with
+   * @param request the request, its ReplyTo and CorrelationId are
+   * overwritten with those of the call
+   * @param timeout the most in milliseconds to wait for the reply, -1 for no
+   * limit. If the reply hasn't come back by then the call is dropped.
+   * @returns the CorrelationId of the call
+   */
+  std::string SendRequest(const std::string &exchange_name,
+                          const std::string &routing_key,
+                          const BasicMessage::ptr_t request, int timeout = -1);
+
+  /**
+   * Makes a call, passing its reply to a callback
+   *
+   * The callback is called from WaitForReply, ProcessReplies or Call, when
+   * the reply comes back or the call times out. It may make other calls.
+   *
+   * @param exchange_name the exchange to publish the request to
+   * @param routing_key the routing key to publish the request with
+   * @param request the request, its ReplyTo and CorrelationId are
+   * overwritten with those of the call
+   * @param callback called once with the reply, or an empty pointer when
+   * the call times out
+   * @param timeout the most in milliseconds to wait for the reply, -1 for no
+   * limit
+   * @returns the CorrelationId of the call
+   */
+  std::string SendRequest(const std::string &exchange_name,
+                          const std::string &routing_key,
+                          const BasicMessage::ptr_t request,
+                          const reply_callback_t &callback, int timeout = -1);
+
+  /**
+   * Waits for the reply to a call made with SendRequest without a callback
+   *
+   * Replies to other calls that come in meanwhile are kept, or passed to
+   * their callbacks.
+   *
+   * @param correlation_id the CorrelationId returned by SendRequest
+   * @param reply [out] the reply
+   * @returns true when a reply came back, false if the call timed out or
+   * its reply has already been taken
+   * @throws std::logic_error if the call was made with a callback
+   */
+  bool WaitForReply(const std::string &correlation_id,
+                    BasicMessage::ptr_t &reply);
+
+  /**
+   * Handles the replies that have come back and the calls that have timed
+   * out, calling their callbacks
+   *
+   * @param timeout the most in milliseconds to wait for something to handle
+   * if there isn't anything yet, 0 to not wait, -1 for no limit
+   * @returns how many calls were handled, 0 if nothing came back in time
+   */
+  std::size_t ProcessReplies(int timeout = 0);
+
+  /**
+   * The number of calls that have been made but haven't been handled yet.
+   * This includes the replies kept for WaitForReply.
+   */
+  std::size_t PendingCalls() const;
+
+ private:
+  boost::scoped_ptr<Detail::RpcClientImpl> m_impl;
+};
+
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif  // SIMPLEAMQPCLIENT_RPCCLIENT_H
@@ -30,13 +30,25 @@
 
 #include "SimpleAmqpClient/AmqpException.h"
 #include "SimpleAmqpClient/AmqpResponseLibraryException.h"
+#include "SimpleAmqpClient/BackPressureException.h"
 #include "SimpleAmqpClient/BasicMessage.h"
 #include "SimpleAmqpClient/Channel.h"
+#include "SimpleAmqpClient/ChannelSelector.h"
+#include "SimpleAmqpClient/Codec.h"
+#include "SimpleAmqpClient/Connection.h"
 #include "SimpleAmqpClient/ConnectionClosedException.h"
 #include "SimpleAmqpClient/ConsumerCancelledException.h"
 #include "SimpleAmqpClient/ConsumerTagNotFoundException.h"
 #include "SimpleAmqpClient/Envelope.h"
+#include "SimpleAmqpClient/FrameTrace.h"
 #include "SimpleAmqpClient/MessageReturnedException.h"
+#include "SimpleAmqpClient/MessageTemplate.h"
+#include "SimpleAmqpClient/Metrics.h"
+#include "SimpleAmqpClient/PreparedTable.h"
+#include "SimpleAmqpClient/RpcClient.h"
+#include "SimpleAmqpClient/SslContext.h"
+#include "SimpleAmqpClient/TableView.h"
+#include "SimpleAmqpClient/Topology.h"
 #include "SimpleAmqpClient/Version.h"
 
 #endif  // SIMPLEAMQPCLIENT_SIMPLEAMQPCLIENT_H
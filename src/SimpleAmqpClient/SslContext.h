@@ -0,0 +1,133 @@
+#ifndef SIMPLEAMQPCLIENT_SSLCONTEXT_H
+#define SIMPLEAMQPCLIENT_SSLCONTEXT_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/Util.h"
+
+#include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <cstddef>
+#include <string>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251 4275)
+#endif
+
+namespace AmqpClient {
+
+namespace Detail {
+class ChannelImpl;
+class SslContextImpl;
+}
+
+/**
+ * TLS settings, and state, shared by the secure connections made with it
+ *
+ * The CA certificate, client certificate and client key are read from disk
+ * and parsed once, when the SslContext is created, rather than on every
+ * connect. The TLS session of the latest connection to each broker host is
+ * kept, so that reconnecting (see Channel::EnableRecovery) or opening more
+ * connections to the same broker resumes it with an abbreviated handshake,
+ * using a session ticket or session ID, whichever the broker hands out.
+ * That saves both ends the key exchange and certificate checks of a full
+ * handshake.
+ *
+ * Both need rabbitmq-c 0.11 or later, which gives access to the OpenSSL
+ * context of its sockets. With an older one the files are read on every
+ * connect, as they are for Channel::CreateSecure with paths, and every
+ * handshake is a full one.
+ *
+ * An SslContext may be shared by Channels used from different threads.
+ */
+class SIMPLEAMQPCLIENT_EXPORT SslContext : boost::noncopyable {
+ public:
+  typedef boost::shared_ptr<SslContext> ptr_t;
+
+  /**
+   * Loads the certificates and key
+   *
+   * @param path_to_ca_cert Path to the CA certificate file, PEM encoded
+   * @param path_to_client_key Path to the client key file, PEM encoded,
+   * empty for no client certificate
+   * @param path_to_client_cert Path to the client certificate file, PEM
+   * encoded, which may be followed by the certificates of its chain
+   * @param verify_hostname Verify the broker's certificate and that it is
+   * for the hostname connected to
+   * @returns a new SslContext object pointer
+   * @throws AmqpLibraryException if a file can't be loaded
+   */
+  static ptr_t Create(const std::string &path_to_ca_cert,
+                      const std::string &path_to_client_key = "",
+                      const std::string &path_to_client_cert = "",
+                      bool verify_hostname = true) {
+    return boost::make_shared<SslContext>(path_to_ca_cert, path_to_client_key,
+                                          path_to_client_cert,
+                                          verify_hostname);
+  }
+
+  explicit SslContext(const std::string &path_to_ca_cert,
+                      const std::string &path_to_client_key,
+                      const std::string &path_to_client_cert,
+                      bool verify_hostname);
+  virtual ~SslContext();
+
+  /**
+   * Sets whether sessions are kept and resumed, on by default
+   *
+   * Turning it off forgets the sessions kept so far.
+   */
+  void SetSessionResumption(bool enabled);
+
+  /**
+   * Forgets the sessions kept so far, the next connection to each broker
+   * makes a full handshake
+   */
+  void ClearSessions();
+
+  /**
+   * The number of handshakes so far that resumed a session
+   */
+  std::size_t GetResumedSessionCount() const;
+
+ private:
+  friend class Detail::ChannelImpl;
+
+  boost::scoped_ptr<Detail::SslContextImpl> m_impl;
+};
+
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif  // SIMPLEAMQPCLIENT_SSLCONTEXT_H
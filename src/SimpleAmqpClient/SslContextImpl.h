@@ -0,0 +1,101 @@
+#ifndef SIMPLEAMQPCLIENT_SSLCONTEXTIMPL_H
+#define SIMPLEAMQPCLIENT_SSLCONTEXTIMPL_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <amqp.h>
+
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "SimpleAmqpClient/Mutex.h"
+
+// As OpenSSL declares them, so that its headers are only needed by
+// SslContext.cpp
+typedef struct evp_pkey_st EVP_PKEY;
+typedef struct ssl_session_st SSL_SESSION;
+typedef struct ssl_st SSL;
+typedef struct x509_st X509;
+typedef struct x509_store_st X509_STORE;
+
+namespace AmqpClient {
+namespace Detail {
+
+class SslContextImpl : boost::noncopyable {
+ public:
+  SslContextImpl(const std::string &path_to_ca_cert,
+                 const std::string &path_to_client_key,
+                 const std::string &path_to_client_cert, bool verify_hostname);
+  ~SslContextImpl();
+
+  // Sets up a socket from amqp_ssl_socket_new to connect to host:port with
+  // this context
+  void Configure(amqp_socket_t *socket, const std::string &host, int port);
+
+  void SetSessionResumption(bool enabled);
+  void ClearSessions();
+  std::size_t GetResumedSessionCount() const;
+
+ private:
+  typedef Mutex mutex_t;
+  // Keyed by the host:port connected to
+  typedef std::map<std::string, SSL_SESSION *> session_map_t;
+
+  // OpenSSL callbacks, the SSL_CTX's app data is the SslContextImpl
+  static int SessionCallback(SSL *ssl, SSL_SESSION *session);
+  static void InfoCallback(const SSL *ssl, int where, int ret);
+
+  void LoadFiles();
+  void Release();
+  void ResumeSession(SSL *ssl);
+  void ConnectionMade(SSL *ssl);
+  bool KeepSession(const SSL *ssl, SSL_SESSION *session);
+
+  const std::string m_path_to_ca_cert;
+  const std::string m_path_to_client_key;
+  const std::string m_path_to_client_cert;
+  const bool m_verify_hostname;
+
+  X509_STORE *m_ca_certs;
+  X509 *m_client_cert;
+  std::vector<X509 *> m_client_cert_chain;
+  EVP_PKEY *m_client_key;
+
+  mutable mutex_t m_mutex;
+  bool m_session_resumption;
+  session_map_t m_sessions;
+  std::size_t m_resumed_sessions;
+};
+
+}  // namespace Detail
+}  // namespace AmqpClient
+
+#endif  // SIMPLEAMQPCLIENT_SSLCONTEXTIMPL_H
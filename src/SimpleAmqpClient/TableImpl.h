@@ -28,7 +28,9 @@
  * ***** END LICENSE BLOCK *****
  */
 
+#include "SimpleAmqpClient/PreparedTable.h"
 #include "SimpleAmqpClient/Table.h"
+#include "SimpleAmqpClient/TableView.h"
 
 #include <boost/cstdint.hpp>
 #include <boost/shared_ptr.hpp>
@@ -44,6 +46,12 @@ namespace Detail {
 
 typedef boost::shared_ptr<amqp_pool_t> amqp_pool_ptr_t;
 
+// The converted form of a PreparedTable, table is allocated from pool
+struct PreparedTableImpl {
+  amqp_pool_ptr_t pool;
+  amqp_table_t table;
+};
+
 struct void_t {};
 
 inline bool operator==(const void_t &, const void_t &) { return true; }
@@ -66,12 +74,26 @@ class TableValueImpl {
   static amqp_table_t CreateAmqpTable(const Table &table,
                                       amqp_pool_ptr_t &pool);
 
+  // Nothing is converted, pool is pointed at the storage of the prepared
+  // table so it outlives the table returned
+  static amqp_table_t CreateAmqpTable(const PreparedTable &table,
+                                      amqp_pool_ptr_t &pool);
+
   static Table CreateTable(const amqp_table_t &table);
 
+  // The view is of table itself, owner (if set) keeps it alive
+  static TableView CreateTableView(const amqp_table_t &table,
+                                   const boost::shared_ptr<const void> &owner);
+
   static amqp_table_t CopyTable(const amqp_table_t &table,
                                 amqp_pool_ptr_t &pool);
 
+  // Copies table into memory allocated from an existing pool
+  static amqp_table_t CopyTable(const amqp_table_t &table, amqp_pool_t &pool);
+
  private:
+  friend class AmqpClient::TableView;
+
   static amqp_table_t CreateAmqpTableInner(const Table &table,
                                            amqp_pool_t &pool);
   static TableValue CreateTableValue(const amqp_field_value_t &entry);
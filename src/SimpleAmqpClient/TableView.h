@@ -0,0 +1,141 @@
+#ifndef SIMPLEAMQPCLIENT_TABLEVIEW_H
+#define SIMPLEAMQPCLIENT_TABLEVIEW_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/Table.h"
+#include "SimpleAmqpClient/Util.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <cstddef>
+#include <string>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251)
+#endif
+
+struct amqp_table_entry_t_;
+
+namespace AmqpClient {
+
+namespace Detail {
+class TableValueImpl;
+}  // namespace Detail
+
+/**
+ * A read-only view of a field table, in the form it was received in
+ *
+ * Building a Table from a received one allocates a map node, a key and a
+ * TableValue for every entry, and more for nested arrays and tables. A
+ * TableView allocates nothing: the entries are looked up where rabbitmq-c
+ * decoded them, and scalars and strings are read straight out. Lookups
+ * compare keys one entry after the other, which is quickest for the handful
+ * of entries tables usually have.
+ *
+ * The lookup functions are named after the std::map ones that Table has.
+ * The Get* functions read a value of the given key the way the TableValue
+ * functions of the same name do, and throw the same exceptions.
+ * Functions taking a key throw std::out_of_range if it isn't in the table.
+ */
+class SIMPLEAMQPCLIENT_EXPORT TableView {
+ public:
+  /**
+   * Makes a view of an empty table
+   */
+  TableView();
+
+  /**
+   * The number of entries
+   */
+  std::size_t size() const { return m_size; }
+
+  /**
+   * Are there no entries
+   */
+  bool empty() const { return 0 == m_size; }
+
+  /**
+   * 1 if there is an entry with the key, 0 otherwise
+   */
+  std::size_t count(const TableKey &key) const;
+
+  /**
+   * Gets the value of an entry as a TableValue
+   */
+  TableValue at(const TableKey &key) const;
+
+  /**
+   * The key of the entry at index, entries are in the order they were
+   * received in
+   */
+  TableKey KeyAt(std::size_t index) const;
+
+  /**
+   * The value of the entry at index
+   */
+  TableValue ValueAt(std::size_t index) const;
+
+  /**
+   * The type of the value of an entry
+   */
+  TableValue::ValueType GetType(const TableKey &key) const;
+
+  bool GetBool(const TableKey &key) const;
+  boost::int64_t GetInteger(const TableKey &key) const;
+  double GetReal(const TableKey &key) const;
+  std::string GetString(const TableKey &key) const;
+
+  /**
+   * Copies the entries into a Table
+   */
+  Table ToTable() const;
+
+ private:
+  friend class Detail::TableValueImpl;
+
+  // NULL if there's no entry with the key
+  const amqp_table_entry_t_ *Lookup(const TableKey &key) const;
+  // Throws std::out_of_range if there's no entry with the key
+  const amqp_table_entry_t_ &Find(const TableKey &key) const;
+
+  const amqp_table_entry_t_ *m_entries;
+  std::size_t m_size;
+  // Keeps the entries alive when they aren't owned by a BasicMessage
+  boost::shared_ptr<const void> m_owner;
+};
+
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif  // SIMPLEAMQPCLIENT_TABLEVIEW_H
@@ -0,0 +1,140 @@
+#ifndef SIMPLEAMQPCLIENT_TOPOLOGY_H
+#define SIMPLEAMQPCLIENT_TOPOLOGY_H
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/Channel.h"
+#include "SimpleAmqpClient/PreparedTable.h"
+#include "SimpleAmqpClient/Table.h"
+#include "SimpleAmqpClient/Util.h"
+
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251 4275)
+#endif
+
+namespace AmqpClient {
+
+/**
+ * A list of exchanges, queues and bindings to declare all at once
+ *
+ * Build the list up, then pass it to Channel::DeclareTopology, which sends
+ * all of the methods to the broker back to back instead of waiting for each
+ * reply in turn. The declarations are made in the order they were added.
+ * The parameters are the same as the Channel methods of the same names.
+ */
+class SIMPLEAMQPCLIENT_EXPORT Topology {
+ public:
+  enum declaration_kind_t {
+    dk_exchange = 0,
+    dk_queue,
+    dk_queue_binding,
+    dk_exchange_binding
+  };
+
+  struct declaration_t {
+    declaration_kind_t kind;
+    // The exchange or queue declared or bound, the destination exchange of
+    // an exchange binding
+    std::string name;
+    // The type of an exchange, the exchange a queue or exchange is bound to
+    std::string target;
+    std::string routing_key;
+    bool passive;
+    bool durable;
+    bool exclusive;
+    bool auto_delete;
+    PreparedTable arguments;
+  };
+  typedef std::vector<declaration_t> declaration_list_t;
+
+  /**
+   * Adds an exchange to declare
+   * @see Channel::DeclareExchange
+   * @returns this Topology, so calls can be chained
+   */
+  Topology &DeclareExchange(
+      const std::string &exchange_name,
+      const std::string &exchange_type = Channel::EXCHANGE_TYPE_DIRECT,
+      bool passive = false, bool durable = false, bool auto_delete = false,
+      const PreparedTable &arguments = PreparedTable());
+
+  /**
+   * Adds a queue to declare
+   * @see Channel::DeclareQueue
+   * @returns this Topology, so calls can be chained
+   */
+  Topology &DeclareQueue(const std::string &queue_name, bool passive = false,
+                         bool durable = false, bool exclusive = true,
+                         bool auto_delete = true,
+                         const PreparedTable &arguments = PreparedTable());
+
+  /**
+   * Adds a queue binding
+   * @see Channel::BindQueue
+   * @returns this Topology, so calls can be chained
+   */
+  Topology &BindQueue(const std::string &queue_name,
+                      const std::string &exchange_name,
+                      const std::string &routing_key = "",
+                      const PreparedTable &arguments = PreparedTable());
+
+  /**
+   * Adds an exchange to exchange binding
+   * @see Channel::BindExchange
+   * @returns this Topology, so calls can be chained
+   */
+  Topology &BindExchange(const std::string &destination,
+                         const std::string &source,
+                         const std::string &routing_key,
+                         const PreparedTable &arguments = PreparedTable());
+
+  /**
+   * The declarations added so far, in order
+   */
+  const declaration_list_t &Declarations() const { return m_declarations; }
+
+  /**
+   * The number of queues in Declarations()
+   */
+  std::size_t QueueCount() const;
+
+ private:
+  declaration_list_t m_declarations;
+};
+
+}  // namespace AmqpClient
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif  // SIMPLEAMQPCLIENT_TOPOLOGY_H
@@ -28,8 +28,8 @@
  * ***** END LICENSE BLOCK *****
  */
 
-#define SIMPLEAMQPCLIENT_VERSION_MAJOR 2
-#define SIMPLEAMQPCLIENT_VERSION_MINOR 5
+#define SIMPLEAMQPCLIENT_VERSION_MAJOR 3
+#define SIMPLEAMQPCLIENT_VERSION_MINOR 0
 #define SIMPLEAMQPCLIENT_VERSION_PATCH 0
 
 #endif  // SIMPLEAMQPCLIENT_VERSION_H
@@ -0,0 +1,370 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// Put these first to avoid warnings about INT#_C macro redefinition
+#include <amqp.h>
+#include <amqp_framing.h>
+#ifdef SAC_SSL_SUPPORT_ENABLED
+#include <amqp_ssl_socket.h>
+#endif
+
+#include "SimpleAmqpClient/SslContext.h"
+
+#include "SimpleAmqpClient/AmqpLibraryException.h"
+#include "SimpleAmqpClient/SslContextImpl.h"
+
+// The OpenSSL context of a socket can be got at from rabbitmq-c 0.11 on
+#if defined(SAC_SSL_SUPPORT_ENABLED) && AMQP_VERSION >= 0x000B0000
+#define SAC_SSL_CONTEXT_ENABLED
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#endif
+
+#include <boost/lexical_cast.hpp>
+#include <new>
+#include <stdexcept>
+
+namespace AmqpClient {
+namespace Detail {
+
+#ifdef SAC_SSL_CONTEXT_ENABLED
+namespace {
+void FreeSessionKey(void *, void *key, CRYPTO_EX_DATA *, int, long, void *) {
+  delete static_cast<std::string *>(key);
+}
+
+// Where the host:port each socket connects to is kept in its SSL_CTX, which
+// rabbitmq-c creates afresh for every socket
+int SessionKeyIndex() {
+  static const int index =
+      SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, &FreeSessionKey);
+  return index;
+}
+
+std::string SessionKey(const SSL *ssl) {
+  const std::string *key = static_cast<const std::string *>(
+      SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), SessionKeyIndex()));
+  return NULL == key ? std::string() : *key;
+}
+
+SslContextImpl *GetContextImpl(const SSL *ssl) {
+  return static_cast<SslContextImpl *>(
+      SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+}
+}  // namespace
+#endif
+
+SslContextImpl::SslContextImpl(const std::string &path_to_ca_cert,
+                               const std::string &path_to_client_key,
+                               const std::string &path_to_client_cert,
+                               bool verify_hostname)
+    : m_path_to_ca_cert(path_to_ca_cert),
+      m_path_to_client_key(path_to_client_key),
+      m_path_to_client_cert(path_to_client_cert),
+      m_verify_hostname(verify_hostname),
+      m_ca_certs(NULL),
+      m_client_cert(NULL),
+      m_client_key(NULL),
+      m_session_resumption(true),
+      m_resumed_sessions(0) {
+#ifndef SAC_SSL_SUPPORT_ENABLED
+  throw std::logic_error(
+      "SSL support has not been compiled into SimpleAmqpClient");
+#endif
+  try {
+    LoadFiles();
+  } catch (...) {
+    Release();
+    throw;
+  }
+}
+
+SslContextImpl::~SslContextImpl() { Release(); }
+
+void SslContextImpl::LoadFiles() {
+#ifdef SAC_SSL_CONTEXT_ENABLED
+  m_ca_certs = X509_STORE_new();
+  if (NULL == m_ca_certs) {
+    throw std::bad_alloc();
+  }
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+  const int loaded =
+      X509_STORE_load_file(m_ca_certs, m_path_to_ca_cert.c_str());
+#else
+  const int loaded =
+      X509_STORE_load_locations(m_ca_certs, m_path_to_ca_cert.c_str(), NULL);
+#endif
+  if (1 != loaded) {
+    throw AmqpLibraryException::CreateException(
+        AMQP_STATUS_SSL_ERROR, "Error setting CA certificate for socket");
+  }
+
+  if (m_path_to_client_key.empty() || m_path_to_client_cert.empty()) {
+    return;
+  }
+  BIO *file = BIO_new_file(m_path_to_client_cert.c_str(), "r");
+  if (NULL != file) {
+    // The certificate, then those of its chain
+    m_client_cert = PEM_read_bio_X509(file, NULL, NULL, NULL);
+    X509 *chain_cert = NULL;
+    while (NULL != m_client_cert &&
+           NULL != (chain_cert = PEM_read_bio_X509(file, NULL, NULL, NULL))) {
+      m_client_cert_chain.push_back(chain_cert);
+    }
+    BIO_free(file);
+  }
+  file = BIO_new_file(m_path_to_client_key.c_str(), "r");
+  if (NULL != file) {
+    m_client_key = PEM_read_bio_PrivateKey(file, NULL, NULL, NULL);
+    BIO_free(file);
+  }
+  // Reading up to the end of the certificate file leaves an error behind
+  ERR_clear_error();
+  if (NULL == m_client_cert || NULL == m_client_key) {
+    throw AmqpLibraryException::CreateException(
+        AMQP_STATUS_SSL_ERROR, "Error setting client certificate for socket");
+  }
+#endif
+}
+
+void SslContextImpl::Release() {
+  ClearSessions();
+#ifdef SAC_SSL_CONTEXT_ENABLED
+  X509_STORE_free(m_ca_certs);
+  m_ca_certs = NULL;
+  X509_free(m_client_cert);
+  m_client_cert = NULL;
+  for (std::vector<X509 *>::iterator it = m_client_cert_chain.begin();
+       it != m_client_cert_chain.end(); ++it) {
+    X509_free(*it);
+  }
+  m_client_cert_chain.clear();
+  EVP_PKEY_free(m_client_key);
+  m_client_key = NULL;
+#endif
+}
+
+void SslContextImpl::Configure(amqp_socket_t *socket, const std::string &host,
+                               int port) {
+#ifdef SAC_SSL_SUPPORT_ENABLED
+#if AMQP_VERSION >= 0x00080001
+  amqp_ssl_socket_set_verify_peer(socket, m_verify_hostname);
+  amqp_ssl_socket_set_verify_hostname(socket, m_verify_hostname);
+#else
+  amqp_ssl_socket_set_verify(socket, m_verify_hostname);
+#endif
+
+#ifdef SAC_SSL_CONTEXT_ENABLED
+  SSL_CTX *context =
+      static_cast<SSL_CTX *>(amqp_ssl_socket_get_context(socket));
+  // The store is shared with every connection, each holding a reference
+  X509_STORE_up_ref(m_ca_certs);
+  SSL_CTX_set_cert_store(context, m_ca_certs);
+  if (NULL != m_client_cert) {
+    if (1 != SSL_CTX_use_certificate(context, m_client_cert) ||
+        1 != SSL_CTX_use_PrivateKey(context, m_client_key)) {
+      throw AmqpLibraryException::CreateException(
+          AMQP_STATUS_SSL_ERROR,
+          "Error setting client certificate for socket");
+    }
+    for (std::vector<X509 *>::const_iterator it =
+             m_client_cert_chain.begin();
+         it != m_client_cert_chain.end(); ++it) {
+      SSL_CTX_add1_chain_cert(context, *it);
+    }
+  }
+
+  // The sessions are kept here rather than in the context, which goes away
+  // with the connection
+  SSL_CTX_set_app_data(context, this);
+  // Without SNI the handshake doesn't name the broker, and a session is only
+  // any good to the broker that issued it
+  std::string *key =
+      new std::string(host + ':' + boost::lexical_cast<std::string>(port));
+  if (1 != SSL_CTX_set_ex_data(context, SessionKeyIndex(), key)) {
+    delete key;
+    throw std::bad_alloc();
+  }
+  SSL_CTX_set_session_cache_mode(
+      context, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(context, &SslContextImpl::SessionCallback);
+  SSL_CTX_set_info_callback(context, &SslContextImpl::InfoCallback);
+#else
+  int status = amqp_ssl_socket_set_cacert(socket, m_path_to_ca_cert.c_str());
+  if (status) {
+    throw AmqpLibraryException::CreateException(
+        status, "Error setting CA certificate for socket");
+  }
+  if (!m_path_to_client_key.empty() && !m_path_to_client_cert.empty()) {
+    status = amqp_ssl_socket_set_key(socket, m_path_to_client_cert.c_str(),
+                                     m_path_to_client_key.c_str());
+    if (status) {
+      throw AmqpLibraryException::CreateException(
+          status, "Error setting client certificate for socket");
+    }
+  }
+#endif
+#else
+  (void)socket;
+#endif
+#ifndef SAC_SSL_CONTEXT_ENABLED
+  (void)host;
+  (void)port;
+#endif
+}
+
+int SslContextImpl::SessionCallback(SSL *ssl, SSL_SESSION *session) {
+#ifdef SAC_SSL_CONTEXT_ENABLED
+  // 1 keeps the reference to the session OpenSSL hands over
+  return GetContextImpl(ssl)->KeepSession(ssl, session) ? 1 : 0;
+#else
+  (void)ssl;
+  (void)session;
+  return 0;
+#endif
+}
+
+void SslContextImpl::InfoCallback(const SSL *ssl, int where, int) {
+#ifdef SAC_SSL_CONTEXT_ENABLED
+  // SSL_connect calls back before it sends the ClientHello, which is the
+  // first chance to offer a session on a socket rabbitmq-c sets up
+  SSL *mutable_ssl = const_cast<SSL *>(ssl);
+  if ((where & SSL_CB_HANDSHAKE_START) && SSL_in_before(ssl)) {
+    GetContextImpl(ssl)->ResumeSession(mutable_ssl);
+  } else if (where & SSL_CB_HANDSHAKE_DONE) {
+    GetContextImpl(ssl)->ConnectionMade(mutable_ssl);
+  }
+#else
+  (void)ssl;
+  (void)where;
+#endif
+}
+
+void SslContextImpl::ResumeSession(SSL *ssl) {
+#ifdef SAC_SSL_CONTEXT_ENABLED
+  mutex_t::scoped_lock lock(m_mutex);
+  session_map_t::const_iterator it = m_sessions.find(SessionKey(ssl));
+  if (!m_session_resumption || m_sessions.end() == it) {
+    return;
+  }
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+  if (!SSL_SESSION_is_resumable(it->second)) {
+    return;
+  }
+#endif
+  SSL_set_session(ssl, it->second);
+#else
+  (void)ssl;
+#endif
+}
+
+void SslContextImpl::ConnectionMade(SSL *ssl) {
+#ifdef SAC_SSL_CONTEXT_ENABLED
+  // With TLS 1.3 it is also called after each session ticket that arrives,
+  // the app data marks the connection as counted
+  if (!SSL_session_reused(ssl) || NULL != SSL_get_app_data(ssl)) {
+    return;
+  }
+  SSL_set_app_data(ssl, this);
+  mutex_t::scoped_lock lock(m_mutex);
+  ++m_resumed_sessions;
+#else
+  (void)ssl;
+#endif
+}
+
+bool SslContextImpl::KeepSession(const SSL *ssl, SSL_SESSION *session) {
+#ifdef SAC_SSL_CONTEXT_ENABLED
+  mutex_t::scoped_lock lock(m_mutex);
+  if (!m_session_resumption) {
+    return false;
+  }
+  // The latest one for the host replaces what was kept before
+  SSL_SESSION *&kept = m_sessions[SessionKey(ssl)];
+  if (NULL != kept) {
+    SSL_SESSION_free(kept);
+  }
+  kept = session;
+  return true;
+#else
+  (void)ssl;
+  (void)session;
+  return false;
+#endif
+}
+
+void SslContextImpl::SetSessionResumption(bool enabled) {
+  if (!enabled) {
+    ClearSessions();
+  }
+  mutex_t::scoped_lock lock(m_mutex);
+  m_session_resumption = enabled;
+}
+
+void SslContextImpl::ClearSessions() {
+  mutex_t::scoped_lock lock(m_mutex);
+#ifdef SAC_SSL_CONTEXT_ENABLED
+  for (session_map_t::iterator it = m_sessions.begin(); it != m_sessions.end();
+       ++it) {
+    SSL_SESSION_free(it->second);
+  }
+#endif
+  m_sessions.clear();
+}
+
+std::size_t SslContextImpl::GetResumedSessionCount() const {
+  mutex_t::scoped_lock lock(m_mutex);
+  return m_resumed_sessions;
+}
+
+}  // namespace Detail
+
+SslContext::SslContext(const std::string &path_to_ca_cert,
+                       const std::string &path_to_client_key,
+                       const std::string &path_to_client_cert,
+                       bool verify_hostname)
+    : m_impl(new Detail::SslContextImpl(path_to_ca_cert, path_to_client_key,
+                                        path_to_client_cert,
+                                        verify_hostname)) {}
+
+SslContext::~SslContext() {}
+
+void SslContext::SetSessionResumption(bool enabled) {
+  m_impl->SetSessionResumption(enabled);
+}
+
+void SslContext::ClearSessions() { m_impl->ClearSessions(); }
+
+std::size_t SslContext::GetResumedSessionCount() const {
+  return m_impl->GetResumedSessionCount();
+}
+
+}  // namespace AmqpClient
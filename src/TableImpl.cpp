@@ -199,6 +199,15 @@ amqp_table_t TableValueImpl::CreateAmqpTable(const Table &table,
   return CreateAmqpTableInner(table, *pool.get());
 }
 
+amqp_table_t TableValueImpl::CreateAmqpTable(const PreparedTable &table,
+                                             amqp_pool_ptr_t &pool) {
+  if (!table.m_impl) {
+    return AMQP_EMPTY_TABLE;
+  }
+  pool = table.m_impl->pool;
+  return table.m_impl->table;
+}
+
 amqp_table_t TableValueImpl::CreateAmqpTableInner(const Table &table,
                                                   amqp_pool_t &pool) {
   amqp_table_t new_table;
@@ -243,6 +252,17 @@ Table TableValueImpl::CreateTable(const amqp_table_t &table) {
   return new_table;
 }
 
+TableView TableValueImpl::CreateTableView(
+    const amqp_table_t &table, const boost::shared_ptr<const void> &owner) {
+  TableView view;
+  if (0 < table.num_entries) {
+    view.m_entries = table.entries;
+    view.m_size = table.num_entries;
+    view.m_owner = owner;
+  }
+  return view;
+}
+
 TableValue TableValueImpl::CreateTableValue(const amqp_field_value_t &entry) {
   switch (entry.kind) {
     case AMQP_FIELD_KIND_VOID:
@@ -304,6 +324,14 @@ amqp_table_t TableValueImpl::CopyTable(const amqp_table_t &table,
   return CopyTableInner(table, *pool.get());
 }
 
+amqp_table_t TableValueImpl::CopyTable(const amqp_table_t &table,
+                                       amqp_pool_t &pool) {
+  if (0 == table.num_entries) {
+    return AMQP_EMPTY_TABLE;
+  }
+  return CopyTableInner(table, pool);
+}
+
 amqp_table_t TableValueImpl::CopyTableInner(const amqp_table_t &table,
                                             amqp_pool_t &pool) {
   amqp_table_t new_table;
@@ -0,0 +1,200 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+// Put these first to avoid warnings about INT#_C macro redefinition
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#include "SimpleAmqpClient/TableView.h"
+
+#include "SimpleAmqpClient/TableImpl.h"
+
+#include <boost/variant/get.hpp>
+
+#include <limits>
+#include <stdexcept>
+
+#include <string.h>
+
+namespace AmqpClient {
+
+namespace {
+TableValue::ValueType KindToType(uint8_t kind) {
+  switch (kind) {
+    case AMQP_FIELD_KIND_BOOLEAN:
+      return TableValue::VT_bool;
+    case AMQP_FIELD_KIND_I8:
+      return TableValue::VT_int8;
+    case AMQP_FIELD_KIND_U8:
+      return TableValue::VT_uint8;
+    case AMQP_FIELD_KIND_I16:
+      return TableValue::VT_int16;
+    case AMQP_FIELD_KIND_U16:
+      return TableValue::VT_uint16;
+    case AMQP_FIELD_KIND_I32:
+      return TableValue::VT_int32;
+    case AMQP_FIELD_KIND_U32:
+      return TableValue::VT_uint32;
+    case AMQP_FIELD_KIND_I64:
+      return TableValue::VT_int64;
+    case AMQP_FIELD_KIND_U64:
+    case AMQP_FIELD_KIND_TIMESTAMP:
+      return TableValue::VT_uint64;
+    case AMQP_FIELD_KIND_F32:
+      return TableValue::VT_float;
+    case AMQP_FIELD_KIND_F64:
+      return TableValue::VT_double;
+    case AMQP_FIELD_KIND_UTF8:
+    case AMQP_FIELD_KIND_BYTES:
+      return TableValue::VT_string;
+    case AMQP_FIELD_KIND_ARRAY:
+      return TableValue::VT_array;
+    case AMQP_FIELD_KIND_TABLE:
+      return TableValue::VT_table;
+    case AMQP_FIELD_KIND_VOID:
+    case AMQP_FIELD_KIND_DECIMAL:
+    default:
+      // Decimals aren't supported by TableValue either
+      return TableValue::VT_void;
+  }
+}
+}  // namespace
+
+TableView::TableView() : m_entries(NULL), m_size(0) {}
+
+const amqp_table_entry_t *TableView::Lookup(const TableKey &key) const {
+  for (std::size_t i = 0; i < m_size; ++i) {
+    const amqp_bytes_t &entry_key = m_entries[i].key;
+    if (entry_key.len == key.size() &&
+        0 == memcmp(entry_key.bytes, key.data(), key.size())) {
+      return &m_entries[i];
+    }
+  }
+  return NULL;
+}
+
+const amqp_table_entry_t &TableView::Find(const TableKey &key) const {
+  const amqp_table_entry_t *entry = Lookup(key);
+  if (NULL == entry) {
+    throw std::out_of_range("TableView: no entry with key " + key);
+  }
+  return *entry;
+}
+
+std::size_t TableView::count(const TableKey &key) const {
+  return NULL == Lookup(key) ? 0 : 1;
+}
+
+TableValue TableView::at(const TableKey &key) const {
+  return Detail::TableValueImpl::CreateTableValue(Find(key).value);
+}
+
+TableKey TableView::KeyAt(std::size_t index) const {
+  if (index >= m_size) {
+    throw std::out_of_range("TableView::KeyAt: index out of range");
+  }
+  return TableKey(static_cast<const char *>(m_entries[index].key.bytes),
+                  m_entries[index].key.len);
+}
+
+TableValue TableView::ValueAt(std::size_t index) const {
+  if (index >= m_size) {
+    throw std::out_of_range("TableView::ValueAt: index out of range");
+  }
+  return Detail::TableValueImpl::CreateTableValue(m_entries[index].value);
+}
+
+TableValue::ValueType TableView::GetType(const TableKey &key) const {
+  return KindToType(Find(key).value.kind);
+}
+
+bool TableView::GetBool(const TableKey &key) const {
+  const amqp_field_value_t &value = Find(key).value;
+  if (AMQP_FIELD_KIND_BOOLEAN != value.kind) {
+    throw boost::bad_get();
+  }
+  return 0 != value.value.boolean;
+}
+
+boost::int64_t TableView::GetInteger(const TableKey &key) const {
+  const amqp_field_value_t &value = Find(key).value;
+  switch (KindToType(value.kind)) {
+    case TableValue::VT_uint8:
+      return value.value.u8;
+    case TableValue::VT_int8:
+      return value.value.i8;
+    case TableValue::VT_uint16:
+      return value.value.u16;
+    case TableValue::VT_int16:
+      return value.value.i16;
+    case TableValue::VT_uint32:
+      return value.value.u32;
+    case TableValue::VT_int32:
+      return value.value.i32;
+    case TableValue::VT_uint64:
+      if (value.value.u64 > static_cast<boost::uint64_t>(
+                                std::numeric_limits<boost::int64_t>::max())) {
+        throw std::overflow_error("Result of GetUint64() is out of range.");
+      }
+      return static_cast<boost::int64_t>(value.value.u64);
+    case TableValue::VT_int64:
+      return value.value.i64;
+    default:
+      throw boost::bad_get();
+  }
+}
+
+double TableView::GetReal(const TableKey &key) const {
+  const amqp_field_value_t &value = Find(key).value;
+  switch (value.kind) {
+    case AMQP_FIELD_KIND_F32:
+      return value.value.f32;
+    case AMQP_FIELD_KIND_F64:
+      return value.value.f64;
+    default:
+      throw boost::bad_get();
+  }
+}
+
+std::string TableView::GetString(const TableKey &key) const {
+  const amqp_field_value_t &value = Find(key).value;
+  if (TableValue::VT_string != KindToType(value.kind)) {
+    throw boost::bad_get();
+  }
+  return std::string(static_cast<const char *>(value.value.bytes.bytes),
+                     value.value.bytes.len);
+}
+
+Table TableView::ToTable() const {
+  amqp_table_t table;
+  table.num_entries = static_cast<int>(m_size);
+  table.entries = const_cast<amqp_table_entry_t *>(m_entries);
+  return Detail::TableValueImpl::CreateTable(table);
+}
+
+}  // namespace AmqpClient
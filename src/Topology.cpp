@@ -0,0 +1,112 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "SimpleAmqpClient/Topology.h"
+
+namespace AmqpClient {
+
+namespace {
+Topology::declaration_t MakeDeclaration(Topology::declaration_kind_t kind,
+                                        const std::string &name,
+                                        const std::string &target,
+                                        const PreparedTable &arguments) {
+  Topology::declaration_t declaration;
+  declaration.kind = kind;
+  declaration.name = name;
+  declaration.target = target;
+  declaration.passive = false;
+  declaration.durable = false;
+  declaration.exclusive = false;
+  declaration.auto_delete = false;
+  declaration.arguments = arguments;
+  return declaration;
+}
+}  // namespace
+
+Topology &Topology::DeclareExchange(const std::string &exchange_name,
+                                    const std::string &exchange_type,
+                                    bool passive, bool durable,
+                                    bool auto_delete,
+                                    const PreparedTable &arguments) {
+  declaration_t declaration =
+      MakeDeclaration(dk_exchange, exchange_name, exchange_type, arguments);
+  declaration.passive = passive;
+  declaration.durable = durable;
+  declaration.auto_delete = auto_delete;
+  m_declarations.push_back(declaration);
+  return *this;
+}
+
+Topology &Topology::DeclareQueue(const std::string &queue_name, bool passive,
+                                 bool durable, bool exclusive,
+                                 bool auto_delete,
+                                 const PreparedTable &arguments) {
+  declaration_t declaration =
+      MakeDeclaration(dk_queue, queue_name, std::string(), arguments);
+  declaration.passive = passive;
+  declaration.durable = durable;
+  declaration.exclusive = exclusive;
+  declaration.auto_delete = auto_delete;
+  m_declarations.push_back(declaration);
+  return *this;
+}
+
+Topology &Topology::BindQueue(const std::string &queue_name,
+                              const std::string &exchange_name,
+                              const std::string &routing_key,
+                              const PreparedTable &arguments) {
+  declaration_t declaration =
+      MakeDeclaration(dk_queue_binding, queue_name, exchange_name, arguments);
+  declaration.routing_key = routing_key;
+  m_declarations.push_back(declaration);
+  return *this;
+}
+
+Topology &Topology::BindExchange(const std::string &destination,
+                                 const std::string &source,
+                                 const std::string &routing_key,
+                                 const PreparedTable &arguments) {
+  declaration_t declaration =
+      MakeDeclaration(dk_exchange_binding, destination, source, arguments);
+  declaration.routing_key = routing_key;
+  m_declarations.push_back(declaration);
+  return *this;
+}
+
+std::size_t Topology::QueueCount() const {
+  std::size_t count = 0;
+  for (declaration_list_t::const_iterator it = m_declarations.begin();
+       it != m_declarations.end(); ++it) {
+    if (dk_queue == it->kind) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+}  // namespace AmqpClient
@@ -58,3 +58,112 @@ TEST_F(connected_test, basic_ack_deliveryinfo) {
 
   channel->BasicAck(info);
 }
+
+TEST_F(connected_test, basic_ack_multiple) {
+  std::string queue = channel->DeclareQueue("");
+  for (int i = 0; i < 4; ++i) {
+    channel->BasicPublish("", queue, BasicMessage::Create("Message Body"));
+  }
+
+  std::string consumer = channel->BasicConsume(queue, "", true, false, true, 3);
+
+  Envelope::ptr_t env;
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(channel->BasicConsumeMessage(consumer, env, 5000));
+  }
+  EXPECT_FALSE(channel->BasicConsumeMessage(consumer, env, 100));
+
+  // Acks all three, making room for the last message
+  channel->BasicAck(env, true);
+  ASSERT_TRUE(channel->BasicConsumeMessage(consumer, env, 5000));
+  channel->BasicAck(env);
+}
+
+TEST_F(connected_test, basic_ack_coalesced) {
+  std::string queue = channel->DeclareQueue("");
+  for (int i = 0; i < 6; ++i) {
+    channel->BasicPublish("", queue, BasicMessage::Create("Message Body"));
+  }
+
+  std::string consumer = channel->BasicConsume(queue, "", true, false, true, 2);
+  channel->SetAckCoalescing(consumer, 10, 1000);
+
+  // Held back acks are sent before waiting on a full prefetch window
+  std::vector<Envelope::ptr_t> envelopes;
+  for (int i = 0; i < 6; ++i) {
+    Envelope::ptr_t env;
+    ASSERT_TRUE(channel->BasicConsumeMessage(consumer, env, 5000));
+    envelopes.push_back(env);
+    if (1 == i % 2) {
+      // Out of order acks are held until the gap is filled
+      channel->BasicAck(envelopes[i]);
+      channel->BasicAck(envelopes[i - 1]);
+    }
+  }
+  channel->FlushAcks();
+
+  channel->SetAckCoalescing(consumer, 0);
+  channel->BasicCancel(consumer);
+}
+
+TEST_F(connected_test, basic_ack_coalesced_gap) {
+  std::string queue = channel->DeclareQueue("");
+  for (int i = 0; i < 3; ++i) {
+    channel->BasicPublish("", queue, BasicMessage::Create("Message Body"));
+  }
+
+  std::string consumer = channel->BasicConsume(queue, "", true, false, true, 2);
+  channel->SetAckCoalescing(consumer, 10, 1000);
+
+  Envelope::ptr_t first;
+  Envelope::ptr_t second;
+  ASSERT_TRUE(channel->BasicConsumeMessage(consumer, first, 5000));
+  ASSERT_TRUE(channel->BasicConsumeMessage(consumer, second, 5000));
+
+  // The first is held on to, so the ack of the second is past a gap and has
+  // to be sent on its own for the third to be delivered
+  channel->BasicAck(second);
+  Envelope::ptr_t third;
+  ASSERT_TRUE(channel->BasicConsumeMessage(consumer, third, 5000));
+
+  channel->BasicAck(first);
+  channel->BasicAck(third);
+  channel->FlushAcks();
+
+  channel->SetAckCoalescing(consumer, 0);
+  channel->BasicCancel(consumer);
+}
+
+TEST_F(connected_test, basic_reject_coalesced) {
+  std::string queue = channel->DeclareQueue("");
+  for (int i = 0; i < 5; ++i) {
+    channel->BasicPublish("", queue, BasicMessage::Create("Message Body"));
+  }
+
+  std::string consumer = channel->BasicConsume(queue, "", true, false);
+  channel->SetAckCoalescing(consumer, 10, 1000);
+
+  std::vector<Envelope::ptr_t> envelopes;
+  for (int i = 0; i < 5; ++i) {
+    Envelope::ptr_t env;
+    ASSERT_TRUE(channel->BasicConsumeMessage(consumer, env, 5000));
+    envelopes.push_back(env);
+  }
+
+  // Rejected just past the acked run, and past a gap
+  channel->BasicAck(envelopes[0]);
+  channel->BasicAck(envelopes[1]);
+  channel->BasicReject(envelopes[2], false);
+  channel->BasicReject(envelopes[4], false);
+  channel->BasicAck(envelopes[3]);
+  channel->FlushAcks();
+
+  // Had a rejected tag gone out in an ack the broker would have closed the
+  // channel
+  channel->SetAckCoalescing(consumer, 0);
+  channel->BasicCancel(consumer);
+  boost::uint32_t message_count = 1;
+  boost::uint32_t consumer_count = 1;
+  channel->DeclareQueueWithCounts(queue, message_count, consumer_count, true);
+  EXPECT_EQ(0u, message_count);
+}
@@ -0,0 +1,140 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <SimpleAmqpClient/AsyncChannel.h>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/use_future.hpp>
+#include <future>
+#include <thread>
+
+#include "connected_test.h"
+
+using namespace AmqpClient;
+
+TEST_F(connected_test, async_publish_confirm) {
+  boost::asio::io_context io_context;
+  AsyncChannel::ptr_t async = AsyncChannel::Create(io_context, channel);
+  std::string queue = channel->DeclareQueue("");
+
+  boost::system::error_code error;
+  Channel::publish_confirm_t status = Channel::pc_lost;
+  async->async_publish(
+      "", queue, BasicMessage::Create("Message Body"), false,
+      [&](boost::system::error_code e, Channel::publish_confirm_t s) {
+        error = e;
+        status = s;
+      });
+  io_context.run();
+
+  EXPECT_FALSE(error);
+  EXPECT_EQ(Channel::pc_ack, status);
+}
+
+TEST_F(connected_test, async_declare_consume) {
+  boost::asio::io_context io_context;
+  AsyncChannel::ptr_t async = AsyncChannel::Create(io_context, channel);
+
+  std::string body;
+  async->async_declare_queue(
+      "", false, false, true, true,
+      [&](boost::system::error_code error, std::string queue) {
+        ASSERT_FALSE(error);
+        async->async_basic_consume(
+            queue, "", true, true, false, 1,
+            [&, queue](boost::system::error_code error, std::string tag) {
+              ASSERT_FALSE(error);
+              async->async_consume(tag, [&](boost::system::error_code error,
+                                            Envelope::ptr_t envelope) {
+                ASSERT_FALSE(error);
+                body = envelope->Message()->Body();
+              });
+              channel->BasicPublish("", queue,
+                                    BasicMessage::Create("Message Body"));
+            });
+      });
+  io_context.run();
+
+  EXPECT_EQ("Message Body", body);
+}
+
+TEST_F(connected_test, async_declare_queue_not_found) {
+  boost::asio::io_context io_context;
+  AsyncChannel::ptr_t async = AsyncChannel::Create(io_context, channel);
+
+  boost::system::error_code error;
+  async->async_declare_queue(
+      "async_declare_queue_not_found", true, false, false, false,
+      [&](boost::system::error_code e, std::string) { error = e; });
+  io_context.run();
+
+  EXPECT_EQ(boost::system::error_code(404, AmqpErrorCategory()), error);
+  // Only the channel used for the declare is closed
+  EXPECT_NO_THROW(channel->DeclareQueue(""));
+}
+
+TEST_F(connected_test, async_consume_bad_tag) {
+  boost::asio::io_context io_context;
+  AsyncChannel::ptr_t async = AsyncChannel::Create(io_context, channel);
+
+  boost::system::error_code error;
+  async->async_consume(
+      "async_consume_bad_tag",
+      [&](boost::system::error_code e, Envelope::ptr_t) { error = e; });
+  io_context.run();
+
+  EXPECT_EQ(make_error_code(ae_consumer_not_found), error);
+}
+
+TEST_F(connected_test, async_use_future) {
+  boost::asio::io_context io_context;
+  AsyncChannel::ptr_t async = AsyncChannel::Create(io_context, channel);
+  std::string queue = channel->DeclareQueue("");
+
+  std::future<Channel::publish_confirm_t> confirmed =
+      async->async_publish("", queue, BasicMessage::Create("Message Body"),
+                           false, boost::asio::use_future);
+  std::thread io_thread([&] { io_context.run(); });
+  EXPECT_EQ(Channel::pc_ack, confirmed.get());
+  io_thread.join();
+}
+
+TEST_F(connected_test, async_pending_aborted) {
+  boost::asio::io_context io_context;
+  AsyncChannel::ptr_t async = AsyncChannel::Create(io_context, channel);
+  std::string queue = channel->DeclareQueue("");
+  std::string tag = channel->BasicConsume(queue);
+
+  boost::system::error_code error;
+  async->async_consume(
+      tag, [&](boost::system::error_code e, Envelope::ptr_t) { error = e; });
+  async.reset();
+  io_context.run();
+
+  EXPECT_EQ(boost::asio::error::operation_aborted, error);
+}
@@ -128,6 +128,36 @@ TEST_F(connected_test, channel_consume_success_timeout) {
   EXPECT_TRUE(channel->BasicConsumeMessage(consumer, consumed_envelope, 5000));
 }
 
+TEST_F(connected_test, channel_pool) {
+  channel->SetChannelPoolSize(4);
+
+  // More consumers than the pool holds, each takes a channel of its own
+  std::vector<std::string> queues;
+  std::vector<std::string> consumers;
+  for (int i = 0; i < 6; ++i) {
+    queues.push_back(channel->DeclareQueue(""));
+    consumers.push_back(channel->BasicConsume(queues.back()));
+  }
+
+  for (int i = 0; i < 6; ++i) {
+    channel->BasicPublish("", queues[i], BasicMessage::Create("Test message"));
+    Envelope::ptr_t envelope;
+    EXPECT_TRUE(channel->BasicConsumeMessage(consumers[i], envelope, 5000));
+  }
+}
+
+TEST_F(connected_test, channel_pool_recover_from_error) {
+  channel->SetChannelPoolSize(2);
+
+  EXPECT_THROW(channel->DeclareExchange("test_channel_exchangedoesnotexist",
+                                        Channel::EXCHANGE_TYPE_FANOUT, true,
+                                        false, true),
+               ChannelException);
+  channel->DeclareExchange("test_channel_exchange",
+                           Channel::EXCHANGE_TYPE_FANOUT, false, false, true);
+  channel->DeleteExchange("test_channel_exchange");
+}
+
 TEST(test_channels, big_message) {
   Channel::ptr_t channel = Channel::Create(connected_test::GetBrokerHost(),
                                            5672, "guest", "guest", "/", 4096);
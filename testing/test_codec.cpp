@@ -0,0 +1,237 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "connected_test.h"
+
+#include <boost/bind.hpp>
+#include <stdexcept>
+
+using namespace AmqpClient;
+
+namespace {
+// Run-length encoding, a byte count followed by the byte it repeats
+class RunLengthCodec : public Codec {
+ public:
+  virtual std::string Name() const { return "x-run-length"; }
+
+  virtual void Compress(const char *data, std::size_t length,
+                        std::string &compressed) const {
+    compressed.clear();
+    for (std::size_t i = 0; i < length;) {
+      std::size_t run = 1;
+      while (i + run < length && run < 255 && data[i + run] == data[i]) {
+        ++run;
+      }
+      compressed.push_back(static_cast<char>(run));
+      compressed.push_back(data[i]);
+      i += run;
+    }
+  }
+
+  virtual void Decompress(const char *data, std::size_t length,
+                          std::string &body) const {
+    if (0 != length % 2) {
+      throw std::runtime_error("corrupt run-length body");
+    }
+    body.clear();
+    for (std::size_t i = 0; i < length; i += 2) {
+      body.append(static_cast<unsigned char>(data[i]), data[i + 1]);
+    }
+  }
+};
+
+void append_body(std::string &body, const char *data, std::size_t length) {
+  body.append(data, length);
+}
+}  // namespace
+
+TEST(codec, compress_message) {
+  RunLengthCodec codec;
+  BasicMessage::ptr_t message = BasicMessage::Create(std::string(300, 'a'));
+  message->Compress(codec);
+
+  EXPECT_EQ("x-run-length", message->ContentEncoding());
+  EXPECT_EQ(std::string("\xff" "a" "\x2d" "a"), message->Body());
+
+  // Not compressed twice
+  EXPECT_THROW(message->Compress(codec), std::logic_error);
+}
+
+TEST(codec, decompress_message) {
+  RunLengthCodec codec;
+  BasicMessage::ptr_t message = BasicMessage::Create(std::string(300, 'a'));
+  EXPECT_THROW(message->Decompress(codec), std::logic_error);
+
+  message->Compress(codec);
+  message->Decompress(codec);
+  EXPECT_FALSE(message->ContentEncodingIsSet());
+  EXPECT_EQ(std::string(300, 'a'), message->Body());
+
+  // Left as it was
+  message->Body("abc");
+  message->ContentEncoding(codec.Name());
+  EXPECT_THROW(message->Decompress(codec), std::runtime_error);
+  EXPECT_EQ("abc", message->Body());
+  EXPECT_EQ("x-run-length", message->ContentEncoding());
+}
+
+TEST(codec, builtin_codecs) {
+  const std::string body(1000, 'b');
+  std::vector<Codec::ptr_t> codecs;
+#ifdef SAC_LZ4_SUPPORT_ENABLED
+  codecs.push_back(Codec::CreateLz4());
+  codecs.push_back(Codec::CreateLz4("bbbbbbbb"));
+  EXPECT_EQ("x-lz4-block", codecs.back()->Name());
+#else
+  EXPECT_THROW(Codec::CreateLz4(), std::logic_error);
+#endif
+#ifdef SAC_ZSTD_SUPPORT_ENABLED
+  codecs.push_back(Codec::CreateZstd());
+  codecs.push_back(Codec::CreateZstd(3, "bbbbbbbb"));
+  EXPECT_EQ("zstd", codecs.back()->Name());
+#else
+  EXPECT_THROW(Codec::CreateZstd(), std::logic_error);
+#endif
+
+  for (std::vector<Codec::ptr_t>::const_iterator it = codecs.begin();
+       it != codecs.end(); ++it) {
+    std::string compressed;
+    (*it)->Compress(body.data(), body.size(), compressed);
+    EXPECT_LT(compressed.size(), body.size());
+
+    std::string decompressed;
+    (*it)->Decompress(compressed.data(), compressed.size(), decompressed);
+    EXPECT_EQ(body, decompressed);
+
+    EXPECT_THROW((*it)->Decompress("junk", 4, decompressed),
+                 std::runtime_error);
+  }
+}
+
+TEST(codec, builtin_codecs_max_body_size) {
+  const std::string body(1000, 'b');
+  std::vector<Codec::ptr_t> codecs;
+#ifdef SAC_LZ4_SUPPORT_ENABLED
+  codecs.push_back(Codec::CreateLz4(std::string(), body.size() - 1));
+#endif
+#ifdef SAC_ZSTD_SUPPORT_ENABLED
+  codecs.push_back(Codec::CreateZstd(3, std::string(), body.size() - 1));
+#endif
+
+  for (std::vector<Codec::ptr_t>::const_iterator it = codecs.begin();
+       it != codecs.end(); ++it) {
+    std::string compressed;
+    (*it)->Compress(body.data(), body.size(), compressed);
+    std::string decompressed;
+    EXPECT_THROW(
+        (*it)->Decompress(compressed.data(), compressed.size(), decompressed),
+        std::runtime_error);
+  }
+}
+
+TEST_F(connected_test, publish_codec) {
+  channel->SetPublishCodec(boost::make_shared<RunLengthCodec>(), 100);
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue);
+
+  BasicMessage::ptr_t message = BasicMessage::Create(std::string(1000, 'a'));
+  channel->BasicPublish("", queue, message);
+  // Left as it was
+  EXPECT_FALSE(message->ContentEncodingIsSet());
+  EXPECT_EQ(1000u, message->BodyLength());
+
+  // Decompressed as it is received
+  Envelope::ptr_t envelope = channel->BasicConsumeMessage(consumer);
+  EXPECT_FALSE(envelope->Message()->ContentEncodingIsSet());
+  EXPECT_EQ(std::string(1000, 'a'), envelope->Message()->Body());
+
+  // Too small to compress
+  channel->BasicPublish("", queue, BasicMessage::Create("aaaa"));
+  envelope = channel->BasicConsumeMessage(consumer);
+  EXPECT_FALSE(envelope->Message()->ContentEncodingIsSet());
+  EXPECT_EQ("aaaa", envelope->Message()->Body());
+
+  // Wouldn't be any smaller
+  std::string mixed;
+  for (int i = 0; i < 200; ++i) {
+    mixed.push_back(static_cast<char>('a' + i % 26));
+  }
+  channel->BasicPublish("", queue, BasicMessage::Create(mixed));
+  envelope = channel->BasicConsumeMessage(consumer);
+  EXPECT_FALSE(envelope->Message()->ContentEncodingIsSet());
+  EXPECT_EQ(mixed, envelope->Message()->Body());
+}
+
+TEST_F(connected_test, add_codec) {
+  RunLengthCodec codec;
+  std::string queue = channel->DeclareQueue("");
+
+  BasicMessage::ptr_t message = BasicMessage::Create(std::string(500, 'c'));
+  message->Compress(codec);
+  channel->BasicPublish("", queue, message);
+
+  // Left compressed without the codec
+  Envelope::ptr_t envelope;
+  ASSERT_TRUE(channel->BasicGet(envelope, queue));
+  EXPECT_EQ(message->Body(), envelope->Message()->Body());
+  EXPECT_EQ("x-run-length", envelope->Message()->ContentEncoding());
+
+  channel->AddCodec(boost::make_shared<RunLengthCodec>());
+  channel->BasicPublish("", queue, message);
+  ASSERT_TRUE(channel->BasicGet(envelope, queue));
+  EXPECT_EQ(std::string(500, 'c'), envelope->Message()->Body());
+  EXPECT_FALSE(envelope->Message()->ContentEncodingIsSet());
+
+  // A corrupt body is handed over as it came
+  BasicMessage::ptr_t corrupt = BasicMessage::Create("abc");
+  corrupt->ContentEncoding(codec.Name());
+  channel->BasicPublish("", queue, corrupt);
+  ASSERT_TRUE(channel->BasicGet(envelope, queue));
+  EXPECT_EQ("abc", envelope->Message()->Body());
+  EXPECT_EQ("x-run-length", envelope->Message()->ContentEncoding());
+}
+
+TEST_F(connected_test, add_codec_streaming) {
+  RunLengthCodec codec;
+  channel->AddCodec(boost::make_shared<RunLengthCodec>());
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue);
+
+  BasicMessage::ptr_t message = BasicMessage::Create(std::string(500, 'c'));
+  message->Compress(codec);
+  channel->BasicPublish("", queue, message);
+
+  // Streamed as it was sent, the content encoding says so
+  std::string received;
+  Envelope::ptr_t envelope;
+  ASSERT_TRUE(channel->BasicConsumeMessageStreaming(
+      consumer, envelope,
+      boost::bind(append_body, boost::ref(received), _1, _2), 5000));
+  EXPECT_EQ(message->Body(), received);
+  EXPECT_EQ("x-run-length", envelope->Message()->ContentEncoding());
+}
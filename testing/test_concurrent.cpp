@@ -0,0 +1,162 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <SimpleAmqpClient/ConcurrentChannel.h>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "connected_test.h"
+
+using namespace AmqpClient;
+
+namespace {
+void declare_queue(Channel &channel, std::string &queue) {
+  queue = channel.DeclareQueue("");
+}
+
+void publish_messages(ConcurrentChannel &channel, const std::string &queue,
+                      int count) {
+  for (int i = 0; i < count; ++i) {
+    channel.BasicPublish("", queue, BasicMessage::Create("Message Body"));
+  }
+}
+
+void consume_messages(ConcurrentChannel &channel, const std::string &consumer,
+                      int count) {
+  for (int i = 0; i < count; ++i) {
+    Envelope::ptr_t envelope;
+    ASSERT_TRUE(channel.BasicConsumeMessage(consumer, envelope, 5000));
+    EXPECT_EQ("Message Body", envelope->Message()->Body());
+    channel.BasicAck(envelope->GetDeliveryInfo());
+  }
+}
+}  // namespace
+
+TEST_F(connected_test, concurrent_execute) {
+  ConcurrentChannel::ptr_t concurrent = ConcurrentChannel::Create(channel);
+
+  std::string queue;
+  concurrent->Execute(boost::bind(&declare_queue, _1, boost::ref(queue)));
+  EXPECT_FALSE(queue.empty());
+}
+
+TEST_F(connected_test, concurrent_publish_consume) {
+  ConcurrentChannel::ptr_t concurrent = ConcurrentChannel::Create(channel);
+
+  std::string queue;
+  concurrent->Execute(boost::bind(&declare_queue, _1, boost::ref(queue)));
+  const std::string consumer =
+      concurrent->BasicConsume(queue, "", true, false, true, 50);
+
+  boost::thread_group threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.create_thread(
+        boost::bind(&publish_messages, boost::ref(*concurrent), queue, 50));
+  }
+  for (int i = 0; i < 2; ++i) {
+    threads.create_thread(
+        boost::bind(&consume_messages, boost::ref(*concurrent), consumer, 100));
+  }
+  threads.join_all();
+
+  Envelope::ptr_t envelope;
+  EXPECT_FALSE(concurrent->BasicConsumeMessage(consumer, envelope, 0));
+}
+
+TEST_F(connected_test, concurrent_cancel_wakes_consumer) {
+  ConcurrentChannel::ptr_t concurrent = ConcurrentChannel::Create(channel);
+
+  std::string queue;
+  concurrent->Execute(boost::bind(&declare_queue, _1, boost::ref(queue)));
+  const std::string consumer = concurrent->BasicConsume(queue);
+  concurrent->BasicCancel(consumer);
+
+  Envelope::ptr_t envelope;
+  EXPECT_THROW(concurrent->BasicConsumeMessage(consumer, envelope),
+               ConsumerCancelledException);
+}
+
+namespace {
+struct ordered_handler {
+  ordered_handler() : received(0), in_order(true) {}
+
+  void operator()(ConcurrentChannel &channel, const Envelope::ptr_t &envelope) {
+    boost::lock_guard<boost::mutex> lock(mutex);
+    if (boost::lexical_cast<std::string>(received) !=
+        envelope->Message()->Body()) {
+      in_order = false;
+    }
+    ++received;
+    channel.BasicAck(envelope->GetDeliveryInfo());
+    done.notify_all();
+  }
+
+  boost::mutex mutex;
+  boost::condition_variable done;
+  int received;
+  bool in_order;
+};
+}  // namespace
+
+TEST_F(connected_test, concurrent_consume_with_handler) {
+  // Outlives the worker threads
+  ordered_handler handler;
+  ConcurrentChannel::ptr_t concurrent = ConcurrentChannel::Create(channel, 4);
+
+  std::string queue;
+  concurrent->Execute(boost::bind(&declare_queue, _1, boost::ref(queue)));
+
+  const std::string consumer = concurrent->BasicConsumeWithHandler(
+      queue, boost::bind<void>(boost::ref(handler), boost::ref(*concurrent),
+                               _1),
+      "", true, false, true, 10);
+
+  for (int i = 0; i < 100; ++i) {
+    concurrent->BasicPublish(
+        "", queue, BasicMessage::Create(boost::lexical_cast<std::string>(i)));
+  }
+
+  {
+    boost::unique_lock<boost::mutex> lock(handler.mutex);
+    while (handler.received < 100) {
+      ASSERT_NE(boost::cv_status::timeout,
+                handler.done.wait_for(lock, boost::chrono::seconds(5)));
+    }
+  }
+  EXPECT_TRUE(handler.in_order);
+
+  Envelope::ptr_t envelope;
+  EXPECT_THROW(concurrent->BasicConsumeMessage(consumer, envelope, 0),
+               std::logic_error);
+  concurrent->BasicCancel(consumer);
+}
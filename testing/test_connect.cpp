@@ -27,6 +27,8 @@
  */
 
 #include <gtest/gtest.h>
+#include "SimpleAmqpClient/AmqpLibraryException.h"
+#include "SimpleAmqpClient/BadUriException.h"
 #include "SimpleAmqpClient/SimpleAmqpClient.h"
 
 #include "connected_test.h"
@@ -67,3 +69,154 @@ TEST(connecting_test, connect_using_uri) {
   std::string host_uri = "amqp://" + connected_test::GetBrokerHost();
   Channel::ptr_t channel = Channel::CreateFromUri(host_uri);
 }
+
+TEST(connecting_test, connection_shared_by_channels) {
+  Connection::ptr_t connection =
+      Connection::Create(connected_test::GetBrokerHost());
+  Channel::ptr_t publisher = connection->CreateChannel();
+  Channel::ptr_t consumer = connection->CreateChannel();
+
+  std::string queue = consumer->DeclareQueue("");
+  std::string tag = consumer->BasicConsume(queue);
+  publisher->BasicPublish("", queue, BasicMessage::Create("Message Body"));
+
+  Envelope::ptr_t envelope;
+  ASSERT_TRUE(consumer->BasicConsumeMessage(envelope, 5000));
+  EXPECT_EQ("Message Body", envelope->Message()->Body());
+
+  // The consumer belongs to the other channel
+  EXPECT_THROW(publisher->BasicConsumeMessage(envelope, 0),
+               ConsumerTagNotFoundException);
+  // but can still be waited on by tag
+  publisher->BasicPublish("", queue, BasicMessage::Create("Message Body"));
+  EXPECT_TRUE(publisher->BasicConsumeMessage(tag, envelope, 5000));
+}
+
+TEST(connecting_test, connection_outlived_by_channel) {
+  Channel::ptr_t channel =
+      Connection::Create(connected_test::GetBrokerHost())->CreateChannel();
+  EXPECT_NO_THROW(channel->DeclareQueue(""));
+}
+
+TEST(connecting_test, connection_channel_destroyed_cancels_consumers) {
+  Channel::ptr_t channel = Channel::Create(connected_test::GetBrokerHost());
+  Connection::ptr_t connection = boost::make_shared<Connection>(channel);
+  std::string queue = channel->DeclareQueue("");
+
+  {
+    Channel::ptr_t leased = connection->CreateChannel();
+    leased->BasicConsume(queue);
+  }
+
+  boost::uint32_t message_count;
+  boost::uint32_t consumer_count;
+  channel->DeclareQueueWithCounts(queue, message_count, consumer_count, true);
+  EXPECT_EQ(0u, consumer_count);
+}
+
+TEST(connecting_test, connect_with_heartbeat) {
+  Channel::ptr_t channel =
+      Channel::Create(connected_test::GetBrokerHost(), 5672, "guest", "guest",
+                      "/", 131072, 1);
+  std::string queue = channel->DeclareQueue("");
+  channel->BasicConsume(queue);
+
+  // Waits through several heartbeat intervals, the connection stays up
+  Envelope::ptr_t envelope;
+  EXPECT_FALSE(channel->BasicConsumeMessage(envelope, 3500));
+  channel->BasicPublish("", queue, BasicMessage::Create("Message Body"));
+  EXPECT_TRUE(channel->BasicConsumeMessage(envelope, 5000));
+}
+
+TEST(connecting_test, connect_using_uri_with_heartbeat) {
+  std::string host_uri = "amqp://" + connected_test::GetBrokerHost();
+  Channel::ptr_t channel = Channel::CreateFromUri(host_uri, 131072, 10);
+  EXPECT_NO_THROW(channel->DeclareQueue(""));
+}
+
+TEST(connecting_test, connect_with_options) {
+  Channel::ConnectionOptions options;
+  options.tcp_nodelay = false;
+  options.receive_buffer_size = 256 * 1024;
+  options.send_buffer_size = 256 * 1024;
+  options.keepalive = true;
+  options.keepalive_idle = 60;
+  options.keepalive_interval = 10;
+  options.keepalive_count = 3;
+  options.connect_timeout = 5000;
+  options.connect_in_parallel = true;
+  Channel::ptr_t channel =
+      Channel::Create(connected_test::GetBrokerHost(), 5672, "guest", "guest",
+                      "/", 131072, 0, options);
+  EXPECT_NO_THROW(channel->DeclareQueue(""));
+}
+
+TEST(connecting_test, connect_using_uri_with_options) {
+  std::string host_uri = "amqp://" + connected_test::GetBrokerHost();
+  Channel::ConnectionOptions options;
+  options.connect_timeout = 5000;
+  Channel::ptr_t channel =
+      Channel::CreateFromUri(host_uri, 131072, 0, options);
+  EXPECT_NO_THROW(channel->DeclareQueue(""));
+}
+
+TEST(connecting_test, connect_timeout) {
+  // Not routed anywhere, so the connect either fails or never completes
+  Channel::ConnectionOptions options;
+  options.connect_timeout = 200;
+  EXPECT_THROW(Channel::ptr_t channel =
+                   Channel::Create("10.255.255.1", 5672, "guest", "guest",
+                                   "/", 131072, 0, options),
+               AmqpLibraryException);
+}
+
+TEST(connecting_test, negotiated_frame_max) {
+  Channel::ptr_t channel = Channel::Create(connected_test::GetBrokerHost(),
+                                           5672, "guest", "guest", "/", 8192);
+  EXPECT_EQ(8192, channel->GetFrameMax());
+  EXPECT_LE(0, channel->GetChannelMax());
+}
+
+TEST(connecting_test, connect_bulk) {
+  Channel::ptr_t channel = Channel::CreateBulk(connected_test::GetBrokerHost());
+  // The broker's limit, 131072 unless it has been configured otherwise
+  EXPECT_LE(4096, channel->GetFrameMax());
+
+  // A body spanning several frames
+  std::string body(4 * channel->GetFrameMax() + 1, 'b');
+  std::string queue = channel->DeclareQueue("");
+  channel->BasicConsume(queue);
+  channel->BasicPublish("", queue, BasicMessage::Create(body));
+  Envelope::ptr_t envelope;
+  ASSERT_TRUE(channel->BasicConsumeMessage(envelope, 5000));
+  EXPECT_EQ(body, envelope->Message()->Body());
+}
+
+TEST_F(connected_test, recovery_after_connection_closed) {
+  Channel::RecoveryOptions options;
+  options.uris.push_back("amqp://" + connected_test::GetBrokerHost());
+  channel->EnableRecovery(options);
+
+  std::string queue = channel->DeclareQueue("test_recovery_queue");
+  channel->BindQueue(queue, "amq.direct", "test_recovery_rk");
+  std::string tag = channel->BasicConsume(queue);
+
+  // The broker closes the connection when immediate is asked for
+  EXPECT_THROW(channel->BasicPublish("", queue,
+                                     BasicMessage::Create("Message Body"),
+                                     false, true),
+               ConnectionException);
+
+  // The queue, binding and consumer are back on the new connection
+  channel->BasicPublish("amq.direct", "test_recovery_rk",
+                        BasicMessage::Create("Message Body"));
+  Envelope::ptr_t envelope;
+  ASSERT_TRUE(channel->BasicConsumeMessage(tag, envelope, 5000));
+  EXPECT_EQ("Message Body", envelope->Message()->Body());
+}
+
+TEST_F(connected_test, recovery_bad_uri) {
+  Channel::RecoveryOptions options;
+  options.uris.push_back("not a uri");
+  EXPECT_THROW(channel->EnableRecovery(options), BadUriException);
+}
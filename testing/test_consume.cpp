@@ -26,7 +26,11 @@
  * ***** END LICENSE BLOCK *****
  */
 
+#include <boost/bind.hpp>
+#include <boost/chrono.hpp>
+#include <boost/lexical_cast.hpp>
 #include <iostream>
+#include <stdexcept>
 #include "connected_test.h"
 
 using namespace AmqpClient;
@@ -189,6 +193,167 @@ TEST_F(connected_test, basic_qos_badconsumer) {
                ConsumerTagNotFoundException);
 }
 
+TEST_F(connected_test, adaptive_prefetch_slow_consumer) {
+  std::string queue = channel->DeclareQueue("");
+  for (int i = 0; i < 50; ++i) {
+    channel->BasicPublish("", queue, BasicMessage::Create("Message"));
+  }
+  std::string consumer =
+      channel->BasicConsume(queue, "", true, false, true, 10);
+  channel->SetAdaptivePrefetch(consumer, 10);
+  EXPECT_EQ(10, channel->GetPrefetchCount(consumer));
+
+  // Nothing is ever delivered to this one, consuming from it is a pause
+  std::string idle_queue = channel->DeclareQueue("");
+  std::string idle = channel->BasicConsume(idle_queue, "", true, false);
+
+  // Pausing 150 ms a message, and longer on a loaded machine, so the
+  // consumer gets through at most 7 a second. Two tuning windows of a second
+  // pass: the first measures the round trip, the second sets the count to
+  // twice what is processed in it, plus one. That stays under 10 unless the
+  // round trip takes most of a second.
+  Envelope::ptr_t incoming;
+  Envelope::ptr_t none;
+  for (int i = 0; i < 20; ++i) {
+    ASSERT_TRUE(channel->BasicConsumeMessage(consumer, incoming, 5000));
+    EXPECT_FALSE(channel->BasicConsumeMessage(idle, none, 150));
+    channel->BasicAck(incoming);
+  }
+  EXPECT_LT(channel->GetPrefetchCount(consumer), 10);
+
+  channel->DeleteQueue(queue);
+  channel->DeleteQueue(idle_queue);
+}
+
+TEST_F(connected_test, adaptive_prefetch_badconsumer) {
+  EXPECT_THROW(channel->SetAdaptivePrefetch("consumer_notexist", 10),
+               ConsumerTagNotFoundException);
+  EXPECT_THROW(channel->GetPrefetchCount("consumer_notexist"),
+               ConsumerTagNotFoundException);
+}
+
+TEST_F(connected_test, buffered_messages) {
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue, "", true, true, true, 0);
+  std::string idle_queue = channel->DeclareQueue("");
+  std::string idle = channel->BasicConsume(idle_queue);
+  for (int i = 0; i < 3; ++i) {
+    channel->BasicPublish("", queue, BasicMessage::Create("Message"));
+  }
+
+  // Read while waiting on the other consumer
+  Envelope::ptr_t incoming;
+  EXPECT_FALSE(channel->BasicConsumeMessage(idle, incoming, 200));
+  EXPECT_EQ(3u, channel->GetBufferedMessages(consumer));
+  EXPECT_EQ(21u, channel->GetBufferedBytes(consumer));
+  EXPECT_EQ(0u, channel->GetBufferedMessages(idle));
+  EXPECT_EQ(3u, channel->GetBufferedMessages());
+  EXPECT_EQ(21u, channel->GetBufferedBytes());
+
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_TRUE(channel->BasicConsumeMessage(consumer, incoming, 0));
+  }
+  EXPECT_EQ(0u, channel->GetBufferedMessages());
+  EXPECT_EQ(0u, channel->GetBufferedBytes());
+}
+
+TEST_F(connected_test, buffer_limits) {
+  Channel::BufferLimits limits;
+  limits.max_messages = 1;
+  channel->SetBufferLimits(limits);
+
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue, "", true, true, true, 0);
+  for (int i = 0; i < 3; ++i) {
+    channel->BasicPublish("", queue, BasicMessage::Create("Message"));
+  }
+
+  // Those not read in passing are still read when consuming
+  Envelope::ptr_t incoming;
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_TRUE(channel->BasicConsumeMessage(consumer, incoming, 1000));
+  }
+  EXPECT_EQ(0u, channel->GetBufferedMessages());
+}
+
+TEST_F(connected_test, buffer_limits_large_message) {
+  Channel::BufferLimits limits;
+  limits.max_bytes = 1024;
+  channel->SetBufferLimits(limits);
+
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue, "", true, true, true, 0);
+  // Many frames, and far past the limit
+  const std::string body(256 * 1024, 'a');
+  channel->BasicPublish("", queue, BasicMessage::Create(body));
+
+  // Only ever read in passing, a message partway read is still finished
+  std::vector<Envelope::ptr_t> envelopes;
+  const boost::chrono::steady_clock::time_point give_up =
+      boost::chrono::steady_clock::now() + boost::chrono::seconds(5);
+  while (envelopes.empty() && boost::chrono::steady_clock::now() < give_up) {
+    channel->BasicConsumeAvailable(envelopes, 1);
+  }
+  ASSERT_EQ(1u, envelopes.size());
+  EXPECT_EQ(body, envelopes.front()->Message()->Body());
+  EXPECT_EQ(0u, channel->GetBufferedBytes());
+}
+
+TEST_F(connected_test, buffered_messages_badconsumer) {
+  EXPECT_THROW(channel->GetBufferedBytes("consumer_notexist"),
+               ConsumerTagNotFoundException);
+}
+
+namespace {
+void append_body(std::string &body, std::size_t &pieces, const char *data,
+                 std::size_t length) {
+  body.append(data, length);
+  ++pieces;
+}
+}  // namespace
+
+TEST_F(connected_test, consume_streaming) {
+  // More than fits in one frame
+  const std::string body(500000, 'a');
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue);
+  channel->BasicPublish("", queue, BasicMessage::Create(body));
+
+  std::string received;
+  std::size_t pieces = 0;
+  Envelope::ptr_t envelope;
+  ASSERT_TRUE(channel->BasicConsumeMessageStreaming(
+      consumer, envelope,
+      boost::bind(append_body, boost::ref(received), boost::ref(pieces), _1,
+                  _2),
+      1000));
+  EXPECT_EQ(body, received);
+  EXPECT_LT(1u, pieces);
+  EXPECT_TRUE(envelope->Message()->Body().empty());
+}
+
+TEST_F(connected_test, consume_streaming_buffered) {
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue);
+  std::string idle_queue = channel->DeclareQueue("");
+  std::string idle = channel->BasicConsume(idle_queue);
+  channel->BasicPublish("", queue, BasicMessage::Create("Message"));
+
+  // Read whole while waiting on the other consumer
+  Envelope::ptr_t envelope;
+  EXPECT_FALSE(channel->BasicConsumeMessage(idle, envelope, 200));
+
+  std::string received;
+  std::size_t pieces = 0;
+  ASSERT_TRUE(channel->BasicConsumeMessageStreaming(
+      consumer, envelope,
+      boost::bind(append_body, boost::ref(received), boost::ref(pieces), _1,
+                  _2),
+      0));
+  EXPECT_EQ("Message", received);
+  EXPECT_EQ(1u, pieces);
+}
+
 TEST_F(connected_test, consumer_cancelled) {
   std::string queue = channel->DeclareQueue("");
   std::string consumer = channel->BasicConsume(queue, "", true, false);
@@ -225,3 +390,156 @@ TEST_F(connected_test, consume_multiple) {
 
   EXPECT_EQ(Body, env->Message()->Body());
 }
+
+TEST_F(connected_test, consume_pooled_messages) {
+  channel->SetMessagePoolSize(4);
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue);
+
+  BasicMessage::ptr_t message = BasicMessage::Create("Message Body");
+  message->CorrelationId("correlation");
+  channel->BasicPublish("", queue, message);
+  channel->BasicPublish("", queue, BasicMessage::Create("Second Body"));
+
+  Envelope::ptr_t delivered = channel->BasicConsumeMessage(consumer);
+  EXPECT_EQ("Message Body", delivered->Message()->Body());
+  EXPECT_EQ("correlation", delivered->Message()->CorrelationId());
+  const Envelope *first_envelope = delivered.get();
+  const BasicMessage *first_message = delivered->Message().get();
+  delivered.reset();
+
+  // The released envelope and message are reused, without the old contents
+  delivered = channel->BasicConsumeMessage(consumer);
+  EXPECT_EQ(first_envelope, delivered.get());
+  EXPECT_EQ(first_message, delivered->Message().get());
+  EXPECT_EQ("Second Body", delivered->Message()->Body());
+  EXPECT_FALSE(delivered->Message()->CorrelationIdIsSet());
+
+  // Pooled messages may outlive the channel
+  channel.reset();
+  EXPECT_EQ("Second Body", delivered->Message()->Body());
+}
+
+TEST_F(connected_test, consume_messages_batch) {
+  std::string queue = channel->DeclareQueue("");
+  std::vector<std::string> consumers(1, channel->BasicConsume(queue));
+
+  std::vector<Envelope::ptr_t> envelopes;
+  EXPECT_EQ(0u, channel->BasicConsumeMessages(consumers, envelopes, 10, 0));
+  EXPECT_TRUE(envelopes.empty());
+
+  for (int i = 0; i < 5; ++i) {
+    channel->BasicPublish(
+        "", queue, BasicMessage::Create(boost::lexical_cast<std::string>(i)));
+  }
+
+  // Waits for the first message, then drains what is already there
+  std::size_t received = 0;
+  while (received < 3) {
+    received += channel->BasicConsumeMessages(consumers, envelopes,
+                                              3 - received, 1000);
+  }
+  ASSERT_EQ(3u, envelopes.size());
+
+  while (received < 5) {
+    received += channel->BasicConsumeMessages(consumers, envelopes, 10, 1000);
+  }
+  ASSERT_EQ(5u, envelopes.size());
+  for (std::size_t i = 0; i < envelopes.size(); ++i) {
+    EXPECT_EQ(boost::lexical_cast<std::string>(i),
+              envelopes[i]->Message()->Body());
+  }
+}
+
+TEST_F(connected_test, consume_any_after_cancel) {
+  std::string queue1 = channel->DeclareQueue("");
+  std::string queue2 = channel->DeclareQueue("");
+  std::string consumer1 = channel->BasicConsume(queue1);
+  std::string consumer2 = channel->BasicConsume(queue2);
+
+  channel->BasicCancel(consumer1);
+  channel->BasicPublish("", queue2, BasicMessage::Create("Message2"));
+
+  Envelope::ptr_t envelope;
+  ASSERT_TRUE(channel->BasicConsumeMessage(envelope, 1000));
+  EXPECT_EQ(consumer2, envelope->ConsumerTag());
+
+  channel->BasicCancel(consumer2);
+  EXPECT_THROW(channel->BasicConsumeMessage(envelope, 0),
+               ConsumerTagNotFoundException);
+
+  std::string consumer3 = channel->BasicConsume(queue1);
+  channel->BasicPublish("", queue1, BasicMessage::Create("Message1"));
+  ASSERT_TRUE(channel->BasicConsumeMessage(envelope, 1000));
+  EXPECT_EQ(consumer3, envelope->ConsumerTag());
+}
+
+TEST_F(connected_test, consumer_priority) {
+  std::string low_queue = channel->DeclareQueue("");
+  std::string high_queue = channel->DeclareQueue("");
+  std::string idle_queue = channel->DeclareQueue("");
+  std::string low = channel->BasicConsume(low_queue);
+  std::string high = channel->BasicConsume(high_queue);
+  std::string idle = channel->BasicConsume(idle_queue);
+  channel->SetConsumerPriority(high, 1);
+
+  for (int i = 0; i < 2; ++i) {
+    channel->BasicPublish("", low_queue, BasicMessage::Create("Low"));
+    channel->BasicPublish("", high_queue, BasicMessage::Create("High"));
+  }
+
+  // Buffer all four while waiting on the other consumer
+  Envelope::ptr_t incoming;
+  EXPECT_FALSE(channel->BasicConsumeMessage(idle, incoming, 200));
+  ASSERT_EQ(4u, channel->GetBufferedMessages());
+
+  std::vector<std::string> consumers;
+  consumers.push_back(low);
+  consumers.push_back(high);
+  const char *expected[] = {"High", "High", "Low", "Low"};
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(channel->BasicConsumeMessage(consumers, incoming, 0));
+    EXPECT_EQ(expected[i], incoming->Message()->Body());
+  }
+}
+
+TEST_F(connected_test, consumer_weight) {
+  std::string heavy_queue = channel->DeclareQueue("");
+  std::string light_queue = channel->DeclareQueue("");
+  std::string idle_queue = channel->DeclareQueue("");
+  std::string heavy = channel->BasicConsume(heavy_queue);
+  std::string light = channel->BasicConsume(light_queue);
+  std::string idle = channel->BasicConsume(idle_queue);
+  channel->SetConsumerPriority(heavy, 0, 3);
+
+  for (int i = 0; i < 4; ++i) {
+    channel->BasicPublish("", heavy_queue, BasicMessage::Create("Heavy"));
+    channel->BasicPublish("", light_queue, BasicMessage::Create("Light"));
+  }
+
+  Envelope::ptr_t incoming;
+  EXPECT_FALSE(channel->BasicConsumeMessage(idle, incoming, 200));
+  ASSERT_EQ(8u, channel->GetBufferedMessages());
+
+  std::vector<std::string> consumers;
+  consumers.push_back(heavy);
+  consumers.push_back(light);
+  std::vector<Envelope::ptr_t> envelopes;
+  ASSERT_EQ(4u, channel->BasicConsumeMessages(consumers, envelopes, 4, 0));
+  std::size_t heavy_count = 0;
+  for (std::size_t i = 0; i < envelopes.size(); ++i) {
+    if (heavy == envelopes[i]->ConsumerTag()) {
+      ++heavy_count;
+    }
+  }
+  EXPECT_EQ(3u, heavy_count);
+}
+
+TEST_F(connected_test, consumer_priority_badweight) {
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue);
+  EXPECT_THROW(channel->SetConsumerPriority(consumer, 0, 0),
+               std::invalid_argument);
+  EXPECT_THROW(channel->SetConsumerPriority("consumer_notexist", 1),
+               ConsumerTagNotFoundException);
+}
@@ -0,0 +1,99 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "connected_test.h"
+
+#include <amqp.h>
+#include <amqp_framing.h>
+
+#include <sstream>
+
+using namespace AmqpClient;
+
+TEST(frame_trace, ring_keeps_newest) {
+  FrameTrace::ptr_t trace = FrameTrace::Create(3);
+  EXPECT_EQ(4u, trace->GetCapacity());
+
+  for (boost::uint64_t tag = 1; tag <= 6; ++tag) {
+    trace->Record(FrameTrace::fe_acked, 1, AMQP_FRAME_METHOD,
+                  AMQP_BASIC_ACK_METHOD, tag);
+  }
+
+  std::vector<FrameTrace::Event> events = trace->GetEvents();
+  ASSERT_EQ(4u, events.size());
+  EXPECT_EQ(3u, events.front().delivery_tag);
+  EXPECT_EQ(6u, events.back().delivery_tag);
+  EXPECT_EQ(6u, trace->GetRecordedCount());
+
+  std::ostringstream dump;
+  trace->Dump(dump);
+  EXPECT_NE(std::string::npos,
+            dump.str().find("acked channel 1 method AMQP_BASIC_ACK_METHOD "
+                            "delivery_tag 6\n"));
+
+  trace->Clear();
+  EXPECT_TRUE(trace->GetEvents().empty());
+}
+
+TEST_F(connected_test, frame_trace_consume) {
+  FrameTrace::ptr_t trace = FrameTrace::Create();
+  channel->SetFrameTrace(trace);
+
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue, "", true, false);
+  channel->BasicPublish("", queue, BasicMessage::Create("message body"));
+
+  Envelope::ptr_t envelope;
+  ASSERT_TRUE(channel->BasicConsumeMessage(consumer, envelope, 1000));
+  channel->BasicAck(envelope);
+
+  std::vector<FrameTrace::Event> events = trace->GetEvents();
+  bool received = false;
+  bool delivered = false;
+  for (std::vector<FrameTrace::Event>::const_iterator it = events.begin();
+       it != events.end(); ++it) {
+    if (FrameTrace::fe_received == it->event &&
+        AMQP_BASIC_DELIVER_METHOD == it->method_id) {
+      EXPECT_EQ(envelope->DeliveryTag(), it->delivery_tag);
+      received = true;
+    }
+    if (FrameTrace::fe_delivered == it->event) {
+      EXPECT_TRUE(received);
+      EXPECT_EQ(envelope->DeliveryTag(), it->delivery_tag);
+      delivered = true;
+    }
+  }
+  EXPECT_TRUE(delivered);
+  ASSERT_FALSE(events.empty());
+  EXPECT_EQ(FrameTrace::fe_acked, events.back().event);
+  EXPECT_EQ(envelope->DeliveryTag(), events.back().delivery_tag);
+
+  channel->SetFrameTrace(FrameTrace::ptr_t());
+  channel->BasicPublish("", queue, BasicMessage::Create("message body"));
+  EXPECT_EQ(events.size(), trace->GetEvents().size());
+}
@@ -28,6 +28,8 @@
 
 #include "connected_test.h"
 
+#include <boost/lexical_cast.hpp>
+
 using namespace AmqpClient;
 
 TEST_F(connected_test, get_ok) {
@@ -78,3 +80,35 @@ TEST_F(connected_test, ack_message) {
   channel->BasicAck(new_message);
   EXPECT_FALSE(channel->BasicGet(new_message, queue, false));
 }
+
+TEST_F(connected_test, get_batch) {
+  std::string queue = channel->DeclareQueue("");
+  // More than are asked for in one go
+  for (int i = 0; i < 150; ++i) {
+    channel->BasicPublish(
+        "", queue, BasicMessage::Create(boost::lexical_cast<std::string>(i)));
+  }
+
+  std::vector<Envelope::ptr_t> envelopes =
+      channel->BasicGetBatch(queue, 100, false);
+  ASSERT_EQ(100u, envelopes.size());
+  for (std::size_t i = 0; i < envelopes.size(); ++i) {
+    EXPECT_EQ(boost::lexical_cast<std::string>(i),
+              envelopes[i]->Message()->Body());
+  }
+  channel->BasicAck(envelopes.back(), true);
+
+  // Stops at the end of the queue
+  envelopes = channel->BasicGetBatch(queue, 100);
+  ASSERT_EQ(50u, envelopes.size());
+  EXPECT_EQ("100", envelopes.front()->Message()->Body());
+  EXPECT_EQ("149", envelopes.back()->Message()->Body());
+
+  EXPECT_TRUE(channel->BasicGetBatch(queue, 100).empty());
+  EXPECT_TRUE(channel->BasicGetBatch(queue, 0).empty());
+}
+
+TEST_F(connected_test, get_batch_bad_queue) {
+  EXPECT_THROW(channel->BasicGetBatch("test_get_nonexistantqueue", 10),
+               ChannelException);
+}
@@ -31,6 +31,7 @@
 #include <amqp.h>
 
 #include <boost/array.hpp>
+#include <boost/bind.hpp>
 
 #include <algorithm>
 #include <iostream>
@@ -127,6 +128,62 @@ TEST(basic_message, embedded_nulls) {
                          reinterpret_cast<char *>(amqp_body2.bytes)));
 }
 
+TEST(basic_message, body_view_and_swap) {
+  const std::string body("Message Body");
+  BasicMessage::ptr_t message = BasicMessage::Create(body);
+
+  EXPECT_EQ(body.length(), message->BodyLength());
+  EXPECT_EQ(body, std::string(message->BodyData(), message->BodyLength()));
+
+  std::string swapped(std::string(4096, 'a'));
+  const char *swapped_data = swapped.data();
+  message->SwapBody(swapped);
+
+  EXPECT_EQ(body, swapped);
+  EXPECT_EQ(4096u, message->BodyLength());
+  // A large body is taken over, not copied
+  EXPECT_EQ(swapped_data, message->BodyData());
+  EXPECT_EQ(std::string(4096, 'a'), message->Body());
+}
+
+namespace {
+void free_body(bool *freed, void *data) {
+  *freed = true;
+  delete[] static_cast<char *>(data);
+}
+}  // namespace
+
+TEST(basic_message, adopted_body) {
+  BasicMessage::ptr_t message = BasicMessage::Create();
+
+  std::vector<char> vector_body(1000, 'v');
+  const char *vector_data = &vector_body[0];
+  message->AdoptBody(vector_body);
+  EXPECT_TRUE(vector_body.empty());
+  EXPECT_EQ(vector_data, message->BodyData());
+  EXPECT_EQ(std::string(1000, 'v'), message->Body());
+
+  bool freed = false;
+  char *raw_body = new char[3];
+  raw_body[0] = 'a';
+  raw_body[1] = 'b';
+  raw_body[2] = 'c';
+  message->AdoptBody(raw_body, 3, boost::bind(free_body, &freed, _1));
+  EXPECT_EQ(raw_body, message->BodyData());
+  EXPECT_EQ("abc", message->Body());
+
+  const std::string external("external body");
+  message->ExternalBody(external.data(), external.length());
+  EXPECT_TRUE(freed);
+  EXPECT_EQ(external.data(), message->BodyData());
+  EXPECT_EQ(external, message->Body());
+
+  std::string swapped;
+  message->SwapBody(swapped);
+  EXPECT_EQ(external, swapped);
+  EXPECT_EQ(0u, message->BodyLength());
+}
+
 TEST_F(connected_test, replaced_received_body) {
   const std::string queue = channel->DeclareQueue("");
   const std::string consumer = channel->BasicConsume(queue);
@@ -143,3 +200,120 @@ TEST_F(connected_test, replaced_received_body) {
   in_message->Body(body2);
   EXPECT_EQ(body2, in_message->Body());
 }
+
+TEST_F(connected_test, swap_received_body) {
+  const std::string queue = channel->DeclareQueue("");
+  const std::string consumer = channel->BasicConsume(queue);
+
+  const std::string body(100000, 'b');
+  channel->BasicPublish("", queue, BasicMessage::Create(body));
+
+  Envelope::ptr_t envelope = channel->BasicConsumeMessage(consumer);
+  BasicMessage::ptr_t in_message = envelope->Message();
+  EXPECT_EQ(body.length(), in_message->BodyLength());
+
+  std::string received;
+  in_message->SwapBody(received);
+  EXPECT_EQ(body, received);
+  EXPECT_EQ(0u, in_message->BodyLength());
+}
+
+TEST_F(connected_test, received_properties) {
+  const std::string queue = channel->DeclareQueue("");
+  const std::string consumer = channel->BasicConsume(queue);
+
+  Table headers;
+  headers.insert(TableEntry("header", "value"));
+  BasicMessage::ptr_t out_message = BasicMessage::Create("body");
+  out_message->CorrelationId("correlation");
+  out_message->ReplyTo("reply");
+  out_message->HeaderTable(headers);
+  channel->BasicPublish("", queue, out_message);
+
+  Envelope::ptr_t envelope = channel->BasicConsumeMessage(consumer);
+  BasicMessage::ptr_t in_message = envelope->Message();
+  EXPECT_FALSE(in_message->ContentTypeIsSet());
+  EXPECT_EQ("correlation", in_message->CorrelationId());
+  EXPECT_EQ("reply", in_message->ReplyTo());
+
+  Table in_headers = in_message->HeaderTable();
+  ASSERT_EQ(1u, in_headers.size());
+  EXPECT_EQ("value", in_headers["header"].GetString());
+
+  in_message->ReplyTo("another");
+  EXPECT_EQ("another", in_message->ReplyTo());
+  EXPECT_EQ("correlation", in_message->CorrelationId());
+}
+
+TEST_F(connected_test, received_header_table_view) {
+  const std::string queue = channel->DeclareQueue("");
+  const std::string consumer = channel->BasicConsume(queue);
+
+  Table headers;
+  headers.insert(TableEntry("header", "value"));
+  BasicMessage::ptr_t out_message = BasicMessage::Create("body");
+  out_message->HeaderTable(headers);
+  channel->BasicPublish("", queue, out_message);
+
+  Envelope::ptr_t envelope = channel->BasicConsumeMessage(consumer);
+  TableView in_headers = envelope->Message()->HeaderTableView();
+  ASSERT_EQ(1u, in_headers.size());
+  EXPECT_EQ("value", in_headers.GetString("header"));
+}
+
+TEST(basic_message, message_template) {
+  Table headers;
+  headers.insert(TableEntry("header", "value"));
+  BasicMessage::ptr_t prototype = BasicMessage::Create("ignored");
+  prototype->ContentType("application/json");
+  prototype->DeliveryMode(BasicMessage::dm_persistent);
+  prototype->MessageId("prototype");
+  prototype->HeaderTable(headers);
+  MessageTemplate::ptr_t message_template = MessageTemplate::Create(*prototype);
+  // The template has its own copy
+  prototype.reset();
+
+  BasicMessage::ptr_t first = message_template->CreateMessage("first");
+  BasicMessage::ptr_t second = message_template->CreateMessage();
+  EXPECT_EQ("first", first->Body());
+  EXPECT_EQ(std::string(), second->Body());
+  EXPECT_EQ("application/json", second->ContentType());
+  EXPECT_EQ(BasicMessage::dm_persistent, second->DeliveryMode());
+  EXPECT_EQ("value", second->HeaderTableView().GetString("header"));
+
+  // Set on one message only
+  first->MessageId("first");
+  first->Timestamp(42);
+  second->ContentTypeClear();
+  EXPECT_EQ("first", first->MessageId());
+  EXPECT_EQ("prototype", second->MessageId());
+  EXPECT_FALSE(second->TimestampIsSet());
+  EXPECT_EQ("application/json", first->ContentType());
+  EXPECT_EQ("prototype", message_template->CreateMessage()->MessageId());
+
+  // Messages may outlive the template
+  message_template.reset();
+  EXPECT_EQ("application/json", first->ContentType());
+  EXPECT_EQ("value", first->HeaderTableView().GetString("header"));
+}
+
+TEST_F(connected_test, publish_message_template) {
+  const std::string queue = channel->DeclareQueue("");
+  const std::string consumer = channel->BasicConsume(queue);
+
+  BasicMessage::ptr_t prototype = BasicMessage::Create();
+  prototype->ContentType("text/plain");
+  prototype->CorrelationId("correlation");
+  MessageTemplate::ptr_t message_template = MessageTemplate::Create(*prototype);
+
+  BasicMessage::ptr_t out_message = message_template->CreateMessage("body");
+  out_message->MessageId("id");
+  channel->BasicPublish("", queue, out_message);
+
+  Envelope::ptr_t envelope = channel->BasicConsumeMessage(consumer);
+  BasicMessage::ptr_t in_message = envelope->Message();
+  EXPECT_EQ("body", in_message->Body());
+  EXPECT_EQ("text/plain", in_message->ContentType());
+  EXPECT_EQ("correlation", in_message->CorrelationId());
+  EXPECT_EQ("id", in_message->MessageId());
+}
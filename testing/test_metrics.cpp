@@ -0,0 +1,151 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "connected_test.h"
+
+#include <amqp.h>
+#include <amqp_framing.h>
+
+using namespace AmqpClient;
+
+TEST(metrics, counting_metrics_totals) {
+  CountingMetrics::ptr_t metrics = CountingMetrics::Create();
+
+  metrics->RpcCompleted(AMQP_QUEUE_DECLARE_METHOD,
+                        boost::chrono::microseconds(300));
+  metrics->RpcCompleted(AMQP_QUEUE_DECLARE_METHOD,
+                        boost::chrono::microseconds(100));
+  metrics->PublishConfirmed(boost::chrono::microseconds(50));
+  metrics->FramesWritten(3);
+  metrics->WaitedForFrame(boost::chrono::microseconds(20), true);
+  metrics->WaitedForFrame(boost::chrono::microseconds(30), false);
+  metrics->QueueDepthChanged(4, 1);
+  metrics->MessagePublished("amq.direct", 10);
+  metrics->MessagePublished("amq.direct", 5);
+  metrics->MessageReceived("consumer", 7);
+  metrics->ChannelOpened();
+  metrics->ChannelClosed();
+
+  CountingMetrics::Counters counters = metrics->GetCounters();
+  const CountingMetrics::Timing &declare =
+      counters.rpcs[AMQP_QUEUE_DECLARE_METHOD];
+  EXPECT_EQ(2u, declare.count);
+  EXPECT_EQ(400, declare.total.count());
+  EXPECT_EQ(300, declare.max.count());
+  EXPECT_EQ(1u, counters.publish_confirms.count);
+  EXPECT_EQ(3u, counters.frames_written);
+  EXPECT_EQ(1u, counters.frames_read);
+  EXPECT_EQ(50, counters.frame_wait.count());
+  EXPECT_EQ(4u, counters.queued_frames);
+  EXPECT_EQ(1u, counters.delivered_messages);
+  EXPECT_EQ(2u, counters.published["amq.direct"].messages);
+  EXPECT_EQ(15u, counters.published["amq.direct"].bytes);
+  EXPECT_EQ(1u, counters.received["consumer"].messages);
+  EXPECT_EQ(1u, counters.channels_opened);
+  EXPECT_EQ(1u, counters.channels_closed);
+
+  metrics->Reset();
+  counters = metrics->GetCounters();
+  EXPECT_TRUE(counters.rpcs.empty());
+  EXPECT_EQ(0u, counters.frames_written);
+  EXPECT_EQ(4u, counters.queued_frames);
+}
+
+TEST(metrics, queue_depth_summed) {
+  CountingMetrics::ptr_t metrics = CountingMetrics::Create();
+
+  // As if from two connections
+  metrics->QueueDepthChanged(3, 1);
+  metrics->QueueDepthChanged(2, 0);
+  metrics->QueueDepthChanged(0, 1);
+  EXPECT_EQ(5u, metrics->GetCounters().queued_frames);
+  EXPECT_EQ(2u, metrics->GetCounters().delivered_messages);
+
+  metrics->QueueDepthChanged(-3, -1);
+  EXPECT_EQ(2u, metrics->GetCounters().queued_frames);
+  EXPECT_EQ(1u, metrics->GetCounters().delivered_messages);
+}
+
+TEST(metrics, prometheus_text) {
+  CountingMetrics::ptr_t metrics = CountingMetrics::Create();
+  metrics->RpcCompleted(AMQP_QUEUE_DECLARE_METHOD,
+                        boost::chrono::microseconds(1500));
+  metrics->MessageReceived("a \"quoted\" tag", 7);
+
+  const std::string text = metrics->ToPrometheusText("sac");
+  EXPECT_NE(std::string::npos,
+            text.find("# TYPE sac_rpc_duration_seconds summary\n"));
+  EXPECT_NE(std::string::npos,
+            text.find("sac_rpc_duration_seconds_sum{method=\"" +
+                      std::string(amqp_method_name(AMQP_QUEUE_DECLARE_METHOD)) +
+                      "\"} 0.001500\n"));
+  EXPECT_NE(std::string::npos,
+            text.find("sac_received_messages_total"
+                      "{consumer_tag=\"a \\\"quoted\\\" tag\"} 1\n"));
+  EXPECT_NE(std::string::npos, text.find("sac_frames_read_total 0\n"));
+}
+
+TEST_F(connected_test, metrics_publish_consume) {
+  CountingMetrics::ptr_t metrics = CountingMetrics::Create();
+  channel->SetMetrics(metrics);
+
+  std::string queue = channel->DeclareQueue("");
+  std::string consumer = channel->BasicConsume(queue);
+  channel->BasicPublish("", queue, BasicMessage::Create("message body"));
+
+  Envelope::ptr_t envelope;
+  ASSERT_TRUE(channel->BasicConsumeMessage(consumer, envelope, 1000));
+
+  CountingMetrics::Counters counters = metrics->GetCounters();
+  EXPECT_EQ(1u, counters.rpcs[AMQP_QUEUE_DECLARE_METHOD].count);
+  EXPECT_EQ(1u, counters.rpcs[AMQP_BASIC_CONSUME_METHOD].count);
+  EXPECT_EQ(1u, counters.publish_confirms.count);
+  EXPECT_EQ(1u, counters.published[""].messages);
+  EXPECT_EQ(12u, counters.published[""].bytes);
+  EXPECT_EQ(1u, counters.received[consumer].messages);
+  EXPECT_EQ(12u, counters.received[consumer].bytes);
+  EXPECT_LT(0u, counters.frames_written);
+  EXPECT_LT(0u, counters.frames_read);
+  EXPECT_EQ(0u, counters.queued_frames);
+  EXPECT_EQ(0u, counters.delivered_messages);
+}
+
+TEST_F(connected_test, metrics_channel_closed) {
+  CountingMetrics::ptr_t metrics = CountingMetrics::Create();
+  channel->SetMetrics(metrics);
+
+  EXPECT_THROW(channel->BasicPublish("test_metrics_notexist", "rk",
+                                     BasicMessage::Create("message body")),
+               ChannelException);
+  EXPECT_EQ(1u, metrics->GetCounters().channels_closed);
+
+  channel->SetMetrics(Metrics::ptr_t());
+  channel->BasicPublish("", "test_metrics_rk",
+                        BasicMessage::Create("message body"));
+  EXPECT_EQ(0u, metrics->GetCounters().channels_opened);
+}
@@ -26,6 +26,9 @@
  * ***** END LICENSE BLOCK *****
  */
 
+#include <boost/bind.hpp>
+#include <boost/chrono.hpp>
+
 #include "connected_test.h"
 
 using namespace AmqpClient;
@@ -103,3 +106,227 @@ TEST_F(connected_test, publish_immediate_success) {
 
   channel->BasicPublish("", queue, message, true);
 }
+
+TEST_F(connected_test, publish_no_confirm) {
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+  std::string queue = channel->DeclareQueue("");
+
+  channel->BasicPublish("", queue, message, false, false, false);
+
+  // Nothing says when the broker has routed it, so poll for a while
+  Envelope::ptr_t envelope;
+  bool got = false;
+  const boost::chrono::steady_clock::time_point give_up =
+      boost::chrono::steady_clock::now() + boost::chrono::seconds(5);
+  while (!got && boost::chrono::steady_clock::now() < give_up) {
+    got = channel->BasicGet(envelope, queue);
+  }
+  EXPECT_TRUE(got);
+}
+
+TEST_F(connected_test, publish_no_confirm_badexchange) {
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+  std::string queue = channel->DeclareQueue("");
+
+  // The broker closes the channel, this isn't reported to the publisher
+  channel->BasicPublish("test_publish_notexist", "test_publish_rk", message,
+                        false, false, false);
+  // Make sure the broker has processed the failed publish
+  channel->DeclareQueue("");
+
+  channel->BasicPublish("", queue, message, false, false, false);
+  channel->BasicPublish("", queue, message);
+
+  Envelope::ptr_t envelope;
+  EXPECT_TRUE(channel->BasicGet(envelope, queue));
+}
+
+TEST_F(connected_test, publish_no_confirm_mandatory) {
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+
+  EXPECT_THROW(channel->BasicPublish("", "test_publish_rk", message, true,
+                                     false, false),
+               std::logic_error);
+}
+
+namespace {
+std::vector<std::pair<boost::uint64_t, Channel::publish_confirm_t> >
+    confirmed_publishes;
+
+void record_confirm(boost::uint64_t sequence,
+                    Channel::publish_confirm_t status) {
+  confirmed_publishes.push_back(std::make_pair(sequence, status));
+}
+}  // namespace
+
+TEST_F(connected_test, publish_async_success) {
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+
+  for (int i = 1; i <= 10; ++i) {
+    EXPECT_EQ(static_cast<boost::uint64_t>(i),
+              channel->BasicPublishAsync("", "test_publish_rk", message));
+  }
+  EXPECT_TRUE(channel->WaitForConfirms());
+}
+
+TEST_F(connected_test, publish_async_callback) {
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+  std::string queue = channel->DeclareQueue("");
+  confirmed_publishes.clear();
+
+  boost::uint64_t first =
+      channel->BasicPublishAsync("", queue, message, true, false,
+                                 record_confirm);
+  boost::uint64_t second =
+      channel->BasicPublishAsync("", queue, message, true, false,
+                                 record_confirm);
+  EXPECT_TRUE(channel->WaitForConfirms());
+
+  ASSERT_EQ(2u, confirmed_publishes.size());
+  EXPECT_EQ(first, confirmed_publishes[0].first);
+  EXPECT_EQ(Channel::pc_ack, confirmed_publishes[0].second);
+  EXPECT_EQ(second, confirmed_publishes[1].first);
+  EXPECT_EQ(Channel::pc_ack, confirmed_publishes[1].second);
+}
+
+TEST_F(connected_test, publish_async_mandatory_fail) {
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+  confirmed_publishes.clear();
+
+  channel->BasicPublishAsync("", "test_publish_notexist", message, true, false,
+                             record_confirm);
+  EXPECT_TRUE(channel->WaitForConfirms());
+
+  ASSERT_EQ(1u, confirmed_publishes.size());
+  EXPECT_EQ(Channel::pc_returned, confirmed_publishes[0].second);
+}
+
+TEST_F(connected_test, publish_async_badexchange) {
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+  confirmed_publishes.clear();
+
+  // The channel.close may already be picked up by the publish itself
+  EXPECT_THROW(
+      {
+        channel->BasicPublishAsync("test_publish_notexist", "test_publish_rk",
+                                   message, false, false, record_confirm);
+        channel->WaitForConfirms();
+      },
+      ChannelException);
+
+  ASSERT_EQ(1u, confirmed_publishes.size());
+  EXPECT_EQ(Channel::pc_lost, confirmed_publishes[0].second);
+
+  // A new confirm channel is opened for the next publish
+  channel->BasicPublishAsync("", "test_publish_rk", message);
+  EXPECT_TRUE(channel->WaitForConfirms());
+}
+
+TEST_F(connected_test, publish_async_back_pressure_block) {
+  BasicMessage::ptr_t message = BasicMessage::Create("message body");
+  std::string queue = channel->DeclareQueue("");
+  confirmed_publishes.clear();
+
+  // Never more than 2 waiting for a confirm, the rest wait their turn
+  channel->SetPublishBackPressure(2, Channel::bp_block);
+  for (int i = 0; i < 10; ++i) {
+    channel->BasicPublishAsync("", queue, message, false, false,
+                               record_confirm);
+  }
+  EXPECT_TRUE(channel->WaitForConfirms());
+
+  ASSERT_EQ(10u, confirmed_publishes.size());
+  for (std::size_t i = 0; i < confirmed_publishes.size(); ++i) {
+    EXPECT_EQ(Channel::pc_ack, confirmed_publishes[i].second);
+  }
+}
+
+TEST_F(connected_test, publish_connection_not_blocked) {
+  EXPECT_FALSE(channel->IsConnectionBlocked());
+}
+
+TEST_F(connected_test, publish_batch) {
+  std::string queue = channel->DeclareQueue("");
+  std::vector<BasicMessage::ptr_t> messages;
+  for (int i = 0; i < 100; ++i) {
+    messages.push_back(BasicMessage::Create("message body"));
+  }
+
+  channel->BasicPublishBatch("", queue, messages, true);
+
+  Envelope::ptr_t envelope;
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(channel->BasicGet(envelope, queue));
+  }
+  EXPECT_FALSE(channel->BasicGet(envelope, queue));
+}
+
+TEST_F(connected_test, publish_batch_back_pressure_block) {
+  std::string queue = channel->DeclareQueue("");
+  std::vector<BasicMessage::ptr_t> messages;
+  for (int i = 0; i < 10; ++i) {
+    messages.push_back(BasicMessage::Create("message body"));
+  }
+
+  // Never more than 2 waiting for a confirm, the rest of the batch waits
+  channel->SetPublishBackPressure(2, Channel::bp_block);
+  channel->BasicPublishBatch("", queue, messages);
+  EXPECT_TRUE(channel->WaitForConfirms(0));
+
+  Envelope::ptr_t envelope;
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_TRUE(channel->BasicGet(envelope, queue));
+  }
+  EXPECT_FALSE(channel->BasicGet(envelope, queue));
+}
+
+TEST_F(connected_test, publish_batch_mandatory_fail) {
+  std::vector<BasicMessage::ptr_t> messages;
+  messages.push_back(BasicMessage::Create("message body"));
+  messages.push_back(BasicMessage::Create("message body"));
+
+  EXPECT_THROW(
+      channel->BasicPublishBatch("", "test_publish_notexist", messages, true),
+      MessageReturnedException);
+  // Nothing should be left waiting for a confirm
+  EXPECT_TRUE(channel->WaitForConfirms(0));
+}
+
+namespace {
+// Writes 'a' to 'z' over and over, carrying on from where it left off
+std::size_t fill_pattern(std::size_t &produced, char *buffer,
+                         std::size_t length) {
+  for (std::size_t i = 0; i < length; ++i) {
+    buffer[i] = static_cast<char>('a' + (produced + i) % 26);
+  }
+  produced += length;
+  return length;
+}
+}  // namespace
+
+TEST_F(connected_test, publish_streaming) {
+  std::string queue = channel->DeclareQueue("");
+  // More than fits in one frame
+  const std::size_t body_size = 1000000;
+  std::size_t produced = 0;
+  channel->BasicPublishStreaming(
+      "", queue, BasicMessage::Create(), body_size,
+      boost::bind(fill_pattern, boost::ref(produced), _1, _2));
+  EXPECT_EQ(body_size, produced);
+
+  std::string expected(body_size, ' ');
+  std::size_t filled = 0;
+  fill_pattern(filled, &expected[0], body_size);
+  Envelope::ptr_t envelope;
+  ASSERT_TRUE(channel->BasicGet(envelope, queue));
+  EXPECT_EQ(expected, envelope->Message()->Body());
+}
+
+TEST_F(connected_test, publish_streaming_mandatory_fail) {
+  std::size_t produced = 0;
+  EXPECT_THROW(channel->BasicPublishStreaming(
+                   "", "test_publish_notexist", BasicMessage::Create(), 10,
+                   boost::bind(fill_pattern, boost::ref(produced), _1, _2),
+                   true),
+               MessageReturnedException);
+}
@@ -246,3 +246,41 @@ TEST_F(connected_test, queue_purge_badqueue) {
   EXPECT_THROW(channel->PurgeQueue("purge_queue_queuenotexist"),
                ChannelException);
 }
+
+TEST_F(connected_test, queue_declare_cached) {
+  channel->SetTopologyCacheEnabled(true);
+  std::string queue = channel->DeclareQueue("queue_declare_cached", false,
+                                            false, false, false);
+
+  // Deleted behind the cache's back, so declaring it again doesn't notice
+  Channel::ptr_t other = Channel::Create(GetBrokerHost());
+  other->DeleteQueue(queue);
+  EXPECT_EQ(queue, channel->DeclareQueue("queue_declare_cached", false, false,
+                                         false, false));
+
+  // Passive declares always go to the broker, and the failure clears the cache
+  EXPECT_THROW(channel->DeclareQueue(queue, true), ChannelException);
+  channel->DeclareQueue("queue_declare_cached", false, false, false, false);
+  other->DeclareQueue(queue, true);
+
+  channel->DeleteQueue(queue);
+}
+
+TEST_F(connected_test, queue_declare_cached_forgotten_on_delete) {
+  channel->SetTopologyCacheEnabled(true);
+  std::string queue = channel->DeclareQueue(
+      "queue_declare_cached_forgotten_on_delete", false, false, false, false);
+  channel->BindQueue(queue, "amq.direct", "rk");
+  channel->DeleteQueue(queue);
+
+  channel->DeclareQueue(queue, false, false, false, false);
+  channel->BindQueue(queue, "amq.direct", "rk");
+  channel->DeclareQueue(queue, true);
+  channel->BasicPublish("amq.direct", "rk", BasicMessage::Create("Body"),
+                        true);
+
+  Envelope::ptr_t envelope;
+  EXPECT_TRUE(channel->BasicGet(envelope, queue));
+
+  channel->DeleteQueue(queue);
+}
@@ -0,0 +1,110 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <gtest/gtest.h>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <vector>
+
+#include "connected_test.h"
+
+using namespace AmqpClient;
+
+namespace {
+// Stands in for the service, replying to one request with reply_body
+void ServeRequest(Channel::ptr_t channel, const std::string &consumer,
+                  const std::string &reply_body) {
+  Envelope::ptr_t request;
+  ASSERT_TRUE(channel->BasicConsumeMessage(consumer, request, 1000));
+  BasicMessage::ptr_t reply = BasicMessage::Create(reply_body);
+  reply->CorrelationId(request->Message()->CorrelationId());
+  channel->BasicPublish("", request->Message()->ReplyTo(), reply);
+}
+
+void KeepReply(std::vector<BasicMessage::ptr_t> &replies,
+               const BasicMessage::ptr_t &reply) {
+  replies.push_back(reply);
+}
+}  // namespace
+
+TEST_F(connected_test, rpc_call) {
+  std::string queue = channel->DeclareQueue("");
+  std::string server = channel->BasicConsume(queue);
+  RpcClient::ptr_t client = RpcClient::Create(channel);
+
+  std::string correlation_id =
+      client->SendRequest("", queue, BasicMessage::Create("Request"), 1000);
+  ServeRequest(channel, server, "Reply");
+
+  BasicMessage::ptr_t reply;
+  ASSERT_TRUE(client->WaitForReply(correlation_id, reply));
+  EXPECT_EQ("Reply", reply->Body());
+  EXPECT_EQ(0u, client->PendingCalls());
+}
+
+TEST_F(connected_test, rpc_many_outstanding) {
+  std::string queue = channel->DeclareQueue("");
+  std::string server = channel->BasicConsume(queue, "", true, true, true, 0);
+  RpcClient::ptr_t client = RpcClient::Create(channel);
+
+  std::vector<std::string> correlation_ids;
+  for (int i = 0; i < 100; ++i) {
+    correlation_ids.push_back(
+        client->SendRequest("", queue, BasicMessage::Create("Request"), 5000));
+  }
+  EXPECT_EQ(100u, client->PendingCalls());
+  for (int i = 0; i < 100; ++i) {
+    ServeRequest(channel, server, boost::lexical_cast<std::string>(i));
+  }
+
+  // Taken in the opposite order to the replies coming back
+  for (int i = 99; i >= 0; --i) {
+    BasicMessage::ptr_t reply;
+    ASSERT_TRUE(client->WaitForReply(correlation_ids[i], reply));
+    EXPECT_EQ(boost::lexical_cast<std::string>(i), reply->Body());
+  }
+  EXPECT_EQ(0u, client->PendingCalls());
+}
+
+TEST_F(connected_test, rpc_timeout) {
+  std::string queue = channel->DeclareQueue("");
+  RpcClient::ptr_t client = RpcClient::Create(channel);
+
+  std::vector<BasicMessage::ptr_t> replies;
+  client->SendRequest("", queue, BasicMessage::Create("Request"),
+                      boost::bind(KeepReply, boost::ref(replies), _1), 100);
+  EXPECT_EQ(1u, client->ProcessReplies(-1));
+  ASSERT_EQ(1u, replies.size());
+  EXPECT_FALSE(replies[0]);
+  EXPECT_EQ(0u, client->PendingCalls());
+
+  BasicMessage::ptr_t reply;
+  EXPECT_FALSE(
+      client->Call("", queue, BasicMessage::Create("Request"), reply, 100));
+}
@@ -0,0 +1,83 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include "connected_test.h"
+#include "connected_test.h"
+
+using namespace AmqpClient;
+
+TEST_F(connected_test, selector_empty_times_out) {
+  ChannelSelector::ptr_t selector = ChannelSelector::Create();
+  std::vector<Channel::ptr_t> ready;
+  EXPECT_EQ(0u, selector->Wait(ready));
+
+  selector->Add(channel);
+  selector->Add(channel);
+  EXPECT_EQ(1u, selector->Size());
+  EXPECT_EQ(0u, selector->Wait(ready, 10));
+  EXPECT_TRUE(ready.empty());
+
+  selector->Remove(channel);
+  EXPECT_EQ(0u, selector->Size());
+}
+
+TEST_F(connected_test, selector_two_connections) {
+  Channel::ptr_t other = Channel::Create(GetBrokerHost());
+  std::string queue = other->DeclareQueue("");
+  std::string consumer = other->BasicConsume(queue);
+
+  ChannelSelector::ptr_t selector = ChannelSelector::Create();
+  selector->Add(channel);
+  selector->Add(other);
+
+  channel->BasicPublish("", queue, BasicMessage::Create("message body"));
+
+  std::vector<Envelope::ptr_t> envelopes;
+  for (int i = 0; i < 10 && envelopes.empty(); ++i) {
+    std::vector<Channel::ptr_t> ready;
+    ASSERT_LT(0u, selector->Wait(ready, 5000));
+    for (std::vector<Channel::ptr_t>::const_iterator it = ready.begin();
+         it != ready.end(); ++it) {
+      EXPECT_EQ(other, *it);
+      (*it)->BasicConsumeAvailable(envelopes);
+    }
+  }
+
+  ASSERT_EQ(1u, envelopes.size());
+  EXPECT_EQ(consumer, envelopes[0]->ConsumerTag());
+  EXPECT_EQ("message body", envelopes[0]->Message()->Body());
+
+  std::vector<Channel::ptr_t> ready;
+  EXPECT_EQ(0u, selector->Wait(ready, 0));
+}
+
+TEST_F(connected_test, consume_available_without_consumers) {
+  std::vector<Envelope::ptr_t> envelopes;
+  EXPECT_EQ(0u, channel->BasicConsumeAvailable(envelopes));
+  EXPECT_TRUE(envelopes.empty());
+}
@@ -876,6 +876,134 @@ TEST(table, convert_to_rabbitmq_empty) {
   EXPECT_EQ(0, table_out.size());
 }
 
+TEST(prepared_table, roundtrip) {
+  Table table_in;
+  table_in.insert(TableEntry("int32_key", int32_t(32)));
+  table_in.insert(TableEntry("string_key", "A string"));
+  Array array_in;
+  array_in.push_back(TableValue(true));
+  table_in.insert(TableEntry("array_key", array_in));
+
+  PreparedTable prepared(table_in);
+  EXPECT_FALSE(prepared.IsEmpty());
+  Table table_out = prepared.GetTable();
+  EXPECT_EQ(table_in.size(), table_out.size());
+  EXPECT_TRUE(std::equal(table_in.begin(), table_in.end(), table_out.begin()));
+}
+
+TEST(prepared_table, empty) {
+  PreparedTable prepared;
+  EXPECT_TRUE(prepared.IsEmpty());
+  EXPECT_TRUE(prepared.GetTable().empty());
+  EXPECT_TRUE(PreparedTable(Table()).IsEmpty());
+  EXPECT_EQ(prepared, PreparedTable(Table()));
+}
+
+TEST(prepared_table, equality) {
+  Table table;
+  table.insert(TableEntry("key", "value"));
+  PreparedTable prepared(table);
+  PreparedTable copy(prepared);
+
+  EXPECT_EQ(prepared, copy);
+  EXPECT_EQ(prepared, PreparedTable(table));
+  EXPECT_NE(prepared, PreparedTable());
+
+  table["key"] = "another value";
+  EXPECT_NE(prepared, PreparedTable(table));
+}
+
+TEST(prepared_table, shared_headers) {
+  Table table_in;
+  table_in.insert(TableEntry("key", "value"));
+  PreparedTable headers(table_in);
+
+  BasicMessage::ptr_t first = BasicMessage::Create();
+  BasicMessage::ptr_t second = BasicMessage::Create();
+  first->HeaderTable(headers);
+  second->HeaderTable(headers);
+  first->HeaderTableClear();
+
+  EXPECT_FALSE(first->HeaderTableIsSet());
+  ASSERT_TRUE(second->HeaderTableIsSet());
+  EXPECT_EQ("value", second->HeaderTable()["key"].GetString());
+}
+
+TEST_F(connected_test, prepared_table_arguments) {
+  Table table;
+  table.insert(TableEntry("x-message-ttl", int32_t(60000)));
+  PreparedTable arguments(table);
+
+  std::string queue = channel->DeclareQueue("", false, false, true, true,
+                                            arguments);
+  // Equivalent arguments, so declaring the queue again is fine
+  channel->DeclareQueue(queue, false, false, true, true, arguments);
+  channel->DeclareQueue(queue, false, false, true, true, table);
+  channel->DeleteQueue(queue);
+}
+
+TEST(table_view, lookup) {
+  Table table_in;
+  table_in.insert(TableEntry("bool_key", true));
+  table_in.insert(TableEntry("int16_key", int16_t(-16)));
+  table_in.insert(TableEntry("uint64_key", uint64_t(64)));
+  table_in.insert(TableEntry("double_key", 2.5));
+  table_in.insert(TableEntry("string_key", "A string"));
+  Table table_inner;
+  table_inner.insert(TableEntry("inner_key", int32_t(32)));
+  table_in.insert(TableEntry("table_key", table_inner));
+
+  BasicMessage::ptr_t message = BasicMessage::Create();
+  message->HeaderTable(table_in);
+  TableView view = message->HeaderTableView();
+
+  EXPECT_EQ(table_in.size(), view.size());
+  EXPECT_FALSE(view.empty());
+  EXPECT_EQ(1u, view.count("string_key"));
+  EXPECT_EQ(0u, view.count("missing_key"));
+
+  EXPECT_TRUE(view.GetBool("bool_key"));
+  EXPECT_EQ(-16, view.GetInteger("int16_key"));
+  EXPECT_EQ(64, view.GetInteger("uint64_key"));
+  EXPECT_EQ(2.5, view.GetReal("double_key"));
+  EXPECT_EQ("A string", view.GetString("string_key"));
+  EXPECT_EQ(TableValue::VT_table, view.GetType("table_key"));
+  EXPECT_EQ(table_inner, view.at("table_key").GetTable());
+
+  EXPECT_THROW(view.GetString("missing_key"), std::out_of_range);
+  EXPECT_THROW(view.GetString("bool_key"), boost::bad_get);
+  EXPECT_THROW(view.GetInteger("string_key"), boost::bad_get);
+
+  Table table_out = view.ToTable();
+  EXPECT_EQ(table_in.size(), table_out.size());
+  EXPECT_TRUE(std::equal(table_in.begin(), table_in.end(), table_out.begin()));
+
+  for (std::size_t i = 0; i < view.size(); ++i) {
+    EXPECT_EQ(table_in[view.KeyAt(i)], view.ValueAt(i));
+  }
+}
+
+TEST(table_view, empty) {
+  BasicMessage::ptr_t message = BasicMessage::Create();
+  TableView view = message->HeaderTableView();
+  EXPECT_TRUE(view.empty());
+  EXPECT_EQ(0u, view.count("key"));
+  EXPECT_TRUE(view.ToTable().empty());
+  EXPECT_THROW(view.KeyAt(0), std::out_of_range);
+}
+
+TEST(table_view, prepared_table) {
+  TableView view;
+  {
+    Table table;
+    table.insert(TableEntry("key", "value"));
+    PreparedTable prepared(table);
+    view = prepared.View();
+  }
+  // The view keeps the prepared table alive
+  EXPECT_EQ("value", view.GetString("key"));
+}
+
 TEST_F(connected_test, basic_message_header_roundtrip) {
   Table table_in;
   table_in.insert(TableEntry("void_key", TableValue()));
@@ -0,0 +1,114 @@
+/*
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MIT
+ *
+ * Copyright (c) 2010-2013 Alan Antonuk
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <gtest/gtest.h>
+
+#include "connected_test.h"
+
+using namespace AmqpClient;
+
+TEST_F(connected_test, topology_declare) {
+  Topology topology;
+  topology.DeclareExchange("topology_declare_exchange",
+                           Channel::EXCHANGE_TYPE_FANOUT, false, false, true)
+      .DeclareQueue("")
+      .DeclareQueue("topology_declare_queue")
+      .BindQueue("topology_declare_queue", "topology_declare_exchange");
+
+  std::vector<std::string> queues = channel->DeclareTopology(topology);
+  ASSERT_EQ(2u, queues.size());
+  EXPECT_FALSE(queues[0].empty());
+  EXPECT_EQ("topology_declare_queue", queues[1]);
+
+  channel->BasicPublish("topology_declare_exchange", "",
+                        BasicMessage::Create("Message Body"));
+  Envelope::ptr_t envelope;
+  EXPECT_TRUE(channel->BasicGet(envelope, "topology_declare_queue"));
+
+  channel->DeleteQueue("topology_declare_queue");
+  channel->DeleteExchange("topology_declare_exchange");
+}
+
+TEST_F(connected_test, topology_declare_many) {
+  Topology topology;
+  for (int i = 0; i < 500; ++i) {
+    topology.DeclareQueue("");
+  }
+  EXPECT_EQ(500u, channel->DeclareTopology(topology).size());
+}
+
+TEST_F(connected_test, topology_declare_fails_partway) {
+  Topology topology;
+  topology.DeclareQueue("topology_declare_fails_partway")
+      .DeclareExchange("topology_declare_fails_partway_notexist",
+                       Channel::EXCHANGE_TYPE_DIRECT, true)
+      .DeclareQueue("topology_declare_fails_partway_after");
+
+  EXPECT_THROW(channel->DeclareTopology(topology), ChannelException);
+
+  // Only the declarations before the failed one were made
+  EXPECT_NO_THROW(
+      channel->DeclareQueue("topology_declare_fails_partway", true));
+  EXPECT_THROW(
+      channel->DeclareQueue("topology_declare_fails_partway_after", true),
+      ChannelException);
+  channel->DeleteQueue("topology_declare_fails_partway");
+}
+
+TEST_F(connected_test, topology_declare_nowait) {
+  Topology topology;
+  topology.DeclareQueue("topology_declare_nowait")
+      .BindQueue("topology_declare_nowait", "amq.direct", "nowait_key");
+
+  EXPECT_TRUE(channel->DeclareTopology(topology, true).empty());
+  // Declaring it again is harmless
+  EXPECT_TRUE(channel->DeclareTopology(topology, true).empty());
+
+  EXPECT_EQ("topology_declare_nowait",
+            channel->DeclareQueue("topology_declare_nowait"));
+  channel->DeleteQueue("topology_declare_nowait");
+}
+
+TEST_F(connected_test, topology_declare_nowait_fails) {
+  Topology topology;
+  topology.DeclareExchange("topology_declare_nowait_notexist",
+                           Channel::EXCHANGE_TYPE_DIRECT, true);
+
+  EXPECT_TRUE(channel->DeclareTopology(topology, true).empty());
+  // The failure isn't reported, and doesn't get in the way of what follows
+  EXPECT_NO_THROW(channel->DeclareQueue(""));
+  channel->BasicPublish("", "topology_declare_nowait_fails",
+                        BasicMessage::Create("Message Body"));
+}
+
+TEST_F(connected_test, topology_declare_nowait_server_named) {
+  Topology topology;
+  topology.DeclareQueue("");
+
+  EXPECT_THROW(channel->DeclareTopology(topology, true), std::logic_error);
+}